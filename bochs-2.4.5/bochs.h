@@ -66,6 +66,7 @@ extern "C" {
 
 #ifndef WIN32
 #  include <unistd.h>
+#  include <sys/uio.h>
 #else
 #  include <io.h>
 #endif
@@ -121,6 +122,9 @@ int bx_read_configuration(const char *rcfile);
 int bx_write_configuration(const char *rcfile, int overwrite);
 void bx_reset_options(void);
 Bit32u crc32(const Bit8u *buf, int len);
+int bx_lz4_compress(const Bit8u *src, int srclen, Bit8u *dst, int dstmax);
+int bx_lz4_decompress(const Bit8u *src, int srclen, Bit8u *dst, int dstlen);
+const char *bx_clone_server(void);
 // for param-tree testing only
 void print_tree(bx_param_c *node, int level = 0);
 
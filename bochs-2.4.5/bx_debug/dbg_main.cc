@@ -1427,8 +1427,14 @@ void bx_dbg_show_command(const char* arg)
     } else if(!strcmp(arg,"vga")){
       DEV_vga_refresh();
       return;
+    } else if(!strcmp(arg,"io-stats")){
+      bx_devices.toggle_io_stats();
+      return;
+    } else if(!strcmp(arg,"screenshot")){
+      bx_gui->screenshot_handler();
+      return;
     } else {
-      dbg_printf("Unrecognized arg: %s (only 'mode', 'int', 'softint', 'extint', 'iret', 'call', 'off', 'dbg-all' and 'dbg-none' are valid)\n", arg);
+      dbg_printf("Unrecognized arg: %s (only 'mode', 'int', 'softint', 'extint', 'iret', 'call', 'off', 'dbg-all', 'dbg-none', 'io-stats' and 'screenshot' are valid)\n", arg);
       return;
     }
   }
@@ -3520,6 +3520,8 @@ yyreduce:
          dbg_printf("show off - toggles off symbolic info\n");
          dbg_printf("show dbg-all - turn on all show flags\n");
          dbg_printf("show dbg-none - turn off all show flags\n");
+         dbg_printf("show io-stats - start counting I/O port accesses, or print and stop\n");
+         dbg_printf("show screenshot - save the screen to screenshotNNN.txt or .bmp\n");
          free((yyvsp[(1) - (3)].sval));free((yyvsp[(2) - (3)].sval));
        }
     break;
@@ -1145,6 +1145,8 @@ help_command:
          dbg_printf("show off - toggles off symbolic info\n");
          dbg_printf("show dbg-all - turn on all show flags\n");
          dbg_printf("show dbg-none - turn off all show flags\n");
+         dbg_printf("show io-stats - start counting I/O port accesses, or print and stop\n");
+         dbg_printf("show screenshot - save the screen to screenshotNNN.txt or .bmp\n");
          free($1);free($2);
        }
      | BX_TOKEN_HELP BX_TOKEN_CALC '\n'
@@ -0,0 +1,290 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Clone server: run many guests from one booted state.
+//
+//  When the guest outputs "Clone" to port 0x8900 and the clone server is
+//  enabled, the simulation stops at that point and reads jobs, one per
+//  line, from stdin or from the clients of a unix domain socket:
+//
+//    <output file> [guest command line]
+//
+//  For each job a copy of the whole simulation is created with fork(), so
+//  the guest memory is shared copy-on-write with the booted state. The clone
+//  writes stdout and stderr to the output file, gets a private redolog on
+//  top of the disk images and hands the command line to the guest, which
+//  reads it back from port 0x8900. When a clone exits, the server replies
+//  with a line "<output file> <exit status>".
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "param_names.h"
+#include "iodev/iodev.h"
+
+#define LOG_THIS genlog->
+
+#if !defined(WIN32)
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/select.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define BX_CLONE_LINE_LEN 4096
+
+typedef struct {
+  pid_t pid;
+  char output[BX_PATHNAME_LEN];
+} bx_clone_job_t;
+
+static char clone_inbuf[BX_CLONE_LINE_LEN];
+static unsigned clone_inlen = 0;
+static char clone_cmdline[BX_CLONE_LINE_LEN + 1];
+
+// Returns the next complete line from the input buffer or NULL. At the
+// end of the input the remaining data is returned as the last line.
+static char *clone_next_line(char *line, bx_bool eof)
+{
+  char *nl = (char*) memchr(clone_inbuf, '\n', clone_inlen);
+  unsigned len;
+
+  if (nl != NULL) {
+    len = (unsigned)(nl - clone_inbuf);
+  } else if (eof || (clone_inlen == sizeof(clone_inbuf))) {
+    len = clone_inlen;
+    if (len == 0) return NULL;
+  } else {
+    return NULL;
+  }
+  memcpy(line, clone_inbuf, len);
+  line[len] = 0;
+  // CRLF line ends of the client
+  if ((len > 0) && (line[len-1] == '\r')) line[len-1] = 0;
+  if (len < clone_inlen) len++;
+  clone_inlen -= len;
+  memmove(clone_inbuf, clone_inbuf + len, clone_inlen);
+  return line;
+}
+
+static void clone_reply(int fd, const char *output, int status)
+{
+  char buf[BX_PATHNAME_LEN + 16];
+  int code;
+
+  if (WIFEXITED(status)) {
+    code = WEXITSTATUS(status);
+  } else if (WIFSIGNALED(status)) {
+    code = 128 + WTERMSIG(status);
+  } else {
+    code = 255;
+  }
+  BX_INFO(("clone server: job '%s' finished with status %d", output, code));
+  int len = snprintf(buf, sizeof(buf), "%s %d\n", output, code);
+  if (write(fd, buf, len) != len) {
+    BX_ERROR(("clone server: could not send status of job '%s'", output));
+  }
+}
+
+static int clone_listen(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    BX_PANIC(("clone server: socket name '%s' too long", path));
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    BX_PANIC(("clone server: could not create socket: %s", strerror(errno)));
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if ((bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) || (listen(fd, 4) < 0)) {
+    BX_PANIC(("clone server: could not listen on '%s': %s", path, strerror(errno)));
+    close(fd);
+    return -1;
+  }
+  BX_INFO(("clone server: waiting for jobs on '%s'", path));
+  return fd;
+}
+
+// Executed in the new process: redirect the output and prepare the devices
+static void clone_setup_child(const char *output)
+{
+  char logname[BX_PATHNAME_LEN + 8];
+  int fd;
+
+  fd = open("/dev/null", O_RDONLY);
+  if (fd >= 0) {
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+  }
+  fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "clone: could not create '%s': %s\n", output, strerror(errno));
+    _exit(127);
+  }
+  dup2(fd, STDOUT_FILENO);
+  dup2(fd, STDERR_FILENO);
+  close(fd);
+
+  if (strcmp(SIM->get_param_string(BXPN_LOG_FILENAME)->getptr(), "-")) {
+    snprintf(logname, sizeof(logname), "%s.log", output);
+    io->init_log(logname);
+  }
+#if BX_SHOW_IPS
+  signal(SIGALRM, bx_signal_handler);
+  alarm(1);
+#endif
+  signal(SIGPIPE, SIG_DFL);
+  DEV_after_clone();
+}
+
+const char *bx_clone_server(void)
+{
+  bx_clone_job_t *jobs;
+  char line[BX_CLONE_LINE_LEN + 1];
+  int max_jobs = SIM->get_param_num(BXPN_CLONE_JOBS)->get();
+  const char *sockname = SIM->get_param_string(BXPN_CLONE_SOCKET)->getptr();
+  int listen_fd = -1, in_fd = STDIN_FILENO, out_fd = STDOUT_FILENO;
+  int running = 0, status, i;
+  bx_bool eof = 0;
+  pid_t pid;
+
+  if (strcmp(SIM->get_param_enum(BXPN_SEL_DISPLAY_LIBRARY)->get_selected(), "nogui")) {
+    BX_ERROR(("clone server: display library '%s' is shared with the clones, use 'nogui'",
+              SIM->get_param_enum(BXPN_SEL_DISPLAY_LIBRARY)->get_selected()));
+  }
+  if (strlen(sockname) > 0) {
+    listen_fd = clone_listen(sockname);
+    if (listen_fd < 0) return NULL;
+    in_fd = out_fd = -1;
+  } else {
+    BX_INFO(("clone server: reading jobs from stdin"));
+  }
+  jobs = new bx_clone_job_t[max_jobs];
+  for (i = 0; i < max_jobs; i++) jobs[i].pid = 0;
+
+#if BX_SHOW_IPS
+  alarm(0);
+  signal(SIGALRM, SIG_IGN);
+#endif
+  signal(SIGPIPE, SIG_IGN);
+  clone_inlen = 0;
+  // the simulation is stopped while the server runs, so the data written
+  // back here stays valid for all clones
+  DEV_before_clone();
+
+  while (1) {
+    // collect the finished clones
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (i = 0; i < max_jobs; i++) {
+        if (jobs[i].pid == pid) {
+          if (out_fd >= 0) clone_reply(out_fd, jobs[i].output, status);
+          jobs[i].pid = 0;
+          running--;
+          break;
+        }
+      }
+    }
+
+    // start new clones
+    while ((running < max_jobs) && (in_fd >= 0) && clone_next_line(line, eof)) {
+      char *output = line + strspn(line, " \t");
+      char *args = output + strcspn(output, " \t");
+      if (*output == 0) continue;
+      if (*args != 0) *args++ = 0;
+      args += strspn(args, " \t");
+      for (i = 0; jobs[i].pid != 0; i++);
+      strncpy(jobs[i].output, output, BX_PATHNAME_LEN);
+      jobs[i].output[BX_PATHNAME_LEN - 1] = 0;
+      strcpy(clone_cmdline, args);
+
+      // the log file and the serial outputs are stdio streams as well
+      fflush(NULL);
+      pid = fork();
+      if (pid == 0) {
+        if (listen_fd >= 0) close(listen_fd);
+        if (in_fd != STDIN_FILENO) close(in_fd);
+        clone_setup_child(jobs[i].output);
+        delete [] jobs;
+        BX_INFO(("clone: running job '%s'", clone_cmdline));
+        return clone_cmdline;
+      }
+      if (pid < 0) {
+        BX_ERROR(("clone server: fork() failed: %s", strerror(errno)));
+        if (out_fd >= 0) clone_reply(out_fd, jobs[i].output, 127 << 8);
+        continue;
+      }
+      jobs[i].pid = pid;
+      running++;
+    }
+
+    // end of the input: wait for the running clones, then either finish
+    // (stdin) or wait for the next client (socket)
+    if ((in_fd >= 0) && eof && (clone_inlen == 0) && (running == 0)) {
+      if (listen_fd < 0) break;
+      close(in_fd);
+      in_fd = out_fd = -1;
+    }
+
+    fd_set fds;
+    int maxfd = -1;
+    struct timeval tv;
+    FD_ZERO(&fds);
+    if ((in_fd >= 0) && !eof && (running < max_jobs)) {
+      FD_SET(in_fd, &fds);
+      maxfd = in_fd;
+    } else if (in_fd < 0) {
+      FD_SET(listen_fd, &fds);
+      maxfd = listen_fd;
+    }
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    if (select(maxfd + 1, &fds, NULL, NULL, &tv) <= 0)
+      continue;
+
+    if (in_fd < 0) {
+      in_fd = accept(listen_fd, NULL, NULL);
+      if (in_fd >= 0) {
+        out_fd = in_fd;
+        eof = 0;
+        clone_inlen = 0;
+      }
+    } else {
+      ssize_t n = read(in_fd, clone_inbuf + clone_inlen, sizeof(clone_inbuf) - clone_inlen);
+      if (n > 0) {
+        clone_inlen += n;
+      } else if ((n == 0) || (errno != EINTR)) {
+        eof = 1;
+      }
+    }
+  }
+
+  delete [] jobs;
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(sockname);
+  }
+  return NULL;
+}
+
+#else
+
+const char *bx_clone_server(void)
+{
+  BX_PANIC(("clone server not supported on this platform"));
+  return NULL;
+}
+
+#endif
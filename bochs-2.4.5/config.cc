@@ -290,6 +290,37 @@ void bx_init_options()
       "set benchmark mode",
       0, BX_MAX_BIT32U, 0);
 
+  // checkpoint (save state) options
+  bx_list_c *checkpoint = new bx_list_c(menu, "checkpoint", "Checkpoint Options");
+  new bx_param_bool_c(checkpoint,
+      "compress",
+      "Compress checkpoints",
+      "Compress the memory contents of saved states",
+      0);
+  new bx_param_bool_c(checkpoint,
+      "incremental",
+      "Incremental checkpoints",
+      "Save only memory pages modified since the last saved or restored state",
+      0);
+
+  // clone server options
+  bx_list_c *clone = new bx_list_c(menu, "clone", "Clone Server Options");
+  new bx_param_bool_c(clone,
+      "enabled",
+      "Enable clone server",
+      "Fork a copy of the simulation for each job when the guest reaches the clone marker",
+      0);
+  new bx_param_string_c(clone,
+      "socket",
+      "Job socket",
+      "Unix domain socket to read jobs from instead of stdin",
+      "", BX_PATHNAME_LEN);
+  new bx_param_num_c(clone,
+      "jobs",
+      "Parallel jobs",
+      "Maximum number of clones running at the same time",
+      1, 1024, 1);
+
   // subtree for special menus
   bx_list_c *special_menus = new bx_list_c(root_param, "menu", "");
 
@@ -467,6 +498,17 @@ void bx_init_options()
   host_ramsize->set_ask_format("Enter memory size (MB): [%d] ");
   host_ramsize->set_options(ramsize->USE_SPIN_CONTROL);
 
+  new bx_param_bool_c(ram,
+      "hugepages",
+      "Use host huge pages",
+      "Back guest RAM with transparent huge pages on the host",
+      0);
+  new bx_param_bool_c(ram,
+      "release",
+      "Release memory on reset",
+      "Return guest RAM to the host on every hardware reset",
+      0);
+
   path = new bx_param_filename_c(rom,
       "path",
       "ROM BIOS image",
@@ -613,7 +655,7 @@ void bx_init_options()
   bx_list_c *pci = new bx_list_c(root_param, "pci", "PCI Options");
 
   // pci options
-  bx_param_c *pci_deps_list[3+BX_N_PCI_SLOTS+2*BX_SUPPORT_PCIDEV];
+  bx_param_c *pci_deps_list[3+BX_N_PCI_SLOTS+2*BX_SUPPORT_PCIDEV+BX_SUPPORT_PCIVBLK];
   bx_param_c **pci_deps_ptr = &pci_deps_list[0];
 
   bx_param_bool_c *i440fx_support = new bx_param_bool_c(pci,
@@ -667,12 +709,51 @@ void bx_init_options()
 #else
   pcidid->set_enabled(0);
 #endif
+  // paravirtual block device options
+  bx_list_c *vblk = new bx_list_c(pci, "vblk", "Paravirtual Block Device");
+#if BX_SUPPORT_PCIVBLK
+  *pci_deps_ptr++ = vblk;
+#endif
+  vblk->set_enabled(BX_SUPPORT_PCIVBLK);
+  enabled = new bx_param_bool_c(vblk,
+      "enabled",
+      "Enable paravirtual block device",
+      "Enables the paravirtual PCI block device",
+      0);
+  enabled->set_enabled(BX_SUPPORT_PCIVBLK);
+  path = new bx_param_filename_c(vblk,
+      "path",
+      "Path of the disk image",
+      "Pathname of the disk image of the paravirtual block device",
+      "", BX_PATHNAME_LEN);
+  path->set_ask_format("Enter new filename: [%s] ");
+  path->set_extension("img");
+  bx_param_enum_c *vblk_mode = new bx_param_enum_c(vblk,
+      "mode",
+      "Type of disk image",
+      "Mode of the disk image (flat, growing, undoable, volatile or cow)",
+      atadevice_mode_names,
+      BX_ATA_MODE_FLAT,
+      BX_ATA_MODE_FLAT);
+  vblk_mode->set_ask_format("Enter mode of the disk image: [%s] ");
+  bx_param_filename_c *vblk_journal = new bx_param_filename_c(vblk,
+      "journal",
+      "Path of journal file",
+      "Pathname of the journal file",
+      "", BX_PATHNAME_LEN);
+  vblk_journal->set_ask_format("Enter path of journal file: [%s]");
+  deplist = new bx_list_c(NULL, 3);
+  deplist->add(path);
+  deplist->add(vblk_mode);
+  deplist->add(vblk_journal);
+  enabled->set_dependent_list(deplist);
   // add final NULL at the end, and build the menu
   *pci_deps_ptr = NULL;
   i440fx_support->set_dependent_list(new bx_list_c(NULL, "", "", pci_deps_list));
   pci->set_options(pci->SHOW_PARENT);
   slot->set_options(slot->SHOW_PARENT);
   pcidev->set_options(pcidev->SHOW_PARENT | pcidev->USE_BOX_TITLE);
+  vblk->set_options(vblk->SHOW_PARENT | vblk->USE_BOX_TITLE);
 
   // display subtree
   bx_list_c *display = new bx_list_c(root_param, "display", "Bochs Display & Interface Options", 7);
@@ -758,8 +839,8 @@ void bx_init_options()
   bx_param_num_c *vga_update_interval = new bx_param_num_c(display,
       "vga_update_interval",
       "VGA Update Interval",
-      "Number of microseconds between VGA updates",
-      40000, BX_MAX_BIT32U,
+      "Number of microseconds between VGA updates (0 = headless, no updates)",
+      0, BX_MAX_BIT32U,
       50000);
   vga_update_interval->set_ask_format ("Type a new value for VGA update interval: [%d] ");
 
@@ -1061,7 +1142,7 @@ void bx_init_options()
     14, 15, 11, 9
   };
 
-  #define BXP_PARAMS_PER_ATA_DEVICE 12
+  #define BXP_PARAMS_PER_ATA_DEVICE 16
 
   bx_list_c *ata_menu[BX_MAX_ATA_CHANNEL];
   bx_list_c *ata_res[BX_MAX_ATA_CHANNEL];
@@ -1170,11 +1251,31 @@ void bx_init_options()
         "Pathname of the journal file",
         "", BX_PATHNAME_LEN);
       journal->set_ask_format("Enter path of journal file: [%s]");
-      deplist = new bx_list_c(NULL, 1);
+      bx_param_num_c *prealloc = new bx_param_num_c(menu,
+        "prealloc",
+        "Preallocated pages",
+        "Number of pages a sparse image file is grown by in advance",
+        0, 65536,
+        0);
+      prealloc->set_ask_format("Enter number of preallocated pages: [%d] ");
+      bx_param_num_c *extent_size = new bx_param_num_c(menu,
+        "extent_size",
+        "Redolog extent size",
+        "Size of the extents of a new redolog in KB (0 = automatic)",
+        0, 1048576,
+        0);
+      extent_size->set_ask_format("Enter redolog extent size in KB: [%d] ");
+      deplist = new bx_list_c(NULL, 3);
       deplist->add(journal);
+      deplist->add(prealloc);
+      deplist->add(extent_size);
       mode->set_dependent_list(deplist, 0);
-      mode->set_dependent_bitmap(BX_ATA_MODE_UNDOABLE, 1);
-      mode->set_dependent_bitmap(BX_ATA_MODE_VOLATILE, 1);
+      mode->set_dependent_bitmap(BX_ATA_MODE_UNDOABLE, 5);
+      mode->set_dependent_bitmap(BX_ATA_MODE_VOLATILE, 5);
+      mode->set_dependent_bitmap(BX_ATA_MODE_COW, 1);
+      mode->set_dependent_bitmap(BX_ATA_MODE_Z_UNDOABLE, 1);
+      mode->set_dependent_bitmap(BX_ATA_MODE_Z_VOLATILE, 1);
+      mode->set_dependent_bitmap(BX_ATA_MODE_SPARSE, 2);
 
       bx_param_num_c *cylinders = new bx_param_num_c(menu,
         "cylinders",
@@ -1227,6 +1328,21 @@ void bx_init_options()
         BX_ATA_TRANSLATION_NONE);
       translation->set_ask_format("Enter translation type: [%s]");
 
+      bx_param_bool_c *async = new bx_param_bool_c(menu,
+        "async",
+        "Asynchronous I/O",
+        "Read and write the disk image in a separate thread",
+        0);
+      async->set_ask_format("Use asynchronous disk I/O? [%s] ");
+
+      bx_param_num_c *write_cache = new bx_param_num_c(menu,
+        "write_cache",
+        "Write-back cache size",
+        "Size of the host write-back cache of the disk in KB (0 = disabled)",
+        0, 1048576,
+        0);
+      write_cache->set_ask_format("Enter write-back cache size in KB: [%d] ");
+
       // the menu and all items on it depend on the present flag
       deplist = new bx_list_c(NULL, 4);
       deplist->add(type);
@@ -1247,11 +1363,13 @@ void bx_init_options()
         heads,
         spt,
         translation,
+        async,
+        write_cache,
         NULL
       };
       deplist = new bx_list_c(NULL, "deplist", "", type_deplist);
       type->set_dependent_list(deplist, 0);
-      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0x3d);
+      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0xfd);
       type->set_dependent_bitmap(BX_ATA_DEVICE_CDROM, 0x02);
 
       type->set_handler(bx_param_handler);
@@ -1375,9 +1493,13 @@ void bx_init_options()
     sprintf(descr, "The path can be a real serial device or a pty (X/Unix only)");
     path = new bx_param_filename_c(menu, "dev", label, descr,
       "", BX_PATHNAME_LEN);
-    deplist = new bx_list_c(NULL, 2);
+    sprintf(label, "Instant transmit for COM%d", i+1);
+    sprintf(descr, "Transmit without emulating the line speed and write the output in bulk");
+    bx_param_bool_c *instant = new bx_param_bool_c(menu, "instant", label, descr, 0);
+    deplist = new bx_list_c(NULL, 3);
     deplist->add(mode);
     deplist->add(path);
+    deplist->add(instant);
     enabled->set_dependent_list(deplist);
   }
 
@@ -1775,6 +1897,11 @@ void bx_init_options()
 
 void bx_reset_options()
 {
+  // checkpoint options
+  SIM->get_param("general.checkpoint")->reset();
+  // clone server options
+  SIM->get_param("general.clone")->reset();
+
   // cpu
   SIM->get_param("cpu")->reset();
 
@@ -2395,10 +2522,6 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         if (type < 0) {
           PARSE_ERR(("%s: ataX-master/slave: unknown type '%s'", context, &params[i][5]));
         }
-      } else if (!strcmp(params[i], "mode=z-undoable")) {
-        PARSE_ERR(("%s: ataX-master/slave mode 'z-undoable' not implemented yet", context));
-      } else if (!strcmp(params[i], "mode=z-volatile")) {
-        PARSE_ERR(("%s: ataX-master/slave mode 'z-volatile' not implemented yet", context));
       } else if (!strncmp(params[i], "mode=", 5)) {
         mode = SIM->get_param_enum("mode", base)->find_by_name(&params[i][5]);
         if (mode < 0) {
@@ -2437,6 +2560,14 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_bool("status", base)->set(1);
       } else if (!strncmp(params[i], "journal=", 8)) {
         SIM->get_param_string("journal", base)->set(&params[i][8]);
+      } else if (!strncmp(params[i], "async=", 6)) {
+        SIM->get_param_bool("async", base)->set(atol(&params[i][6]));
+      } else if (!strncmp(params[i], "prealloc=", 9)) {
+        SIM->get_param_num("prealloc", base)->set(atol(&params[i][9]));
+      } else if (!strncmp(params[i], "extent_size=", 12)) {
+        SIM->get_param_num("extent_size", base)->set(atol(&params[i][12]));
+      } else if (!strncmp(params[i], "write_cache=", 12)) {
+        SIM->get_param_num("write_cache", base)->set(atol(&params[i][12]));
       } else {
         PARSE_ERR(("%s: ataX-master/slave directive malformed.", context));
       }
@@ -2682,10 +2813,46 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_num(BXPN_HOST_MEM_SIZE)->set(atol(&params[i][5]));
       } else if (!strncmp(params[i], "guest=", 6)) {
         SIM->get_param_num(BXPN_MEM_SIZE)->set(atol(&params[i][6]));
+      } else if (!strncmp(params[i], "hugepages=", 10)) {
+        if (parse_param_bool(params[i], 10, BXPN_MEM_HUGEPAGES) < 0) {
+          PARSE_ERR(("%s: memory directive malformed.", context));
+        }
+      } else if (!strncmp(params[i], "release=", 8)) {
+        if (parse_param_bool(params[i], 8, BXPN_MEM_RELEASE) < 0) {
+          PARSE_ERR(("%s: memory directive malformed.", context));
+        }
       } else {
         PARSE_ERR(("%s: memory directive malformed.", context));
       }
     }
+  } else if (!strcmp(params[0], "checkpoint")) {
+    for (i=1; i<num_params; i++) {
+      if (!strncmp(params[i], "compress=", 9)) {
+        if (parse_param_bool(params[i], 9, BXPN_CHECKPOINT_COMPRESS) < 0) {
+          PARSE_ERR(("%s: checkpoint directive malformed.", context));
+        }
+      } else if (!strncmp(params[i], "incremental=", 12)) {
+        if (parse_param_bool(params[i], 12, BXPN_CHECKPOINT_INCREMENTAL) < 0) {
+          PARSE_ERR(("%s: checkpoint directive malformed.", context));
+        }
+      } else {
+        PARSE_ERR(("%s: checkpoint directive malformed.", context));
+      }
+    }
+  } else if (!strcmp(params[0], "clone")) {
+    for (i=1; i<num_params; i++) {
+      if (!strncmp(params[i], "enabled=", 8)) {
+        if (parse_param_bool(params[i], 8, BXPN_CLONE_ENABLED) < 0) {
+          PARSE_ERR(("%s: clone directive malformed.", context));
+        }
+      } else if (!strncmp(params[i], "socket=", 7)) {
+        SIM->get_param_string(BXPN_CLONE_SOCKET)->set(&params[i][7]);
+      } else if (!strncmp(params[i], "jobs=", 5)) {
+        SIM->get_param_num(BXPN_CLONE_JOBS)->set(atol(&params[i][5]));
+      } else {
+        PARSE_ERR(("%s: clone directive malformed.", context));
+      }
+    }
   } else if (!strcmp(params[0], "romimage")) {
     if ((num_params < 2) || (num_params > 3)) {
       PARSE_ERR(("%s: romimage directive: wrong # args.", context));
@@ -2766,7 +2933,12 @@ static int parse_line_formatted(const char *context, int num_params, char *param
     if (num_params != 2) {
       PARSE_ERR(("%s: vga_update_interval directive: wrong # args.", context));
     }
-    SIM->get_param_num(BXPN_VGA_UPDATE_INTERVAL)->set(atol(params[1]));
+    long interval = atol(params[1]);
+    if ((interval > 0) && (interval < 40000)) {
+      PARSE_WARN(("%s: vga_update_interval must be 0 (headless) or at least 40000, using 40000.", context));
+      interval = 40000;
+    }
+    SIM->get_param_num(BXPN_VGA_UPDATE_INTERVAL)->set(interval);
   } else if (!strcmp(params[0], "vga")) {
     if (num_params != 2) {
       PARSE_ERR(("%s: vga directive: wrong # args.", context));
@@ -2899,6 +3071,8 @@ static int parse_line_formatted(const char *context, int num_params, char *param
       } else if (!strncmp(params[i], "dev=", 4)) {
         SIM->get_param_string("dev", base)->set(&params[i][4]);
         SIM->get_param_bool("enabled", base)->set(1);
+      } else if (!strncmp(params[i], "instant=", 8)) {
+        SIM->get_param_bool("instant", base)->set(atol(&params[i][8]));
       } else {
         PARSE_ERR(("%s: unknown parameter for com%d ignored.", context, idx));
       }
@@ -2989,6 +3163,26 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         BX_ERROR(("%s: unknown parameter for pcidev ignored.", context));
       }
     }
+  } else if (!strcmp(params[0], "pcivblk")) {
+    base = (bx_list_c*) SIM->get_param(BXPN_PCIVBLK);
+    for (i=1; i<num_params; i++) {
+      if (!strncmp(params[i], "enabled=", 8)) {
+        SIM->get_param_bool("enabled", base)->set(atol(&params[i][8]));
+      } else if (!strncmp(params[i], "path=", 5)) {
+        SIM->get_param_string("path", base)->set(&params[i][5]);
+      } else if (!strncmp(params[i], "mode=", 5)) {
+        if (!SIM->get_param_enum("mode", base)->set_by_name(&params[i][5]))
+          PARSE_ERR(("%s: pcivblk: unknown mode '%s'", context, &params[i][5]));
+      } else if (!strncmp(params[i], "journal=", 8)) {
+        SIM->get_param_string("journal", base)->set(&params[i][8]);
+      } else {
+        PARSE_WARN(("%s: unknown parameter '%s' for pcivblk ignored.", context, params[i]));
+      }
+    }
+    if (SIM->get_param_bool("enabled", base)->get() &&
+        (strlen(SIM->get_param_string("path", base)->getptr()) == 0)) {
+      PARSE_ERR(("%s: pcivblk directive incomplete (path is required)", context));
+    }
   } else if (!strcmp(params[0], "cmosimage")) {
     for (i=1; i<num_params; i++) {
       if (!strncmp(params[i], "file=", 5)) {
@@ -3439,6 +3633,18 @@ int bx_write_atadevice_options(FILE *fp, Bit8u channel, Bit8u drive, bx_list_c *
         if (strcmp(SIM->get_param_string("journal", base)->getptr(), "") != 0)
           fprintf(fp, ", journal=\"%s\"", SIM->get_param_string("journal", base)->getptr());
 
+      if (SIM->get_param_bool("async", base)->get())
+        fprintf(fp, ", async=1");
+
+      if (SIM->get_param_num("prealloc", base)->get() > 0)
+        fprintf(fp, ", prealloc=%d", SIM->get_param_num("prealloc", base)->get());
+
+      if (SIM->get_param_num("extent_size", base)->get() > 0)
+        fprintf(fp, ", extent_size=%d", SIM->get_param_num("extent_size", base)->get());
+
+      if (SIM->get_param_num("write_cache", base)->get() > 0)
+        fprintf(fp, ", write_cache=%d", SIM->get_param_num("write_cache", base)->get());
+
     } else if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_CDROM) {
       fprintf(fp, "type=cdrom, path=\"%s\", status=%s",
         SIM->get_param_string("path", base)->getptr(),
@@ -3447,7 +3653,7 @@ int bx_write_atadevice_options(FILE *fp, Bit8u channel, Bit8u drive, bx_list_c *
 
     fprintf(fp, ", biosdetect=%s", SIM->get_param_enum("biosdetect", base)->get_selected());
 
-    if (SIM->get_param_string("model", base)->getptr()>0) {
+    if (strlen(SIM->get_param_string("model", base)->getptr()) > 0) {
         fprintf(fp, ", model=\"%s\"", SIM->get_param_string("model", base)->getptr());
     }
 
@@ -3472,6 +3678,7 @@ int bx_write_serial_options(FILE *fp, bx_list_c *base, int n)
   if (SIM->get_param_bool("enabled", base)->get()) {
     fprintf(fp, ", mode=%s", SIM->get_param_enum("mode", base)->get_selected());
     fprintf(fp, ", dev=\"%s\"", SIM->get_param_string("dev", base)->getptr());
+    fprintf(fp, ", instant=%d", SIM->get_param_bool("instant", base)->get());
   }
   fprintf(fp, "\n");
   return 0;
@@ -3703,8 +3910,22 @@ int bx_write_configuration(const char *rc, int overwrite)
     fprintf(fp, ", options=\"%s\"\n", strptr);
   else
     fprintf(fp, "\n");
-  fprintf(fp, "memory: host=%d, guest=%d\n", SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get(),
-    SIM->get_param_num(BXPN_MEM_SIZE)->get());
+  fprintf(fp, "memory: host=%d, guest=%d, hugepages=%d, release=%d\n",
+    SIM->get_param_num(BXPN_HOST_MEM_SIZE)->get(),
+    SIM->get_param_num(BXPN_MEM_SIZE)->get(),
+    SIM->get_param_bool(BXPN_MEM_HUGEPAGES)->get(),
+    SIM->get_param_bool(BXPN_MEM_RELEASE)->get());
+  fprintf(fp, "checkpoint: compress=%d, incremental=%d\n",
+    SIM->get_param_bool(BXPN_CHECKPOINT_COMPRESS)->get(),
+    SIM->get_param_bool(BXPN_CHECKPOINT_INCREMENTAL)->get());
+  fprintf(fp, "clone: enabled=%d, jobs=%d",
+    SIM->get_param_bool(BXPN_CLONE_ENABLED)->get(),
+    SIM->get_param_num(BXPN_CLONE_JOBS)->get());
+  strptr = SIM->get_param_string(BXPN_CLONE_SOCKET)->getptr();
+  if (strlen(strptr) > 0)
+    fprintf(fp, ", socket=\"%s\"\n", strptr);
+  else
+    fprintf(fp, "\n");
   strptr = SIM->get_param_string(BXPN_ROM_PATH)->getptr();
   if (strlen(strptr) > 0) {
     fprintf(fp, "romimage: file=\"%s\"", strptr);
@@ -3792,6 +4013,16 @@ int bx_write_configuration(const char *rc, int overwrite)
       SIM->get_param_num(BXPN_PCIDEV_VENDOR)->get(),
       SIM->get_param_num(BXPN_PCIDEV_DEVICE)->get());
   }
+  base = (bx_list_c*) SIM->get_param(BXPN_PCIVBLK);
+  if (SIM->get_param_bool("enabled", base)->get()) {
+    fprintf(fp, "pcivblk: enabled=1, path=\"%s\", mode=%s",
+      SIM->get_param_string("path", base)->getptr(),
+      SIM->get_param_enum("mode", base)->get_selected());
+    if (strlen(SIM->get_param_string("journal", base)->getptr()) > 0) {
+      fprintf(fp, ", journal=\"%s\"", SIM->get_param_string("journal", base)->getptr());
+    }
+    fprintf(fp, "\n");
+  }
   fprintf(fp, "vga_update_interval: %u\n", SIM->get_param_num(BXPN_VGA_UPDATE_INTERVAL)->get());
   fprintf(fp, "vga: extension=%s\n", SIM->get_param_string(BXPN_VGA_EXTENSION)->getptr());
 #if BX_SUPPORT_SMP
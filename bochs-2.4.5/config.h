@@ -121,12 +121,14 @@
 #define BX_HAVE_SOCKLEN_T 1
 #define BX_HAVE_SOCKADDR_IN_SIN_LEN 0
 #define BX_HAVE_GETTIMEOFDAY 1
+#define BX_HAVE_PTHREAD 1
 #if defined(WIN32)
 #define BX_HAVE_REALTIME_USEC 1
 #else
 #define BX_HAVE_REALTIME_USEC (BX_HAVE_GETTIMEOFDAY)
 #endif
 #define BX_HAVE_MKSTEMP 1
+#define BX_HAVE_PREADV 1
 #define BX_HAVE_SYS_MMAN_H 1
 #define BX_HAVE_XPM_H 0
 #define BX_HAVE_TIMELOCAL 1
@@ -191,6 +193,7 @@
 #define BX_USE_USB_UHCI_SMF 1  // USB UHCI hub
 #define BX_USE_USB_OHCI_SMF 1  // USB OHCI hub
 #define BX_USE_PCIPNIC_SMF  1  // PCI pseudo NIC
+#define BX_USE_PCIVBLK_SMF  1  // PCI paravirtual block device
 #define BX_USE_NE2K_SMF     1  // NE2K
 #define BX_USE_EFI_SMF      1  // External FPU IRQ
 #define BX_USE_GAMEPORT_SMF 1  // Gameport
@@ -210,7 +213,8 @@
    || !BX_USE_P2I_SMF || !BX_USE_PCIVGA_SMF || !BX_USE_USB_UHCI_SMF \
    || !BX_USE_USB_OHCI_SMF || !BX_USE_PCIPNIC_SMF || !BX_USE_PIDE_SMF \
    || !BX_USE_ACPI_SMF || !BX_USE_NE2K_SMF || !BX_USE_EFI_SMF \
-   || !BX_USE_GAMEPORT_SMF || !BX_USE_PCIDEV_SMF || !BX_USE_CIRRUS_SMF)
+   || !BX_USE_GAMEPORT_SMF || !BX_USE_PCIDEV_SMF || !BX_USE_CIRRUS_SMF \
+   || !BX_USE_PCIVBLK_SMF)
 #error You must use SMF to have plugins
 #endif
 
@@ -840,6 +844,13 @@ typedef
   #error To enable the PCI pseudo NIC, you must also enable PCI
 #endif
 
+// Paravirtual PCI block device
+#define BX_SUPPORT_PCIVBLK 0
+
+#if (BX_SUPPORT_PCIVBLK && !BX_SUPPORT_PCI)
+  #error To enable the PCI paravirtual block device, you must also enable PCI
+#endif
+
 // this enables the lowlevel stuff below if one of the NICs is present
 #define BX_NETWORKING 0
 
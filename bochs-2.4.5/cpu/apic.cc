@@ -209,6 +209,7 @@ void bx_local_apic_c::reset(unsigned type)
   for(i=0; i<BX_LAPIC_MAX_INTS; i++) {
     irr[i] = isr[i] = tmr[i] = 0;
   }
+  irr_summary = isr_summary = 0;
 
   timer_divconf = 0;
   timer_divide_factor = 1;
@@ -516,13 +517,13 @@ void bx_local_apic_c::write_spurious_interrupt_register(Bit32u value)
 void bx_local_apic_c::receive_EOI(Bit32u value)
 {
   BX_DEBUG(("Wrote 0x%x to EOI", value));
-  int vec = highest_priority_int(isr);
+  int vec = highest_priority_int(isr, isr_summary);
   if(vec < 0) {
     BX_DEBUG(("EOI written without any bit in ISR"));
   } else {
     if ((Bit32u) vec != spurious_vector) {
        BX_DEBUG(("local apic received EOI, hopefully for vector 0x%02x", vec));
-       isr[vec] = 0;
+       clear_vector(isr, &isr_summary, vec);
        if(tmr[vec]) {
            apic_bus_broadcast_eoi(vec);
            tmr[vec] = 0;
@@ -661,12 +662,47 @@ Bit32u bx_local_apic_c::read_aligned(bx_phy_address addr)
   return data;
 }
 
-int bx_local_apic_c::highest_priority_int(Bit8u *array)
+int bx_local_apic_c::highest_priority_int(Bit8u *array, Bit16u summary)
 {
-  for(int i=BX_LAPIC_LAST_VECTOR; i>=BX_LAPIC_FIRST_VECTOR; i--)
-    if(array[i]) return i;
+  // vectors below BX_LAPIC_FIRST_VECTOR are never set, so the summary
+  // bit of priority class 0 is never set either
+  if (summary == 0) return -1;
 
-  return -1;
+  int i = 15;
+  while (!(summary & (1 << i))) i--;
+
+  // the summary guarantees a set vector in this priority class
+  for(i = (i << 4) | 0xf; !array[i]; i--);
+
+  return i;
+}
+
+void bx_local_apic_c::set_vector(Bit8u *array, Bit16u *summary, unsigned vector)
+{
+  array[vector] = 1;
+  *summary |= 1 << (vector >> 4);
+}
+
+void bx_local_apic_c::clear_vector(Bit8u *array, Bit16u *summary, unsigned vector)
+{
+  array[vector] = 0;
+
+  unsigned first = vector & 0xf0;
+  for (unsigned i=first; i < first+16; i++)
+    if (array[i]) return;
+
+  *summary &= ~(1 << (vector >> 4));
+}
+
+// rebuild isr_summary and irr_summary from the isr and irr arrays,
+// used after the arrays were restored from a saved state
+void bx_local_apic_c::update_summaries(void)
+{
+  isr_summary = irr_summary = 0;
+  for(unsigned i=BX_LAPIC_FIRST_VECTOR; i<=BX_LAPIC_LAST_VECTOR; i++) {
+    if(isr[i]) isr_summary |= 1 << (i >> 4);
+    if(irr[i]) irr_summary |= 1 << (i >> 4);
+  }
 }
 
 void bx_local_apic_c::service_local_apic(void)
@@ -677,9 +713,9 @@ void bx_local_apic_c::service_local_apic(void)
   }
   if(INTR) return;  // INTR already up; do nothing
   // find first interrupt in irr.
-  int first_irr = highest_priority_int(irr);
+  int first_irr = highest_priority_int(irr, irr_summary);
   if (first_irr < 0) return;   // no interrupts, leave INTR=0
-  int first_isr = highest_priority_int(isr);
+  int first_isr = highest_priority_int(isr, isr_summary);
   if (first_isr >= 0 && first_irr <= first_isr) {
     BX_DEBUG(("lapic(%d): not delivering int 0x%02x because int 0x%02x is in service", apic_id, first_irr, first_isr));
     return;
@@ -753,7 +789,7 @@ void bx_local_apic_c::trigger_irq(Bit8u vector, unsigned trigger_mode, bx_bool b
   }
 
 service_vector:
-  irr[vector] = 1;
+  set_vector(irr, &irr_summary, vector);
   tmr[vector] = trigger_mode;	// set for level triggered
   service_local_apic();
 }
@@ -764,7 +800,7 @@ void bx_local_apic_c::untrigger_irq(Bit8u vector, unsigned trigger_mode)
   // hardware says "no more".  clear the bit.  If the CPU hasn't yet
   // acknowledged the interrupt, it will never be serviced.
   BX_ASSERT(irr[vector] == 1);
-  irr[vector] = 0;
+  clear_vector(irr, &irr_summary, vector);
   if(bx_dbg.apic) print_status();
 }
 
@@ -775,13 +811,13 @@ Bit8u bx_local_apic_c::acknowledge_int(void)
     BX_PANIC(("APIC %d acknowledged an interrupt, but INTR=0", apic_id));
 
   BX_ASSERT(INTR);
-  int vector = highest_priority_int(irr);
+  int vector = highest_priority_int(irr, irr_summary);
   if (vector < 0) goto spurious;
   if((vector & 0xf0) <= get_ppr()) goto spurious;
   BX_ASSERT(irr[vector] == 1);
   BX_DEBUG(("acknowledge_int() returning vector 0x%02x", vector));
-  irr[vector] = 0;
-  isr[vector] = 1;
+  clear_vector(irr, &irr_summary, vector);
+  set_vector(isr, &isr_summary, vector);
   if(bx_dbg.apic) {
     BX_INFO(("Status after setting isr:"));
     print_status();
@@ -846,7 +882,7 @@ bx_bool bx_local_apic_c::match_logical_addr(apic_dest_t address)
 
 Bit8u bx_local_apic_c::get_ppr(void)
 {
-  int ppr = highest_priority_int(isr);
+  int ppr = highest_priority_int(isr, isr_summary);
 
   if((ppr < 0) || ((task_priority & 0xF0) >= ((Bit32u) ppr & 0xF0)))
     ppr = task_priority;
@@ -869,9 +905,9 @@ void bx_local_apic_c::set_tpr(Bit8u priority)
 Bit8u bx_local_apic_c::get_apr(void)
 {
   Bit32u tpr  = (task_priority >> 4) & 0xf;
-  int first_isr = highest_priority_int(isr);
+  int first_isr = highest_priority_int(isr, isr_summary);
   if (first_isr < 0) first_isr = 0;
-  int first_irr = highest_priority_int(irr);
+  int first_irr = highest_priority_int(irr, irr_summary);
   if (first_irr < 0) first_irr = 0;
   Bit32u isrv = (first_isr >> 4) & 0xf;
   Bit32u irrv = (first_irr >> 4) & 0xf;
@@ -67,6 +67,11 @@ class BOCHSAPI bx_local_apic_c : public logfunctions
   // the I/O APIC or another processor, it sets a bit in irr. The bit is
   // cleared when the interrupt is acknowledged by the processor.
   Bit8u irr[BX_LAPIC_MAX_INTS];
+  // Priority class summaries of isr and irr: bit n is set when any vector
+  // of priority class n (vector >> 4) is set, so the highest vector is
+  // found without scanning all 256 entries.
+  Bit16u isr_summary;
+  Bit16u irr_summary;
 
 #define APIC_ERR_ILLEGAL_ADDR    0x80
 #define APIC_ERR_RX_ILLEGAL_VEC  0x40
@@ -139,7 +144,10 @@ public:
   void trigger_irq(Bit8u vector, unsigned trigger_mode, bx_bool bypass_irr_isr = 0);
   void untrigger_irq(Bit8u vector, unsigned trigger_mode);
   Bit8u acknowledge_int(void);  // only the local CPU should call this
-  int highest_priority_int(Bit8u *array);
+  int highest_priority_int(Bit8u *array, Bit16u summary);
+  void set_vector(Bit8u *array, Bit16u *summary, unsigned vector);
+  void clear_vector(Bit8u *array, Bit16u *summary, unsigned vector);
+  void update_summaries(void);
   void receive_EOI(Bit32u value);
   void send_ipi(apic_dest_t dest, Bit32u lo_cmd);
   void write_spurious_interrupt_register(Bit32u value);
@@ -158,6 +166,7 @@ public:
   void set_initial_timer_count(Bit32u value);
   void startup_msg(Bit8u vector);
   void register_state(bx_param_c *parent);
+  void after_restore_state(void) { update_summaries(); }
 };
 
 int apic_bus_deliver_lowest_priority(Bit8u vector, apic_dest_t dest, bx_bool trig_mode, bx_bool broadcast);
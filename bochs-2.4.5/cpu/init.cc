@@ -695,6 +695,10 @@ void BX_CPU_C::after_restore_state(void)
 
   TLB_flush();
 
+#if BX_SUPPORT_APIC
+  BX_CPU_THIS_PTR lapic.after_restore_state();
+#endif
+
 #if BX_CPU_LEVEL >= 4 && BX_SUPPORT_ALIGNMENT_CHECK
   handleAlignmentCheck();
 #endif
@@ -100,6 +100,8 @@ bx_gui_c::bx_gui_c(void)
   put("GUI"); // Init in specific_init
   statusitem_count = 0;
   framebuffer = NULL;
+  screenshot_requested = 0;
+  screenshot_count = 0;
 }
 
 bx_gui_c::~bx_gui_c()
@@ -225,6 +227,10 @@ void bx_gui_c::init(int argc, char **argv, unsigned tilewidth, unsigned tileheig
   if (SIM->get_param_bool(BXPN_TEXT_SNAPSHOT_CHECK)->get()) {
     bx_pc_system.register_timer(this, bx_gui_c::snapshot_checker, (unsigned) 1000000, 1, 1, "snap_chk");
   }
+#if !defined(WIN32)
+  // screenshots requested with SIGUSR1 are saved from this timer
+  bx_pc_system.register_timer(this, bx_gui_c::screenshot_checker, (unsigned) 100000, 1, 1, "screenshot");
+#endif
 
   BX_GUI_THIS charmap_updated = 0;
 
@@ -480,6 +486,80 @@ void bx_gui_c::snapshot_handler(void)
   free(text_snapshot);
 }
 
+// Request a screenshot from a signal handler. It is saved later by
+// screenshot_checker(), when the simulation is in a consistent state.
+void bx_gui_c::request_screenshot(void)
+{
+  BX_GUI_THIS screenshot_requested = 1;
+}
+
+void bx_gui_c::screenshot_checker(void *this_ptr)
+{
+  if (BX_GUI_THIS screenshot_requested) {
+    BX_GUI_THIS screenshot_requested = 0;
+    screenshot_handler();
+  }
+}
+
+// Save the current screen to screenshotNNN.bmp in graphics modes or to
+// screenshotNNN.txt in text modes. This also works in the headless mode
+// (vga_update_interval 0), since the VGA renders the frame on demand.
+void bx_gui_c::screenshot_handler(void)
+{
+  char filename[BX_PATHNAME_LEN];
+  char *text_snapshot;
+  Bit8u *gfx_snapshot, header[54], pad[3] = {0, 0, 0};
+  Bit32u len, line_len;
+  unsigned iWidth, iHeight, y;
+  FILE *fp;
+
+  if (DEV_vga_get_gfx_snapshot(&gfx_snapshot, &iWidth, &iHeight)) {
+    sprintf(filename, "screenshot%03u.bmp", BX_GUI_THIS screenshot_count++);
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+      BX_ERROR(("screenshot: cannot create '%s'", filename));
+      free(gfx_snapshot);
+      return;
+    }
+    // 24 bpp BMP: the lines are stored bottom-up and padded to 4 bytes
+    line_len = (iWidth * 3 + 3) & ~3;
+    len = line_len * iHeight;
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    WriteHostDWordToLittleEndian(&header[2], sizeof(header) + len);
+    WriteHostDWordToLittleEndian(&header[10], sizeof(header));
+    WriteHostDWordToLittleEndian(&header[14], 40);
+    WriteHostDWordToLittleEndian(&header[18], iWidth);
+    WriteHostDWordToLittleEndian(&header[22], iHeight);
+    WriteHostWordToLittleEndian(&header[26], 1);
+    WriteHostWordToLittleEndian(&header[28], 24);
+    WriteHostDWordToLittleEndian(&header[34], len);
+    fwrite(header, 1, sizeof(header), fp);
+    for (y = iHeight; y > 0; y--) {
+      fwrite(gfx_snapshot + (y - 1) * iWidth * 3, 1, iWidth * 3, fp);
+      fwrite(pad, 1, line_len - iWidth * 3, fp);
+    }
+    fclose(fp);
+    free(gfx_snapshot);
+  } else if (make_text_snapshot(&text_snapshot, &len) >= 0) {
+    sprintf(filename, "screenshot%03u.txt", BX_GUI_THIS screenshot_count++);
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+      BX_ERROR(("screenshot: cannot create '%s'", filename));
+      free(text_snapshot);
+      return;
+    }
+    fwrite(text_snapshot, 1, len, fp);
+    fclose(fp);
+    free(text_snapshot);
+  } else {
+    BX_ERROR(("screenshot failed, mode not implemented"));
+    return;
+  }
+  BX_INFO(("screenshot saved to '%s'", filename));
+}
+
 // Read ASCII chars from the system clipboard and paste them into bochs.
 // Note that paste cannot work with the key mapping tables loaded.
 void bx_gui_c::paste_handler(void)
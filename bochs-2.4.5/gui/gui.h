@@ -131,6 +131,8 @@ public:
   int register_statusitem(const char *text);
   static void init_signal_handlers();
   static void toggle_mouse_enable(void);
+  static void request_screenshot(void);
+  static void screenshot_handler(void);
 
 
 protected:
@@ -145,6 +147,7 @@ protected:
   static void paste_handler(void);
   static void snapshot_handler(void);
   static void snapshot_checker(void *);
+  static void screenshot_checker(void *);
   static void config_handler(void);
   static void userbutton_handler(void);
   static void save_restore_handler(void);
@@ -178,6 +181,8 @@ protected:
   Bit8u host_bpp;
   Bit8u *framebuffer;
   Bit32u dialog_caps;
+  volatile bx_bool screenshot_requested;
+  unsigned screenshot_count;
 };
 
 
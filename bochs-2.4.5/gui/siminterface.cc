@@ -27,6 +27,13 @@
 #include "param_names.h"
 #include "iodev.h"
 
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+// name of the binary hardware state file in the checkpoint folder
+#define BX_SR_STATE_FILE "state.bin"
+
 bx_simulator_interface_c *SIM = NULL;
 logfunctions *siminterface_log = NULL;
 bx_list_c *root_param = NULL;
@@ -66,6 +73,8 @@ class bx_real_sim_c : public bx_simulator_interface_c {
   int exit_code;
   unsigned param_id;
   bx_bool wx_debug_gui;
+  // last checkpoint saved or restored, parent of incremental checkpoints
+  char sr_parent_path[BX_PATHNAME_LEN];
 public:
   bx_real_sim_c();
   virtual ~bx_real_sim_c() {}
@@ -177,7 +186,8 @@ public:
   virtual bx_bool restore_bochs_param(bx_list_c *root, const char *sr_path, const char *restore_name);
 
 private:
-  bx_bool save_sr_param(FILE *fp, bx_param_c *node, const char *sr_path, int level);
+  bx_bool save_sr_binary(const char *sr_path, bx_list_c *root);
+  bx_bool restore_sr_binary(bx_list_c *root, const char *sr_path, const char *restore_name);
 };
 
 #if BX_DEBUGGER && BX_DEBUGGER_GUI
@@ -317,6 +327,7 @@ bx_real_sim_c::bx_real_sim_c()
   exit_code = 0;
   param_id = BXP_NEW_PARAM_ID;
   user_options = NULL;
+  sr_parent_path[0] = 0;
 }
 
 void bx_real_sim_c::reset_all_param()
@@ -480,8 +491,11 @@ const char *atadevice_mode_names[] = {
   "undoable",
   "growing",
   "volatile",
-//"z-undoable",
-//"z-volatile",
+  "mmap",
+  "mmap-volatile",
+  "cow",
+  "z-undoable",
+  "z-volatile",
   NULL
 };
 
@@ -935,19 +949,7 @@ bx_bool bx_real_sim_c::save_state(const char *checkpoint_path)
   } else {
     return 0;
   }
-  bx_list_c *sr_list = get_bochs_root();
-  ndev = sr_list->get_size();
-  for (dev=0; dev<ndev; dev++) {
-    sprintf(sr_file, "%s/%s", checkpoint_path, sr_list->get(dev)->get_name());
-    fp = fopen(sr_file, "w");
-    if (fp != NULL) {
-      save_sr_param(fp, sr_list->get(dev), checkpoint_path, 0);
-      fclose(fp);
-    } else {
-      return 0;
-    }
-  }
-  return 1;
+  return save_sr_binary(checkpoint_path, get_bochs_root());
 }
 
 bx_bool bx_real_sim_c::restore_config()
@@ -1049,6 +1051,12 @@ bx_bool bx_real_sim_c::restore_bochs_param(bx_list_c *root, const char *sr_path,
     return 0;
   }
 
+  sprintf(devstate, "%s/%s", sr_path, BX_SR_STATE_FILE);
+  if (access(devstate, F_OK) == 0) {
+    return restore_sr_binary(root, sr_path, restore_name);
+  }
+
+  // text format written by Bochs versions up to 2.4.5
   sprintf(devstate, "%s/%s", sr_path, restore_name);
   BX_INFO(("restoring '%s'", devstate));
   bx_list_c *base = root;
@@ -1143,8 +1151,14 @@ bx_bool bx_real_sim_c::restore_bochs_param(bx_list_c *root, const char *sr_path,
 
 bx_bool bx_real_sim_c::restore_hardware()
 {
+  char sr_file[BX_PATHNAME_LEN];
   bx_list_c *sr_list = get_bochs_root();
   int ndev = sr_list->get_size();
+
+  sprintf(sr_file, "%s/%s", get_param_string(BXPN_RESTORE_PATH)->getptr(), BX_SR_STATE_FILE);
+  if (access(sr_file, F_OK) == 0) {
+    return restore_sr_binary(sr_list, get_param_string(BXPN_RESTORE_PATH)->getptr(), NULL);
+  }
   for (int dev=0; dev<ndev; dev++) {
     if (!restore_bochs_param(sr_list, get_param_string(BXPN_RESTORE_PATH)->getptr(), sr_list->get(dev)->get_name()))
       return 0;
@@ -1152,98 +1166,753 @@ bx_bool bx_real_sim_c::restore_hardware()
   return 1;
 }
 
-bx_bool bx_real_sim_c::save_sr_param(FILE *fp, bx_param_c *node, const char *sr_path, int level)
+//
+// Binary checkpoint format. The whole "bochs" save/restore subtree is
+// stored in a single file inside the checkpoint folder:
+//
+//   header      magic, format version, position of param tree and data area,
+//               folder of the parent checkpoint (incremental checkpoints)
+//   param tree  one record per param, lists followed by their children
+//   data area   contents of the data params (RAM, VGA memory, buffers), each
+//               block starting at a page aligned file offset
+//
+// A record is: type (1 byte), length of name (1 byte), name, value
+//   BXT_PARAM_NUM, BXT_PARAM_ENUM  64-bit value
+//   BXT_PARAM_BOOL                 1 byte
+//   BXT_PARAM_STRING               32-bit length, characters
+//   BXT_PARAM_DATA                 64-bit file offset, 32-bit size, encoding
+//   BXT_LIST                       32-bit number of children, children
+// All numbers are stored in little endian byte order.
+//
+// Data blocks are stored in one of two encodings:
+//   BX_SR_DATA_RAW    plain copy, all-zero pages are left as holes in the
+//                     file. Guest RAM can be mapped copy-on-write from such
+//                     a block at restore time instead of reading it.
+//   BX_SR_DATA_PAGED  a directory with one entry per 4K page (64-bit file
+//                     offset, 32-bit type and length) followed by the page
+//                     contents. A page is either all zero, stored as is,
+//                     LZ4 compressed or unchanged since the parent checkpoint.
+// Version 1 files have no parent and no encoding byte, all data is raw.
+//
+
+#define BX_SR_MAGIC       "BXSTATE"
+#define BX_SR_VERSION     2
+#define BX_SR_HEADER_SIZE 32
+#define BX_SR_ALIGN       4096
+
+#define BX_SR_DATA_RAW    0
+#define BX_SR_DATA_PAGED  1
+
+#define BX_SR_PAGE_ZERO   0
+#define BX_SR_PAGE_RAW    1
+#define BX_SR_PAGE_LZ4    2
+#define BX_SR_PAGE_PARENT 3
+
+#define BX_SR_DIR_ENTRY_SIZE  12
+#define BX_SR_IO_BUFFER_SIZE  (1024 * 1024)
+#define BX_SR_MAX_DATA_PARAMS 64
+#define BX_SR_MAX_PARENTS     64
+
+static const Bit8u sr_zero_page[BX_SR_ALIGN] = {0};
+
+typedef struct {
+  Bit8u  *buf;
+  Bit32u  size;
+  Bit32u  maxsize;
+} bx_sr_buffer_t;
+
+static void sr_put(bx_sr_buffer_t *sr, const void *data, Bit32u len)
 {
-  int i;
-  Bit64s value;
-  char tmpstr[BX_PATHNAME_LEN], tmpbyte[4];
-  FILE *fp2;
-
-  for (i=0; i<level; i++)
-    fprintf(fp, "  ");
-  if (node == NULL) {
-      BX_ERROR(("NULL pointer"));
-      return 0;
+  if ((sr->size + len) > sr->maxsize) {
+    sr->maxsize = (sr->size + len) * 2;
+    sr->buf = (Bit8u*) realloc(sr->buf, sr->maxsize);
   }
-  fprintf(fp, "%s = ", node->get_name());
+  memcpy(sr->buf + sr->size, data, len);
+  sr->size += len;
+}
+
+static void sr_put8(bx_sr_buffer_t *sr, Bit8u val)
+{
+  sr_put(sr, &val, 1);
+}
+
+static void sr_put32(bx_sr_buffer_t *sr, Bit32u val)
+{
+  Bit8u tmp[4];
+  WriteHostDWordToLittleEndian((Bit32u*) tmp, val);
+  sr_put(sr, tmp, 4);
+}
+
+static void sr_put64(bx_sr_buffer_t *sr, Bit64u val)
+{
+  Bit8u tmp[8];
+  WriteHostQWordToLittleEndian((Bit64u*) tmp, val);
+  sr_put(sr, tmp, 8);
+}
+
+// serialize the param tree, collect the data params for the data area
+static bx_bool sr_put_param(bx_sr_buffer_t *sr, bx_param_c *node, bx_shadow_data_c **data, Bit32u *data_pos, int *ndata, int maxdata)
+{
+  const char *name = node->get_name();
+  Bit32u len;
+  int i;
+
+  sr_put8(sr, (Bit8u) node->get_type());
+  len = strlen(name);
+  if (len > 255) len = 255;
+  sr_put8(sr, (Bit8u) len);
+  sr_put(sr, name, len);
   switch (node->get_type()) {
     case BXT_PARAM_NUM:
-      value = ((bx_param_num_c*)node)->get64();
-      if (((bx_param_num_c*)node)->get_base() == BASE_DEC) {
-        if (((bx_param_num_c*)node)->get_min() >= BX_MIN_BIT64U) {
-          if ((Bit64u)((bx_param_num_c*)node)->get_max() > BX_MAX_BIT32U) {
-            fprintf(fp, FMT_LL"u\n", value);
-          } else {
-            fprintf(fp, "%u\n", (Bit32u) value);
-          }
-        } else {
-          fprintf(fp, "%d\n", (Bit32s) value);
-        }
-      } else {
-        if (node->get_format()) {
-          fprintf(fp, node->get_format(), value);
-        } else {
-          if ((Bit64u)((bx_param_num_c*)node)->get_max() > BX_MAX_BIT32U) {
-            fprintf(fp, "0x"FMT_LL"x", (Bit64u) value);
-          } else {
-            fprintf(fp, "0x%x", (Bit32u) value);
-          }
+    case BXT_PARAM_ENUM:
+      {
+        bx_param_num_c *nparam = (bx_param_num_c*)node;
+        Bit64s value = nparam->get64();
+        // values of 32-bit params are stored zero or sign extended like the
+        // text format did, save handlers may return -1 for unsigned params
+        if ((Bit64u) nparam->get_max() <= BX_MAX_BIT32U) {
+          if (nparam->get_min() >= BX_MIN_BIT64U)
+            value = (Bit32u) value;
+          else
+            value = (Bit32s) value;
         }
-        fprintf(fp, "\n");
+        sr_put64(sr, (Bit64u) value);
+        break;
       }
-      break;
     case BXT_PARAM_BOOL:
-      fprintf(fp, "%s\n", ((bx_param_bool_c*)node)->get()?"true":"false");
-      break;
-    case BXT_PARAM_ENUM:
-      fprintf(fp, "%s\n", ((bx_param_enum_c*)node)->get_selected());
+      sr_put8(sr, (Bit8u)((bx_param_bool_c*)node)->get());
       break;
     case BXT_PARAM_STRING:
       if (((bx_param_string_c*)node)->get_options() & bx_param_string_c::RAW_BYTES) {
-        tmpstr[0] = 0;
-        for (i = 0; i < ((bx_param_string_c*)node)->get_maxsize(); i++) {
-          if (i > 0) {
-            tmpbyte[0] = ((bx_param_string_c*)node)->get_separator();
-            tmpbyte[1] = 0;
-            strcat(tmpstr, tmpbyte);
-          }
-          sprintf(tmpbyte, "%02x", (Bit8u)((bx_param_string_c*)node)->getptr()[i]);
-          strcat(tmpstr, tmpbyte);
-        }
-        fprintf(fp, "%s\n", tmpstr);
+        len = ((bx_param_string_c*)node)->get_maxsize();
       } else {
-        fprintf(fp, "%s\n", ((bx_param_string_c*)node)->getptr());
+        len = strlen(((bx_param_string_c*)node)->getptr());
       }
+      sr_put32(sr, len);
+      sr_put(sr, ((bx_param_string_c*)node)->getptr(), len);
       break;
     case BXT_PARAM_DATA:
-      fprintf(fp, "%s.%s\n", node->get_parent()->get_name(), node->get_name());
-      if (sr_path)
-        sprintf(tmpstr, "%s/%s.%s", sr_path, node->get_parent()->get_name(), node->get_name());
-      else
-        sprintf(tmpstr, "%s.%s", node->get_parent()->get_name(), node->get_name());
-      fp2 = fopen(tmpstr, "wb");
-      if (fp2 != NULL) {
-        fwrite(((bx_shadow_data_c*)node)->getptr(), 1, ((bx_shadow_data_c*)node)->get_size(), fp2);
-        fclose(fp2);
+      if (*ndata >= maxdata) {
+        BX_ERROR(("save_state(): too many data params"));
+        return 0;
       }
+      // file offset and encoding are filled in when the data is written
+      data[*ndata] = (bx_shadow_data_c*)node;
+      data_pos[*ndata] = sr->size;
+      (*ndata)++;
+      sr_put64(sr, 0);
+      sr_put32(sr, ((bx_shadow_data_c*)node)->get_size());
+      sr_put8(sr, BX_SR_DATA_RAW);
       break;
     case BXT_LIST:
       {
-        fprintf(fp, "{\n");
         bx_list_c *list = (bx_list_c*)node;
+        sr_put32(sr, list->get_size());
         for (i=0; i < list->get_size(); i++) {
-          save_sr_param(fp, list->get(i), sr_path, level+1);
+          if (!sr_put_param(sr, list->get(i), data, data_pos, ndata, maxdata))
+            return 0;
+        }
+        break;
+      }
+    default:
+      BX_ERROR(("save_state(): unknown parameter type"));
+      return 0;
+  }
+  return 1;
+}
+
+static bx_bool sr_write(int fd, const void *data, Bit64u len)
+{
+  const Bit8u *ptr = (const Bit8u*) data;
+
+  while (len > 0) {
+    // keep the chunks below 1GB, some hosts do not like bigger ones
+    unsigned chunk = (len > 0x40000000) ? 0x40000000 : (unsigned) len;
+    int ret = ::write(fd, ptr, chunk);
+    if (ret <= 0) return 0;
+    ptr += ret;
+    len -= ret;
+  }
+  return 1;
+}
+
+static bx_bool sr_write_at(int fd, const void *data, Bit64u len, Bit64u offset)
+{
+  if (lseek(fd, (off_t) offset, SEEK_SET) < 0) return 0;
+  return sr_write(fd, data, len);
+}
+
+// buffered output for the data area
+typedef struct {
+  int fd;
+  Bit64u offset;       // file offset of the next byte
+  Bit64u file_size;    // end of the data written to the file so far
+  Bit8u *buf;
+  Bit32u buf_used;
+  bx_bool error;
+  bx_bool compress;
+  Bit8u *dirty;        // pages modified since the parent, NULL if not incremental
+  Bit32u dirty_pages;
+} bx_sr_writer_t;
+
+static void sr_flush(bx_sr_writer_t *w)
+{
+  if (w->buf_used > 0) {
+    if (!w->error && !sr_write_at(w->fd, w->buf, w->buf_used, w->offset - w->buf_used))
+      w->error = 1;
+    if (w->offset > w->file_size)
+      w->file_size = w->offset;
+    w->buf_used = 0;
+  }
+}
+
+static void sr_out(bx_sr_writer_t *w, const void *data, Bit32u len)
+{
+  if ((w->buf_used + len) > BX_SR_IO_BUFFER_SIZE)
+    sr_flush(w);
+  if (len > BX_SR_IO_BUFFER_SIZE) {
+    if (!w->error && !sr_write_at(w->fd, data, len, w->offset))
+      w->error = 1;
+    w->offset += len;
+    if (w->offset > w->file_size)
+      w->file_size = w->offset;
+  } else {
+    memcpy(w->buf + w->buf_used, data, len);
+    w->buf_used += len;
+    w->offset += len;
+  }
+}
+
+// skipping the output leaves a hole in the file which reads as zeroes
+static void sr_skip_to(bx_sr_writer_t *w, Bit64u offset)
+{
+  sr_flush(w);
+  w->offset = offset;
+}
+
+static void sr_write_raw_data(bx_sr_writer_t *w, const Bit8u *ptr, Bit32u size)
+{
+  for (Bit32u pos = 0; pos < size; pos += BX_SR_ALIGN) {
+    Bit32u len = ((size - pos) < BX_SR_ALIGN) ? (size - pos) : BX_SR_ALIGN;
+    if (!memcmp(ptr + pos, sr_zero_page, len)) {
+      sr_skip_to(w, w->offset + len);
+    } else {
+      sr_out(w, ptr + pos, len);
+    }
+  }
+}
+
+static void sr_write_paged_data(bx_sr_writer_t *w, const Bit8u *ptr, Bit32u size, bx_bool use_dirty)
+{
+  Bit32u npages = (size + BX_SR_ALIGN - 1) / BX_SR_ALIGN;
+  Bit64u dir_offset = w->offset;
+  Bit8u *dir = new Bit8u[npages * BX_SR_DIR_ENTRY_SIZE];
+  Bit8u cbuf[BX_SR_ALIGN];
+  Bit32u page, len, type;
+  int clen;
+
+  sr_skip_to(w, dir_offset + npages * BX_SR_DIR_ENTRY_SIZE);
+  for (page = 0; page < npages; page++) {
+    const Bit8u *src = ptr + page * BX_SR_ALIGN;
+    Bit64u offset = w->offset;
+    len = size - page * BX_SR_ALIGN;
+    if (len > BX_SR_ALIGN) len = BX_SR_ALIGN;
+    if (use_dirty && (page < w->dirty_pages) && !(w->dirty[page >> 3] & (1 << (page & 7)))) {
+      type = BX_SR_PAGE_PARENT;
+      len = 0;
+    } else if (!memcmp(src, sr_zero_page, len)) {
+      type = BX_SR_PAGE_ZERO;
+      len = 0;
+    } else if (w->compress && ((clen = bx_lz4_compress(src, len, cbuf, len - 1)) > 0)) {
+      type = BX_SR_PAGE_LZ4;
+      len = clen;
+      sr_out(w, cbuf, len);
+    } else {
+      type = BX_SR_PAGE_RAW;
+      sr_out(w, src, len);
+    }
+    WriteHostQWordToLittleEndian((Bit64u*)(dir + page * BX_SR_DIR_ENTRY_SIZE), offset);
+    WriteHostDWordToLittleEndian((Bit32u*)(dir + page * BX_SR_DIR_ENTRY_SIZE + 8), (type << 24) | len);
+  }
+  sr_flush(w);
+  if (!w->error && !sr_write_at(w->fd, dir, npages * BX_SR_DIR_ENTRY_SIZE, dir_offset))
+    w->error = 1;
+  if ((dir_offset + npages * BX_SR_DIR_ENTRY_SIZE) > w->file_size)
+    w->file_size = dir_offset + npages * BX_SR_DIR_ENTRY_SIZE;
+  delete [] dir;
+}
+
+static void sr_get_abs_path(const char *path, char *abs_path)
+{
+#ifndef WIN32
+  char tmp[PATH_MAX];
+  if ((realpath(path, tmp) != NULL) && (strlen(tmp) < BX_PATHNAME_LEN)) {
+    strcpy(abs_path, tmp);
+    return;
+  }
+#endif
+  strncpy(abs_path, path, BX_PATHNAME_LEN);
+  abs_path[BX_PATHNAME_LEN - 1] = 0;
+}
+
+bx_bool bx_real_sim_c::save_sr_binary(const char *sr_path, bx_list_c *root)
+{
+  char sr_file[BX_PATHNAME_LEN], tmp_file[BX_PATHNAME_LEN], abs_path[BX_PATHNAME_LEN];
+  bx_shadow_data_c *data[BX_SR_MAX_DATA_PARAMS];
+  Bit32u data_pos[BX_SR_MAX_DATA_PARAMS];
+  bx_sr_buffer_t tree = {NULL, 0, 0}, header = {NULL, 0, 0};
+  bx_sr_writer_t w;
+  const char *parent = NULL;
+  int i, ndata = 0;
+  bx_bool ret = 0;
+
+  if (!sr_put_param(&tree, root, data, data_pos, &ndata, BX_SR_MAX_DATA_PARAMS)) {
+    free(tree.buf);
+    return 0;
+  }
+
+  memset(&w, 0, sizeof(w));
+  w.compress = get_param_bool(BXPN_CHECKPOINT_COMPRESS)->get();
+  sr_get_abs_path(sr_path, abs_path);
+  if (BX_MEM(0)->dirty_tracking_enabled()) {
+    // pages not modified since the last checkpoint are taken from there
+    w.dirty = new Bit8u[BX_MEM(0)->get_host_dirty_bitmap_size()];
+    w.dirty_pages = BX_MEM(0)->get_host_dirty_bitmap_size() * 8;
+    BX_MEM(0)->snapshot_dirty_host_pages(w.dirty);
+    if (get_param_bool(BXPN_CHECKPOINT_INCREMENTAL)->get() &&
+        (sr_parent_path[0] != 0) && strcmp(sr_parent_path, abs_path)) {
+      parent = sr_parent_path;
+      BX_INFO(("saving incremental checkpoint, parent is '%s'", parent));
+    }
+  }
+
+  sr_put(&header, BX_SR_MAGIC, 8);
+  sr_put32(&header, BX_SR_VERSION);
+  sr_put32(&header, 0);
+  sr_put64(&header, tree.size);
+  sr_put64(&header, 0);
+  sr_put32(&header, parent ? strlen(parent) : 0);
+  if (parent) sr_put(&header, parent, strlen(parent));
+  Bit64u data_start = (header.size + tree.size + BX_SR_ALIGN - 1) & ~(Bit64u)(BX_SR_ALIGN - 1);
+  WriteHostDWordToLittleEndian((Bit32u*)(header.buf + 12), header.size);
+  WriteHostQWordToLittleEndian((Bit64u*)(header.buf + 24), data_start);
+
+  // A running simulation may have its RAM mapped from the checkpoint which
+  // is overwritten now. Write a new file and replace the old one only when
+  // complete, the mapping keeps the old file contents alive.
+  sprintf(sr_file, "%s/%s", sr_path, BX_SR_STATE_FILE);
+  sprintf(tmp_file, "%s.tmp", sr_file);
+  w.fd = ::open(tmp_file, O_RDWR | O_CREAT | O_TRUNC
+#ifdef O_BINARY
+                | O_BINARY
+#endif
+                , S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+  if (w.fd >= 0) {
+    w.buf = new Bit8u[BX_SR_IO_BUFFER_SIZE];
+    w.offset = data_start;
+    for (i = 0; (i < ndata) && !w.error; i++) {
+      Bit32u size = data[i]->get_size();
+      bx_bool use_dirty = (parent != NULL) && (data[i]->get_options() & bx_shadow_data_c::DIRTY_PAGES);
+      Bit8u encoding = (w.compress || use_dirty) ? BX_SR_DATA_PAGED : BX_SR_DATA_RAW;
+      sr_skip_to(&w, (w.offset + BX_SR_ALIGN - 1) & ~(Bit64u)(BX_SR_ALIGN - 1));
+      WriteHostQWordToLittleEndian((Bit64u*)(tree.buf + data_pos[i]), w.offset);
+      tree.buf[data_pos[i] + 12] = encoding;
+      if (encoding == BX_SR_DATA_PAGED) {
+        sr_write_paged_data(&w, data[i]->getptr(), size, use_dirty);
+      } else {
+        sr_write_raw_data(&w, data[i]->getptr(), size);
+      }
+    }
+    sr_flush(&w);
+    // a hole at the end of the file needs its last byte written
+    if (!w.error && (w.offset > w.file_size)) {
+      w.error = !sr_write_at(w.fd, sr_zero_page, 1, w.offset - 1);
+    }
+    ret = !w.error &&
+          sr_write_at(w.fd, header.buf, header.size, 0) &&
+          sr_write(w.fd, tree.buf, tree.size);
+    ::close(w.fd);
+    delete [] w.buf;
+  }
+  free(tree.buf);
+  free(header.buf);
+  if (w.dirty != NULL) delete [] w.dirty;
+  if (ret) {
+#ifdef WIN32
+    unlink(sr_file);
+#endif
+    ret = (rename(tmp_file, sr_file) == 0);
+  }
+  if (ret) {
+    strcpy(sr_parent_path, abs_path);
+  } else {
+    BX_ERROR(("save_state(): error writing '%s'", sr_file));
+    if (w.fd >= 0) unlink(tmp_file);
+    // the dirty page information is gone, next checkpoint must be a full one
+    sr_parent_path[0] = 0;
+  }
+  return ret;
+}
+
+typedef struct {
+  const Bit8u *ptr;    // param tree
+  const Bit8u *end;
+  int fd;
+  Bit64u file_size;
+  Bit32u version;
+  const char *parent;  // folder of the parent checkpoint, NULL if none
+  int depth;           // number of parents walked so far
+  bx_list_c *root;
+  bx_param_c *only;    // restore this data param only (from a parent)
+} bx_sr_reader_t;
+
+static bx_bool sr_restore_file(bx_list_c *root, const char *sr_path, const char *restore_name, bx_param_c *only, int depth);
+
+static bx_bool sr_get(bx_sr_reader_t *sr, void *data, Bit32u len)
+{
+  if ((Bit32u)(sr->end - sr->ptr) < len) return 0;
+  memcpy(data, sr->ptr, len);
+  sr->ptr += len;
+  return 1;
+}
+
+static bx_bool sr_get8(bx_sr_reader_t *sr, Bit8u *val)
+{
+  return sr_get(sr, val, 1);
+}
+
+static bx_bool sr_get32(bx_sr_reader_t *sr, Bit32u *val)
+{
+  Bit8u tmp[4];
+  if (!sr_get(sr, tmp, 4)) return 0;
+  ReadHostDWordFromLittleEndian((Bit32u*) tmp, *val);
+  return 1;
+}
+
+static bx_bool sr_get64(bx_sr_reader_t *sr, Bit64u *val)
+{
+  Bit8u tmp[8];
+  if (!sr_get(sr, tmp, 8)) return 0;
+  ReadHostQWordFromLittleEndian((Bit64u*) tmp, *val);
+  return 1;
+}
+
+static bx_bool sr_read_at(int fd, void *data, Bit32u len, Bit64u offset)
+{
+  Bit8u *ptr = (Bit8u*) data;
+
+  if (lseek(fd, (off_t) offset, SEEK_SET) < 0) return 0;
+  while (len > 0) {
+    unsigned chunk = (len > 0x40000000) ? 0x40000000 : len;
+    int ret = ::read(fd, ptr, chunk);
+    if (ret <= 0) return 0;
+    ptr += ret;
+    len -= ret;
+  }
+  return 1;
+}
+
+static bx_bool sr_restore_raw_data(bx_sr_reader_t *sr, bx_shadow_data_c *param, Bit64u offset, Bit32u size)
+{
+  Bit8u *ptr = param->getptr();
+
+  if ((offset + size) > sr->file_size) return 0;
+#if BX_HAVE_SYS_MMAN_H
+  if (param->get_options() & bx_shadow_data_c::MAP_ON_RESTORE) {
+    Bit32u pagemask = getpagesize() - 1;
+    if ((((bx_ptr_equiv_t) ptr | size | offset) & pagemask) == 0) {
+      // copy-on-write mapping, nothing is read until the guest touches it
+      void *map = mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, sr->fd, (off_t) offset);
+      if (map != MAP_FAILED) return 1;
+      BX_ERROR(("restore: cannot map data param '%s', reading it", param->get_name()));
+    }
+  }
+#endif
+  return sr_read_at(sr->fd, ptr, size, offset);
+}
+
+static bx_bool sr_restore_paged_data(bx_sr_reader_t *sr, bx_shadow_data_c *param, Bit64u offset, Bit32u saved_size, Bit32u size)
+{
+  Bit8u *ptr = param->getptr();
+  Bit32u npages = (saved_size + BX_SR_ALIGN - 1) / BX_SR_ALIGN;
+  Bit32u page, entry, type, len, plen;
+  Bit64u pos, buf_start = 0;
+  Bit32u buf_len = 0;
+  bx_bool has_parent = 0, fresh = 0, ret = 1;
+
+  Bit8u *dir = new Bit8u[npages * BX_SR_DIR_ENTRY_SIZE];
+  if (!sr_read_at(sr->fd, dir, npages * BX_SR_DIR_ENTRY_SIZE, offset)) {
+    delete [] dir;
+    return 0;
+  }
+  for (page = 0; page < npages; page++) {
+    ReadHostDWordFromLittleEndian((Bit32u*)(dir + page * BX_SR_DIR_ENTRY_SIZE + 8), entry);
+    if ((entry >> 24) == BX_SR_PAGE_PARENT) has_parent = 1;
+  }
+  if (has_parent) {
+    // start with the contents of the parent, then apply the changed pages
+    if (sr->parent == NULL) {
+      BX_ERROR(("restore: data param '%s' needs a parent checkpoint", param->get_name()));
+      ret = 0;
+    } else if (sr->depth >= BX_SR_MAX_PARENTS) {
+      BX_ERROR(("restore: too many nested parent checkpoints"));
+      ret = 0;
+    } else {
+      ret = sr_restore_file(sr->root, sr->parent, NULL, param, sr->depth + 1);
+    }
+  }
+#if BX_HAVE_SYS_MMAN_H
+  else if (param->get_options() & bx_shadow_data_c::MAP_ON_RESTORE) {
+    // fresh anonymous memory, zero pages need not be touched
+    Bit32u pagemask = getpagesize() - 1;
+    if ((((bx_ptr_equiv_t) ptr | size) & pagemask) == 0) {
+      fresh = (mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                    -1, 0) != MAP_FAILED);
+    }
+  }
+#endif
+
+  Bit8u *buf = new Bit8u[BX_SR_IO_BUFFER_SIZE];
+  for (page = 0; (page < npages) && ret; page++) {
+    ReadHostQWordFromLittleEndian((Bit64u*)(dir + page * BX_SR_DIR_ENTRY_SIZE), pos);
+    ReadHostDWordFromLittleEndian((Bit32u*)(dir + page * BX_SR_DIR_ENTRY_SIZE + 8), entry);
+    type = entry >> 24;
+    len = entry & 0xffffff;
+    plen = saved_size - page * BX_SR_ALIGN;
+    if (plen > BX_SR_ALIGN) plen = BX_SR_ALIGN;
+    // pages not fitting into the param (size mismatch) are dropped
+    if ((page * BX_SR_ALIGN + plen) > size) continue;
+    Bit8u *dst = ptr + page * BX_SR_ALIGN;
+    switch (type) {
+      case BX_SR_PAGE_ZERO:
+        if (!fresh) memset(dst, 0, plen);
+        break;
+      case BX_SR_PAGE_PARENT:
+        break;
+      case BX_SR_PAGE_RAW:
+      case BX_SR_PAGE_LZ4:
+        if ((len > BX_SR_ALIGN) || ((pos + len) > sr->file_size)) {
+          ret = 0;
+          break;
+        }
+        if ((pos < buf_start) || ((pos + len) > (buf_start + buf_len))) {
+          buf_start = pos;
+          buf_len = BX_SR_IO_BUFFER_SIZE;
+          if ((buf_start + buf_len) > sr->file_size)
+            buf_len = (Bit32u)(sr->file_size - buf_start);
+          if (!sr_read_at(sr->fd, buf, buf_len, buf_start)) {
+            ret = 0;
+            break;
+          }
+        }
+        if (type == BX_SR_PAGE_RAW) {
+          if (len != plen) ret = 0;
+          else memcpy(dst, buf + (pos - buf_start), len);
+        } else {
+          ret = (bx_lz4_decompress(buf + (pos - buf_start), len, dst, plen) == (int) plen);
         }
-        for (i=0; i<level; i++)
-          fprintf(fp, "  ");
-        fprintf(fp, "}\n");
         break;
+      default:
+        ret = 0;
+    }
+  }
+  delete [] buf;
+  delete [] dir;
+  return ret;
+}
+
+static bx_bool sr_restore_data(bx_sr_reader_t *sr, bx_shadow_data_c *param, Bit64u offset, Bit32u size, Bit8u encoding)
+{
+  Bit32u saved_size = size;
+
+  if (size != param->get_size()) {
+    BX_ERROR(("restore: size mismatch for data param '%s'", param->get_name()));
+    if (size > param->get_size()) size = param->get_size();
+  }
+  if (encoding == BX_SR_DATA_PAGED) {
+    return sr_restore_paged_data(sr, param, offset, saved_size, size);
+  }
+  return sr_restore_raw_data(sr, param, offset, size);
+}
+
+// restore one record, param == NULL skips the record
+static bx_bool sr_restore_param(bx_sr_reader_t *sr, bx_list_c *base, const char *restore_name)
+{
+  char name[256], pname[BX_PATHNAME_LEN];
+  bx_param_c *param = NULL;
+  Bit8u type, len, val8, encoding = BX_SR_DATA_RAW;
+  Bit32u val32, n;
+  Bit64u val64;
+
+  if (!sr_get8(sr, &type) || !sr_get8(sr, &len) || !sr_get(sr, name, len))
+    return 0;
+  name[len] = 0;
+  if ((base != NULL) && ((restore_name == NULL) || !strcmp(name, restore_name))) {
+    param = SIM->get_param(name, base);
+    if (param == NULL) {
+      if (sr->only == NULL) BX_ERROR(("restore: param '%s' not found, ignored", name));
+    } else if (param->get_type() != type) {
+      if (sr->only == NULL) BX_ERROR(("restore: param '%s' has wrong type, ignored", name));
+      param = NULL;
+    } else if ((sr->only != NULL) && (type != BXT_LIST) && (param != sr->only)) {
+      param = NULL;
+    } else if (type != BXT_LIST) {
+      param->get_param_path(pname, BX_PATHNAME_LEN);
+      BX_DEBUG(("restoring parameter '%s'", pname));
+    }
+  }
+  switch (type) {
+    case BXT_PARAM_NUM:
+    case BXT_PARAM_ENUM:
+      if (!sr_get64(sr, &val64)) return 0;
+      if (param) ((bx_param_num_c*)param)->set((Bit64s) val64);
+      break;
+    case BXT_PARAM_BOOL:
+      if (!sr_get8(sr, &val8)) return 0;
+      if (param) ((bx_param_bool_c*)param)->set(val8);
+      break;
+    case BXT_PARAM_STRING:
+      {
+        if (!sr_get32(sr, &val32) || ((Bit32u)(sr->end - sr->ptr) < val32)) return 0;
+        if (param) {
+          bx_param_string_c *sparam = (bx_param_string_c*)param;
+          Bit32u maxsize = sparam->get_maxsize();
+          char *buf = new char[maxsize + 1];
+          memset(buf, 0, maxsize + 1);
+          memcpy(buf, sr->ptr, (val32 < maxsize) ? val32 : maxsize);
+          sparam->set(buf);
+          delete [] buf;
+        }
+        sr->ptr += val32;
+        break;
+      }
+    case BXT_PARAM_DATA:
+      if (!sr_get64(sr, &val64) || !sr_get32(sr, &val32)) return 0;
+      if ((sr->version >= 2) && !sr_get8(sr, &encoding)) return 0;
+      if (param && !sr_restore_data(sr, (bx_shadow_data_c*)param, val64, val32, encoding)) {
+        BX_ERROR(("restore: cannot read data param '%s'", name));
+        return 0;
+      }
+      break;
+    case BXT_LIST:
+      if (!sr_get32(sr, &n)) return 0;
+      for (val32 = 0; val32 < n; val32++) {
+        if (!sr_restore_param(sr, (bx_list_c*)param, NULL))
+          return 0;
       }
+      break;
     default:
-      BX_ERROR(("save_sr_param(): unknown parameter type"));
+      BX_ERROR(("restore: unknown parameter type %d", type));
       return 0;
   }
+  return 1;
+}
 
+// restore the params of the checkpoint in 'sr_path', all of them or the
+// subtree 'restore_name' or the single data param 'only'
+static bx_bool sr_restore_file(bx_list_c *root, const char *sr_path, const char *restore_name, bx_param_c *only, int depth)
+{
+  char sr_file[BX_PATHNAME_LEN], parent[BX_PATHNAME_LEN];
+  Bit8u header[BX_SR_HEADER_SIZE + 4];
+  bx_sr_reader_t sr;
+  Bit32u header_size, parent_len, n, i;
+  Bit64u tree_size, data_start;
+  Bit8u type, len;
+  bx_bool ret = 0;
+
+  sprintf(sr_file, "%s/%s", sr_path, BX_SR_STATE_FILE);
+  if (only == NULL) {
+    BX_INFO(("restoring '%s'%s%s", sr_file, restore_name ? " param " : "",
+             restore_name ? restore_name : ""));
+  } else {
+    BX_INFO(("restoring data param '%s' from parent '%s'", only->get_name(), sr_file));
+  }
+  memset(&sr, 0, sizeof(sr));
+  sr.root = root;
+  sr.only = only;
+  sr.depth = depth;
+  sr.fd = ::open(sr_file, O_RDONLY
+#ifdef O_BINARY
+                 | O_BINARY
+#endif
+                 );
+  if (sr.fd < 0) {
+    BX_ERROR(("restore: cannot open '%s'", sr_file));
+    return 0;
+  }
+  struct stat stat_buf;
+  if ((fstat(sr.fd, &stat_buf) != 0) || !sr_read_at(sr.fd, header, BX_SR_HEADER_SIZE, 0)) {
+    BX_ERROR(("restore: cannot read '%s'", sr_file));
+    ::close(sr.fd);
+    return 0;
+  }
+  sr.file_size = stat_buf.st_size;
+  sr.ptr = header + 8;
+  sr.end = header + BX_SR_HEADER_SIZE;
+  sr_get32(&sr, &sr.version);
+  sr_get32(&sr, &header_size);
+  sr_get64(&sr, &tree_size);
+  sr_get64(&sr, &data_start);
+  if (memcmp(header, BX_SR_MAGIC, 8) || (header_size < BX_SR_HEADER_SIZE) ||
+      ((header_size + tree_size) > sr.file_size)) {
+    BX_ERROR(("restore: '%s' is not a Bochs checkpoint", sr_file));
+    ::close(sr.fd);
+    return 0;
+  }
+  if (sr.version > BX_SR_VERSION) {
+    BX_ERROR(("restore: checkpoint version %d is not supported", sr.version));
+    ::close(sr.fd);
+    return 0;
+  }
+  if (sr.version >= 2) {
+    if (!sr_read_at(sr.fd, header, 4, BX_SR_HEADER_SIZE)) {
+      ::close(sr.fd);
+      return 0;
+    }
+    ReadHostDWordFromLittleEndian((Bit32u*) header, parent_len);
+    if ((parent_len >= BX_PATHNAME_LEN) ||
+        ((parent_len > 0) && !sr_read_at(sr.fd, parent, parent_len, BX_SR_HEADER_SIZE + 4))) {
+      BX_ERROR(("restore: '%s' is corrupted", sr_file));
+      ::close(sr.fd);
+      return 0;
+    }
+    parent[parent_len] = 0;
+    if (parent_len > 0) sr.parent = parent;
+  }
+  Bit8u *tree = new Bit8u[(Bit32u) tree_size];
+  if (sr_read_at(sr.fd, tree, (Bit32u) tree_size, header_size)) {
+    // the root record is the "bochs" list itself, descend into it
+    sr.ptr = tree;
+    sr.end = tree + tree_size;
+    if (sr_get8(&sr, &type) && (type == BXT_LIST) && sr_get8(&sr, &len) &&
+        ((Bit32u)(sr.end - sr.ptr) >= len)) {
+      sr.ptr += len;
+      ret = sr_get32(&sr, &n);
+      for (i = 0; (i < n) && ret; i++) {
+        ret = sr_restore_param(&sr, root, restore_name);
+      }
+    }
+    if (!ret) BX_ERROR(("restore: '%s' is corrupted", sr_file));
+  }
+  delete [] tree;
+  // mappings of data params stay valid after the file is closed
+  ::close(sr.fd);
+  return ret;
+}
+
+bx_bool bx_real_sim_c::restore_sr_binary(bx_list_c *root, const char *sr_path, const char *restore_name)
+{
+  if (!sr_restore_file(root, sr_path, restore_name, NULL, 0))
+    return 0;
+  if (restore_name == NULL) {
+    // the restored state is the parent of the next incremental checkpoint
+    sr_get_abs_path(sr_path, sr_parent_path);
+    if (BX_MEM(0)->dirty_tracking_enabled()) {
+      Bit8u *dirty = new Bit8u[BX_MEM(0)->get_dirty_bitmap_size()];
+      BX_MEM(0)->snapshot_dirty_pages(dirty);
+      delete [] dirty;
+    }
+  }
   return 1;
 }
 
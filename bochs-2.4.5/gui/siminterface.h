@@ -802,6 +802,12 @@ class BOCHSAPI bx_shadow_data_c : public bx_param_c {
   Bit32u data_size;
   Bit8u *data_ptr;
 public:
+  enum {
+    MAP_ON_RESTORE = 1,    // data lives in a private mmap'ed area, restore
+                           // may map the checkpoint file over it
+    DIRTY_PAGES = 2        // guest RAM, modified pages are tracked by the
+                           // memory object for incremental checkpoints
+  } bx_shadow_data_opt_bits;
   bx_shadow_data_c(bx_param_c *parent,
       const char *name,
       Bit8u *ptr_to_data,
@@ -950,9 +956,12 @@ enum {
 #define BX_ATA_MODE_UNDOABLE     7
 #define BX_ATA_MODE_GROWING      8
 #define BX_ATA_MODE_VOLATILE     9
-#define BX_ATA_MODE_Z_UNDOABLE  10
-#define BX_ATA_MODE_Z_VOLATILE  11
-#define BX_ATA_MODE_LAST        11
+#define BX_ATA_MODE_MMAP        10
+#define BX_ATA_MODE_MMAP_VOLATILE 11
+#define BX_ATA_MODE_COW         12
+#define BX_ATA_MODE_Z_UNDOABLE  13
+#define BX_ATA_MODE_Z_VOLATILE  14
+#define BX_ATA_MODE_LAST        14
 
 #define BX_CLOCK_SYNC_NONE       0
 #define BX_CLOCK_SYNC_REALTIME   1
@@ -47,6 +47,11 @@ bx_devices_c::bx_devices_c()
 
   read_port_to_handler = NULL;
   write_port_to_handler = NULL;
+  read_port_dispatch = NULL;
+  write_port_dispatch = NULL;
+#if BX_DEBUGGER
+  io_stats = NULL;
+#endif
   io_read_handlers.next = NULL;
   io_read_handlers.handler_name = NULL;
   io_write_handlers.next = NULL;
@@ -107,6 +112,10 @@ void bx_devices_c::init(BX_MEM_C *newmem)
   BX_DEBUG(("Init $Id: devices.cc,v 1.150 2009/12/04 19:50:26 sshwarts Exp $"));
   mem = newmem;
 
+  /* all dispatch entries are free, entry 0 belongs to the default handler */
+  memset(io_read_dispatch, 0, sizeof(io_read_dispatch));
+  memset(io_write_dispatch, 0, sizeof(io_write_dispatch));
+
   /* set builtin default handlers, will be overwritten by the real default handler */
   register_default_io_read_handler(NULL, &default_read_handler, def_name, 7);
   io_read_handlers.next = &io_read_handlers;
@@ -124,11 +133,19 @@ void bx_devices_c::init(BX_MEM_C *newmem)
     delete [] write_port_to_handler;
   read_port_to_handler = new struct io_handler_struct *[PORTS];
   write_port_to_handler = new struct io_handler_struct *[PORTS];
+  if (read_port_dispatch)
+    delete [] read_port_dispatch;
+  if (write_port_dispatch)
+    delete [] write_port_dispatch;
+  read_port_dispatch = new Bit16u[PORTS];
+  write_port_dispatch = new Bit16u[PORTS];
 
   /* set handlers to the default one */
   for (i=0; i < PORTS; i++) {
     read_port_to_handler[i] = &io_read_handlers;
     write_port_to_handler[i] = &io_write_handlers;
+    read_port_dispatch[i] = io_read_handlers.dispatch;
+    write_port_dispatch[i] = io_write_handlers.dispatch;
   }
 
   for (i=0; i < BX_MAX_IRQS; i++) {
@@ -271,6 +288,11 @@ void bx_devices_c::init(BX_MEM_C *newmem)
   if (SIM->get_param_bool(BXPN_PNIC_ENABLED)->get()) {
     PLUG_load_plugin(pcipnic, PLUGTYPE_OPTIONAL);
   }
+#endif
+#if BX_SUPPORT_PCIVBLK
+  if (SIM->get_param_bool(BXPN_PCIVBLK_ENABLED)->get()) {
+    PLUG_load_plugin(pcivblk, PLUGTYPE_OPTIONAL);
+  }
 #endif
   }
 #endif
@@ -415,6 +437,18 @@ void bx_devices_c::after_restore_state()
   bx_plugins_after_restore_state();
 }
 
+void bx_devices_c::before_clone()
+{
+  bx_plugins_before_clone();
+}
+
+void bx_devices_c::after_clone()
+{
+  bx_virt_timer.after_clone();
+  bx_slowdown_timer.after_clone();
+  bx_plugins_after_clone();
+}
+
 void bx_devices_c::exit()
 {
   // delete i/o handlers before unloading plugins
@@ -437,6 +471,14 @@ void bx_devices_c::exit()
     delete [] curr->handler_name;
     delete curr;
   }
+  memset(io_read_dispatch, 0, sizeof(io_read_dispatch));
+  memset(io_write_dispatch, 0, sizeof(io_write_dispatch));
+#if BX_DEBUGGER
+  if (io_stats) {
+    delete [] io_stats;
+    io_stats = NULL;
+  }
+#endif
 
   bx_virt_timer.setup();
   bx_slowdown_timer.exit();
@@ -611,6 +653,8 @@ bx_bool bx_devices_c::register_io_read_handler(void *this_ptr, bx_read_handler_t
     strcpy(io_read_handler->handler_name, name);
     io_read_handler->mask = mask;
     io_read_handler->usage_count = 0;
+    io_read_handler->dispatch = alloc_io_dispatch(io_read_dispatch, io_read_handler,
+                                                   (void *)&bad_len_read_handler);
     // add the handler to the double linked list of handlers
     io_read_handlers.prev->next = io_read_handler;
     io_read_handler->next = &io_read_handlers;
@@ -620,6 +664,7 @@ bx_bool bx_devices_c::register_io_read_handler(void *this_ptr, bx_read_handler_t
 
   io_read_handler->usage_count++;
   read_port_to_handler[addr] = io_read_handler;
+  read_port_dispatch[addr] = io_read_handler->dispatch;
   return 1; // address mapped successfully
 }
 
@@ -663,6 +708,8 @@ bx_bool bx_devices_c::register_io_write_handler(void *this_ptr, bx_write_handler
     strcpy(io_write_handler->handler_name, name);
     io_write_handler->mask = mask;
     io_write_handler->usage_count = 0;
+    io_write_handler->dispatch = alloc_io_dispatch(io_write_dispatch, io_write_handler,
+                                                   (void *)&bad_len_write_handler);
     // add the handler to the double linked list of handlers
     io_write_handlers.prev->next = io_write_handler;
     io_write_handler->next = &io_write_handlers;
@@ -672,6 +719,7 @@ bx_bool bx_devices_c::register_io_write_handler(void *this_ptr, bx_write_handler
 
   io_write_handler->usage_count++;
   write_port_to_handler[addr] = io_write_handler;
+  write_port_dispatch[addr] = io_write_handler->dispatch;
   return 1; // address mapped successfully
 }
 
@@ -726,6 +774,8 @@ bx_bool bx_devices_c::register_io_read_handler_range(void *this_ptr, bx_read_han
     strcpy(io_read_handler->handler_name, name);
     io_read_handler->mask = mask;
     io_read_handler->usage_count = 0;
+    io_read_handler->dispatch = alloc_io_dispatch(io_read_dispatch, io_read_handler,
+                                                   (void *)&bad_len_read_handler);
     // add the handler to the double linked list of handlers
     io_read_handlers.prev->next = io_read_handler;
     io_read_handler->next = &io_read_handlers;
@@ -734,8 +784,10 @@ bx_bool bx_devices_c::register_io_read_handler_range(void *this_ptr, bx_read_han
   }
 
   io_read_handler->usage_count += end_addr - begin_addr + 1;
-  for (addr = begin_addr; addr <= end_addr; addr++)
-	  read_port_to_handler[addr] = io_read_handler;
+  for (addr = begin_addr; addr <= end_addr; addr++) {
+    read_port_to_handler[addr] = io_read_handler;
+    read_port_dispatch[addr] = io_read_handler->dispatch;
+  }
   return 1; // address mapped successfully
 }
 
@@ -790,6 +842,8 @@ bx_bool bx_devices_c::register_io_write_handler_range(void *this_ptr, bx_write_h
     strcpy(io_write_handler->handler_name, name);
     io_write_handler->mask = mask;
     io_write_handler->usage_count = 0;
+    io_write_handler->dispatch = alloc_io_dispatch(io_write_dispatch, io_write_handler,
+                                                   (void *)&bad_len_write_handler);
     // add the handler to the double linked list of handlers
     io_write_handlers.prev->next = io_write_handler;
     io_write_handler->next = &io_write_handlers;
@@ -798,8 +852,10 @@ bx_bool bx_devices_c::register_io_write_handler_range(void *this_ptr, bx_write_h
   }
 
   io_write_handler->usage_count += end_addr - begin_addr + 1;
-  for (addr = begin_addr; addr <= end_addr; addr++)
-	  write_port_to_handler[addr] = io_write_handler;
+  for (addr = begin_addr; addr <= end_addr; addr++) {
+    write_port_to_handler[addr] = io_write_handler;
+    write_port_dispatch[addr] = io_write_handler->dispatch;
+  }
   return 1; // address mapped successfully
 }
 
@@ -816,6 +872,8 @@ bx_bool bx_devices_c::register_default_io_read_handler(void *this_ptr, bx_read_h
   io_read_handlers.handler_name = new char[strlen(name)+1];
   strcpy(io_read_handlers.handler_name, name);
   io_read_handlers.mask = mask;
+  io_read_handlers.dispatch = 0;
+  set_io_dispatch(&io_read_dispatch[0], &io_read_handlers, (void *)&bad_len_read_handler);
 
   return 1;
 }
@@ -831,6 +889,8 @@ bx_bool bx_devices_c::register_default_io_write_handler(void *this_ptr, bx_write
   io_write_handlers.handler_name = new char[strlen(name)+1];
   strcpy(io_write_handlers.handler_name, name);
   io_write_handlers.mask = mask;
+  io_write_handlers.dispatch = 0;
+  set_io_dispatch(&io_write_dispatch[0], &io_write_handlers, (void *)&bad_len_write_handler);
 
   return 1;
 }
@@ -870,9 +930,11 @@ bx_bool bx_devices_c::unregister_io_read_handler(void *this_ptr, bx_read_handler
   }
 
   read_port_to_handler[addr] = &io_read_handlers; // reset to default
+  read_port_dispatch[addr] = io_read_handlers.dispatch;
   io_read_handler->usage_count--;
 
   if (!io_read_handler->usage_count) { // kill this handler entry
+    io_read_dispatch[io_read_handler->dispatch].handler = NULL;
     io_read_handler->prev->next = io_read_handler->next;
     io_read_handler->next->prev = io_read_handler->prev;
     delete [] io_read_handler->handler_name;
@@ -904,9 +966,11 @@ bx_bool bx_devices_c::unregister_io_write_handler(void *this_ptr, bx_write_handl
     return 0;
 
   write_port_to_handler[addr] = &io_write_handlers; // reset to default
+  write_port_dispatch[addr] = io_write_handlers.dispatch;
   io_write_handler->usage_count--;
 
   if (!io_write_handler->usage_count) { // kill this handler entry
+    io_write_dispatch[io_write_handler->dispatch].handler = NULL;
     io_write_handler->prev->next = io_write_handler->next;
     io_write_handler->next->prev = io_write_handler->prev;
     delete [] io_write_handler->handler_name;
@@ -952,58 +1016,120 @@ bx_bool bx_devices_c::unregister_io_write_handler_range(void *this_ptr, bx_write
 }
 
 
-/*
- * Read a byte of data from the IO memory address space
- */
-
-  Bit32u BX_CPP_AttrRegparmN(2)
-bx_devices_c::inp(Bit16u addr, unsigned io_len)
+Bit16u bx_devices_c::alloc_io_dispatch(struct io_dispatch_struct *table,
+                                       struct io_handler_struct *handler, void *bad_len)
 {
-  struct io_handler_struct *io_read_handler;
-  Bit32u ret;
-
-  BX_INSTR_INP(addr, io_len);
-
-  io_read_handler = read_port_to_handler[addr];
-  if (io_read_handler->mask & io_len) {
-	ret = ((bx_read_handler_t)io_read_handler->funct)(io_read_handler->this_ptr, (Bit32u)addr, io_len);
-  } else {
-    switch (io_len) {
-      case 1: ret = 0xff; break;
-      case 2: ret = 0xffff; break;
-      default: ret = 0xffffffff; break;
-    }
-    if (addr != 0x0cf8) { // don't flood the logfile when probing PCI
-      BX_ERROR(("read from port 0x%04x with len %d returns 0x%x", addr, io_len, ret));
+  for (Bit16u i = 1; i < BX_MAX_IO_DISPATCH; i++) {
+    if (table[i].handler == NULL) {
+      set_io_dispatch(&table[i], handler, bad_len);
+      return i;
     }
   }
+  BX_PANIC(("no free I/O dispatch entry for %s", handler->handler_name));
+  return 0;
+}
+
+void bx_devices_c::set_io_dispatch(struct io_dispatch_struct *entry,
+                                   struct io_handler_struct *handler, void *bad_len)
+{
+  for (unsigned i = 0; i < 3; i++) {
+    entry->funct[i] = (handler->mask & (1 << i)) ? handler->funct : bad_len;
+  }
+  entry->this_ptr = handler->this_ptr;
+  entry->handler = handler;
+}
 
-  BX_INSTR_INP2(addr, io_len, ret);
-  BX_DBG_IO_REPORT(addr, io_len, BX_READ, ret);
+// Called for accesses with an I/O length the handler of the port does not
+// support (see set_io_dispatch)
+Bit32u bx_devices_c::bad_len_read_handler(void *this_ptr, Bit32u address, unsigned io_len)
+{
+  Bit32u ret;
 
-  return(ret);
+  UNUSED(this_ptr);
+  switch (io_len) {
+    case 1: ret = 0xff; break;
+    case 2: ret = 0xffff; break;
+    default: ret = 0xffffffff; break;
+  }
+  if (address != 0x0cf8) { // don't flood the logfile when probing PCI
+    BX_ERROR(("read from port 0x%04x with len %d returns 0x%x", address, io_len, ret));
+  }
+  return ret;
 }
 
+void bx_devices_c::bad_len_write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len)
+{
+  UNUSED(this_ptr);
+  if (address != 0x0cf8) { // don't flood the logfile when probing PCI
+    BX_ERROR(("write to port 0x%04x with len %d ignored", address, io_len));
+  }
+}
 
-/*
- * Write a byte of data to the IO memory address space.
- */
+#if BX_DEBUGGER
+struct io_stats_entry {
+  Bit32u index;   // port, plus PORTS for writes
+  Bit64u count;
+  Bit64u usec;
+};
 
-  void BX_CPP_AttrRegparmN(3)
-bx_devices_c::outp(Bit16u addr, Bit32u value, unsigned io_len)
+static int io_stats_compare(const void *a, const void *b)
 {
-  struct io_handler_struct *io_write_handler;
+  const struct io_stats_entry *ea = (const struct io_stats_entry *) a;
+  const struct io_stats_entry *eb = (const struct io_stats_entry *) b;
+
+  if (ea->usec != eb->usec)
+    return (ea->usec < eb->usec) ? 1 : -1;
+  if (ea->count != eb->count)
+    return (ea->count < eb->count) ? 1 : -1;
+  return (ea->index < eb->index) ? -1 : 1;
+}
 
-  BX_INSTR_OUTP(addr, io_len, value);
-  BX_DBG_IO_REPORT(addr, io_len, BX_WRITE, value);
+// Starts collecting the per-port statistics if they are off, otherwise
+// prints them sorted by the time spent in the handlers and stops.
+void bx_devices_c::toggle_io_stats(void)
+{
+  if (io_stats == NULL) {
+    io_stats = new struct io_stats_struct[2 * PORTS];
+    memset(io_stats, 0, 2 * PORTS * sizeof(struct io_stats_struct));
+    dbg_printf("I/O port statistics enabled, 'show io-stats' again prints them\n");
+    return;
+  }
 
-  io_write_handler = write_port_to_handler[addr];
-  if (io_write_handler->mask & io_len) {
-	((bx_write_handler_t)io_write_handler->funct)(io_write_handler->this_ptr, (Bit32u)addr, value, io_len);
-  } else if (addr != 0x0cf8) { // don't flood the logfile when probing PCI
-    BX_ERROR(("write to port 0x%04x with len %d ignored", addr, io_len));
+  struct io_stats_entry *list = new struct io_stats_entry[2 * PORTS];
+  Bit32u n = 0, i;
+  Bit64u count = 0, usec = 0;
+  for (i = 0; i < 2 * PORTS; i++) {
+    if (io_stats[i].count > 0) {
+      list[n].index = i;
+      list[n].count = io_stats[i].count;
+      list[n].usec = io_stats[i].usec;
+      count += list[n].count;
+      usec += list[n].usec;
+      n++;
+    }
   }
+  delete [] io_stats;
+  io_stats = NULL;
+  qsort(list, n, sizeof(struct io_stats_entry), io_stats_compare);
+
+  dbg_printf("I/O port statistics: " FMT_LL "u accesses, " FMT_LL "u usec\n", count, usec);
+  dbg_printf("port  dir     accesses          usec  nsec/access  handler\n");
+  for (i = 0; i < n; i++) {
+    Bit32u port = list[i].index & (PORTS - 1);
+    bx_bool write = (list[i].index >= PORTS);
+    char count_str[24], usec_str[24], nsec_str[24];
+    // FMT_LL has no field width, the columns are padded as strings
+    sprintf(count_str, FMT_LL "u", list[i].count);
+    sprintf(usec_str, FMT_LL "u", list[i].usec);
+    sprintf(nsec_str, FMT_LL "u", list[i].usec * 1000 / list[i].count);
+    dbg_printf("%04x  %s  %11s  %12s  %11s  %s\n", port, write ? "out" : "in ",
+      count_str, usec_str, nsec_str,
+      write ? write_port_to_handler[port]->handler_name :
+              read_port_to_handler[port]->handler_name);
+  }
+  delete [] list;
 }
+#endif
 
 bx_bool bx_devices_c::is_harddrv_enabled(void)
 {
@@ -53,6 +53,7 @@ void libdma_LTX_plugin_fini(void)
 bx_dma_c::bx_dma_c()
 {
   put("DMA");
+  memset(h, 0, sizeof(h));
 }
 
 bx_dma_c::~bx_dma_c()
@@ -76,6 +77,8 @@ unsigned bx_dma_c::registerDMA8Channel(unsigned channel,
   BX_INFO(("channel %u used by %s", channel, name));
   BX_DMA_THIS h[channel].dmaRead8  = dmaRead;
   BX_DMA_THIS h[channel].dmaWrite8 = dmaWrite;
+  BX_DMA_THIS h[channel].dmaReadBlock8  = NULL;
+  BX_DMA_THIS h[channel].dmaWriteBlock8 = NULL;
   BX_DMA_THIS s[0].chan[channel].used = 1;
   return 1; // OK
 }
@@ -97,10 +100,41 @@ unsigned bx_dma_c::registerDMA16Channel(unsigned channel,
   channel &= 0x03;
   BX_DMA_THIS h[channel].dmaRead16  = dmaRead;
   BX_DMA_THIS h[channel].dmaWrite16 = dmaWrite;
+  BX_DMA_THIS h[channel].dmaReadBlock16  = NULL;
+  BX_DMA_THIS h[channel].dmaWriteBlock16 = NULL;
   BX_DMA_THIS s[1].chan[channel].used = 1;
   return 1; // OK
 }
 
+// A block transfer channel moves as many bytes as possible per DMA request:
+// up to the terminal count, the wrap of the address counter or
+// BX_DMA_BUFFER_SIZE bytes. The handlers return the number of bytes (words)
+// they have actually moved, which may be less than 'maxlen'. get_TC() returns
+// 1 during a handler call if moving all of 'maxlen' reaches terminal count.
+unsigned bx_dma_c::registerDMA8BlockChannel(unsigned channel,
+    Bit16u (* dmaRead)(Bit8u *buffer, Bit16u maxlen),
+    Bit16u (* dmaWrite)(Bit8u *buffer, Bit16u maxlen),
+    const char *name)
+{
+  if (! BX_DMA_THIS registerDMA8Channel(channel, NULL, NULL, name))
+    return 0; // Fail
+  BX_DMA_THIS h[channel].dmaReadBlock8  = dmaRead;
+  BX_DMA_THIS h[channel].dmaWriteBlock8 = dmaWrite;
+  return 1; // OK
+}
+
+unsigned bx_dma_c::registerDMA16BlockChannel(unsigned channel,
+    Bit16u (* dmaRead)(Bit16u *buffer, Bit16u maxlen),
+    Bit16u (* dmaWrite)(Bit16u *buffer, Bit16u maxlen),
+    const char *name)
+{
+  if (! BX_DMA_THIS registerDMA16Channel(channel, NULL, NULL, name))
+    return 0; // Fail
+  BX_DMA_THIS h[channel & 0x03].dmaReadBlock16  = dmaRead;
+  BX_DMA_THIS h[channel & 0x03].dmaWriteBlock16 = dmaWrite;
+  return 1; // OK
+}
+
 unsigned bx_dma_c::unregisterDMAChannel(unsigned channel)
 {
   bx_bool ma_sl = (channel > 3);
@@ -673,7 +707,7 @@ void bx_dma_c::raise_HLDA(void)
 {
   unsigned channel;
   bx_phy_address phy_addr;
-  bx_bool count_expired = 0;
+  bx_bool expired = 0;
   bx_bool ma_sl = 0;
 
   BX_DMA_THIS HLDA = 1;
@@ -705,6 +739,15 @@ void bx_dma_c::raise_HLDA(void)
              (BX_DMA_THIS s[ma_sl].chan[channel].current_address << ma_sl);
 
   BX_DMA_THIS s[ma_sl].DACK[channel] = 1;
+
+  if ((!ma_sl && (BX_DMA_THIS h[channel].dmaReadBlock8 ||
+                  BX_DMA_THIS h[channel].dmaWriteBlock8)) ||
+      (ma_sl && (BX_DMA_THIS h[channel].dmaReadBlock16 ||
+                 BX_DMA_THIS h[channel].dmaWriteBlock16))) {
+    BX_DMA_THIS transfer_block(ma_sl, channel, phy_addr);
+    return;
+  }
+
   // check for expiration of count, so we can signal TC and DACK(n)
   // at the same time.
   if (BX_DMA_THIS s[ma_sl].chan[channel].mode.address_decrement==0)
@@ -715,21 +758,9 @@ void bx_dma_c::raise_HLDA(void)
   if (BX_DMA_THIS s[ma_sl].chan[channel].current_count == 0xffff) {
     // count expired, done with transfer
     // assert TC, deassert HRQ & DACK(n) lines
-    BX_DMA_THIS s[ma_sl].status_reg |= (1 << channel); // hold TC in status reg
     BX_DMA_THIS TC = 1;
-    count_expired = 1;
-    if (BX_DMA_THIS s[ma_sl].chan[channel].mode.autoinit_enable == 0) {
-      // set mask bit if not in autoinit mode
-      BX_DMA_THIS s[ma_sl].mask[channel] = 1;
-    }
-    else {
-      // count expired, but in autoinit mode
-      // reload count and base address
-      BX_DMA_THIS s[ma_sl].chan[channel].current_address =
-        BX_DMA_THIS s[ma_sl].chan[channel].base_address;
-      BX_DMA_THIS s[ma_sl].chan[channel].current_count =
-        BX_DMA_THIS s[ma_sl].chan[channel].base_count;
-    }
+    expired = 1;
+    BX_DMA_THIS count_expired(ma_sl, channel);
   }
 
   Bit8u data_byte;
@@ -799,14 +830,165 @@ void bx_dma_c::raise_HLDA(void)
     BX_PANIC(("hlda: transfer_type 3 is undefined"));
   }
 
-  if (count_expired) {
-    BX_DMA_THIS TC = 0;            // clear TC, adapter card already notified
-    BX_DMA_THIS HLDA = 0;
-    bx_pc_system.set_HRQ(0);           // clear HRQ to CPU
-    BX_DMA_THIS s[ma_sl].DACK[channel] = 0; // clear DACK to adapter card
+  if (expired) {
+    BX_DMA_THIS end_of_transfer(ma_sl, channel);
+  }
+}
+
+// Copies a block of at most two pages between guest memory and 'buffer'.
+// Plain RAM is copied with memcpy, other areas (VGA memory, ROMs, memory
+// mapped devices) go through the memory handlers byte by byte.
+static void dma_copy(bx_phy_address addr, unsigned len, Bit8u *buffer, unsigned rw)
+{
+  bx_iovec_t iov[2];
+  int i, iovcnt;
+
+  iovcnt = BX_MEM(0)->getHostMemIovec(addr, len, rw, iov, 0, 2);
+  if (iovcnt < 0) {
+    for (unsigned n = 0; n < len; n++) {
+      if (rw == BX_WRITE)
+        DEV_MEM_WRITE_PHYSICAL(addr + n, 1, buffer + n);
+      else
+        DEV_MEM_READ_PHYSICAL(addr + n, 1, buffer + n);
+    }
+    return;
+  }
+  for (i = 0; i < iovcnt; i++) {
+    if (rw == BX_WRITE)
+      memcpy(iov[i].iov_base, buffer, iov[i].iov_len);
+    else
+      memcpy(buffer, iov[i].iov_base, iov[i].iov_len);
+    buffer += iov[i].iov_len;
+  }
+}
+
+// Moves a block in response to a DMA request of a block transfer channel
+void bx_dma_c::transfer_block(bx_bool ma_sl, unsigned channel, bx_phy_address phy_addr)
+{
+  Bit16u buffer[BX_DMA_BUFFER_SIZE / 2];
+  Bit8u *bytes = (Bit8u *) buffer;
+  Bit16u maxlen, len = 0;
+  unsigned i;
+
+  // an incrementing transfer moves the rest of the count, but doesn't wrap
+  // the address counter within the 64k (128k) page
+  if (BX_DMA_THIS s[ma_sl].chan[channel].mode.address_decrement==0) {
+    Bit32u units = (Bit32u) BX_DMA_THIS s[ma_sl].chan[channel].current_count + 1;
+    if (units > (0x10000 - (Bit32u) BX_DMA_THIS s[ma_sl].chan[channel].current_address))
+      units = 0x10000 - BX_DMA_THIS s[ma_sl].chan[channel].current_address;
+    if (units > (BX_DMA_BUFFER_SIZE >> ma_sl))
+      units = BX_DMA_BUFFER_SIZE >> ma_sl;
+    maxlen = (Bit16u) units;
+  } else {
+    maxlen = 1;
+  }
+  // TC goes along with the last byte (word) of the count
+  BX_DMA_THIS TC = ((Bit32u) maxlen == (Bit32u) BX_DMA_THIS s[ma_sl].chan[channel].current_count + 1);
+
+  if (BX_DMA_THIS s[ma_sl].chan[channel].mode.transfer_type == 1 || // write
+      BX_DMA_THIS s[ma_sl].chan[channel].mode.transfer_type == 0) { // verify
+    // DMA controlled xfer of bytes from I/O to Memory
     if (!ma_sl) {
-      BX_DMA_THIS set_DRQ(4, 0); // clear DRQ to cascade
-      BX_DMA_THIS s[1].DACK[0] = 0; // clear DACK to cascade
+      if (BX_DMA_THIS h[channel].dmaWriteBlock8)
+        len = BX_DMA_THIS h[channel].dmaWriteBlock8(bytes, maxlen);
+      else
+        BX_PANIC(("no dmaWrite handler for channel %u.", channel));
+    }
+    else {
+      if (BX_DMA_THIS h[channel].dmaWriteBlock16)
+        len = BX_DMA_THIS h[channel].dmaWriteBlock16(buffer, maxlen);
+      else
+        BX_PANIC(("no dmaWrite handler for channel %u.", channel));
+#ifdef BX_BIG_ENDIAN
+      for (i = 0; i < len; i++)
+        WriteHostWordToLittleEndian(&bytes[i << 1], buffer[i]);
+#endif
+    }
+    if (len > maxlen) {
+      BX_PANIC(("dmaWrite handler for channel %u moved too much data", channel));
+      len = maxlen;
+    }
+    if (BX_DMA_THIS s[ma_sl].chan[channel].mode.transfer_type == 1) {
+      dma_copy(phy_addr, len << ma_sl, bytes, BX_WRITE);
+      for (i = 0; i < len; i++)
+        BX_DBG_DMA_REPORT(phy_addr + (i << ma_sl), 1 << ma_sl, BX_WRITE,
+          ma_sl ? buffer[i] : bytes[i]);
+    }
+  }
+  else if (BX_DMA_THIS s[ma_sl].chan[channel].mode.transfer_type == 2) { // read
+    // DMA controlled xfer of bytes from Memory to I/O
+    dma_copy(phy_addr, maxlen << ma_sl, bytes, BX_READ);
+    if (!ma_sl) {
+      if (BX_DMA_THIS h[channel].dmaReadBlock8)
+        len = BX_DMA_THIS h[channel].dmaReadBlock8(bytes, maxlen);
+      else
+        len = maxlen;
+    }
+    else {
+#ifdef BX_BIG_ENDIAN
+      for (i = 0; i < maxlen; i++)
+        ReadHostWordFromLittleEndian(&bytes[i << 1], buffer[i]);
+#endif
+      if (BX_DMA_THIS h[channel].dmaReadBlock16)
+        len = BX_DMA_THIS h[channel].dmaReadBlock16(buffer, maxlen);
+      else
+        len = maxlen;
+    }
+    if (len > maxlen) {
+      BX_PANIC(("dmaRead handler for channel %u moved too much data", channel));
+      len = maxlen;
     }
+    for (i = 0; i < len; i++)
+      BX_DBG_DMA_REPORT(phy_addr + (i << ma_sl), 1 << ma_sl, BX_READ,
+        ma_sl ? buffer[i] : bytes[i]);
+  }
+  else {
+    BX_PANIC(("hlda: transfer_type 3 is undefined"));
+  }
+
+  if (len > 0) {
+    if (BX_DMA_THIS s[ma_sl].chan[channel].mode.address_decrement==0)
+      BX_DMA_THIS s[ma_sl].chan[channel].current_address += len;
+    else
+      BX_DMA_THIS s[ma_sl].chan[channel].current_address--;
+    BX_DMA_THIS s[ma_sl].chan[channel].current_count -= len;
+    if (BX_DMA_THIS s[ma_sl].chan[channel].current_count == 0xffff) {
+      BX_DMA_THIS count_expired(ma_sl, channel);
+      BX_DMA_THIS end_of_transfer(ma_sl, channel);
+      return;
+    }
+  }
+  BX_DMA_THIS TC = 0; // the handler stopped before terminal count
+}
+
+// Reports the terminal count of a channel in the status register and masks
+// the channel, or reloads its address and count in autoinit mode
+void bx_dma_c::count_expired(bx_bool ma_sl, unsigned channel)
+{
+  BX_DMA_THIS s[ma_sl].status_reg |= (1 << channel); // hold TC in status reg
+  if (BX_DMA_THIS s[ma_sl].chan[channel].mode.autoinit_enable == 0) {
+    // set mask bit if not in autoinit mode
+    BX_DMA_THIS s[ma_sl].mask[channel] = 1;
+  }
+  else {
+    // count expired, but in autoinit mode
+    // reload count and base address
+    BX_DMA_THIS s[ma_sl].chan[channel].current_address =
+      BX_DMA_THIS s[ma_sl].chan[channel].base_address;
+    BX_DMA_THIS s[ma_sl].chan[channel].current_count =
+      BX_DMA_THIS s[ma_sl].chan[channel].base_count;
+  }
+}
+
+// Deasserts TC, HRQ and DACK(n) once the adapter card has seen TC
+void bx_dma_c::end_of_transfer(bx_bool ma_sl, unsigned channel)
+{
+  BX_DMA_THIS TC = 0;            // clear TC, adapter card already notified
+  BX_DMA_THIS HLDA = 0;
+  bx_pc_system.set_HRQ(0);           // clear HRQ to CPU
+  BX_DMA_THIS s[ma_sl].DACK[channel] = 0; // clear DACK to adapter card
+  if (!ma_sl) {
+    BX_DMA_THIS set_DRQ(4, 0); // clear DRQ to cascade
+    BX_DMA_THIS s[1].DACK[0] = 0; // clear DACK to cascade
   }
 }
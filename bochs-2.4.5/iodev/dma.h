@@ -30,6 +30,9 @@
 #  define BX_DMA_THIS this->
 #endif
 
+// largest block moved by a single request of a block transfer channel
+#define BX_DMA_BUFFER_SIZE 512
+
 class bx_dma_c : public bx_dma_stub_c {
 public:
   bx_dma_c();
@@ -50,6 +53,14 @@ public:
     void (* dmaRead)(Bit16u *data_word),
     void (* dmaWrite)(Bit16u *data_word),
     const char *name);
+  virtual unsigned registerDMA8BlockChannel(unsigned channel,
+    Bit16u (* dmaRead)(Bit8u *buffer, Bit16u maxlen),
+    Bit16u (* dmaWrite)(Bit8u *buffer, Bit16u maxlen),
+    const char *name);
+  virtual unsigned registerDMA16BlockChannel(unsigned channel,
+    Bit16u (* dmaRead)(Bit16u *buffer, Bit16u maxlen),
+    Bit16u (* dmaWrite)(Bit16u *buffer, Bit16u maxlen),
+    const char *name);
   virtual unsigned unregisterDMAChannel(unsigned channel);
 
 private:
@@ -62,6 +73,9 @@ private:
 #endif
   BX_DMA_SMF void control_HRQ(bx_bool ma_sl);
   BX_DMA_SMF void reset_controller(unsigned num);
+  BX_DMA_SMF void transfer_block(bx_bool ma_sl, unsigned channel, bx_phy_address phy_addr);
+  BX_DMA_SMF void count_expired(bx_bool ma_sl, unsigned channel);
+  BX_DMA_SMF void end_of_transfer(bx_bool ma_sl, unsigned channel);
 
   struct {
     bx_bool DRQ[4];  // DMA Request
@@ -98,6 +112,12 @@ private:
     void (* dmaWrite8)(Bit8u *data_byte);
     void (* dmaRead16)(Bit16u *data_word);
     void (* dmaWrite16)(Bit16u *data_word);
+    // block transfer handlers, they move up to 'maxlen' bytes (words)
+    // per request and return the number actually moved
+    Bit16u (* dmaReadBlock8)(Bit8u *buffer, Bit16u maxlen);
+    Bit16u (* dmaWriteBlock8)(Bit8u *buffer, Bit16u maxlen);
+    Bit16u (* dmaReadBlock16)(Bit16u *buffer, Bit16u maxlen);
+    Bit16u (* dmaWriteBlock16)(Bit16u *buffer, Bit16u maxlen);
   } h[4]; // DMA read and write handlers
 };
 
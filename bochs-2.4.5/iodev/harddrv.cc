@@ -135,13 +135,24 @@ bx_hard_drive_c::bx_hard_drive_c()
       channels[channel].drives[device].cdrom.cd =  NULL;
 #endif
     }
+    channels[channel].io_thread = NULL;
+    channels[channel].async_op = ASYNC_NONE;
   }
   iolight_timer_index = BX_NULL_TIMER_HANDLE;
+  async_timer_index = BX_NULL_TIMER_HANDLE;
+  flush_timer_index = BX_NULL_TIMER_HANDLE;
 }
 
 bx_hard_drive_c::~bx_hard_drive_c()
 {
   for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+#if BX_HAVE_PTHREAD
+    // waits for the outstanding transfer
+    if (channels[channel].io_thread != NULL) {
+      delete channels[channel].io_thread;
+      channels[channel].io_thread = NULL;
+    }
+#endif
     for (Bit8u device=0; device<2; device ++) {
       if (channels[channel].drives[device].hard_drive != NULL) {
         channels[channel].drives[device].hard_drive->close();
@@ -270,6 +281,7 @@ void bx_hard_drive_c::init(void)
       BX_HD_THIS channels[channel].drives[device].statusbar_id = -1;
       BX_HD_THIS channels[channel].drives[device].iolight_counter = 0;
       BX_HD_THIS channels[channel].drives[device].identify_set = 0;
+      BX_HD_THIS channels[channel].drives[device].async_io = 0;
       if (!SIM->get_param_bool("present", base)->get()) continue;
 
       // Make model string
@@ -327,7 +339,8 @@ void bx_hard_drive_c::init(void)
           case BX_ATA_MODE_SPARSE:
             BX_INFO(("HD on ata%d-%d: '%s' 'sparse' mode ", channel, device,
                      SIM->get_param_string("path", base)->getptr()));
-            channels[channel].drives[device].hard_drive = new sparse_image_t();
+            channels[channel].drives[device].hard_drive =
+              new sparse_image_t(SIM->get_param_num("prealloc", base)->get());
             break;
 
           case BX_ATA_MODE_VMWARE3:
@@ -346,7 +359,8 @@ void bx_hard_drive_c::init(void)
             BX_INFO(("HD on ata%d-%d: '%s' 'undoable' mode ", channel, device,
                      SIM->get_param_string("path", base)->getptr()));
             channels[channel].drives[device].hard_drive = new undoable_image_t(
-                SIM->get_param_string("journal", base)->getptr());
+                SIM->get_param_string("journal", base)->getptr(),
+                SIM->get_param_num("extent_size", base)->get() * 1024);
             break;
 
           case BX_ATA_MODE_GROWING:
@@ -359,28 +373,44 @@ void bx_hard_drive_c::init(void)
             BX_INFO(("HD on ata%d-%d: '%s' 'volatile' mode ", channel, device,
                      SIM->get_param_string("path", base)->getptr()));
             channels[channel].drives[device].hard_drive = new volatile_image_t(
+                SIM->get_param_string("journal", base)->getptr(),
+                SIM->get_param_num("extent_size", base)->get() * 1024);
+            break;
+
+          case BX_ATA_MODE_COW:
+            BX_INFO(("HD on ata%d-%d: '%s' 'cow' mode ", channel, device,
+                     SIM->get_param_string("path", base)->getptr()));
+            channels[channel].drives[device].hard_drive = new cow_image_t(
                 SIM->get_param_string("journal", base)->getptr());
             break;
 
+#ifdef _POSIX_MAPPED_FILES
+          case BX_ATA_MODE_MMAP:
+            BX_INFO(("HD on ata%d-%d: '%s' 'mmap' mode ", channel, device,
+                     SIM->get_param_string("path", base)->getptr()));
+            channels[channel].drives[device].hard_drive = new mmap_image_t(0);
+            break;
+
+          case BX_ATA_MODE_MMAP_VOLATILE:
+            BX_INFO(("HD on ata%d-%d: '%s' 'mmap-volatile' mode ", channel, device,
+                     SIM->get_param_string("path", base)->getptr()));
+            channels[channel].drives[device].hard_drive = new mmap_image_t(1);
+            break;
+#endif
+
 #if BX_COMPRESSED_HD_SUPPORT
           case BX_ATA_MODE_Z_UNDOABLE:
-            BX_PANIC(("z-undoable disk support not implemented"));
-#if 0
             BX_INFO(("HD on ata%d-%d: '%s' 'z-undoable' mode ", channel, device,
                      SIM->get_param_string("path", base)->getptr()));
             channels[channel].drives[device].hard_drive = new z_undoable_image_t(disk_size,
                 SIM->get_param_string("journal", base)->getptr());
-#endif
             break;
 
           case BX_ATA_MODE_Z_VOLATILE:
-            BX_PANIC(("z-volatile disk support not implemented"));
-#if 0
             BX_INFO(("HD on ata%d-%d: '%s' 'z-volatile' mode ", channel, device,
                      SIM->get_param_string("path", base)->getptr()));
             channels[channel].drives[device].hard_drive = new z_volatile_image_t(disk_size,
                 SIM->get_param_string("journal", base)->getptr());
-#endif
             break;
 #endif //BX_COMPRESSED_HD_SUPPORT
 
@@ -399,7 +429,10 @@ void bx_hard_drive_c::init(void)
         if ((image_mode == BX_ATA_MODE_FLAT) || (image_mode == BX_ATA_MODE_CONCAT) ||
             (image_mode == BX_ATA_MODE_GROWING) || (image_mode == BX_ATA_MODE_UNDOABLE) ||
             (image_mode == BX_ATA_MODE_VOLATILE) || (image_mode == BX_ATA_MODE_VMWARE3) ||
-            (image_mode == BX_ATA_MODE_VMWARE4) || (image_mode == BX_ATA_MODE_SPARSE)) {
+            (image_mode == BX_ATA_MODE_VMWARE4) || (image_mode == BX_ATA_MODE_SPARSE) ||
+            (image_mode == BX_ATA_MODE_MMAP) || (image_mode == BX_ATA_MODE_MMAP_VOLATILE) ||
+            (image_mode == BX_ATA_MODE_COW) || (image_mode == BX_ATA_MODE_Z_UNDOABLE) ||
+            (image_mode == BX_ATA_MODE_Z_VOLATILE)) {
           geometry_detect = ((cyl == 0) || (image_mode == BX_ATA_MODE_VMWARE3) || (image_mode == BX_ATA_MODE_VMWARE4));
           if ((heads == 0) || (spt == 0)) {
             BX_PANIC(("ata%d-%d cannot have zero heads, or sectors/track", channel, device));
@@ -442,6 +475,33 @@ void bx_hard_drive_c::init(void)
         } else if (geometry_detect) {
           BX_PANIC(("ata%d-%d image doesn't support geometry detection", channel, device));
         }
+
+        if (SIM->get_param_num("write_cache", base)->get() > 0) {
+          BX_INFO(("ata%d-%d: using a write-back cache of %d KB", channel, device,
+                   SIM->get_param_num("write_cache", base)->get()));
+          BX_HD_THIS channels[channel].drives[device].hard_drive =
+            new write_cache_image_t(BX_HD_THIS channels[channel].drives[device].hard_drive,
+                                    SIM->get_param_num("write_cache", base)->get() * 2);
+        }
+
+        if (SIM->get_param_bool("async", base)->get()) {
+#if BX_HAVE_PTHREAD
+          if (BX_HD_THIS channels[channel].io_thread == NULL) {
+            BX_HD_THIS channels[channel].io_thread = new image_io_thread_t();
+            if (!BX_HD_THIS channels[channel].io_thread->start()) {
+              BX_ERROR(("ata%d: could not create i/o thread", channel));
+              delete BX_HD_THIS channels[channel].io_thread;
+              BX_HD_THIS channels[channel].io_thread = NULL;
+            }
+          }
+          if (BX_HD_THIS channels[channel].io_thread != NULL) {
+            BX_INFO(("ata%d-%d: using asynchronous i/o", channel, device));
+            BX_HD_THIS channels[channel].drives[device].async_io = 1;
+          }
+#else
+          BX_ERROR(("ata%d-%d: asynchronous i/o not supported on this platform", channel, device));
+#endif
+        }
       } else if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_CDROM) {
         bx_list_c *cdrom_rt = (bx_list_c*)SIM->get_param(BXPN_MENU_RUNTIME_CDROM);
         cdrom_rt->add(base);
@@ -655,6 +715,16 @@ void bx_hard_drive_c::init(void)
     BX_HD_THIS iolight_timer_index =
       DEV_register_timer(this, iolight_timer_handler, 100000, 0,0, "HD/CD i/o light");
   }
+  // register timer for the completion of asynchronous transfers
+  if (BX_HD_THIS async_timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_HD_THIS async_timer_index =
+      DEV_register_timer(this, async_timer_handler, 10, 1,0, "HD async i/o");
+  }
+  // register timer for the periodic write-back of image metadata
+  if (BX_HD_THIS flush_timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_HD_THIS flush_timer_index =
+      DEV_register_timer(this, flush_timer_handler, BX_HD_FLUSH_INTERVAL, 1,1, "HD image write-back");
+  }
 }
 
 void bx_hard_drive_c::reset(unsigned type)
@@ -674,7 +744,7 @@ void bx_hard_drive_c::register_state(void)
   bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "hard_drive", "Hard Drive State", BX_MAX_ATA_CHANNEL);
   for (i=0; i<BX_MAX_ATA_CHANNEL; i++) {
     sprintf(cname, "%d", i);
-    chan = new bx_list_c(list, cname, 3);
+    chan = new bx_list_c(list, cname, 4);
     for (j=0; j<2; j++) {
       if (BX_DRIVE_IS_PRESENT(i, j)) {
         sprintf(dname, "drive%d", i);
@@ -718,6 +788,126 @@ void bx_hard_drive_c::register_state(void)
       }
     }
     new bx_shadow_num_c(chan, "drive_select", &BX_HD_THIS channels[i].drive_select);
+    new bx_shadow_num_c(chan, "async_op", &BX_HD_THIS channels[i].async_op);
+  }
+}
+
+// A transfer running in the i/o thread is not part of the saved state.
+// The address registers are only updated when it is completed and the
+// buffer is saved, so the transfer is simply started again.
+void bx_hard_drive_c::after_restore_state(void)
+{
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    Bit8u op = BX_HD_THIS channels[channel].async_op;
+    if (op != ASYNC_NONE) {
+      BX_HD_THIS channels[channel].async_op = ASYNC_NONE;
+      ide_async_start(channel, op);
+    }
+  }
+}
+
+// Called before the simulation is cloned (see clone.cc). The clones read the
+// metadata of the images from the shared files again when it drops out of
+// their caches, so the tables kept in memory are written back first. The
+// outstanding transfers are completed, the i/o thread owns the image.
+void bx_hard_drive_c::before_clone(void)
+{
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    ide_async_complete(channel, 1);
+  }
+  BX_HD_THIS flush_timer();
+}
+
+// Called in a clone of the simulation (see clone.cc). The image files are
+// shared with the parent and all other clones, so flat disks get a private
+// volatile redolog on top of the original image file. Cow disks keep their
+// tables copied by fork() and get the redolog on top of the cow image. The
+// redolog of the other modes cannot be copied, these images stay shared.
+// The i/o threads do not exist in the clone, so they are created again and
+// an outstanding transfer is restarted on the new image. The images restart
+// their own threads (read-ahead of compressed images) in after_clone().
+void bx_hard_drive_c::after_clone(void)
+{
+  char  ata_name[20];
+  bx_list_c *base;
+  device_image_t *image;
+  unsigned image_mode;
+  device_image_t *cow;
+  Bit8u op;
+
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    op = BX_HD_THIS channels[channel].async_op;
+    BX_HD_THIS channels[channel].async_op = ASYNC_NONE;
+#if BX_HAVE_PTHREAD
+    if (BX_HD_THIS channels[channel].io_thread != NULL) {
+      // the old object may be locked by the thread of the parent, don't touch it
+      BX_HD_THIS channels[channel].io_thread = new image_io_thread_t();
+      if (!BX_HD_THIS channels[channel].io_thread->start()) {
+        BX_ERROR(("ata%d: could not create i/o thread", channel));
+        delete BX_HD_THIS channels[channel].io_thread;
+        BX_HD_THIS channels[channel].io_thread = NULL;
+        BX_HD_THIS channels[channel].drives[0].async_io = 0;
+        BX_HD_THIS channels[channel].drives[1].async_io = 0;
+      }
+    }
+#endif
+    for (Bit8u device=0; device<2; device ++) {
+      if ((BX_HD_THIS channels[channel].drives[device].device_type != IDE_DISK) ||
+          (BX_HD_THIS channels[channel].drives[device].hard_drive == NULL))
+        continue;
+      BX_HD_THIS channels[channel].drives[device].hard_drive->after_clone();
+      sprintf(ata_name, "ata.%d.%s", channel, (device==0)?"master":"slave");
+      base = (bx_list_c*) SIM->get_param(ata_name);
+      image_mode = SIM->get_param_enum("mode", base)->get();
+      // the private mapping has been copied by fork()
+      if (image_mode == BX_ATA_MODE_MMAP_VOLATILE)
+        continue;
+      if ((image_mode != BX_ATA_MODE_FLAT) && (image_mode != BX_ATA_MODE_MMAP) &&
+          (image_mode != BX_ATA_MODE_COW)) {
+        BX_ERROR(("ata%d-%d: '%s' mode image is shared with the other clones", channel, device,
+                  atadevice_mode_names[image_mode]));
+        continue;
+      }
+      cow = NULL;
+      if (image_mode == BX_ATA_MODE_COW) {
+        // the overlay file is shared, but the tables of the cow image are
+        // private copies now: keep reading through them and send the writes
+        // to a private redolog on top
+        cow = BX_HD_THIS channels[channel].drives[device].hard_drive;
+        if (SIM->get_param_num("write_cache", base)->get() > 0)
+          cow = ((write_cache_image_t*)cow)->get_image();
+        image = new volatile_image_t(cow, SIM->get_param_string("journal", base)->getptr());
+      } else {
+        image = new volatile_image_t(SIM->get_param_string("journal", base)->getptr());
+      }
+      if (image->open(SIM->get_param_string("path", base)->getptr()) < 0) {
+        BX_PANIC(("ata%d-%d: could not reopen hard drive image file '%s'", channel, device,
+                  SIM->get_param_string("path", base)->getptr()));
+        // the cow image is still in use below
+        if (cow == NULL)
+          delete image;
+        continue;
+      }
+      image->cylinders = BX_HD_THIS channels[channel].drives[device].hard_drive->cylinders;
+      image->heads = BX_HD_THIS channels[channel].drives[device].hard_drive->heads;
+      image->sectors = BX_HD_THIS channels[channel].drives[device].hard_drive->sectors;
+      image->hd_size = BX_HD_THIS channels[channel].drives[device].hard_drive->hd_size;
+      if (SIM->get_param_num("write_cache", base)->get() > 0) {
+        // the dirty sectors copied from the parent go to the redolog
+        image = ((write_cache_image_t*)BX_HD_THIS channels[channel].drives[device].hard_drive)->replace_image(image);
+      } else {
+        device_image_t *new_image = image;
+        image = BX_HD_THIS channels[channel].drives[device].hard_drive;
+        BX_HD_THIS channels[channel].drives[device].hard_drive = new_image;
+      }
+      // the replaced cow image is owned by the new redolog
+      if (cow == NULL) {
+        image->close();
+        delete image;
+      }
+    }
+    if (op != ASYNC_NONE)
+      ide_async_start(channel, op);
   }
 }
 
@@ -727,6 +917,50 @@ void bx_hard_drive_c::iolight_timer_handler(void *this_ptr)
   class_ptr->iolight_timer();
 }
 
+void bx_hard_drive_c::async_timer_handler(void *this_ptr)
+{
+  bx_hard_drive_c *class_ptr = (bx_hard_drive_c *) this_ptr;
+  class_ptr->async_timer();
+}
+
+// Polls the i/o threads while transfers are outstanding
+void bx_hard_drive_c::async_timer()
+{
+  bx_bool busy = 0;
+
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    if (BX_HD_THIS channels[channel].async_op != ASYNC_NONE) {
+      ide_async_complete(channel, 0);
+      busy |= (BX_HD_THIS channels[channel].async_op != ASYNC_NONE);
+    }
+  }
+  if (!busy)
+    bx_pc_system.deactivate_timer(BX_HD_THIS async_timer_index);
+}
+
+void bx_hard_drive_c::flush_timer_handler(void *this_ptr)
+{
+  bx_hard_drive_c *class_ptr = (bx_hard_drive_c *) this_ptr;
+  class_ptr->flush_timer();
+}
+
+// Writes back the metadata that the images keep in memory, so that a crash
+// of the simulator loses at most the last BX_HD_FLUSH_INTERVAL of changes
+void bx_hard_drive_c::flush_timer()
+{
+  for (Bit8u channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
+    // the i/o thread owns the image while a transfer is running
+    if (BX_HD_THIS channels[channel].async_op != ASYNC_NONE)
+      continue;
+    for (unsigned device=0; device<2; device++) {
+      if (BX_DRIVE_IS_HD(channel, device) &&
+          (BX_HD_THIS channels[channel].drives[device].hard_drive->flush_cache() < 0)) {
+        BX_ERROR(("ata%d-%d: could not flush hard drive image", channel, device));
+      }
+    }
+  }
+}
+
 void bx_hard_drive_c::iolight_timer()
 {
   for (unsigned channel=0; channel<BX_MAX_ATA_CHANNEL; channel++) {
@@ -795,6 +1029,10 @@ Bit32u bx_hard_drive_c::read(Bit32u address, unsigned io_len)
     }
   }
 
+  // the status shows BSY until the transfer of the i/o thread is finished
+  if (BX_HD_THIS channels[channel].async_op != ASYNC_NONE)
+    ide_async_complete(channel, 0);
+
   switch (port) {
     case 0x00: // hard disk data (16bit) 0x1f0
       if (BX_SELECTED_CONTROLLER(channel).status.drq == 0) {
@@ -872,8 +1110,10 @@ Bit32u bx_hard_drive_c::read(Bit32u address, unsigned io_len)
               BX_SELECTED_CONTROLLER(channel).status.drq = 1;
               BX_SELECTED_CONTROLLER(channel).status.seek_complete = 1;
 
-              if (ide_read_sector(channel, BX_SELECTED_CONTROLLER(channel).buffer,
-                                  BX_SELECTED_CONTROLLER(channel).buffer_size)) {
+              if (BX_SELECTED_DRIVE(channel).async_io) {
+                ide_async_start(channel, ASYNC_READ);
+              } else if (ide_read_sector(channel, BX_SELECTED_CONTROLLER(channel).buffer,
+                                         BX_SELECTED_CONTROLLER(channel).buffer_size)) {
                 BX_SELECTED_CONTROLLER(channel).buffer_index = 0;
                 raise_interrupt(channel);
               }
@@ -1238,6 +1478,10 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
     }
   }
 
+  // the i/o thread uses the controller buffer and the image
+  if (BX_HD_THIS channels[channel].async_op != ASYNC_NONE)
+    ide_async_complete(channel, 1);
+
   switch (io_len) {
     case 1:
       BX_DEBUG(("8-bit write to %04x = %02x {%s}",
@@ -1301,38 +1545,11 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
 
           /* if buffer completely writtten */
           if (BX_SELECTED_CONTROLLER(channel).buffer_index >= BX_SELECTED_CONTROLLER(channel).buffer_size) {
-            if (ide_write_sector(channel, BX_SELECTED_CONTROLLER(channel).buffer,
-                                 BX_SELECTED_CONTROLLER(channel).buffer_size)) {
-              if ((BX_SELECTED_CONTROLLER(channel).current_command == 0xC5) ||
-                  (BX_SELECTED_CONTROLLER(channel).current_command == 0x39)) {
-                if (BX_SELECTED_CONTROLLER(channel).num_sectors > BX_SELECTED_CONTROLLER(channel).multiple_sectors) {
-                  BX_SELECTED_CONTROLLER(channel).buffer_size = BX_SELECTED_CONTROLLER(channel).multiple_sectors * 512;
-                } else {
-                  BX_SELECTED_CONTROLLER(channel).buffer_size = BX_SELECTED_CONTROLLER(channel).num_sectors * 512;
-                }
-              }
-              BX_SELECTED_CONTROLLER(channel).buffer_index = 0;
-
-              /* When the write is complete, controller clears the DRQ bit and
-               * sets the BSY bit.
-               * If at least one more sector is to be written, controller sets DRQ bit,
-               * clears BSY bit, and issues IRQ
-               */
-
-              if (BX_SELECTED_CONTROLLER(channel).num_sectors != 0) {
-                BX_SELECTED_CONTROLLER(channel).status.busy = 0;
-                BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
-                BX_SELECTED_CONTROLLER(channel).status.drq = 1;
-                BX_SELECTED_CONTROLLER(channel).status.corrected_data = 0;
-                BX_SELECTED_CONTROLLER(channel).status.err = 0;
-              } else { /* no more sectors to write */
-                BX_SELECTED_CONTROLLER(channel).status.busy = 0;
-                BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
-                BX_SELECTED_CONTROLLER(channel).status.drq = 0;
-                BX_SELECTED_CONTROLLER(channel).status.err = 0;
-                BX_SELECTED_CONTROLLER(channel).status.corrected_data = 0;
-              }
-              raise_interrupt(channel);
+            if (BX_SELECTED_DRIVE(channel).async_io) {
+              ide_async_start(channel, ASYNC_WRITE);
+            } else if (ide_write_sector(channel, BX_SELECTED_CONTROLLER(channel).buffer,
+                                        BX_SELECTED_CONTROLLER(channel).buffer_size)) {
+              ide_write_complete(channel);
             }
           }
           break;
@@ -2119,8 +2336,10 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
           }
           BX_SELECTED_CONTROLLER(channel).current_command = value;
 
-          if (ide_read_sector(channel, BX_SELECTED_CONTROLLER(channel).buffer,
-                                  BX_SELECTED_CONTROLLER(channel).buffer_size)) {
+          if (BX_SELECTED_DRIVE(channel).async_io) {
+            ide_async_start(channel, ASYNC_READ);
+          } else if (ide_read_sector(channel, BX_SELECTED_CONTROLLER(channel).buffer,
+                                     BX_SELECTED_CONTROLLER(channel).buffer_size)) {
             BX_SELECTED_CONTROLLER(channel).error_register = 0;
             BX_SELECTED_CONTROLLER(channel).status.busy  = 0;
             BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
@@ -2454,11 +2673,19 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
           }
           break;
 
-        // power management & flush cache stubs
-        case 0xE0: // STANDBY NOW
-        case 0xE1: // IDLE IMMEDIATE
         case 0xE7: // FLUSH CACHE
         case 0xEA: // FLUSH CACHE EXT
+          if (BX_SELECTED_IS_HD(channel) &&
+              (BX_SELECTED_DRIVE(channel).hard_drive->flush_cache() < 0)) {
+            BX_ERROR(("ata%d-%d: could not flush hard drive image", channel, BX_SLAVE_SELECTED(channel)));
+            command_aborted(channel, value);
+            break;
+          }
+          // fall through
+
+        // power management stubs
+        case 0xE0: // STANDBY NOW
+        case 0xE1: // IDLE IMMEDIATE
           BX_SELECTED_CONTROLLER(channel).status.busy = 0;
           BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
           BX_SELECTED_CONTROLLER(channel).status.write_fault = 0;
@@ -2690,6 +2917,23 @@ bx_hard_drive_c::calculate_logical_address(Bit8u channel, Bit64s *sector)
   return 1;
 }
 
+// The sectors of a multi-sector transfer are consecutive logical sectors,
+// all of them must be inside the disk.
+  bx_bool BX_CPP_AttrRegparmN(3)
+bx_hard_drive_c::check_sector_range(Bit8u channel, Bit64s sector, int count)
+{
+  Bit64s sector_count =
+    (Bit64s)BX_SELECTED_DRIVE(channel).hard_drive->cylinders *
+    BX_SELECTED_DRIVE(channel).hard_drive->heads *
+    BX_SELECTED_DRIVE(channel).hard_drive->sectors;
+
+  if ((sector + count) > sector_count) {
+    BX_ERROR(("transfer of %d sectors at %d crosses the end of the disk", count, (Bit32u)sector));
+    return 0;
+  }
+  return 1;
+}
+
   void BX_CPP_AttrRegparmN(1)
 bx_hard_drive_c::increment_address(Bit8u channel)
 {
@@ -3411,6 +3655,54 @@ bx_bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer)
   return 1;
 }
 
+// Transfers the next len bytes of a READ DMA / WRITE DMA command with one
+// request to the image, directly from / to the guest memory described by the
+// scatter/gather list. Returns 1 if done, 0 if the transfer has to be done
+// sector by sector (ATAPI, direction mismatch, more data than sectors left)
+// and -1 if the command has been aborted.
+int bx_hard_drive_c::bmdma_transfer(Bit8u channel, bx_bool read, const bx_iovec_t *iov, int iovcnt, Bit32u len)
+{
+  Bit8u cmd = BX_SELECTED_CONTROLLER(channel).current_command;
+  Bit64s logical_sector = 0;
+  Bit64s ret;
+
+  if (!BX_SELECTED_IS_HD(channel) ||
+      (len > BX_SELECTED_CONTROLLER(channel).num_sectors * 512))
+    return 0;
+  if (read) {
+    if ((cmd != 0xC8) && (cmd != 0x25)) return 0;
+  } else {
+    if ((cmd != 0xCA) && (cmd != 0x35)) return 0;
+  }
+  int sector_count = (len / 512);
+  if (!calculate_logical_address(channel, &logical_sector) ||
+      !check_sector_range(channel, logical_sector, sector_count)) {
+    BX_ERROR(("bmdma_transfer() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
+    command_aborted(channel, cmd);
+    return -1;
+  }
+  /* set status bar conditions for device */
+  if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, !read);
+  BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+  bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+  if (read) {
+    ret = BX_SELECTED_DRIVE(channel).hard_drive->readv_sectors(logical_sector, iov, iovcnt);
+  } else {
+    ret = BX_SELECTED_DRIVE(channel).hard_drive->writev_sectors(logical_sector, iov, iovcnt);
+  }
+  if (ret < (Bit64s)len) {
+    BX_ERROR(("could not %s hard drive image file at byte %lu", read ? "read()" : "write()",
+              (unsigned long)logical_sector*512));
+    command_aborted(channel, cmd);
+    return -1;
+  }
+  while (sector_count-- > 0)
+    increment_address(channel);
+
+  return 1;
+}
+
 void bx_hard_drive_c::bmdma_complete(Bit8u channel)
 {
   BX_SELECTED_CONTROLLER(channel).status.busy = 0;
@@ -3452,33 +3744,25 @@ bx_bool bx_hard_drive_c::ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u bu
   Bit64s ret;
 
   int sector_count = (buffer_size / 512);
-  Bit8u *bufptr = buffer;
-  do {
-    if (!calculate_logical_address(channel, &logical_sector)) {
-      BX_ERROR(("ide_read_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    ret = BX_SELECTED_DRIVE(channel).hard_drive->lseek(logical_sector * 512, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file"));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    if (!BX_SELECTED_DRIVE(channel).iolight_counter)
-      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
-    BX_SELECTED_DRIVE(channel).iolight_counter = 5;
-    bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
-    ret = BX_SELECTED_DRIVE(channel).hard_drive->read((bx_ptr_t)bufptr, 512);
-    if (ret < 512) {
-      BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
+  if (!calculate_logical_address(channel, &logical_sector) ||
+      !check_sector_range(channel, logical_sector, sector_count)) {
+    BX_ERROR(("ide_read_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  /* set status bar conditions for device */
+  if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
+  BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+  bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+  ret = BX_SELECTED_DRIVE(channel).hard_drive->read_sectors(logical_sector, (bx_ptr_t)buffer, sector_count);
+  if (ret < (Bit64s)sector_count * 512) {
+    BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  while (sector_count-- > 0)
     increment_address(channel);
-    bufptr += 512;
-  } while (--sector_count > 0);
 
   return 1;
 }
@@ -3489,37 +3773,155 @@ bx_bool bx_hard_drive_c::ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u b
   Bit64s ret;
 
   int sector_count = (buffer_size / 512);
-  Bit8u *bufptr = buffer;
-  do {
-    if (!calculate_logical_address(channel, &logical_sector)) {
-      BX_ERROR(("ide_write_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    ret = BX_SELECTED_DRIVE(channel).hard_drive->lseek(logical_sector * 512, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file at byte %lu", (unsigned long)logical_sector * 512));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    if (!BX_SELECTED_DRIVE(channel).iolight_counter)
-      bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
-    BX_SELECTED_DRIVE(channel).iolight_counter = 5;
-    bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
-    ret = BX_SELECTED_DRIVE(channel).hard_drive->write((bx_ptr_t)bufptr, 512);
-    if (ret < 512) {
-      BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
-      command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
-      return 0;
-    }
+  if (!calculate_logical_address(channel, &logical_sector) ||
+      !check_sector_range(channel, logical_sector, sector_count)) {
+    BX_ERROR(("ide_write_sector() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  /* set status bar conditions for device */
+  if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
+  BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+  bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+  ret = BX_SELECTED_DRIVE(channel).hard_drive->write_sectors(logical_sector, (bx_ptr_t)buffer, sector_count);
+  if (ret < (Bit64s)sector_count * 512) {
+    BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*512));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return 0;
+  }
+  while (sector_count-- > 0)
     increment_address(channel);
-    bufptr += 512;
-  } while (--sector_count > 0);
 
   return 1;
 }
 
+// Prepares the next block of a PIO write command after the buffer has been
+// written to the image
+void bx_hard_drive_c::ide_write_complete(Bit8u channel)
+{
+  if ((BX_SELECTED_CONTROLLER(channel).current_command == 0xC5) ||
+      (BX_SELECTED_CONTROLLER(channel).current_command == 0x39)) {
+    if (BX_SELECTED_CONTROLLER(channel).num_sectors > BX_SELECTED_CONTROLLER(channel).multiple_sectors) {
+      BX_SELECTED_CONTROLLER(channel).buffer_size = BX_SELECTED_CONTROLLER(channel).multiple_sectors * 512;
+    } else {
+      BX_SELECTED_CONTROLLER(channel).buffer_size = BX_SELECTED_CONTROLLER(channel).num_sectors * 512;
+    }
+  }
+  BX_SELECTED_CONTROLLER(channel).buffer_index = 0;
+
+  /* When the write is complete, controller clears the DRQ bit and
+   * sets the BSY bit.
+   * If at least one more sector is to be written, controller sets DRQ bit,
+   * clears BSY bit, and issues IRQ
+   */
+
+  if (BX_SELECTED_CONTROLLER(channel).num_sectors != 0) {
+    BX_SELECTED_CONTROLLER(channel).status.busy = 0;
+    BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
+    BX_SELECTED_CONTROLLER(channel).status.drq = 1;
+    BX_SELECTED_CONTROLLER(channel).status.corrected_data = 0;
+    BX_SELECTED_CONTROLLER(channel).status.err = 0;
+  } else { /* no more sectors to write */
+    BX_SELECTED_CONTROLLER(channel).status.busy = 0;
+    BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
+    BX_SELECTED_CONTROLLER(channel).status.drq = 0;
+    BX_SELECTED_CONTROLLER(channel).status.err = 0;
+    BX_SELECTED_CONTROLLER(channel).status.corrected_data = 0;
+  }
+  raise_interrupt(channel);
+}
+
+// Starts a PIO transfer of the controller buffer in the i/o thread of the
+// channel. The controller stays busy until ide_async_complete() finds the
+// transfer finished; the address registers are updated only then. Without
+// an i/o thread (e.g. a restored state) the transfer is done right away.
+void bx_hard_drive_c::ide_async_start(Bit8u channel, Bit8u op)
+{
+  Bit64s logical_sector = 0;
+  Bit64s ret;
+
+  int sector_count = (BX_SELECTED_CONTROLLER(channel).buffer_size / 512);
+  if (!calculate_logical_address(channel, &logical_sector) ||
+      !check_sector_range(channel, logical_sector, sector_count)) {
+    BX_ERROR(("ide_async_start() reached invalid sector %lu, aborting", (unsigned long)logical_sector));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return;
+  }
+  /* set status bar conditions for device */
+  if (!BX_SELECTED_DRIVE(channel).iolight_counter)
+    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, op == ASYNC_WRITE);
+  BX_SELECTED_DRIVE(channel).iolight_counter = 5;
+  bx_pc_system.activate_timer(BX_HD_THIS iolight_timer_index, 100000, 0);
+
+  BX_SELECTED_CONTROLLER(channel).status.busy = 1;
+  BX_SELECTED_CONTROLLER(channel).status.drq = 0;
+  BX_HD_THIS channels[channel].async_op = op;
+#if BX_HAVE_PTHREAD
+  if (BX_HD_THIS channels[channel].io_thread != NULL) {
+    BX_HD_THIS channels[channel].io_thread->submit(BX_SELECTED_DRIVE(channel).hard_drive,
+      op == ASYNC_WRITE, logical_sector, BX_SELECTED_CONTROLLER(channel).buffer, sector_count);
+    bx_pc_system.activate_timer(BX_HD_THIS async_timer_index, 10, 1);
+    return;
+  }
+#endif
+  if (op == ASYNC_WRITE) {
+    ret = BX_SELECTED_DRIVE(channel).hard_drive->write_sectors(logical_sector,
+            BX_SELECTED_CONTROLLER(channel).buffer, sector_count);
+  } else {
+    ret = BX_SELECTED_DRIVE(channel).hard_drive->read_sectors(logical_sector,
+            BX_SELECTED_CONTROLLER(channel).buffer, sector_count);
+  }
+  ide_async_finish(channel, ret);
+}
+
+// Completes the transfer of the i/o thread. Without 'wait' nothing is done
+// if the transfer is still running.
+void bx_hard_drive_c::ide_async_complete(Bit8u channel, bx_bool wait)
+{
+#if BX_HAVE_PTHREAD
+  ssize_t ret;
+
+  if ((BX_HD_THIS channels[channel].async_op == ASYNC_NONE) ||
+      (BX_HD_THIS channels[channel].io_thread == NULL))
+    return;
+  if (wait) {
+    ret = BX_HD_THIS channels[channel].io_thread->wait();
+  } else if (!BX_HD_THIS channels[channel].io_thread->poll(&ret)) {
+    return;
+  }
+  ide_async_finish(channel, ret);
+#endif
+}
+
+void bx_hard_drive_c::ide_async_finish(Bit8u channel, Bit64s ret)
+{
+  Bit8u op = BX_HD_THIS channels[channel].async_op;
+  int sector_count = (BX_SELECTED_CONTROLLER(channel).buffer_size / 512);
+
+  BX_HD_THIS channels[channel].async_op = ASYNC_NONE;
+  if (ret < (Bit64s)sector_count * 512) {
+    BX_ERROR(("could not %s() hard drive image file", (op == ASYNC_WRITE) ? "write" : "read"));
+    command_aborted(channel, BX_SELECTED_CONTROLLER(channel).current_command);
+    return;
+  }
+  while (sector_count-- > 0)
+    increment_address(channel);
+
+  if (op == ASYNC_WRITE) {
+    ide_write_complete(channel);
+  } else {
+    BX_SELECTED_CONTROLLER(channel).error_register = 0;
+    BX_SELECTED_CONTROLLER(channel).status.busy  = 0;
+    BX_SELECTED_CONTROLLER(channel).status.drive_ready = 1;
+    BX_SELECTED_CONTROLLER(channel).status.seek_complete = 1;
+    BX_SELECTED_CONTROLLER(channel).status.drq   = 1;
+    BX_SELECTED_CONTROLLER(channel).status.corrected_data = 0;
+    BX_SELECTED_CONTROLLER(channel).buffer_index = 0;
+    raise_interrupt(channel);
+  }
+}
+
 void bx_hard_drive_c::lba48_transform(Bit8u channel, bx_bool lba48)
 {
   BX_SELECTED_CONTROLLER(channel).lba48 = lba48;
@@ -23,6 +23,14 @@
 
 #define MAX_MULTIPLE_SECTORS 16
 
+// outstanding asynchronous transfer of a channel
+#define ASYNC_NONE  0
+#define ASYNC_READ  1
+#define ASYNC_WRITE 2
+
+// interval of the metadata write-back of the disk images (usec)
+#define BX_HD_FLUSH_INTERVAL 5000000
+
 typedef enum _sense {
       SENSE_NONE = 0, SENSE_NOT_READY = 2, SENSE_ILLEGAL_REQUEST = 5,
       SENSE_UNIT_ATTENTION = 6
@@ -38,6 +46,7 @@ typedef enum _asc {
 } asc_t;
 
 class device_image_t;
+class image_io_thread_t;
 class LOWLEVEL_CDROM;
 
 typedef struct {
@@ -175,9 +184,13 @@ public:
 #if BX_SUPPORT_PCI
   virtual bx_bool  bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
   virtual bx_bool  bmdma_write_sector(Bit8u channel, Bit8u *buffer);
+  virtual int      bmdma_transfer(Bit8u channel, bx_bool read, const bx_iovec_t *iov, int iovcnt, Bit32u len);
   virtual void     bmdma_complete(Bit8u channel);
 #endif
   virtual void     register_state(void);
+  virtual void     after_restore_state(void);
+  virtual void     before_clone(void);
+  virtual void     after_clone(void);
 
   virtual Bit32u virt_read_handler(Bit32u address, unsigned io_len)
   {
@@ -198,11 +211,16 @@ public:
 
   static void iolight_timer_handler(void *);
   BX_HD_SMF void iolight_timer(void);
+  static void async_timer_handler(void *);
+  BX_HD_SMF void async_timer(void);
+  static void flush_timer_handler(void *);
+  BX_HD_SMF void flush_timer(void);
 
 private:
 
   BX_HD_SMF bx_bool calculate_logical_address(Bit8u channel, Bit64s *sector) BX_CPP_AttrRegparmN(2);
   BX_HD_SMF void increment_address(Bit8u channel) BX_CPP_AttrRegparmN(1);
+  BX_HD_SMF bx_bool check_sector_range(Bit8u channel, Bit64s sector, int count) BX_CPP_AttrRegparmN(3);
   BX_HD_SMF void identify_drive(Bit8u channel);
   BX_HD_SMF void identify_ATAPI_drive(Bit8u channel);
   BX_HD_SMF void command_aborted(Bit8u channel, unsigned command);
@@ -217,6 +235,10 @@ private:
   BX_HD_SMF void set_signature(Bit8u channel, Bit8u id);
   BX_HD_SMF bx_bool ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u buffer_size);
   BX_HD_SMF bx_bool ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u buffer_size);
+  BX_HD_SMF void ide_write_complete(Bit8u channel);
+  BX_HD_SMF void ide_async_start(Bit8u channel, Bit8u op);
+  BX_HD_SMF void ide_async_finish(Bit8u channel, Bit64s ret);
+  BX_HD_SMF void ide_async_complete(Bit8u channel, bx_bool wait);
   BX_HD_SMF void lba48_transform(Bit8u channel, bx_bool lba48);
 
   // FIXME:
@@ -242,9 +264,13 @@ private:
       int statusbar_id;
       int iolight_counter;
       Bit8u device_num; // for ATAPI identify & inquiry
+      bx_bool async_io; // disk transfers done by the channel's i/o thread
     } drives[2];
     unsigned drive_select;
 
+    image_io_thread_t *io_thread;
+    Bit8u  async_op;  // ASYNC_READ / ASYNC_WRITE while a transfer is running
+
     Bit16u ioaddr1;
     Bit16u ioaddr2;
     Bit8u  irq;
@@ -252,6 +278,8 @@ private:
   } channels[BX_MAX_ATA_CHANNEL];
 
   int iolight_timer_index;
+  int async_timer_index;
+  int flush_timer_index;
   Bit8u cdrom_count;
 };
 
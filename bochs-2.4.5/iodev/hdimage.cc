@@ -41,6 +41,163 @@ device_image_t::device_image_t()
   hd_size = 0;
 }
 
+ssize_t device_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+
+  for (unsigned i = 0; i < count; i++) {
+    if (lseek((Bit64s)(sector + i) * 512, SEEK_SET) < 0)
+      return -1;
+    if (read(bufptr, 512) != 512)
+      return -1;
+    bufptr += 512;
+  }
+  return (ssize_t)count * 512;
+}
+
+ssize_t device_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+
+  for (unsigned i = 0; i < count; i++) {
+    if (lseek((Bit64s)(sector + i) * 512, SEEK_SET) < 0)
+      return -1;
+    if (write(bufptr, 512) != 512)
+      return -1;
+    bufptr += 512;
+  }
+  return (ssize_t)count * 512;
+}
+
+static size_t bx_iovec_size(const bx_iovec_t *iov, int iovcnt)
+{
+  size_t size = 0;
+  for (int i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
+  return size;
+}
+
+ssize_t device_image_t::readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
+{
+  size_t size = bx_iovec_size(iov, iovcnt);
+  Bit8u *buf = new Bit8u[size], *bufptr = buf;
+  ssize_t ret = read_sectors(sector, buf, (unsigned)(size / 512));
+
+  if (ret == (ssize_t)size) {
+    for (int i = 0; i < iovcnt; i++) {
+      memcpy(iov[i].iov_base, bufptr, iov[i].iov_len);
+      bufptr += iov[i].iov_len;
+    }
+  }
+  delete [] buf;
+  return ret;
+}
+
+ssize_t device_image_t::writev_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
+{
+  size_t size = bx_iovec_size(iov, iovcnt);
+  Bit8u *buf = new Bit8u[size], *bufptr = buf;
+
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(bufptr, iov[i].iov_base, iov[i].iov_len);
+    bufptr += iov[i].iov_len;
+  }
+  ssize_t ret = write_sectors(sector, buf, (unsigned)(size / 512));
+  delete [] buf;
+  return ret;
+}
+
+// positional read / write on a file descriptor, retried until the whole
+// buffer is transferred or the end of the file is reached
+static ssize_t bx_pread(int fd, void* buf, size_t count, Bit64s offset)
+{
+#ifdef WIN32
+  if (::lseek(fd, (off_t)offset, SEEK_SET) < 0)
+    return -1;
+  return ::read(fd, (char*) buf, count);
+#else
+  size_t done = 0;
+  while (done < count) {
+    ssize_t ret = ::pread(fd, (char*) buf + done, count - done, (off_t)(offset + done));
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (ret == 0) break;
+    done += ret;
+  }
+  return (ssize_t)done;
+#endif
+}
+
+static ssize_t bx_pwrite(int fd, const void* buf, size_t count, Bit64s offset)
+{
+#ifdef WIN32
+  if (::lseek(fd, (off_t)offset, SEEK_SET) < 0)
+    return -1;
+  return ::write(fd, (const char*) buf, count);
+#else
+  size_t done = 0;
+  while (done < count) {
+    ssize_t ret = ::pwrite(fd, (const char*) buf + done, count - done, (off_t)(offset + done));
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    done += ret;
+  }
+  return (ssize_t)done;
+#endif
+}
+
+// Grows or truncates the file to new_size bytes, a new part reads back
+// as zeroes
+static int bx_set_filesize(int fd, Bit64s new_size)
+{
+#ifdef WIN32
+  return (_chsize_s(fd, new_size) == 0) ? 0 : -1;
+#else
+  return ftruncate(fd, (off_t)new_size);
+#endif
+}
+
+#if BX_HAVE_PREADV
+// same as bx_pread() / bx_pwrite() for a scatter/gather list
+static ssize_t bx_preadwritev(int fd, const bx_iovec_t *iov, int iovcnt, Bit64s offset, bx_bool write)
+{
+  bx_iovec_t *vec = new bx_iovec_t[iovcnt];
+  ssize_t done = 0, ret;
+  int i = 0;
+
+  memcpy(vec, iov, iovcnt * sizeof(bx_iovec_t));
+  while (i < iovcnt) {
+    if (write) {
+      ret = ::pwritev(fd, vec + i, iovcnt - i, (off_t)(offset + done));
+    } else {
+      ret = ::preadv(fd, vec + i, iovcnt - i, (off_t)(offset + done));
+    }
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      done = -1;
+      break;
+    }
+    if (ret == 0) break;
+    done += ret;
+    // skip the entries already transferred
+    while ((i < iovcnt) && ((size_t)ret >= vec[i].iov_len)) {
+      ret -= vec[i].iov_len;
+      i++;
+    }
+    if (ret > 0) {
+      vec[i].iov_base = (char*) vec[i].iov_base + ret;
+      vec[i].iov_len -= ret;
+    }
+  }
+  delete [] vec;
+  return done;
+}
+#endif
+
 /*** default_image_t function definitions ***/
 
 int default_image_t::open(const char* pathname)
@@ -114,6 +271,28 @@ ssize_t default_image_t::write(const void* buf, size_t count)
   return ::write(fd, (char*) buf, count);
 }
 
+ssize_t default_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  return bx_pread(fd, buf, (size_t)count * 512, (Bit64s)sector * 512);
+}
+
+ssize_t default_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  return bx_pwrite(fd, buf, (size_t)count * 512, (Bit64s)sector * 512);
+}
+
+#if BX_HAVE_PREADV
+ssize_t default_image_t::readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
+{
+  return bx_preadwritev(fd, iov, iovcnt, (Bit64s)sector * 512, 0);
+}
+
+ssize_t default_image_t::writev_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
+{
+  return bx_preadwritev(fd, iov, iovcnt, (Bit64s)sector * 512, 1);
+}
+#endif
+
 char increment_string(char *str, int diff)
 {
   // find the last character of the string, and increment it.
@@ -260,16 +439,54 @@ ssize_t concat_image_t::write(const void* buf, size_t count)
   return ::write(fd, (char*) buf, count);
 }
 
+// split the transfer at the boundaries of the partial images
+ssize_t concat_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  Bit64s offset = (Bit64s)sector * 512;
+  size_t left = (size_t)count * 512, done = 0;
+
+  for (int i=0; (i<maxfd) && (left > 0); i++) {
+    Bit64s end = start_offset_table[i] + length_table[i];
+    if (offset >= end) continue;
+    size_t len = (left < (size_t)(end - offset)) ? left : (size_t)(end - offset);
+    if (bx_pread(fd_table[i], (Bit8u*) buf + done, len, offset - start_offset_table[i]) != (ssize_t)len)
+      return -1;
+    offset += len;
+    done += len;
+    left -= len;
+  }
+  return (ssize_t)done;
+}
+
+ssize_t concat_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  Bit64s offset = (Bit64s)sector * 512;
+  size_t left = (size_t)count * 512, done = 0;
+
+  for (int i=0; (i<maxfd) && (left > 0); i++) {
+    Bit64s end = start_offset_table[i] + length_table[i];
+    if (offset >= end) continue;
+    size_t len = (left < (size_t)(end - offset)) ? left : (size_t)(end - offset);
+    if (bx_pwrite(fd_table[i], (const Bit8u*) buf + done, len, offset - start_offset_table[i]) != (ssize_t)len)
+      return -1;
+    offset += len;
+    done += len;
+    left -= len;
+  }
+  return (ssize_t)done;
+}
+
 /*** sparse_image_t function definitions ***/
 
-sparse_image_t::sparse_image_t ()
+sparse_image_t::sparse_image_t (unsigned prealloc)
 {
   fd = -1;
   pathname = NULL;
-#ifdef _POSIX_MAPPED_FILES
-  mmap_header = NULL;
-#endif
   pagetable = NULL;
+  dirty_map = NULL;
+  dirty_blocks = 0;
+  prealloc_pages = prealloc;
+  parent_image = NULL;
 }
 
 /*
@@ -334,46 +551,31 @@ void sparse_image_t::read_header()
  data_start = 0;
  while ((size_t)data_start < preamble_size) data_start += pagesize;
 
- bx_bool did_mmap = 0;
+ // The page table is a private copy: a shared mapping of the file would let
+ // the kernel write back entries of pages whose data is not yet stored.
+ pagetable = new Bit32u[numpages];
 
-#ifdef _POSIX_MAPPED_FILES
-// Try to memory map from the beginning of the file (0 is trivially a page multiple)
- void * mmap_header = mmap(NULL, preamble_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
- if (mmap_header == MAP_FAILED)
+ if (pagetable == NULL)
  {
-   BX_INFO(("failed to mmap sparse disk file - using conventional file access"));
-   mmap_header = NULL;
+   panic("could not allocate memory for sparse disk block table");
  }
- else
+
+ ret = ::read(fd, pagetable, sizeof(Bit32u) * numpages);
+
+ if (-1 == ret)
  {
-   mmap_length = preamble_size;
-   did_mmap = 1;
-   pagetable = ((Bit32u *) (((Bit8u *) mmap_header) + sizeof(header)));
-   system_pagesize_mask = getpagesize() - 1;
+     panic(strerror(errno));
  }
-#endif
 
- if (!did_mmap)
+ if ((int)(sizeof(Bit32u) * numpages) != ret)
  {
-   pagetable = new Bit32u[numpages];
-
-   if (pagetable == NULL)
-   {
-     panic("could not allocate memory for sparse disk block table");
-   }
-
-   ret = ::read(fd, pagetable, sizeof(Bit32u) * numpages);
-
-   if (-1 == ret)
-   {
-       panic(strerror(errno));
-   }
-
-   if ((int)(sizeof(Bit32u) * numpages) != ret)
-   {
-     panic("could not read entire block table");
-   }
+   panic("could not read entire block table");
  }
+
+ Bit32u table_blocks = (numpages + SPARSE_TABLE_BLOCK_ENTRIES - 1) / SPARSE_TABLE_BLOCK_ENTRIES;
+ dirty_map = new Bit8u[(table_blocks + 7) / 8];
+ memset(dirty_map, 0, (table_blocks + 7) / 8);
+ dirty_blocks = 0;
 }
 
 int sparse_image_t::open (const char* pathname0)
@@ -398,7 +600,7 @@ int sparse_image_t::open (const char* pathname0)
   struct stat stat_buf;
   if (fstat(fd, &stat_buf) != 0) panic(("fstat() returns error!"));
 
-  underlying_filesize = stat_buf.st_size;
+  underlying_filesize = allocated_filesize = stat_buf.st_size;
 
   if ((underlying_filesize % pagesize) != 0)
     panic("size of sparse disk image is not multiple of page size");
@@ -442,19 +644,18 @@ int sparse_image_t::open (const char* pathname0)
 void sparse_image_t::close()
 {
   BX_DEBUG(("concat_image_t.close"));
-  if (pathname != NULL)
+  if (fd > -1)
   {
-    free(pathname);
+    if (flush_cache() < 0)
+      BX_ERROR(("sparse: could not write back the page table of %s", pathname));
+    // drop the preallocated pages that were not used
+    if ((allocated_filesize > underlying_filesize) && (bx_set_filesize(fd, underlying_filesize) < 0))
+      BX_ERROR(("sparse: could not truncate %s", pathname));
   }
-#ifdef _POSIX_MAPPED_FILES
-  if (mmap_header != NULL)
+  if (pathname != NULL)
   {
-    int ret = munmap(mmap_header, mmap_length);
-    if (ret != 0)
-      BX_INFO(("failed to un-memory map sparse disk file"));
+    free(pathname);
   }
-  pagetable = NULL; // We didn't malloc it
-#endif
   if (fd > -1) {
     ::close(fd);
   }
@@ -462,6 +663,10 @@ void sparse_image_t::close()
   {
     delete [] pagetable;
   }
+  if (dirty_map != NULL)
+  {
+    delete [] dirty_map;
+  }
   if (parent_image != NULL)
   {
     delete parent_image;
@@ -614,9 +819,6 @@ ssize_t sparse_image_t::write (const void* buf, size_t count)
 
   ssize_t total_written = 0;
 
-  Bit32u update_pagetable_start = position_virtual_page;
-  Bit32u update_pagetable_count = 0;
-
   BX_DEBUG(("sparse_image_t.write %ld bytes", (long)count));
 
   while (count != 0)
@@ -640,7 +842,29 @@ ssize_t sparse_image_t::write (const void* buf, size_t count)
       pagetable[position_virtual_page] = htod32(next_data_page);
       position_physical_page = next_data_page;
 
+      // the entry is written back later by flush_cache()
+      Bit32u block = position_virtual_page / SPARSE_TABLE_BLOCK_ENTRIES;
+      if (!(dirty_map[block >> 3] & (1 << (block & 7))))
+      {
+        dirty_map[block >> 3] |= (1 << (block & 7));
+        dirty_blocks++;
+      }
+
       Bit64s page_file_start = data_start + ((Bit64s)position_physical_page << pagesize_shift);
+      Bit64s page_file_end = page_file_start + pagesize;
+
+      // A partly written page must read back zeroes for the rest, so the
+      // file is grown (by a run of pages if preallocation is enabled).
+      // Whole pages extend the file by themselves.
+      if ((page_file_end > allocated_filesize) &&
+          ((prealloc_pages > 0) || ((parent_image == NULL) && (can_write != pagesize))))
+      {
+        Bit64s new_size = page_file_end + ((Bit64s)prealloc_pages << pagesize_shift);
+        if ((new_size - data_start) > total_size)
+          new_size = data_start + total_size;
+        if (bx_set_filesize(fd, new_size) < 0) panic(strerror(errno));
+        allocated_filesize = new_size;
+      }
 
       if (parent_image != NULL)
       {
@@ -677,26 +901,12 @@ ssize_t sparse_image_t::write (const void* buf, size_t count)
         {
           free(writebuffer);
         }
-      }
-      else
-      {
-        // We need to write a zero page because read has been returning zeroes
-        // We seek as close to the page end as possible, and then write a little
-        // This produces a sparse file which has blanks
-        // Also very quick, even when pagesize is massive
-        int ret = (int)::lseek(fd, page_file_start + pagesize - 4, SEEK_SET);
-        // underlying_current_filepos update deferred
-        if (ret == -1) panic(strerror(errno));
-
-        Bit32u zero = 0;
-        ret = ::write(fd, &zero, 4);
-        if (ret == -1) panic(strerror(errno));
-
-        if (ret != 4) panic("failed to write entire blank page to disk");
+        underlying_current_filepos = page_file_end;
       }
 
-      update_pagetable_count = (position_virtual_page - update_pagetable_start) + 1;
-      underlying_filesize = underlying_current_filepos = page_file_start + pagesize;
+      underlying_filesize = page_file_end;
+      if (allocated_filesize < page_file_end)
+        allocated_filesize = page_file_end;
     }
 
     BX_ASSERT(position_physical_page != SPARSE_PAGE_NOT_ALLOCATED);
@@ -741,44 +951,71 @@ ssize_t sparse_image_t::write (const void* buf, size_t count)
     count -= can_write;
   }
 
-  if (update_pagetable_count != 0)
-  {
-    bx_bool done = 0;
-    off_t pagetable_write_from = sizeof(header) + (sizeof(Bit32u) * update_pagetable_start);
-    size_t write_bytecount = update_pagetable_count * sizeof(Bit32u);
-
-#ifdef _POSIX_MAPPED_FILES
-    if (mmap_header != NULL)
-    {
-      // Sync from the beginning of the page
-      size_t system_page_offset = pagetable_write_from & system_pagesize_mask;
-      void *start = ((Bit8u *) mmap_header + pagetable_write_from - system_page_offset);
-
-      int ret = msync(start, system_page_offset + write_bytecount, MS_ASYNC);
+  return total_written;
+}
 
-      if (ret != 0)
-        panic(strerror(errno));
+int sparse_image_t::flush_cache()
+{
+  Bit32u numpages = dtoh32(header.numpages);
+  Bit32u table_blocks = (numpages + SPARSE_TABLE_BLOCK_ENTRIES - 1) / SPARSE_TABLE_BLOCK_ENTRIES;
+  Bit32u block = 0, last;
 
-      done = 1;
-    }
+  if (dirty_blocks == 0)
+    return 0;
+#ifndef WIN32
+  // the data must be stored before the page table entries pointing to it
+  if (fsync(fd) < 0)
+    return -1;
 #endif
-
-    if (!done)
+  while (block < table_blocks)
+  {
+    if (!(dirty_map[block >> 3] & (1 << (block & 7))))
     {
-      int ret = (int)::lseek(fd, pagetable_write_from, SEEK_SET);
-      // underlying_current_filepos update deferred
-      if (ret == -1) panic(strerror(errno));
-
-      //printf("Writing header at position %ld size %ld\n", (long) pagetable_write_from, (long) write_bytecount);
-      ret = ::write(fd, &pagetable[update_pagetable_start], write_bytecount);
-      if (ret == -1) panic(strerror(errno));
-      if ((size_t)ret != write_bytecount) panic("could not write entire updated block header");
+      block++;
+      continue;
+    }
+    // write back a run of adjacent dirty blocks at once
+    last = block;
+    while (((last + 1) < table_blocks) && (dirty_map[(last + 1) >> 3] & (1 << ((last + 1) & 7))))
+      last++;
+
+    Bit32u first_entry = block * SPARSE_TABLE_BLOCK_ENTRIES;
+    Bit32u end_entry = (last + 1) * SPARSE_TABLE_BLOCK_ENTRIES;
+    if (end_entry > numpages) end_entry = numpages;
+    Bit64s offset = sizeof(header) + ((Bit64s)first_entry * sizeof(Bit32u));
+    size_t len = (end_entry - first_entry) * sizeof(Bit32u);
+
+    if (bx_pwrite(fd, &pagetable[first_entry], len, offset) != (ssize_t)len)
+      return -1;
+    // bx_pwrite() may move the file position
+    underlying_current_filepos = -1;
 
-      underlying_current_filepos = pagetable_write_from + write_bytecount;
+    for (; block <= last; block++)
+    {
+      dirty_map[block >> 3] &= ~(1 << (block & 7));
+      dirty_blocks--;
     }
   }
+#ifndef WIN32
+  if (fsync(fd) < 0)
+    return -1;
+#endif
+  return 0;
+}
 
-  return total_written;
+// the page table is in memory, so one seek covers the whole transfer
+ssize_t sparse_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  if (lseek((Bit64s)sector * 512, SEEK_SET) < 0)
+    return -1;
+  return read(buf, (size_t)count * 512);
+}
+
+ssize_t sparse_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  if (lseek((Bit64s)sector * 512, SEEK_SET) < 0)
+    return -1;
+  return write(buf, (size_t)count * 512);
 }
 
 #if DLL_HD_SUPPORT
@@ -854,14 +1091,17 @@ ssize_t dll_image_t::write (const void* buf, size_t count)
 #endif // DLL_HD_SUPPORT
 
 // redolog implementation
-redolog_t::redolog_t()
+redolog_t::redolog_t(bx_bool _is_volatile)
 {
   fd = -1;
+  is_volatile = _is_volatile;
   catalog = NULL;
-  bitmap = NULL;
   extent_index = (Bit32u)0;
   extent_offset = (Bit32u)0;
   extent_next = (Bit32u)0;
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    bitmap_cache[i].bitmap = NULL;
+  }
 }
 
 void redolog_t::print_header()
@@ -887,9 +1127,9 @@ void redolog_t::print_header()
   }
 }
 
-int redolog_t::make_header(const char* type, Bit64u size)
+int redolog_t::make_header(const char* type, Bit64u size, Bit32u extent_size)
 {
-  Bit32u entries, extent_size, bitmap_size;
+  Bit32u entries, bitmap_size;
   Bit64u maxsize;
   Bit32u flip=0;
 
@@ -900,48 +1140,82 @@ int redolog_t::make_header(const char* type, Bit64u size)
   header.standard.version = htod32(STANDARD_HEADER_VERSION);
   header.standard.header = htod32(STANDARD_HEADER_SIZE);
 
-  entries = 512;
-  bitmap_size = 1;
+  if ((extent_size != 0) && ((extent_size < 4096) || ((extent_size & (extent_size - 1)) != 0))) {
+    BX_ERROR(("redolog : extent size %d is not a power of 2 of at least 4096, using default", extent_size));
+    extent_size = 0;
+  }
 
-  // Compute #entries and extent size values
-  do {
-    extent_size = 8 * bitmap_size * 512;
+  if (extent_size != 0) {
+    // Fixed extent size, the catalog gets as many entries as needed
+    bitmap_size = extent_size / (8 * 512);
+    entries = (Bit32u)((size + extent_size - 1) / extent_size);
+    if (entries == 0) entries = 1;
 
     header.specific.catalog = htod32(entries);
     header.specific.bitmap = htod32(bitmap_size);
     header.specific.extent = htod32(extent_size);
+  } else {
+    entries = 512;
+    bitmap_size = 1;
+
+    // Compute #entries and extent size values
+    do {
+      extent_size = 8 * bitmap_size * 512;
 
-    maxsize = (Bit64u)entries * (Bit64u)extent_size;
+      header.specific.catalog = htod32(entries);
+      header.specific.bitmap = htod32(bitmap_size);
+      header.specific.extent = htod32(extent_size);
 
-    flip++;
+      maxsize = (Bit64u)entries * (Bit64u)extent_size;
 
-    if(flip&0x01) bitmap_size *= 2;
-    else entries *= 2;
-  } while (maxsize < size);
+      flip++;
+
+      if(flip&0x01) bitmap_size *= 2;
+      else entries *= 2;
+    } while (maxsize < size);
+  }
 
   header.specific.disk = htod64(size);
 
   print_header();
 
   catalog = (Bit32u*)malloc(dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap = (Bit8u*)malloc(dtoh32(header.specific.bitmap));
 
-  if ((catalog == NULL) || (bitmap==NULL))
-    BX_PANIC(("redolog : could not malloc catalog or bitmap"));
+  if (catalog == NULL)
+    BX_PANIC(("redolog : could not malloc catalog"));
 
   for (Bit32u i=0; i<dtoh32(header.specific.catalog); i++)
     catalog[i] = htod32(REDOLOG_PAGE_NOT_ALLOCATED);
 
+  return init_cache();
+}
+
+// Sets up the bitmap cache once the header and the catalog are known
+int redolog_t::init_cache()
+{
   bitmap_blocs = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
   extent_blocs = 1 + (dtoh32(header.specific.extent) - 1) / 512;
 
   BX_DEBUG(("redolog : each bitmap is %d blocs", bitmap_blocs));
   BX_DEBUG(("redolog : each extent is %d blocs", extent_blocs));
 
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    bitmap_cache[i].index = REDOLOG_PAGE_NOT_ALLOCATED;
+    bitmap_cache[i].bitmap = (Bit8u*)malloc(dtoh32(header.specific.bitmap));
+    if (bitmap_cache[i].bitmap == NULL) {
+      BX_PANIC(("redolog : could not malloc bitmap"));
+      return -1;
+    }
+    bitmap_cache[i].dirty = 0;
+    bitmap_cache[i].last_use = 0;
+  }
+  use_counter = 0;
+  catalog_dirty_first = REDOLOG_PAGE_NOT_ALLOCATED;
+  catalog_dirty_last = 0;
   return 0;
 }
 
-int redolog_t::create(const char* filename, const char* type, Bit64u size)
+int redolog_t::create(const char* filename, const char* type, Bit64u size, Bit32u extent_size)
 {
   BX_INFO(("redolog : creating redolog %s", filename));
 
@@ -951,10 +1225,10 @@ int redolog_t::create(const char* filename, const char* type, Bit64u size)
 #endif
             , S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP);
 
-  return create(filedes, type, size);
+  return create(filedes, type, size, extent_size);
 }
 
-int redolog_t::create(int filedes, const char* type, Bit64u size)
+int redolog_t::create(int filedes, const char* type, Bit64u size, Bit32u extent_size)
 {
   fd = filedes;
 
@@ -963,7 +1237,7 @@ int redolog_t::create(int filedes, const char* type, Bit64u size)
     return -1; // open failed
   }
 
-  if (make_header(type, size) < 0)
+  if (make_header(type, size, extent_size) < 0)
   {
     return -1;
   }
@@ -975,6 +1249,8 @@ int redolog_t::create(int filedes, const char* type, Bit64u size)
   // FIXME could mmap
   ::write(fd, catalog, dtoh32(header.specific.catalog) * sizeof (Bit32u));
 
+  file_size = dtoh32(header.standard.header) + dtoh32(header.specific.catalog) * sizeof(Bit32u);
+
   return 0;
 }
 
@@ -1057,28 +1333,29 @@ int redolog_t::open(const char* filename, const char *type)
   }
   BX_INFO(("redolog : next extent will be at index %d",extent_next));
 
-  // memory used for storing bitmaps
-  bitmap = (Bit8u *)malloc(dtoh32(header.specific.bitmap));
-
-  bitmap_blocs = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
-  extent_blocs = 1 + (dtoh32(header.specific.extent) - 1) / 512;
-
-  BX_DEBUG(("redolog : each bitmap is %d blocs", bitmap_blocs));
-  BX_DEBUG(("redolog : each extent is %d blocs", extent_blocs));
+  file_size = ::lseek(fd, 0, SEEK_END);
 
-  return 0;
+  return init_cache();
 }
 
 void redolog_t::close()
 {
-  if (fd >= 0)
+  if (fd >= 0) {
+    if (!is_volatile && (flush_cache() < 0))
+      BX_ERROR(("redolog : could not write back bitmaps and catalog"));
     ::close(fd);
+    fd = -1;
+  }
 
   if (catalog != NULL)
     free(catalog);
+  catalog = NULL;
 
-  if (bitmap != NULL)
-    free(bitmap);
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if (bitmap_cache[i].bitmap != NULL)
+      free(bitmap_cache[i].bitmap);
+    bitmap_cache[i].bitmap = NULL;
+  }
 }
 
 Bit64u redolog_t::get_size()
@@ -1112,37 +1389,15 @@ Bit64s redolog_t::lseek(Bit64s offset, int whence)
 
 ssize_t redolog_t::read(void* buf, size_t count)
 {
-  Bit64s bloc_offset, bitmap_offset;
+  Bit64u sector = (Bit64u)extent_index * extent_blocs + extent_offset;
+  bx_bool present;
 
   if (count != 512)
     BX_PANIC(("redolog : read HD with count not 512"));
 
   BX_DEBUG(("redolog : reading index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
 
-  if (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED)
-  {
-    // page not allocated
-    return 0;
-  }
-
-  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocs + bitmap_blocs);
-  bloc_offset    = bitmap_offset + ((Bit64s)512 * (bitmap_blocs + extent_offset));
-
-  BX_DEBUG(("redolog : bitmap offset is %x", (Bit32u)bitmap_offset));
-  BX_DEBUG(("redolog : bloc offset is %x", (Bit32u)bloc_offset));
-
-  // FIXME if same extent_index as before we can skip bitmap read
-
-  ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-
-  if (::read(fd, bitmap,  dtoh32(header.specific.bitmap)) != (ssize_t)dtoh32(header.specific.bitmap))
-  {
-    BX_PANIC(("redolog : failed to read bitmap for extent %d", extent_index));
-    return 0;
-  }
-
-  if (((bitmap[extent_offset/8] >> (extent_offset%8)) & 0x01) == 0x00)
+  if ((find_run(sector, 1, &present) != 1) || !present)
   {
     BX_DEBUG(("read not in redolog"));
 
@@ -1150,108 +1405,266 @@ ssize_t redolog_t::read(void* buf, size_t count)
     return 0;
   }
 
-  ::lseek(fd, (off_t)bloc_offset, SEEK_SET);
-
-  return (::read(fd, buf, count));
+  return read_sectors(sector, buf, 1, NULL);
 }
 
 ssize_t redolog_t::write(const void* buf, size_t count)
 {
-  Bit32u i;
-  Bit64s bloc_offset, bitmap_offset, catalog_offset;
-  ssize_t written;
-  bx_bool update_catalog = 0;
-
   if (count != 512)
     BX_PANIC(("redolog : write HD with count not 512"));
 
   BX_DEBUG(("redolog : writing index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
-  if (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED)
-  {
-    if (extent_next >= dtoh32(header.specific.catalog))
-    {
-      BX_PANIC(("redolog : can't allocate new extent... catalog is full"));
-      return 0;
-    }
 
-    BX_DEBUG(("redolog : allocating new extent at %d", extent_next));
-
-    // Extent not allocated, allocate new
-    catalog[extent_index] = htod32(extent_next);
-
-    extent_next += 1;
+  return write_sectors((Bit64u)extent_index * extent_blocs + extent_offset, buf, 1);
+}
 
-    char *zerobuffer = (char*)malloc(512);
-    memset(zerobuffer, 0, 512);
+// file offset of the bitmap of an allocated extent, the blocs follow it
+Bit64s redolog_t::get_bitmap_offset(Bit32u index)
+{
+  Bit64s bitmap_offset;
 
-    // Write bitmap
-    bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-    bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocs + bitmap_blocs);
-    ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-    for (i=0; i<bitmap_blocs; i++)
-    {
-      ::write(fd, zerobuffer, 512);
-    }
-    // Write extent
-    for (i=0; i<extent_blocs; i++)
-    {
-      ::write(fd, zerobuffer, 512);
-    }
+  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
+  bitmap_offset += (Bit64s)512 * dtoh32(catalog[index]) * (extent_blocs + bitmap_blocs);
+  return bitmap_offset;
+}
 
-    free(zerobuffer);
+int redolog_t::write_bitmap(int slot)
+{
+  Bit32u size = dtoh32(header.specific.bitmap);
 
-    update_catalog = 1;
+  if (bx_pwrite(fd, bitmap_cache[slot].bitmap, size, get_bitmap_offset(bitmap_cache[slot].index)) != (ssize_t)size) {
+    BX_ERROR(("redolog : failed to write bitmap for extent %d", bitmap_cache[slot].index));
+    return -1;
   }
+  bitmap_cache[slot].dirty = 0;
+  return 0;
+}
 
-  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocs + bitmap_blocs);
-  bloc_offset    = bitmap_offset + ((Bit64s)512 * (bitmap_blocs + extent_offset));
+// Returns the cache slot holding the bitmap of extent 'index', -1 if the
+// extent is not allocated and 'alloc' is not set and -2 on error. A new
+// extent is added at the end of the file with an empty bitmap.
+int redolog_t::get_bitmap(Bit32u index, bx_bool alloc)
+{
+  Bit32u size = dtoh32(header.specific.bitmap);
+  bx_bool create = 0;
+  int i, slot = 0;
 
-  BX_DEBUG(("redolog : bitmap offset is %x", (Bit32u)bitmap_offset));
-  BX_DEBUG(("redolog : bloc offset is %x", (Bit32u)bloc_offset));
+  if (dtoh32(catalog[index]) == REDOLOG_PAGE_NOT_ALLOCATED) {
+    if (!alloc) return -1;
+    if (extent_next >= dtoh32(header.specific.catalog)) {
+      BX_PANIC(("redolog : can't allocate new extent... catalog is full"));
+      return -2;
+    }
 
-  // Write bloc
-  ::lseek(fd, (off_t)bloc_offset, SEEK_SET);
-  written = ::write(fd, buf, count);
+    BX_DEBUG(("redolog : allocating new extent at %d", extent_next));
 
-  // Write bitmap
-  // FIXME if same extent_index as before we can skip bitmap read
-  ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-  if (::read(fd, bitmap,  dtoh32(header.specific.bitmap)) != (ssize_t)dtoh32(header.specific.bitmap))
-  {
-    BX_PANIC(("redolog : failed to read bitmap for extent %d", extent_index));
-    return 0;
+    catalog[index] = htod32(extent_next);
+    extent_next += 1;
+    if (index < catalog_dirty_first) catalog_dirty_first = index;
+    if (index > catalog_dirty_last) catalog_dirty_last = index;
+
+    // grow the file by the whole extent, the new blocs read back as zeroes
+    Bit64s extent_end = get_bitmap_offset(index) + (Bit64s)512 * (bitmap_blocs + extent_blocs);
+    if (extent_end > file_size) {
+      if (bx_set_filesize(fd, extent_end) < 0) {
+        BX_ERROR(("redolog : could not grow file for extent %d", index));
+        return -2;
+      }
+      file_size = extent_end;
+    }
+    create = 1;
+  } else {
+    for (i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+      if (bitmap_cache[i].index == index) {
+        bitmap_cache[i].last_use = ++use_counter;
+        return i;
+      }
+    }
   }
-
-  // If bloc does not belong to extent yet
-  if (((bitmap[extent_offset/8] >> (extent_offset%8)) & 0x01) == 0x00)
-  {
-    bitmap[extent_offset/8] |= 1 << (extent_offset%8);
-    ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-    ::write(fd, bitmap,  dtoh32(header.specific.bitmap));
+  // replace the least recently used bitmap
+  for (i = 1; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if (bitmap_cache[i].last_use < bitmap_cache[slot].last_use)
+      slot = i;
   }
+  if (bitmap_cache[slot].dirty) {
+#ifndef WIN32
+    // the blocs must be stored before the bitmap pointing to them
+    if (!is_volatile)
+      fsync(fd);
+#endif
+    if (write_bitmap(slot) < 0)
+      return -2;
+  }
+  bitmap_cache[slot].index = index;
+  bitmap_cache[slot].last_use = ++use_counter;
+  if (create) {
+    memset(bitmap_cache[slot].bitmap, 0, size);
+    bitmap_cache[slot].dirty = 1;
+  } else {
+    if (bx_pread(fd, bitmap_cache[slot].bitmap, size, get_bitmap_offset(index)) != (ssize_t)size) {
+      BX_PANIC(("redolog : failed to read bitmap for extent %d", index));
+      bitmap_cache[slot].index = REDOLOG_PAGE_NOT_ALLOCATED;
+      return -2;
+    }
+    bitmap_cache[slot].dirty = 0;
+  }
+  return slot;
+}
 
-  // Write catalog
-  if (update_catalog)
-  {
-    // FIXME if mmap
-    catalog_offset  = (Bit64s)STANDARD_HEADER_SIZE + (extent_index * sizeof(Bit32u));
-
-    BX_DEBUG(("redolog : writing catalog at offset %x", (Bit32u)catalog_offset));
+// Returns the number of sectors from 'sector' on (at most count) that are
+// either all stored in the redolog or all missing (*present tells which),
+// -1 on error. A run may span several extents.
+int redolog_t::find_run(Bit64u sector, unsigned count, bx_bool *present)
+{
+  unsigned run = 0;
 
-    ::lseek(fd, (off_t)catalog_offset, SEEK_SET);
-    ::write(fd, &catalog[extent_index], sizeof(Bit32u));
+  while (run < count) {
+    Bit32u index = (Bit32u)((sector + run) / extent_blocs);
+    Bit32u offset = (Bit32u)((sector + run) % extent_blocs);
+    int slot = get_bitmap(index, 0);
+    if (slot == -2) return -1;
+    if (slot < 0) {
+      // whole extent not in the redolog
+      if ((run > 0) && *present) return run;
+      *present = 0;
+      run += extent_blocs - offset;
+      continue;
+    }
+    Bit8u *bitmap = bitmap_cache[slot].bitmap;
+    for (; (run < count) && (offset < extent_blocs); run++, offset++) {
+      bx_bool bit = (bitmap[offset/8] >> (offset%8)) & 0x01;
+      if (run == 0) {
+        *present = bit;
+      } else if (bit != *present) {
+        return run;
+      }
+    }
   }
-
-  return written;
+  return count;
 }
 
-/*** growing_image_t function definitions ***/
-
-growing_image_t::growing_image_t()
+ssize_t redolog_t::read_sectors(Bit64u sector, void* buf, unsigned count, device_image_t *base)
 {
-  redolog = new redolog_t();
-}
+  Bit8u *bufptr = (Bit8u*) buf;
+  unsigned total = count;
+  bx_bool present;
+
+  if ((sector + count) * 512 > dtoh64(header.specific.disk))
+    return -1;
+  while (count > 0) {
+    int run = find_run(sector, count, &present);
+    if (run <= 0) return -1;
+    if (!present) {
+      if (base == NULL) {
+        memset(bufptr, 0, run * 512);
+      } else if (base->read_sectors(sector, bufptr, run) != (ssize_t)run * 512) {
+        return -1;
+      }
+    } else {
+      // the blocs of an extent are contiguous in the file
+      for (unsigned done = 0; done < (unsigned)run; ) {
+        Bit32u index = (Bit32u)((sector + done) / extent_blocs);
+        Bit32u offset = (Bit32u)((sector + done) % extent_blocs);
+        unsigned n = extent_blocs - offset;
+        if (n > run - done) n = run - done;
+        Bit64s bloc_offset = get_bitmap_offset(index) + ((Bit64s)512 * (bitmap_blocs + offset));
+        if (bx_pread(fd, bufptr + done * 512, n * 512, bloc_offset) != (ssize_t)n * 512) {
+          BX_ERROR(("redolog : failed to read blocs of extent %d", index));
+          return -1;
+        }
+        done += n;
+      }
+    }
+    sector += run;
+    bufptr += run * 512;
+    count -= run;
+  }
+  return (ssize_t)total * 512;
+}
+
+ssize_t redolog_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  const Bit8u *bufptr = (const Bit8u*) buf;
+  unsigned total = count;
+
+  if ((sector + count) * 512 > dtoh64(header.specific.disk))
+    return -1;
+  while (count > 0) {
+    Bit32u index = (Bit32u)(sector / extent_blocs);
+    Bit32u offset = (Bit32u)(sector % extent_blocs);
+    unsigned n = extent_blocs - offset;
+    if (n > count) n = count;
+    int slot = get_bitmap(index, 1);
+    if (slot < 0) return -1;
+
+    Bit64s bloc_offset = get_bitmap_offset(index) + ((Bit64s)512 * (bitmap_blocs + offset));
+    if (bx_pwrite(fd, bufptr, n * 512, bloc_offset) != (ssize_t)n * 512) {
+      BX_ERROR(("redolog : failed to write blocs of extent %d", index));
+      return -1;
+    }
+
+    // mark the blocs in the cached bitmap, written back later
+    Bit8u *bitmap = bitmap_cache[slot].bitmap;
+    for (unsigned i = 0; i < n; i++, offset++) {
+      if (((bitmap[offset/8] >> (offset%8)) & 0x01) == 0x00) {
+        bitmap[offset/8] |= 1 << (offset%8);
+        bitmap_cache[slot].dirty = 1;
+      }
+    }
+    sector += n;
+    bufptr += n * 512;
+    count -= n;
+  }
+  return (ssize_t)total * 512;
+}
+
+int redolog_t::flush_cache()
+{
+  bx_bool dirty = (catalog_dirty_first != REDOLOG_PAGE_NOT_ALLOCATED);
+  int i;
+
+  // the cached tables of a volatile redolog never need to be in the file
+  if (is_volatile)
+    return 0;
+  for (i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++)
+    dirty |= bitmap_cache[i].dirty;
+  if (!dirty)
+    return 0;
+#ifndef WIN32
+  // the blocs must be stored before the bitmaps and the catalog
+  if (fsync(fd) < 0)
+    return -1;
+#endif
+  for (i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if (bitmap_cache[i].dirty && (write_bitmap(i) < 0))
+      return -1;
+  }
+  if (catalog_dirty_first != REDOLOG_PAGE_NOT_ALLOCATED) {
+    Bit64s catalog_offset = (Bit64s)STANDARD_HEADER_SIZE + (catalog_dirty_first * sizeof(Bit32u));
+    size_t len = (catalog_dirty_last - catalog_dirty_first + 1) * sizeof(Bit32u);
+
+    BX_DEBUG(("redolog : writing catalog at offset %x", (Bit32u)catalog_offset));
+
+    if (bx_pwrite(fd, &catalog[catalog_dirty_first], len, catalog_offset) != (ssize_t)len) {
+      BX_ERROR(("redolog : could not write catalog"));
+      return -1;
+    }
+    catalog_dirty_first = REDOLOG_PAGE_NOT_ALLOCATED;
+    catalog_dirty_last = 0;
+  }
+#ifndef WIN32
+  if (fsync(fd) < 0)
+    return -1;
+#endif
+  return 0;
+}
+
+/*** growing_image_t function definitions ***/
+
+growing_image_t::growing_image_t()
+{
+  redolog = new redolog_t();
+}
 
 growing_image_t::~growing_image_t()
 {
@@ -1288,12 +1701,28 @@ ssize_t growing_image_t::write(const void* buf, size_t count)
   return redolog->write((char*) buf, count);
 }
 
+ssize_t growing_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  return redolog->read_sectors(sector, buf, count, NULL);
+}
+
+ssize_t growing_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(sector, buf, count);
+}
+
+int growing_image_t::flush_cache()
+{
+  return redolog->flush_cache();
+}
+
 /*** undoable_image_t function definitions ***/
 
-undoable_image_t::undoable_image_t(const char* _redolog_name)
+undoable_image_t::undoable_image_t(const char* _redolog_name, Bit32u _extent_size)
 {
   redolog = new redolog_t();
   ro_disk = new default_image_t();
+  extent_size = _extent_size;
   redolog_name = NULL;
   if (_redolog_name != NULL) {
     if (strcmp(_redolog_name,"") != 0) {
@@ -1332,7 +1761,7 @@ int undoable_image_t::open(const char* pathname)
 
   if (redolog->open(logname,REDOLOG_SUBTYPE_UNDOABLE) < 0)
   {
-    if (redolog->create(logname, REDOLOG_SUBTYPE_UNDOABLE, hd_size) < 0)
+    if (redolog->create(logname, REDOLOG_SUBTYPE_UNDOABLE, hd_size, extent_size) < 0)
     {
       BX_PANIC(("Can't open or create redolog '%s'",logname));
       return -1;
@@ -1345,143 +1774,1017 @@ int undoable_image_t::open(const char* pathname)
     }
   }
 
-  BX_INFO(("'undoable' disk opened: ro-file is '%s', redolog is '%s'", pathname, logname));
-  free(logname);
+  BX_INFO(("'undoable' disk opened: ro-file is '%s', redolog is '%s'", pathname, logname));
+  free(logname);
+
+  return 0;
+}
+
+void undoable_image_t::close ()
+{
+  redolog->close();
+  ro_disk->close();
+
+  if (redolog_name!=NULL)
+    free(redolog_name);
+}
+
+Bit64s undoable_image_t::lseek(Bit64s offset, int whence)
+{
+  redolog->lseek(offset, whence);
+  return ro_disk->lseek(offset, whence);
+}
+
+ssize_t undoable_image_t::read(void* buf, size_t count)
+{
+  // This should be fixed if count != 512
+  if ((size_t)redolog->read((char*) buf, count) != count)
+    return ro_disk->read((char*) buf, count);
+  else
+    return count;
+}
+
+ssize_t undoable_image_t::write(const void* buf, size_t count)
+{
+  return redolog->write((char*) buf, count);
+}
+
+ssize_t undoable_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  return redolog->read_sectors(sector, buf, count, ro_disk);
+}
+
+ssize_t undoable_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(sector, buf, count);
+}
+
+int undoable_image_t::flush_cache()
+{
+  return redolog->flush_cache();
+}
+
+/*** volatile_image_t function definitions ***/
+
+volatile_image_t::volatile_image_t(const char* _redolog_name, Bit32u _extent_size)
+{
+  redolog = new redolog_t(1);
+  ro_disk = new default_image_t();
+  base_image = ro_disk;
+  extent_size = _extent_size;
+  redolog_temp = NULL;
+  redolog_name = NULL;
+  if (_redolog_name != NULL) {
+    if (strcmp(_redolog_name,"") != 0) {
+      redolog_name = strdup(_redolog_name);
+    }
+  }
+}
+
+volatile_image_t::volatile_image_t(device_image_t *_base_image, const char* _redolog_name)
+{
+  redolog = new redolog_t(1);
+  ro_disk = NULL;
+  base_image = _base_image;
+  extent_size = 0;
+  redolog_temp = NULL;
+  redolog_name = NULL;
+  if (_redolog_name != NULL) {
+    if (strcmp(_redolog_name,"") != 0) {
+      redolog_name = strdup(_redolog_name);
+    }
+  }
+}
+
+volatile_image_t::~volatile_image_t()
+{
+  delete redolog;
+  delete base_image;
+}
+
+int volatile_image_t::open(const char* pathname)
+{
+  int filedes;
+  const char *logname=NULL;
+
+  if ((ro_disk != NULL) && (ro_disk->open(pathname, O_RDONLY)<0))
+    return -1;
+
+  hd_size = base_image->hd_size;
+  // if redolog name was set
+  if (redolog_name != NULL) {
+    if (strcmp(redolog_name, "") != 0) {
+      logname = redolog_name;
+    }
+  }
+
+  // otherwise use pathname as template
+  if (logname == NULL) {
+    logname = pathname;
+  }
+
+  redolog_temp = (char*)malloc(strlen(logname) + VOLATILE_REDOLOG_EXTENSION_LENGTH + 1);
+  sprintf (redolog_temp, "%s%s", logname, VOLATILE_REDOLOG_EXTENSION);
+
+  filedes = mkstemp (redolog_temp);
+
+  if (filedes < 0)
+  {
+    BX_PANIC(("Can't create volatile redolog '%s'", redolog_temp));
+    return -1;
+  }
+  if (redolog->create(filedes, REDOLOG_SUBTYPE_VOLATILE, hd_size, extent_size) < 0)
+  {
+    BX_PANIC(("Can't create volatile redolog '%s'", redolog_temp));
+    return -1;
+  }
+
+#if (!defined(WIN32)) && !BX_WITH_MACOS
+  // on unix it is legal to delete an open file
+  unlink(redolog_temp);
+#endif
+
+  BX_INFO(("'volatile' disk opened: ro-file is '%s', redolog is '%s'", pathname, redolog_temp));
+
+  return 0;
+}
+
+void volatile_image_t::close()
+{
+  redolog->close();
+  base_image->close();
+
+#if defined(WIN32) || BX_WITH_MACOS
+  // on non-unix we have to wait till the file is closed to delete it
+  unlink(redolog_temp);
+#endif
+  if (redolog_temp!=NULL)
+    free(redolog_temp);
+
+  if (redolog_name!=NULL)
+    free(redolog_name);
+}
+
+Bit64s volatile_image_t::lseek(Bit64s offset, int whence)
+{
+  redolog->lseek(offset, whence);
+  return base_image->lseek(offset, whence);
+}
+
+ssize_t volatile_image_t::read(void* buf, size_t count)
+{
+  // This should be fixed if count != 512
+  if ((size_t)redolog->read((char*) buf, count) != count)
+    return base_image->read((char*) buf, count);
+  else
+    return count;
+}
+
+ssize_t volatile_image_t::write(const void* buf, size_t count)
+{
+  return redolog->write((char*) buf, count);
+}
+
+// the redolog is discarded at the end, so there is no flush_cache()
+ssize_t volatile_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  return redolog->read_sectors(sector, buf, count, base_image);
+}
+
+ssize_t volatile_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(sector, buf, count);
+}
+
+/*** cow_image_t function definitions ***/
+
+// Crash consistency: data clusters are always written before the table
+// entries pointing to them, and flush_cache() syncs the data before it writes
+// back the tables. After a host crash the overlay contains at least the
+// state of the last disk cache flush of the guest. Clusters written later
+// may be lost or leaked, but a table never points to unwritten data.
+
+cow_image_t::cow_image_t(const char* _overlay_name)
+{
+  ro_disk = new default_image_t();
+  overlay_name = NULL;
+  if (_overlay_name != NULL) {
+    if (strcmp(_overlay_name, "") != 0) {
+      overlay_name = strdup(_overlay_name);
+    }
+  }
+  fd = -1;
+  l1_table = NULL;
+  cluster_buf = NULL;
+  for (int i = 0; i < COW_L2_CACHE_SIZE; i++) {
+    l2_cache[i].table = NULL;
+  }
+}
+
+cow_image_t::~cow_image_t()
+{
+  delete ro_disk;
+}
+
+int cow_image_t::create_overlay(const char* filename)
+{
+  fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC
+#ifdef O_BINARY
+              | O_BINARY
+#endif
+              , S_IWUSR | S_IRUSR | S_IRGRP | S_IWGRP);
+  if (fd < 0) {
+    return -1;
+  }
+  cluster_size = COW_CLUSTER_SIZE;
+  l2_size = cluster_size / sizeof(Bit64u);
+  l1_size = (Bit32u)((hd_size + (Bit64u)cluster_size * l2_size - 1) / ((Bit64u)cluster_size * l2_size));
+
+  memset(&header, 0, sizeof(header));
+  strcpy((char*)header.standard.magic, STANDARD_HEADER_MAGIC);
+  strcpy((char*)header.standard.type, COW_TYPE);
+  strcpy((char*)header.standard.subtype, COW_SUBTYPE_OVERLAY);
+  header.standard.version = htod32(STANDARD_HEADER_VERSION);
+  header.standard.header = htod32(STANDARD_HEADER_SIZE);
+  header.specific.cluster = htod32(cluster_size);
+  header.specific.l1_size = htod32(l1_size);
+  header.specific.disk = htod64(hd_size);
+
+  l1_table = new Bit64u[l1_size];
+  memset(l1_table, 0, l1_size * sizeof(Bit64u));
+  if ((bx_pwrite(fd, &header, STANDARD_HEADER_SIZE, 0) != STANDARD_HEADER_SIZE) ||
+      (bx_pwrite(fd, l1_table, l1_size * sizeof(Bit64u), STANDARD_HEADER_SIZE) != (ssize_t)(l1_size * sizeof(Bit64u)))) {
+    BX_ERROR(("cow : could not write header of '%s'", filename));
+    return -1;
+  }
+  return 0;
+}
+
+int cow_image_t::open_overlay(const char* filename)
+{
+  fd = ::open(filename, O_RDWR
+#ifdef O_BINARY
+              | O_BINARY
+#endif
+              );
+  if (fd < 0) {
+    return -1;
+  }
+  if (bx_pread(fd, &header, STANDARD_HEADER_SIZE, 0) != STANDARD_HEADER_SIZE) {
+    BX_PANIC(("cow : could not read header"));
+    return -1;
+  }
+  if ((strcmp((char*)header.standard.magic, STANDARD_HEADER_MAGIC) != 0) ||
+      (strcmp((char*)header.standard.type, COW_TYPE) != 0) ||
+      (strcmp((char*)header.standard.subtype, COW_SUBTYPE_OVERLAY) != 0)) {
+    BX_PANIC(("cow : '%s' is not an overlay file", filename));
+    return -1;
+  }
+  if (dtoh32(header.standard.version) != STANDARD_HEADER_VERSION) {
+    BX_PANIC(("cow : Bad header version"));
+    return -1;
+  }
+  cluster_size = dtoh32(header.specific.cluster);
+  if ((cluster_size < 4096) || ((cluster_size & (cluster_size - 1)) != 0)) {
+    BX_PANIC(("cow : Bad cluster size %d", cluster_size));
+    return -1;
+  }
+  if (dtoh64(header.specific.disk) != hd_size) {
+    BX_PANIC(("size reported by overlay doesn't match r/o disk size"));
+    return -1;
+  }
+  l2_size = cluster_size / sizeof(Bit64u);
+  l1_size = dtoh32(header.specific.l1_size);
+  if ((Bit64u)l1_size * cluster_size * l2_size < hd_size) {
+    BX_PANIC(("cow : level 1 table too small"));
+    return -1;
+  }
+  l1_table = new Bit64u[l1_size];
+  if (bx_pread(fd, l1_table, l1_size * sizeof(Bit64u), STANDARD_HEADER_SIZE) != (ssize_t)(l1_size * sizeof(Bit64u))) {
+    BX_PANIC(("cow : could not read level 1 table"));
+    return -1;
+  }
+  return 0;
+}
+
+int cow_image_t::open(const char* pathname)
+{
+  char *name;
+  Bit64s size;
+
+  if (ro_disk->open(pathname, O_RDONLY) < 0)
+    return -1;
+  hd_size = ro_disk->hd_size;
+
+  if (overlay_name != NULL) {
+    name = strdup(overlay_name);
+  } else {
+    name = (char*)malloc(strlen(pathname) + COW_EXTENSION_LENGTH + 1);
+    sprintf(name, "%s%s", pathname, COW_EXTENSION);
+  }
+  if (open_overlay(name) < 0) {
+    if (create_overlay(name) < 0) {
+      BX_PANIC(("Can't open or create overlay '%s'", name));
+      free(name);
+      return -1;
+    }
+  }
+
+  // new clusters are appended to the file
+  size = ::lseek(fd, 0, SEEK_END);
+  if (size < (Bit64s)(STANDARD_HEADER_SIZE + l1_size * sizeof(Bit64u)))
+    size = STANDARD_HEADER_SIZE + l1_size * sizeof(Bit64u);
+  next_cluster = ((Bit64u)size + cluster_size - 1) & ~(Bit64u)(cluster_size - 1);
+
+  cluster_buf = new Bit8u[cluster_size];
+  for (int i = 0; i < COW_L2_CACHE_SIZE; i++) {
+    l2_cache[i].offset = 0;
+    l2_cache[i].table = new Bit64u[l2_size];
+    l2_cache[i].dirty = 0;
+    l2_cache[i].last_use = 0;
+  }
+  use_counter = 0;
+  l1_dirty = 0;
+  position = 0;
+
+  BX_INFO(("'cow' disk opened: ro-file is '%s', overlay is '%s', cluster size %d",
+           pathname, name, cluster_size));
+  free(name);
+  return 0;
+}
+
+void cow_image_t::close()
+{
+  if (fd >= 0) {
+    flush_cache();
+    ::close(fd);
+    fd = -1;
+  }
+  for (int i = 0; i < COW_L2_CACHE_SIZE; i++) {
+    delete [] l2_cache[i].table;
+    l2_cache[i].table = NULL;
+  }
+  delete [] l1_table;
+  l1_table = NULL;
+  delete [] cluster_buf;
+  cluster_buf = NULL;
+  ro_disk->close();
+  if (overlay_name != NULL) {
+    free(overlay_name);
+    overlay_name = NULL;
+  }
+}
+
+int cow_image_t::write_l2_table(int slot)
+{
+  if (bx_pwrite(fd, l2_cache[slot].table, cluster_size, l2_cache[slot].offset) != (ssize_t)cluster_size) {
+    BX_ERROR(("cow : could not write level 2 table at offset " FMT_LL "d", l2_cache[slot].offset));
+    return -1;
+  }
+  l2_cache[slot].dirty = 0;
+  return 0;
+}
+
+// Returns the cache slot holding the level 2 table for 'l1_index', -1 if it
+// does not exist and 'alloc' is not set and -2 on error. A new table is
+// only created in the cache, the space in the file is reserved.
+int cow_image_t::get_l2_table(Bit32u l1_index, bx_bool alloc)
+{
+  Bit64u offset = dtoh64(l1_table[l1_index]);
+  int i, slot = 0;
+  bx_bool create = 0;
+
+  if (offset == 0) {
+    if (!alloc) return -1;
+    offset = next_cluster;
+    next_cluster += cluster_size;
+    l1_table[l1_index] = htod64(offset);
+    l1_dirty = 1;
+    create = 1;
+  } else {
+    for (i = 0; i < COW_L2_CACHE_SIZE; i++) {
+      if (l2_cache[i].offset == offset) {
+        l2_cache[i].last_use = ++use_counter;
+        return i;
+      }
+    }
+  }
+  // replace the least recently used table
+  for (i = 1; i < COW_L2_CACHE_SIZE; i++) {
+    if (l2_cache[i].last_use < l2_cache[slot].last_use)
+      slot = i;
+  }
+  if (l2_cache[slot].dirty) {
+#ifndef WIN32
+    fsync(fd);
+#endif
+    if (write_l2_table(slot) < 0)
+      return -2;
+  }
+  l2_cache[slot].offset = offset;
+  l2_cache[slot].last_use = ++use_counter;
+  if (create) {
+    memset(l2_cache[slot].table, 0, cluster_size);
+    l2_cache[slot].dirty = 1;
+  } else {
+    // a table at the end of the file may not have been written completely
+    ssize_t ret = bx_pread(fd, l2_cache[slot].table, cluster_size, offset);
+    if (ret < 0) {
+      BX_ERROR(("cow : could not read level 2 table at offset " FMT_LL "d", offset));
+      l2_cache[slot].offset = 0;
+      return -2;
+    }
+    memset((Bit8u*)l2_cache[slot].table + ret, 0, cluster_size - ret);
+    l2_cache[slot].dirty = 0;
+  }
+  return slot;
+}
+
+// reads / writes a run of sectors from the base image (offset 0) or from
+// the overlay file
+ssize_t cow_image_t::transfer_run(bx_bool write, Bit64u offset, Bit64u sector, Bit8u *buf, unsigned count)
+{
+  ssize_t ret;
+
+  if (count == 0)
+    return 0;
+  if (offset == 0) {
+    ret = ro_disk->read_sectors(sector, buf, count);
+  } else if (write) {
+    ret = bx_pwrite(fd, buf, (size_t)count * 512, (Bit64s)offset);
+  } else {
+    ret = bx_pread(fd, buf, (size_t)count * 512, (Bit64s)offset);
+  }
+  return (ret == (ssize_t)count * 512) ? ret : -1;
+}
+
+ssize_t cow_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf, *run_buf = bufptr;
+  Bit64u run_sector = sector, run_offset = 0, offset;
+  unsigned run = 0, total = count;
+  Bit32u spc = cluster_size / 512;
+
+  if ((sector + count) * 512 > hd_size)
+    return -1;
+  while (count > 0) {
+    Bit64u cluster = sector / spc;
+    Bit32u in_cluster = (Bit32u)(sector % spc);
+    unsigned n = spc - in_cluster;
+    if (n > count) n = count;
+    int slot = get_l2_table((Bit32u)(cluster / l2_size), 0);
+    if (slot == -2) return -1;
+    offset = (slot < 0) ? 0 : dtoh64(l2_cache[slot].table[cluster % l2_size]);
+    if (offset != 0) offset += (Bit64u)in_cluster * 512;
+    // merge with the previous run if the data is contiguous
+    if ((run > 0) && (((offset == 0) && (run_offset == 0)) ||
+        ((offset != 0) && (run_offset != 0) && (offset == run_offset + (Bit64u)run * 512)))) {
+      run += n;
+    } else {
+      if (transfer_run(0, run_offset, run_sector, run_buf, run) < 0)
+        return -1;
+      run_sector = sector;
+      run_offset = offset;
+      run_buf = bufptr;
+      run = n;
+    }
+    sector += n;
+    bufptr += n * 512;
+    count -= n;
+  }
+  if (transfer_run(0, run_offset, run_sector, run_buf, run) < 0)
+    return -1;
+  return (ssize_t)total * 512;
+}
+
+// writes a run of sectors to the overlay file and then enters the new
+// clusters of the run in their table
+int cow_image_t::write_run(Bit64u offset, Bit8u *buf, unsigned count)
+{
+  Bit32u n = pend_count;
+
+  pend_count = 0;
+  if (transfer_run(1, offset, 0, buf, count) < 0) {
+    // nothing points to the clusters, use the space again
+    if (n > 0)
+      next_cluster = pend_offset;
+    return -1;
+  }
+  if (n > 0) {
+    for (Bit32u i = 0; i < n; i++)
+      l2_cache[pend_slot].table[pend_index + i] = htod64(pend_offset + (Bit64u)i * cluster_size);
+    l2_cache[pend_slot].dirty = 1;
+  }
+  return 0;
+}
+
+ssize_t cow_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf, *run_buf = bufptr;
+  Bit64u run_offset = 0, offset;
+  unsigned run = 0, total = count;
+  Bit32u spc = cluster_size / 512, l1_index, last_l1 = 0xffffffff;
+  bx_bool alloc;
+
+  if ((sector + count) * 512 > hd_size)
+    return -1;
+  pend_count = 0;
+  while (count > 0) {
+    Bit64u cluster = sector / spc;
+    Bit32u in_cluster = (Bit32u)(sector % spc);
+    unsigned n = spc - in_cluster;
+    if (n > count) n = count;
+    l1_index = (Bit32u)(cluster / l2_size);
+    if (l1_index != last_l1) {
+      // the table of the pending run may be evicted from the cache
+      if (write_run(run_offset, run_buf, run) < 0)
+        return -1;
+      run = 0;
+      last_l1 = l1_index;
+    }
+    int slot = get_l2_table(l1_index, 1);
+    if (slot < 0) return -1;
+    Bit64u *entry = &l2_cache[slot].table[cluster % l2_size];
+    offset = dtoh64(*entry);
+    alloc = (offset == 0);
+    if (alloc) {
+      if (n < spc) {
+        // copy the rest of the cluster from the base image
+        Bit64u first = cluster * spc;
+        unsigned valid = spc;
+        if ((first + valid) * 512 > hd_size)
+          valid = (unsigned)(hd_size / 512 - first);
+        memset(cluster_buf, 0, cluster_size);
+        if (ro_disk->read_sectors(first, cluster_buf, valid) != (ssize_t)valid * 512)
+          return -1;
+        memcpy(cluster_buf + in_cluster * 512, bufptr, n * 512);
+        if (write_run(run_offset, run_buf, run) < 0)
+          return -1;
+        run = 0;
+        if (bx_pwrite(fd, cluster_buf, cluster_size, (Bit64s)next_cluster) != (ssize_t)cluster_size)
+          return -1;
+        *entry = htod64(next_cluster);
+        l2_cache[slot].dirty = 1;
+        next_cluster += cluster_size;
+        sector += n;
+        bufptr += n * 512;
+        count -= n;
+        continue;
+      }
+      offset = next_cluster;
+      next_cluster += cluster_size;
+    }
+    offset += (Bit64u)in_cluster * 512;
+    if ((run > 0) && (offset == run_offset + (Bit64u)run * 512)) {
+      run += n;
+    } else {
+      if (write_run(run_offset, run_buf, run) < 0)
+        return -1;
+      run_offset = offset;
+      run_buf = bufptr;
+      run = n;
+    }
+    if (alloc) {
+      // the new clusters of a run follow each other in the same table
+      if (pend_count == 0) {
+        pend_slot = slot;
+        pend_index = (Bit32u)(cluster % l2_size);
+        pend_offset = offset;
+      }
+      pend_count++;
+    }
+    sector += n;
+    bufptr += n * 512;
+    count -= n;
+  }
+  if (write_run(run_offset, run_buf, run) < 0)
+    return -1;
+  return (ssize_t)total * 512;
+}
+
+void cow_image_t::after_clone()
+{
+  // the parent has written back its tables before fork(), so the file is up
+  // to date: don't write the copies as well
+  l1_dirty = 0;
+  for (int i = 0; i < COW_L2_CACHE_SIZE; i++)
+    l2_cache[i].dirty = 0;
+}
+
+int cow_image_t::flush_cache()
+{
+  bx_bool dirty = l1_dirty;
+  int i;
+
+  for (i = 0; i < COW_L2_CACHE_SIZE; i++)
+    dirty |= l2_cache[i].dirty;
+  if (!dirty)
+    return 0;
+#ifndef WIN32
+  // the data must be stored before the tables pointing to it
+  if (fsync(fd) < 0)
+    return -1;
+#endif
+  for (i = 0; i < COW_L2_CACHE_SIZE; i++) {
+    if (l2_cache[i].dirty && (write_l2_table(i) < 0))
+      return -1;
+  }
+  if (l1_dirty) {
+    if (bx_pwrite(fd, l1_table, l1_size * sizeof(Bit64u), STANDARD_HEADER_SIZE) != (ssize_t)(l1_size * sizeof(Bit64u))) {
+      BX_ERROR(("cow : could not write level 1 table"));
+      return -1;
+    }
+    l1_dirty = 0;
+  }
+#ifndef WIN32
+  if (fsync(fd) < 0)
+    return -1;
+#endif
+  return 0;
+}
+
+Bit64s cow_image_t::lseek(Bit64s offset, int whence)
+{
+  if ((offset % 512) != 0) {
+    BX_PANIC(("cow : lseek HD with offset not multiple of 512"));
+    return -1;
+  }
+  if (whence == SEEK_CUR) {
+    offset += position;
+  } else if (whence == SEEK_END) {
+    offset += (Bit64s)hd_size;
+  }
+  if ((offset < 0) || (offset > (Bit64s)hd_size)) {
+    BX_PANIC(("cow : lseek to byte %ld failed", (long)offset));
+    return -1;
+  }
+  position = offset;
+  return position;
+}
+
+ssize_t cow_image_t::read(void* buf, size_t count)
+{
+  if ((count % 512) != 0)
+    BX_PANIC(("cow : read HD with count not multiple of 512"));
+  ssize_t ret = read_sectors((Bit64u)position / 512, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+ssize_t cow_image_t::write(const void* buf, size_t count)
+{
+  if ((count % 512) != 0)
+    BX_PANIC(("cow : write HD with count not multiple of 512"));
+  ssize_t ret = write_sectors((Bit64u)position / 512, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
+
+#ifdef _POSIX_MAPPED_FILES
+/*** mmap_image_t function definitions ***/
+
+mmap_image_t::mmap_image_t(bx_bool _is_private)
+{
+  is_private = _is_private;
+  data = NULL;
+  position = 0;
+}
+
+int mmap_image_t::open(const char* pathname)
+{
+  struct stat stat_buf;
+  void *ptr;
+
+  int fd = ::open(pathname, is_private ? O_RDONLY : O_RDWR);
+  if (fd < 0) {
+    return fd;
+  }
+  if (fstat(fd, &stat_buf)) {
+    BX_PANIC(("fstat() returns error!"));
+  }
+  hd_size = (Bit64u)stat_buf.st_size;
+  if ((hd_size % 512) != 0) {
+    BX_PANIC(("size of disk image must be multiple of 512 bytes"));
+  }
+  if ((hd_size == 0) || (hd_size != (Bit64u)(size_t)hd_size)) {
+    BX_ERROR(("disk image '%s' is empty or too large to be mapped", pathname));
+    ::close(fd);
+    return -1;
+  }
+  // the mapping stays valid after closing the file
+  ptr = mmap(NULL, (size_t)hd_size, PROT_READ | PROT_WRITE,
+             is_private ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (ptr == MAP_FAILED) {
+    BX_ERROR(("could not map disk image '%s': %s", pathname, strerror(errno)));
+    return -1;
+  }
+  data = (Bit8u*) ptr;
+  position = 0;
+  BX_INFO(("'%s' disk opened: '%s' mapped at %p", is_private ? "mmap-volatile" : "mmap",
+           pathname, ptr));
+  return 0;
+}
+
+void mmap_image_t::close()
+{
+  if (data != NULL) {
+    munmap(data, (size_t)hd_size);
+    data = NULL;
+  }
+}
+
+Bit64s mmap_image_t::lseek(Bit64s offset, int whence)
+{
+  if (whence == SEEK_CUR) {
+    offset += position;
+  } else if (whence == SEEK_END) {
+    offset += (Bit64s)hd_size;
+  } else if (whence != SEEK_SET) {
+    return -1;
+  }
+  if ((offset < 0) || (offset > (Bit64s)hd_size)) {
+    return -1;
+  }
+  position = offset;
+  return position;
+}
+
+ssize_t mmap_image_t::read(void* buf, size_t count)
+{
+  if ((Bit64u)position + count > hd_size)
+    count = (size_t)(hd_size - position);
+  memcpy(buf, data + position, count);
+  position += count;
+  return (ssize_t)count;
+}
+
+ssize_t mmap_image_t::write(const void* buf, size_t count)
+{
+  if ((Bit64u)position + count > hd_size)
+    count = (size_t)(hd_size - position);
+  memcpy(data + position, buf, count);
+  position += count;
+  return (ssize_t)count;
+}
+
+ssize_t mmap_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  if ((sector + count) * 512 > hd_size)
+    return -1;
+  memcpy(buf, data + sector * 512, (size_t)count * 512);
+  return (ssize_t)count * 512;
+}
+
+ssize_t mmap_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  if ((sector + count) * 512 > hd_size)
+    return -1;
+  memcpy(data + sector * 512, buf, (size_t)count * 512);
+  return (ssize_t)count * 512;
+}
+
+ssize_t mmap_image_t::readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
+{
+  Bit8u *ptr = data + sector * 512;
+  size_t size = bx_iovec_size(iov, iovcnt);
 
-  return 0;
+  if ((sector * 512 + size) > hd_size)
+    return -1;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(iov[i].iov_base, ptr, iov[i].iov_len);
+    ptr += iov[i].iov_len;
+  }
+  return (ssize_t)size;
 }
 
-void undoable_image_t::close ()
+ssize_t mmap_image_t::writev_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
 {
-  redolog->close();
-  ro_disk->close();
+  Bit8u *ptr = data + sector * 512;
+  size_t size = bx_iovec_size(iov, iovcnt);
 
-  if (redolog_name!=NULL)
-    free(redolog_name);
+  if ((sector * 512 + size) > hd_size)
+    return -1;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
+    ptr += iov[i].iov_len;
+  }
+  return (ssize_t)size;
 }
+#endif
 
-Bit64s undoable_image_t::lseek(Bit64s offset, int whence)
+/*** write_cache_image_t function definitions ***/
+
+write_cache_image_t::write_cache_image_t(device_image_t *_image, unsigned cache_sectors)
 {
-  redolog->lseek(offset, whence);
-  return ro_disk->lseek(offset, whence);
+  unsigned entries = 1;
+
+  image = _image;
+  capacity = cache_sectors;
+  used = 0;
+  hash_shift = 32;
+  // at most half of the hash table entries are in use
+  while (entries < capacity * 2) {
+    entries <<= 1;
+    hash_shift--;
+  }
+  data = new Bit8u[capacity * 512];
+  slot_sector = new Bit64u[capacity];
+  hash_table = new Bit32u[entries];
+  memset(hash_table, 0, entries * sizeof(Bit32u));
+  order = new write_cache_entry_t[capacity];
+  min_sector = BX_CONST64(0xffffffffffffffff);
+  max_sector = 0;
+  position = 0;
+
+  cylinders = image->cylinders;
+  heads = image->heads;
+  sectors = image->sectors;
+  hd_size = image->hd_size;
 }
 
-ssize_t undoable_image_t::read(void* buf, size_t count)
+write_cache_image_t::~write_cache_image_t()
 {
-  // This should be fixed if count != 512
-  if ((size_t)redolog->read((char*) buf, count) != count)
-    return ro_disk->read((char*) buf, count);
-  else
-    return count;
+  delete image;
+  delete [] order;
+  delete [] hash_table;
+  delete [] slot_sector;
+  delete [] data;
 }
 
-ssize_t undoable_image_t::write(const void* buf, size_t count)
+int write_cache_image_t::open(const char* pathname)
 {
-  return redolog->write((char*) buf, count);
+  int ret = image->open(pathname);
+  if (ret >= 0)
+    hd_size = image->hd_size;
+  return ret;
 }
 
-/*** volatile_image_t function definitions ***/
-
-volatile_image_t::volatile_image_t(const char* _redolog_name)
+void write_cache_image_t::close()
 {
-  redolog = new redolog_t();
-  ro_disk = new default_image_t();
-  redolog_temp = NULL;
-  redolog_name = NULL;
-  if (_redolog_name != NULL) {
-    if (strcmp(_redolog_name,"") != 0) {
-      redolog_name = strdup(_redolog_name);
-    }
-  }
+  if (write_back() < 0)
+    BX_ERROR(("write cache: %d sectors could not be written back", used));
+  image->close();
 }
 
-volatile_image_t::~volatile_image_t()
+device_image_t *write_cache_image_t::replace_image(device_image_t *new_image)
 {
-  delete redolog;
-  delete ro_disk;
+  device_image_t *old_image = image;
+  image = new_image;
+  return old_image;
 }
 
-int volatile_image_t::open(const char* pathname)
+// Returns the hash table index of the sector, which is either the entry of
+// the sector or the empty entry where it has to be inserted
+Bit32u write_cache_image_t::lookup(Bit64u sector)
 {
-  int filedes;
-  const char *logname=NULL;
+  Bit32u mask = (Bit32u)((BX_CONST64(1) << (32 - hash_shift)) - 1);
+  Bit32u index = ((Bit32u)(sector ^ (sector >> 32)) * 0x9e3779b1) >> hash_shift;
 
-  if (ro_disk->open(pathname, O_RDONLY)<0)
-    return -1;
+  while ((hash_table[index] != 0) && (slot_sector[hash_table[index] - 1] != sector))
+    index = (index + 1) & mask;
+  return index;
+}
 
-  hd_size = ro_disk->hd_size;
-  // if redolog name was set
-  if (redolog_name != NULL) {
-    if (strcmp(redolog_name, "") != 0) {
-      logname = redolog_name;
-    }
-  }
+static int write_cache_compare(const void *a, const void *b)
+{
+  Bit64u sa = ((const write_cache_entry_t*) a)->sector;
+  Bit64u sb = ((const write_cache_entry_t*) b)->sector;
+  return (sa < sb) ? -1 : (sa > sb);
+}
 
-  // otherwise use pathname as template
-  if (logname == NULL) {
-    logname = pathname;
+// Writes the dirty sectors to the image, adjacent sectors with one call.
+// The cache is empty afterwards unless a write failed.
+int write_cache_image_t::write_back()
+{
+  bx_iovec_t iov[WRITE_CACHE_MAX_RUN];
+  unsigned i, n;
+
+  if (used == 0)
+    return 0;
+  for (i = 0; i < used; i++) {
+    order[i].sector = slot_sector[i];
+    order[i].slot = i;
+  }
+  qsort(order, used, sizeof(write_cache_entry_t), write_cache_compare);
+
+  for (i = 0; i < used; i += n) {
+    n = 0;
+    do {
+      iov[n].iov_base = data + order[i + n].slot * 512;
+      iov[n].iov_len = 512;
+      n++;
+    } while ((i + n < used) && (n < WRITE_CACHE_MAX_RUN) &&
+             (order[i + n].sector == order[i].sector + n));
+    if (image->writev_sectors(order[i].sector, iov, n) != (ssize_t)n * 512)
+      return -1;
   }
 
-  redolog_temp = (char*)malloc(strlen(logname) + VOLATILE_REDOLOG_EXTENSION_LENGTH + 1);
-  sprintf (redolog_temp, "%s%s", logname, VOLATILE_REDOLOG_EXTENSION);
+  used = 0;
+  memset(hash_table, 0, (1 << (32 - hash_shift)) * sizeof(Bit32u));
+  min_sector = BX_CONST64(0xffffffffffffffff);
+  max_sector = 0;
+  return 0;
+}
 
-  filedes = mkstemp (redolog_temp);
+int write_cache_image_t::flush_cache()
+{
+  if (write_back() < 0) {
+    BX_ERROR(("write cache: could not write back the dirty sectors"));
+    return -1;
+  }
+  return image->flush_cache();
+}
 
-  if (filedes < 0)
-  {
-    BX_PANIC(("Can't create volatile redolog '%s'", redolog_temp));
+Bit64s write_cache_image_t::lseek(Bit64s offset, int whence)
+{
+  if ((offset % 512) != 0) {
+    BX_PANIC(("write cache : lseek HD with offset not multiple of 512"));
     return -1;
   }
-  if (redolog->create(filedes, REDOLOG_SUBTYPE_VOLATILE, hd_size) < 0)
-  {
-    BX_PANIC(("Can't create volatile redolog '%s'", redolog_temp));
+  if (whence == SEEK_CUR) {
+    offset += position;
+  } else if (whence == SEEK_END) {
+    offset += (Bit64s)hd_size;
+  }
+  if ((offset < 0) || (offset > (Bit64s)hd_size)) {
+    BX_PANIC(("write cache : lseek to byte %ld failed", (long)offset));
     return -1;
   }
-
-#if (!defined(WIN32)) && !BX_WITH_MACOS
-  // on unix it is legal to delete an open file
-  unlink(redolog_temp);
-#endif
-
-  BX_INFO(("'volatile' disk opened: ro-file is '%s', redolog is '%s'", pathname, redolog_temp));
-
-  return 0;
+  position = offset;
+  return position;
 }
 
-void volatile_image_t::close()
+ssize_t write_cache_image_t::read(void* buf, size_t count)
 {
-  redolog->close();
-  ro_disk->close();
-
-#if defined(WIN32) || BX_WITH_MACOS
-  // on non-unix we have to wait till the file is closed to delete it
-  unlink(redolog_temp);
-#endif
-  if (redolog_temp!=NULL)
-    free(redolog_temp);
+  if ((count % 512) != 0)
+    BX_PANIC(("write cache : read HD with count not multiple of 512"));
+  ssize_t ret = read_sectors((Bit64u)position / 512, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
+}
 
-  if (redolog_name!=NULL)
-    free(redolog_name);
+ssize_t write_cache_image_t::write(const void* buf, size_t count)
+{
+  if ((count % 512) != 0)
+    BX_PANIC(("write cache : write HD with count not multiple of 512"));
+  ssize_t ret = write_sectors((Bit64u)position / 512, buf, (unsigned)(count / 512));
+  if (ret > 0) position += ret;
+  return ret;
 }
 
-Bit64s volatile_image_t::lseek(Bit64s offset, int whence)
+ssize_t write_cache_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
 {
-  redolog->lseek(offset, whence);
-  return ro_disk->lseek(offset, whence);
+  ssize_t ret = image->read_sectors(sector, buf, count);
+  Bit32u index;
+
+  if ((ret < (ssize_t)count * 512) || (used == 0) ||
+      (sector > max_sector) || (sector + count <= min_sector))
+    return ret;
+  for (unsigned i = 0; i < count; i++) {
+    index = lookup(sector + i);
+    if (hash_table[index] != 0)
+      memcpy((Bit8u*) buf + i * 512, data + (hash_table[index] - 1) * 512, 512);
+  }
+  return ret;
 }
 
-ssize_t volatile_image_t::read(void* buf, size_t count)
+ssize_t write_cache_image_t::readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt)
 {
-  // This should be fixed if count != 512
-  if ((size_t)redolog->read((char*) buf, count) != count)
-    return ro_disk->read((char*) buf, count);
-  else
-    return count;
+  if ((used == 0) || (sector > max_sector) ||
+      (sector + bx_iovec_size(iov, iovcnt) / 512 <= min_sector))
+    return image->readv_sectors(sector, iov, iovcnt);
+  return device_image_t::readv_sectors(sector, iov, iovcnt);
 }
 
-ssize_t volatile_image_t::write(const void* buf, size_t count)
+ssize_t write_cache_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
 {
-  return redolog->write((char*) buf, count);
+  const Bit8u *bufptr = (const Bit8u*) buf;
+  Bit32u index;
+
+  // a transfer larger than the cache goes to the image directly
+  if (count > capacity) {
+    if (write_back() < 0)
+      return -1;
+    return image->write_sectors(sector, buf, count);
+  }
+  for (unsigned i = 0; i < count; i++) {
+    index = lookup(sector + i);
+    if (hash_table[index] == 0) {
+      if (used == capacity) {
+        if (write_back() < 0)
+          return -1;
+        index = lookup(sector + i);
+      }
+      slot_sector[used] = sector + i;
+      hash_table[index] = ++used;
+    }
+    memcpy(data + (hash_table[index] - 1) * 512, bufptr, 512);
+    bufptr += 512;
+  }
+  if (sector < min_sector) min_sector = sector;
+  if (sector + count - 1 > max_sector) max_sector = sector + count - 1;
+  return (ssize_t)count * 512;
 }
 
 #if BX_COMPRESSED_HD_SUPPORT
@@ -1491,10 +2794,30 @@ ssize_t volatile_image_t::write(const void* buf, size_t count)
 z_ro_image_t::z_ro_image_t()
 {
   offset = (Bit64s)0;
+  fd = -1;
+  gzfile = NULL;
+  index = NULL;
+  zbuf = NULL;
+  for (int i = 0; i < Z_RO_CACHE_SIZE; i++) {
+    cache[i].data = NULL;
+  }
+#if BX_HAVE_PTHREAD
+  prefetch_running = 0;
+  prefetch_buf = NULL;
+  prefetch_zbuf = NULL;
+#endif
+}
+
+z_ro_image_t::~z_ro_image_t()
+{
+  close();
 }
 
 int z_ro_image_t::open(const char* pathname)
 {
+  z_ro_header_t header;
+  int i;
+
   fd = ::open(pathname, O_RDONLY
 #ifdef O_BINARY
               | O_BINARY
@@ -1507,16 +2830,114 @@ int z_ro_image_t::open(const char* pathname)
     return fd;
   }
 
-  gzfile = gzdopen(fd, "rb");
+  if ((bx_pread(fd, &header, STANDARD_HEADER_SIZE, 0) != STANDARD_HEADER_SIZE) ||
+      (strcmp((char*)header.standard.magic, STANDARD_HEADER_MAGIC) != 0) ||
+      (strcmp((char*)header.standard.type, Z_RO_TYPE) != 0)) {
+    BX_INFO(("'%s' has no chunk index, seeking is slow", pathname));
+    // the gzip trailer ends with the uncompressed size modulo 4 GB
+    Bit64s fsize = ::lseek(fd, 0, SEEK_END);
+    Bit8u isize[4];
+    if ((fsize < 18) || (bx_pread(fd, isize, 4, fsize - 4) != 4)) {
+      BX_PANIC(("z_ro_image: '%s' is not a gzip file", pathname));
+      return -1;
+    }
+    hd_size = (Bit64u)isize[0] | ((Bit64u)isize[1] << 8) |
+              ((Bit64u)isize[2] << 16) | ((Bit64u)isize[3] << 24);
+    ::lseek(fd, 0, SEEK_SET);
+    gzfile = gzdopen(fd, "rb");
+    return 0;
+  }
+  if ((strcmp((char*)header.standard.subtype, Z_RO_SUBTYPE_CHUNKED) != 0) ||
+      (dtoh32(header.standard.version) != STANDARD_HEADER_VERSION)) {
+    BX_PANIC(("z_ro_image: unsupported format of '%s'", pathname));
+    return -1;
+  }
+  chunk_size = dtoh32(header.specific.chunk);
+  chunk_count = dtoh32(header.specific.count);
+  hd_size = dtoh64(header.specific.disk);
+  if ((chunk_size < 512) || ((chunk_size & (chunk_size - 1)) != 0) ||
+      ((Bit64u)chunk_count * chunk_size < hd_size)) {
+    BX_PANIC(("z_ro_image: bad header in '%s'", pathname));
+    return -1;
+  }
+
+  index = new Bit64u[chunk_count + 1];
+  if (bx_pread(fd, index, (chunk_count + 1) * sizeof(Bit64u), STANDARD_HEADER_SIZE) !=
+      (ssize_t)((chunk_count + 1) * sizeof(Bit64u))) {
+    BX_PANIC(("z_ro_image: could not read the index of '%s'", pathname));
+    return -1;
+  }
+  for (Bit32u c = 0; c <= chunk_count; c++) {
+    index[c] = dtoh64(index[c]);
+    if ((c > 0) && ((index[c] < index[c-1]) || (index[c] - index[c-1] > chunk_size))) {
+      BX_PANIC(("z_ro_image: bad index entry %d in '%s'", c, pathname));
+      return -1;
+    }
+  }
+
+  zbuf = new Bit8u[chunk_size];
+  for (i = 0; i < Z_RO_CACHE_SIZE; i++) {
+    cache[i].chunk = 0xffffffff;
+    cache[i].data = new Bit8u[chunk_size];
+    cache[i].last_use = 0;
+  }
+  use_counter = 0;
+  last_chunk = 0xffffffff;
+
+#if BX_HAVE_PTHREAD
+  prefetch_stop = 0;
+  prefetch_busy = 0;
+  prefetch_done = 0;
+  prefetch_chunk = 0xffffffff;
+  prefetch_buf = new Bit8u[chunk_size];
+  prefetch_zbuf = new Bit8u[chunk_size];
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+  prefetch_running = (pthread_create(&thread, NULL, prefetch_main, this) == 0);
+  if (!prefetch_running) {
+    BX_ERROR(("z_ro_image: could not create read-ahead thread"));
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+#endif
+
+  BX_INFO(("z_ro_image: '%s' has %d chunks of %d bytes", pathname, chunk_count, chunk_size));
   return 0;
 }
 
 void z_ro_image_t::close()
 {
-  if (fd > -1) {
+#if BX_HAVE_PTHREAD
+  if (prefetch_running) {
+    pthread_mutex_lock(&mutex);
+    prefetch_stop = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+    prefetch_running = 0;
+  }
+  delete [] prefetch_buf;
+  prefetch_buf = NULL;
+  delete [] prefetch_zbuf;
+  prefetch_zbuf = NULL;
+#endif
+  if (gzfile != NULL) {
     gzclose(gzfile);
-    // ::close(fd);
+    gzfile = NULL;
+  } else if (fd > -1) {
+    ::close(fd);
+  }
+  fd = -1;
+  for (int i = 0; i < Z_RO_CACHE_SIZE; i++) {
+    delete [] cache[i].data;
+    cache[i].data = NULL;
   }
+  delete [] index;
+  index = NULL;
+  delete [] zbuf;
+  zbuf = NULL;
 }
 
 Bit64s z_ro_image_t::lseek(Bit64s _offset, int whence)
@@ -1536,6 +2957,11 @@ Bit64s z_ro_image_t::lseek(Bit64s _offset, int whence)
 
 ssize_t z_ro_image_t::read(void* buf, size_t count)
 {
+  if (gzfile == NULL) {
+    ssize_t ret = read_sectors((Bit64u)offset / 512, buf, (unsigned)(count / 512));
+    if (ret > 0) offset += ret;
+    return ret;
+  }
   gzseek(gzfile, offset, SEEK_SET);
   return gzread(gzfile, buf, count);
 }
@@ -1546,6 +2972,175 @@ ssize_t z_ro_image_t::write(const void* buf, size_t count)
   return 0;
 }
 
+// Reads chunk 'chunk' into buf (chunk_size bytes). Only uses the read-only
+// members, so it is called by the read-ahead thread as well.
+int z_ro_image_t::load_chunk(Bit32u chunk, Bit8u *buf, Bit8u *cbuf)
+{
+  Bit32u zlen = (Bit32u)(index[chunk + 1] - index[chunk]);
+  Bit64u start = (Bit64u)chunk * chunk_size;
+  uLongf len = chunk_size;
+
+  // the last chunk only holds the rest of the disk
+  if (start + len > hd_size)
+    len = (uLongf)(hd_size - start);
+  if (zlen == len) {
+    // stored uncompressed
+    if (bx_pread(fd, buf, zlen, (Bit64s)index[chunk]) != (ssize_t)zlen)
+      return -1;
+  } else {
+    uLongf need = len;
+    if (bx_pread(fd, cbuf, zlen, (Bit64s)index[chunk]) != (ssize_t)zlen)
+      return -1;
+    if ((uncompress(buf, &len, cbuf, zlen) != Z_OK) || (len != need))
+      return -1;
+  }
+  return 0;
+}
+
+// Returns the cache slot holding chunk 'chunk' or -1 on error
+int z_ro_image_t::get_chunk(Bit32u chunk)
+{
+  bx_bool loaded = 0;
+  int i, slot = 0;
+
+  for (i = 0; i < Z_RO_CACHE_SIZE; i++) {
+    if (cache[i].chunk == chunk) {
+      cache[i].last_use = ++use_counter;
+      return i;
+    }
+  }
+  // replace the least recently used chunk
+  for (i = 1; i < Z_RO_CACHE_SIZE; i++) {
+    if (cache[i].last_use < cache[slot].last_use)
+      slot = i;
+  }
+  cache[slot].chunk = 0xffffffff;
+#if BX_HAVE_PTHREAD
+  if (prefetch_running) {
+    pthread_mutex_lock(&mutex);
+    while (prefetch_busy && (prefetch_chunk == chunk))
+      pthread_cond_wait(&cond, &mutex);
+    if (prefetch_done && (prefetch_chunk == chunk)) {
+      Bit8u *tmp = cache[slot].data;
+      cache[slot].data = prefetch_buf;
+      prefetch_buf = tmp;
+      prefetch_done = 0;
+      loaded = 1;
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+#endif
+  if (!loaded && (load_chunk(chunk, cache[slot].data, zbuf) < 0)) {
+    BX_ERROR(("z_ro_image: could not read chunk %d", chunk));
+    return -1;
+  }
+  cache[slot].chunk = chunk;
+  cache[slot].last_use = ++use_counter;
+#if BX_HAVE_PTHREAD
+  // sequential access: decompress the next chunk in the background
+  if (prefetch_running && (chunk == last_chunk + 1) && (chunk + 1 < chunk_count))
+    prefetch(chunk + 1);
+#endif
+  last_chunk = chunk;
+  return slot;
+}
+
+ssize_t z_ro_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  Bit8u *bufptr = (Bit8u*) buf;
+  Bit64u pos = sector * 512;
+  size_t left = (size_t)count * 512;
+
+  if (gzfile != NULL) {
+    gzseek(gzfile, (Bit64s)sector * 512, SEEK_SET);
+    return gzread(gzfile, buf, count * 512);
+  }
+  if (pos + left > hd_size)
+    return -1;
+  while (left > 0) {
+    Bit32u chunk = (Bit32u)(pos / chunk_size);
+    Bit32u in_chunk = (Bit32u)(pos % chunk_size);
+    size_t n = chunk_size - in_chunk;
+    if (n > left) n = left;
+    int slot = get_chunk(chunk);
+    if (slot < 0) return -1;
+    memcpy(bufptr, cache[slot].data + in_chunk, n);
+    pos += n;
+    bufptr += n;
+    left -= n;
+  }
+  return (ssize_t)count * 512;
+}
+
+ssize_t z_ro_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  BX_PANIC(("z_ro_image: write not supported"));
+  return 0;
+}
+
+void z_ro_image_t::after_clone()
+{
+#if BX_HAVE_PTHREAD
+  if (!prefetch_running)
+    return;
+  // the thread of the parent may have held the mutex or filled prefetch_buf
+  // partially at the time of the fork
+  prefetch_stop = 0;
+  prefetch_busy = 0;
+  prefetch_done = 0;
+  prefetch_chunk = 0xffffffff;
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+  prefetch_running = (pthread_create(&thread, NULL, prefetch_main, this) == 0);
+  if (!prefetch_running) {
+    BX_ERROR(("z_ro_image: could not create read-ahead thread"));
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+#endif
+}
+
+#if BX_HAVE_PTHREAD
+// Asks the read-ahead thread for a chunk, unless it is busy or the chunk
+// is already cached
+void z_ro_image_t::prefetch(Bit32u chunk)
+{
+  for (int i = 0; i < Z_RO_CACHE_SIZE; i++) {
+    if (cache[i].chunk == chunk) return;
+  }
+  pthread_mutex_lock(&mutex);
+  if (!prefetch_busy && !(prefetch_done && (prefetch_chunk == chunk))) {
+    prefetch_chunk = chunk;
+    prefetch_done = 0;
+    prefetch_busy = 1;
+    pthread_cond_broadcast(&cond);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+void *z_ro_image_t::prefetch_main(void *arg)
+{
+  z_ro_image_t *img = (z_ro_image_t*) arg;
+  int ret;
+
+  pthread_mutex_lock(&img->mutex);
+  while (1) {
+    while (!img->prefetch_stop && !img->prefetch_busy)
+      pthread_cond_wait(&img->cond, &img->mutex);
+    if (img->prefetch_stop) break;
+    // prefetch_chunk and prefetch_buf are not changed while busy
+    pthread_mutex_unlock(&img->mutex);
+    ret = img->load_chunk(img->prefetch_chunk, img->prefetch_buf, img->prefetch_zbuf);
+    pthread_mutex_lock(&img->mutex);
+    img->prefetch_busy = 0;
+    img->prefetch_done = (ret == 0);
+    pthread_cond_broadcast(&img->cond);
+  }
+  pthread_mutex_unlock(&img->mutex);
+  return NULL;
+}
+#endif
+
 
 /*** z_undoable_image_t function definitions ***/
 
@@ -1576,6 +3171,11 @@ int z_undoable_image_t::open(const char* pathname)
   if (ro_disk->open(pathname)<0)
     return -1;
 
+  // the chunked format knows the disk size
+  if (ro_disk->hd_size != 0)
+    size = ro_disk->hd_size;
+  hd_size = ro_disk->hd_size;
+
   // If redolog name was set
   if (redolog_name != NULL) {
     if (strcmp(redolog_name, "") != 0) {
@@ -1634,12 +3234,27 @@ ssize_t z_undoable_image_t::write(const void* buf, size_t count)
   return redolog->write((char*) buf, count);
 }
 
+ssize_t z_undoable_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  return redolog->read_sectors(sector, buf, count, ro_disk);
+}
+
+ssize_t z_undoable_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(sector, buf, count);
+}
+
+int z_undoable_image_t::flush_cache()
+{
+  return redolog->flush_cache();
+}
+
 
 /*** z_volatile_image_t function definitions ***/
 
 z_volatile_image_t::z_volatile_image_t(Bit64u _size, const char* _redolog_name)
 {
-  redolog = new redolog_t();
+  redolog = new redolog_t(1);
   ro_disk = new z_ro_image_t();
   size = _size;
 
@@ -1666,6 +3281,11 @@ int z_volatile_image_t::open(const char* pathname)
   if (ro_disk->open(pathname)<0)
     return -1;
 
+  // the chunked format knows the disk size
+  if (ro_disk->hd_size != 0)
+    size = ro_disk->hd_size;
+  hd_size = ro_disk->hd_size;
+
   // if redolog name was set
   if (redolog_name != NULL) {
     if (strcmp(redolog_name, "") != 0) {
@@ -1741,4 +3361,125 @@ ssize_t z_volatile_image_t::write (const void* buf, size_t count)
   return redolog->write((char*) buf, count);
 }
 
+ssize_t z_volatile_image_t::read_sectors(Bit64u sector, void* buf, unsigned count)
+{
+  return redolog->read_sectors(sector, buf, count, ro_disk);
+}
+
+ssize_t z_volatile_image_t::write_sectors(Bit64u sector, const void* buf, unsigned count)
+{
+  return redolog->write_sectors(sector, buf, count);
+}
+
+#endif
+
+#if BX_HAVE_PTHREAD
+
+/*** image_io_thread_t function definitions ***/
+
+image_io_thread_t::image_io_thread_t()
+{
+  running = 0;
+  stop = 0;
+  pending = 0;
+  done = 0;
+  image = NULL;
+  buf = NULL;
+  result = -1;
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&cond, NULL);
+}
+
+image_io_thread_t::~image_io_thread_t()
+{
+  if (running) {
+    pthread_mutex_lock(&mutex);
+    while (pending && !done)
+      pthread_cond_wait(&cond, &mutex);
+    stop = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, NULL);
+  }
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+}
+
+bx_bool image_io_thread_t::start(void)
+{
+  if (!running) {
+    running = (pthread_create(&thread, NULL, thread_main, this) == 0);
+  }
+  return running;
+}
+
+void image_io_thread_t::submit(device_image_t *img, bx_bool wr, Bit64u sec, void* buffer, unsigned cnt)
+{
+  pthread_mutex_lock(&mutex);
+  image = img;
+  is_write = wr;
+  sector = sec;
+  buf = buffer;
+  count = cnt;
+  done = 0;
+  pending = 1;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+bx_bool image_io_thread_t::poll(ssize_t *res)
+{
+  bx_bool ret;
+
+  pthread_mutex_lock(&mutex);
+  ret = done;
+  if (done) {
+    *res = result;
+    pending = 0;
+    done = 0;
+  }
+  pthread_mutex_unlock(&mutex);
+  return ret;
+}
+
+ssize_t image_io_thread_t::wait(void)
+{
+  ssize_t res;
+
+  pthread_mutex_lock(&mutex);
+  while (pending && !done)
+    pthread_cond_wait(&cond, &mutex);
+  res = result;
+  pending = 0;
+  done = 0;
+  pthread_mutex_unlock(&mutex);
+  return res;
+}
+
+void *image_io_thread_t::thread_main(void *arg)
+{
+  image_io_thread_t *t = (image_io_thread_t*) arg;
+  ssize_t res;
+
+  pthread_mutex_lock(&t->mutex);
+  while (1) {
+    while (!t->stop && (!t->pending || t->done))
+      pthread_cond_wait(&t->cond, &t->mutex);
+    if (t->stop) break;
+    // the request fields are not changed while the request is pending
+    pthread_mutex_unlock(&t->mutex);
+    if (t->is_write) {
+      res = t->image->write_sectors(t->sector, t->buf, t->count);
+    } else {
+      res = t->image->read_sectors(t->sector, t->buf, t->count);
+    }
+    pthread_mutex_lock(&t->mutex);
+    t->result = res;
+    t->done = 1;
+    pthread_cond_broadcast(&t->cond);
+  }
+  pthread_mutex_unlock(&t->mutex);
+  return NULL;
+}
+
 #endif
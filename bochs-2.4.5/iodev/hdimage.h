@@ -27,6 +27,8 @@
 #define SPARSE_HEADER_V1       1
 #define SPARSE_HEADER_SIZE        (256) // Plenty of room for later
 #define SPARSE_PAGE_NOT_ALLOCATED (0xffffffff)
+// Page table entries per write-back unit of the in-memory page table
+#define SPARSE_TABLE_BLOCK_ENTRIES (1024)
 
  typedef struct
  {
@@ -63,6 +65,7 @@
 // #define REDOLOG_SUBTYPE_Z_VOLATILE "z-Volatile"
 
 #define REDOLOG_PAGE_NOT_ALLOCATED (0xffffffff)
+#define REDOLOG_BITMAP_CACHE_SIZE 16
 
 #define UNDOABLE_REDOLOG_EXTENSION ".redolog"
 #define UNDOABLE_REDOLOG_EXTENSION_LENGTH (strlen(UNDOABLE_REDOLOG_EXTENSION))
@@ -104,6 +107,56 @@
    Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (redolog_specific_header_v1_t))];
  } redolog_header_v1_t;
 
+#define COW_TYPE "Cow"
+#define COW_SUBTYPE_OVERLAY "Overlay"
+
+#define COW_EXTENSION ".cow"
+#define COW_EXTENSION_LENGTH (strlen(COW_EXTENSION))
+#define COW_CLUSTER_SIZE  (64 * 1024)
+#define COW_L2_CACHE_SIZE 16
+
+ typedef struct
+ {
+   // the fields in the header are kept in little endian
+   Bit32u  cluster;    // cluster size in bytes
+   Bit32u  l1_size;    // #entries in the level 1 table
+   Bit64u  disk;       // disk size in bytes
+ } cow_specific_header_t;
+
+ typedef struct
+ {
+   standard_header_t standard;
+   cow_specific_header_t specific;
+
+   Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (cow_specific_header_t))];
+ } cow_header_t;
+
+// Compressed image: the header is followed by an index of #chunks + 1 file
+// offsets (Bit64u, little endian) of the chunks, the last entry is the end
+// of the data. Each chunk is compressed with zlib on its own, so any chunk
+// can be read without the ones before it. A chunk as long as its
+// uncompressed size is stored uncompressed.
+#define Z_RO_TYPE "Compressed"
+#define Z_RO_SUBTYPE_CHUNKED "Chunked"
+#define Z_RO_CHUNK_SIZE  (64 * 1024)
+#define Z_RO_CACHE_SIZE  16
+
+ typedef struct
+ {
+   // the fields in the header are kept in little endian
+   Bit32u  chunk;      // uncompressed chunk size in bytes
+   Bit32u  count;      // #chunks
+   Bit64u  disk;       // disk size in bytes
+ } z_ro_specific_header_t;
+
+ typedef struct
+ {
+   standard_header_t standard;
+   z_ro_specific_header_t specific;
+
+   Bit8u padding[STANDARD_HEADER_SIZE - (sizeof (standard_header_t) + sizeof (z_ro_specific_header_t))];
+ } z_ro_header_t;
+
 // htod : convert host to disk (little) endianness
 // dtoh : convert disk (little) to host endianness
 #if defined (BX_LITTLE_ENDIAN)
@@ -145,6 +198,31 @@ class device_image_t
       // written (count).
       virtual ssize_t write(const void* buf, size_t count) = 0;
 
+      // Read count sectors starting at sector to the buffer buf. The
+      // current position is not used. Return the number of bytes read
+      // (count * 512). The default does one lseek() and read() per sector.
+      virtual ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+
+      // Write count sectors starting at sector from buf. The current
+      // position is not used. Return the number of bytes written
+      // (count * 512). The default does one lseek() and write() per sector.
+      virtual ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Read / write sectors starting at sector to / from the scatter/gather
+      // list iov. The total size of the list must be a multiple of 512.
+      // Return the number of bytes transferred. The default goes through a
+      // temporary buffer and read_sectors() / write_sectors().
+      virtual ssize_t readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+      virtual ssize_t writev_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+
+      // Make sure that all data written so far is stored on the host (disk
+      // cache flush of the guest). Returns negative on error.
+      virtual int flush_cache() { return 0; }
+
+      // Called in a clone created with fork() before the image is used
+      // there. The default does nothing.
+      virtual void after_clone() {}
+
       unsigned cylinders;
       unsigned heads;
       unsigned sectors;
@@ -176,6 +254,15 @@ class default_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+#if BX_HAVE_PREADV
+      ssize_t readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+      ssize_t writev_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+#endif
+
   private:
       int fd;
 
@@ -206,6 +293,11 @@ class concat_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
   private:
 #define BX_CONCAT_MAX_IMAGES 8
       int fd_table[BX_CONCAT_MAX_IMAGES];
@@ -235,10 +327,17 @@ class sparse_image_t : public device_image_t
 // 256 byte header, containing details such as page size and number of pages
 // Page indirection table, mapping virtual pages to physical pages within file
 // Physical pages till end of file
+//
+// Entries of newly allocated pages are only changed in memory and written
+// back to the file by flush_cache(), i.e. on close, on a guest cache flush
+// and periodically. After a crash the pages allocated since the last
+// write-back are lost: their data is not referenced by the page table, so
+// the old contents (zeroes or parent image) are read back. The file is
+// grown by prealloc pages at once if requested.
 
   public:
       // Default constructor
-      sparse_image_t();
+      sparse_image_t(unsigned prealloc = 0);
 
       // Open a image. Returns non-negative if successful.
       int open(const char* pathname);
@@ -258,14 +357,17 @@ class sparse_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Write back the changed page table entries.
+      int flush_cache();
+
   private:
  int fd;
 
-#ifdef _POSIX_MAPPED_FILES
- void *  mmap_header;
- size_t  mmap_length;
- size_t  system_pagesize_mask;
-#endif
  Bit32u *  pagetable;
 
  // Header is written to disk in little-endian (x86) format
@@ -280,6 +382,13 @@ class sparse_image_t : public device_image_t
 
  Bit64s  data_start;
  Bit64s  underlying_filesize;
+ Bit64s  allocated_filesize; // including preallocated pages
+ unsigned prealloc_pages;
+
+ // one bit per SPARSE_TABLE_BLOCK_ENTRIES page table entries not yet
+ // written back to the file
+ Bit8u * dirty_map;
+ Bit32u  dirty_blocks;
 
  char *  pathname;
 
@@ -335,13 +444,19 @@ class dll_image_t : public device_image_t
 #endif
 
 // REDOLOG class
+// The catalog and the bitmaps of the recently used extents are kept in
+// memory. Changes are written back when a bitmap is evicted from the cache
+// and by flush_cache(), which syncs the data first. A volatile redolog is
+// deleted on close, so it is never synced and only evicted bitmaps are
+// written.
 class redolog_t
 {
   public:
-      redolog_t();
-      int make_header(const char* type, Bit64u size);
-      int create(const char* filename, const char* type, Bit64u size);
-      int create(int filedes, const char* type, Bit64u size);
+      redolog_t(bx_bool _is_volatile = 0);
+      // extent_size 0 selects the extent size from the disk size
+      int make_header(const char* type, Bit64u size, Bit32u extent_size = 0);
+      int create(const char* filename, const char* type, Bit64u size, Bit32u extent_size = 0);
+      int create(int filedes, const char* type, Bit64u size, Bit32u extent_size = 0);
       int open(const char* filename, const char* type);
       void close();
       Bit64u get_size();
@@ -350,18 +465,44 @@ class redolog_t
       ssize_t read(void* buf, size_t count);
       ssize_t write(const void* buf, size_t count);
 
+      // Read count sectors. Runs of sectors not in the redolog are read from
+      // base with a single request, or cleared if base is NULL.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count, device_image_t *base);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Write back the cached bitmaps and catalog entries.
+      int flush_cache();
+
   private:
       void             print_header();
+      int              init_cache();
+      int              find_run(Bit64u sector, unsigned count, bx_bool *present);
+      int              get_bitmap(Bit32u index, bx_bool alloc);
+      int              write_bitmap(int slot);
+      Bit64s           get_bitmap_offset(Bit32u index);
+
       int              fd;
+      bx_bool          is_volatile;
       redolog_header_t header;     // Header is kept in x86 (little) endianness
       Bit32u          *catalog;
-      Bit8u           *bitmap;
       Bit32u           extent_index;
       Bit32u           extent_offset;
       Bit32u           extent_next;
+      Bit64s           file_size;
 
       Bit32u           bitmap_blocs;
       Bit32u           extent_blocs;
+
+      // range of catalog entries not yet written back
+      Bit32u           catalog_dirty_first;
+      Bit32u           catalog_dirty_last;
+      struct {
+        Bit32u   index;               // extent index, REDOLOG_PAGE_NOT_ALLOCATED if unused
+        Bit8u   *bitmap;
+        bx_bool  dirty;
+        Bit32u   last_use;
+      } bitmap_cache[REDOLOG_BITMAP_CACHE_SIZE];
+      Bit32u           use_counter;
 };
 
 // GROWING MODE
@@ -390,6 +531,14 @@ class growing_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Write back the cached redolog metadata.
+      int flush_cache();
+
   private:
       redolog_t *redolog;
 };
@@ -399,7 +548,7 @@ class undoable_image_t : public device_image_t
 {
   public:
       // Contructor
-      undoable_image_t(const char* redolog_name);
+      undoable_image_t(const char* redolog_name, Bit32u extent_size = 0);
       virtual ~undoable_image_t();
 
       // Open a image. Returns non-negative if successful.
@@ -420,10 +569,19 @@ class undoable_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Write back the cached redolog metadata.
+      int flush_cache();
+
   private:
       redolog_t       *redolog;       // Redolog instance
       default_image_t *ro_disk;       // Read-only flat disk instance
       char            *redolog_name;  // Redolog name
+      Bit32u           extent_size;   // of a new redolog, 0 = automatic
 };
 
 
@@ -432,7 +590,10 @@ class volatile_image_t : public device_image_t
 {
   public:
       // Contructor
-      volatile_image_t(const char* redolog_name);
+      volatile_image_t(const char* redolog_name, Bit32u extent_size = 0);
+      // Constructor for a redolog on top of base_image, which is an opened
+      // image owned from now on. The pathname of open() only names the redolog.
+      volatile_image_t(device_image_t *base_image, const char* redolog_name);
       virtual ~volatile_image_t();
 
       // Open a image. Returns non-negative if successful.
@@ -453,25 +614,231 @@ class volatile_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
   private:
       redolog_t       *redolog;       // Redolog instance
-      default_image_t *ro_disk;       // Read-only flat disk instance
+      default_image_t *ro_disk;       // Read-only flat disk instance, or NULL
+      device_image_t  *base_image;    // ro_disk or the image given to the constructor
       char            *redolog_name;  // Redolog name
       char            *redolog_temp;  // Redolog temporary file name
+      Bit32u           extent_size;   // of the redolog, 0 = automatic
+};
+
+// COW MODE
+// Overlay file on top of a read-only flat image. The overlay is divided into
+// clusters, a level 1 table points to level 2 tables which point to the
+// data clusters. All offsets are 64-bit file offsets, 0 means that the
+// cluster is read from the base image. The level 1 table is kept in memory,
+// the level 2 tables go through a small LRU cache. Changes of the tables are
+// only written back when a table is evicted from the cache, when the guest
+// flushes the disk cache and when the image is closed.
+class cow_image_t : public device_image_t
+{
+  public:
+      // Constructor
+      cow_image_t(const char* overlay_name);
+      virtual ~cow_image_t();
+
+      // Open a image. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Write back the cached tables and sync the overlay file.
+      int flush_cache();
+
+      // Called in a clone created with fork(): the tables are private copies
+      // from now on and are never written back to the shared overlay.
+      void after_clone();
+
+  private:
+      int     create_overlay(const char* filename);
+      int     open_overlay(const char* filename);
+      int     get_l2_table(Bit32u l1_index, bx_bool alloc);
+      int     write_l2_table(int slot);
+      ssize_t transfer_run(bx_bool write, Bit64u offset, Bit64u sector, Bit8u *buf, unsigned count);
+      int     write_run(Bit64u offset, Bit8u *buf, unsigned count);
+
+      default_image_t *ro_disk;       // Read-only flat disk instance
+      char            *overlay_name;  // Overlay name
+      int              fd;
+      cow_header_t     header;        // Header is kept in x86 (little) endianness
+      Bit32u           cluster_size;
+      Bit32u           l2_size;       // #entries in a level 2 table
+      Bit32u           l1_size;
+      Bit64u          *l1_table;      // kept in little endianness
+      bx_bool          l1_dirty;
+      Bit64u           next_cluster;  // file offset of the next new cluster
+      // new clusters of the run being written, entered in the table
+      // only after the run has been written
+      int              pend_slot;
+      Bit32u           pend_index;
+      Bit32u           pend_count;
+      Bit64u           pend_offset;
+      Bit64s           position;
+      Bit8u           *cluster_buf;
+      struct {
+        Bit64u   offset;              // file offset of the table, 0 if unused
+        Bit64u  *table;               // kept in little endianness
+        bx_bool  dirty;
+        Bit32u   last_use;
+      } l2_cache[COW_L2_CACHE_SIZE];
+      Bit32u           use_counter;
+};
+
+#ifdef _POSIX_MAPPED_FILES
+// MMAP MODE
+// Flat image mapped into the address space. With a private mapping the image
+// file is only read and all writes are lost at the end of the session.
+class mmap_image_t : public device_image_t
+{
+  public:
+      // Constructor
+      mmap_image_t(bx_bool is_private);
+
+      // Open a image. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read / write sectors at the given sector without using the
+      // current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+      ssize_t readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+      ssize_t writev_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+
+  private:
+      bx_bool is_private;
+      Bit8u  *data;
+      Bit64s  position;
+};
+#endif
+
+// WRITE-BACK CACHE
+// Keeps the sectors written by the guest in memory in front of an image of
+// any mode. The dirty sectors are written back in runs of adjacent sectors
+// by flush_cache(), i.e. on a guest cache flush, periodically and on close,
+// or when the cache is full. Reads are served from the cache first.
+#define WRITE_CACHE_MAX_RUN 256
+
+typedef struct {
+  Bit64u sector;
+  Bit32u slot;
+} write_cache_entry_t;
+
+class write_cache_image_t : public device_image_t
+{
+  public:
+      // Constructor, image is an opened image which is owned from now on
+      write_cache_image_t(device_image_t *image, unsigned cache_sectors);
+      virtual ~write_cache_image_t();
+
+      // Open a image. Returns non-negative if successful.
+      int open(const char* pathname);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+      ssize_t readv_sectors(Bit64u sector, const bx_iovec_t *iov, int iovcnt);
+
+      // Write back the dirty sectors, then flush the image.
+      int flush_cache();
+
+      void after_clone() { image->after_clone(); }
+
+      // Replace the image below the cache, the cached sectors are kept.
+      // Returns the old image.
+      device_image_t *replace_image(device_image_t *new_image);
+      device_image_t *get_image() { return image; }
+
+  private:
+      Bit32u  lookup(Bit64u sector);
+      int     write_back();
+
+      device_image_t *image;
+      unsigned  capacity;        // #sectors
+      unsigned  used;            // #dirty sectors
+      Bit8u    *data;            // capacity * 512 bytes
+      Bit64u   *slot_sector;     // sector held by a slot
+      Bit32u   *hash_table;      // slot + 1 of a sector, 0 = empty
+      unsigned  hash_shift;      // 32 - log2(#hash table entries)
+      write_cache_entry_t *order; // dirty sectors sorted for the write-back
+      Bit64u    min_sector, max_sector;
+      Bit64s    position;
 };
 
 
 #if BX_COMPRESSED_HD_SUPPORT
 
 #include <zlib.h>
-
+#if BX_HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 // Default compressed READ-ONLY image class
+// Images in the chunked format are read through an LRU cache of
+// decompressed chunks. On sequential access the next chunk is decompressed
+// in advance by a separate thread if pthreads are available. Plain gzip
+// files are still supported, but every seek decompresses from an earlier
+// point of the file.
 class z_ro_image_t : public device_image_t
 {
   public:
       // Contructor
       z_ro_image_t();
+      virtual ~z_ro_image_t();
 
       // Open a image. Returns non-negative if successful.
       int open(const char* pathname);
@@ -491,11 +858,47 @@ class z_ro_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // The read-ahead thread is not copied by fork(): start a new one.
+      void after_clone();
+
   private:
+      int     load_chunk(Bit32u chunk, Bit8u *buf, Bit8u *zbuf);
+      int     get_chunk(Bit32u chunk);
+
       Bit64s offset;
       int fd;
-      gzFile gzfile;
-
+      gzFile gzfile;                  // plain gzip file, NULL if chunked
+      Bit32u chunk_size;
+      Bit32u chunk_count;
+      Bit64u *index;                  // in host endianness
+      Bit8u  *zbuf;                   // compressed data of a chunk
+      struct {
+        Bit32u   chunk;               // 0xffffffff if unused
+        Bit8u   *data;
+        Bit32u   last_use;
+      } cache[Z_RO_CACHE_SIZE];
+      Bit32u use_counter;
+      Bit32u last_chunk;
+#if BX_HAVE_PTHREAD
+      void    prefetch(Bit32u chunk);
+      static void *prefetch_main(void *arg);
+
+      pthread_t       thread;
+      pthread_mutex_t mutex;
+      pthread_cond_t  cond;
+      bx_bool         prefetch_running;
+      bx_bool         prefetch_stop;
+      bx_bool         prefetch_busy;  // prefetch_chunk is being decompressed
+      bx_bool         prefetch_done;  // prefetch_buf holds prefetch_chunk
+      Bit32u          prefetch_chunk;
+      Bit8u          *prefetch_buf;
+      Bit8u          *prefetch_zbuf;
+#endif
 };
 
 // Z-UNDOABLE MODE
@@ -524,6 +927,16 @@ class z_undoable_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      // Write back the cached redolog metadata.
+      int flush_cache();
+
+      void after_clone() { ro_disk->after_clone(); }
+
   private:
       redolog_t       *redolog;       // Redolog instance
       z_ro_image_t    *ro_disk;       // Read-only compressed flat disk instance
@@ -557,6 +970,13 @@ class z_volatile_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Read / write count sectors at the given sector without using
+      // the current position.
+      ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+      ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
+
+      void after_clone() { ro_disk->after_clone(); }
+
   private:
       redolog_t       *redolog;       // Redolog instance
       z_ro_image_t    *ro_disk;       // Read-only compressed flat disk instance
@@ -567,6 +987,52 @@ class z_volatile_image_t : public device_image_t
 
 #endif
 
+#if BX_HAVE_PTHREAD
+
+#include <pthread.h>
+
+// Host thread doing the read_sectors() / write_sectors() calls of an
+// image in the background. Only one request can be outstanding.
+class image_io_thread_t
+{
+  public:
+      // Contructor
+      image_io_thread_t();
+      virtual ~image_io_thread_t();
+
+      // Start the thread. Returns non-zero if successful.
+      bx_bool start(void);
+
+      // Submit a request. The image and the buffer must not be used by
+      // the caller until the request is completed.
+      void submit(device_image_t *image, bx_bool write, Bit64u sector, void* buf, unsigned count);
+
+      // Returns non-zero and the result of the request if it is completed.
+      bx_bool poll(ssize_t *result);
+
+      // Wait for the completion of the request and return the result.
+      ssize_t wait(void);
+
+  private:
+      static void *thread_main(void *arg);
+
+      pthread_t       thread;
+      pthread_mutex_t mutex;
+      pthread_cond_t  cond;
+      bx_bool         running;
+      bx_bool         stop;
+      bx_bool         pending;       // request submitted, not yet completed
+      bx_bool         done;          // request completed, result available
+      device_image_t *image;
+      bx_bool         is_write;
+      Bit64u          sector;
+      void           *buf;
+      unsigned        count;
+      ssize_t         result;
+};
+
+#endif
+
 #endif // HDIMAGE_HEADERS_ONLY
 
 #endif
@@ -70,6 +70,8 @@ class BOCHSAPI bx_devmodel_c : public logfunctions {
   virtual void reset(unsigned type) {}
   virtual void register_state(void) {}
   virtual void after_restore_state(void) {}
+  virtual void before_clone(void) {}
+  virtual void after_clone(void) {}
 #if BX_DEBUGGER
   virtual void debug_dump(void) {}
 #endif
@@ -152,6 +154,9 @@ public:
   virtual bx_bool bmdma_write_sector(Bit8u channel, Bit8u *buffer) {
     STUBFUNC(HD, bmdma_write_sector); return 0;
   }
+  virtual int bmdma_transfer(Bit8u channel, bx_bool read, const bx_iovec_t *iov, int iovcnt, Bit32u len) {
+    STUBFUNC(HD, bmdma_transfer); return 0;
+  }
   virtual void bmdma_complete(Bit8u channel) {
     STUBFUNC(HD, bmdma_complete);
   }
@@ -201,6 +206,22 @@ public:
   {
     STUBFUNC(dma, registerDMA16Channel); return 0;
   }
+  virtual unsigned registerDMA8BlockChannel(
+    unsigned channel,
+    Bit16u (* dmaRead)(Bit8u *buffer, Bit16u maxlen),
+    Bit16u (* dmaWrite)(Bit8u *buffer, Bit16u maxlen),
+    const char *name)
+  {
+    STUBFUNC(dma, registerDMA8BlockChannel); return 0;
+  }
+  virtual unsigned registerDMA16BlockChannel(
+    unsigned channel,
+    Bit16u (* dmaRead)(Bit16u *buffer, Bit16u maxlen),
+    Bit16u (* dmaWrite)(Bit16u *buffer, Bit16u maxlen),
+    const char *name)
+  {
+    STUBFUNC(dma, registerDMA16BlockChannel); return 0;
+  }
   virtual unsigned unregisterDMAChannel(unsigned channel) {
     STUBFUNC(dma, unregisterDMAChannel); return 0;
   }
@@ -247,6 +268,10 @@ public:
                                  unsigned *txHeight, unsigned *txWidth) {
     STUBFUNC(vga, get_text_snapshot);
   }
+  virtual bx_bool get_gfx_snapshot(Bit8u **gfx_snapshot,
+                                   unsigned *iWidth, unsigned *iHeight) {
+    STUBFUNC(vga, get_gfx_snapshot);  return 0;
+  }
   virtual void trigger_timer(void *this_ptr) {
     STUBFUNC(vga, trigger_timer);
   }
@@ -362,6 +387,8 @@ public:
   void exit(void);
   void register_state(void);
   void after_restore_state(void);
+  void before_clone(void);
+  void after_clone(void);
   BX_MEM_C *mem;  // address space associated with these devices
   bx_bool register_io_read_handler(void *this_ptr, bx_read_handler_t f,
                                    Bit32u addr, const char *name, Bit8u mask);
@@ -385,8 +412,11 @@ public:
   bx_bool register_default_io_write_handler(void *this_ptr, bx_write_handler_t f, const char *name, Bit8u mask);
   bx_bool register_irq(unsigned irq, const char *name);
   bx_bool unregister_irq(unsigned irq, const char *name);
-  Bit32u inp(Bit16u addr, unsigned io_len) BX_CPP_AttrRegparmN(2);
-  void   outp(Bit16u addr, Bit32u value, unsigned io_len) BX_CPP_AttrRegparmN(3);
+  BX_CPP_INLINE Bit32u inp(Bit16u addr, unsigned io_len) BX_CPP_AttrRegparmN(2);
+  BX_CPP_INLINE void   outp(Bit16u addr, Bit32u value, unsigned io_len) BX_CPP_AttrRegparmN(3);
+#if BX_DEBUGGER
+  void toggle_io_stats(void);
+#endif
 
   void register_removable_keyboard(void *dev, bx_keyb_enq_t keyb_enq);
   void unregister_removable_keyboard(void *dev);
@@ -470,6 +500,7 @@ private:
 	char *handler_name;  // name of device
 	int usage_count;
 	Bit8u mask;          // io_len mask
+	Bit16u dispatch;     // index of the entry in the dispatch table
   };
   struct io_handler_struct io_read_handlers;
   struct io_handler_struct io_write_handlers;
@@ -477,6 +508,37 @@ private:
   struct io_handler_struct **read_port_to_handler;
   struct io_handler_struct **write_port_to_handler;
 
+  // The dispatch tables used by inp() and outp(). Each port holds the index
+  // of the entry of its handler, which has a function for each io_len, so
+  // an access with a length not in the handler mask goes to the bad length
+  // handler without being checked. Entry 0 is the default handler.
+#define BX_MAX_IO_DISPATCH 1024
+  struct io_dispatch_struct {
+    void *funct[3];   // handler for io_len 1, 2 and 4 (indexed by io_len >> 1)
+    void *this_ptr;
+    struct io_handler_struct *handler; // NULL if the entry is free
+  };
+  struct io_dispatch_struct io_read_dispatch[BX_MAX_IO_DISPATCH];
+  struct io_dispatch_struct io_write_dispatch[BX_MAX_IO_DISPATCH];
+  Bit16u *read_port_dispatch;
+  Bit16u *write_port_dispatch;
+
+  Bit16u alloc_io_dispatch(struct io_dispatch_struct *table, struct io_handler_struct *handler, void *bad_len);
+  void   set_io_dispatch(struct io_dispatch_struct *entry, struct io_handler_struct *handler, void *bad_len);
+  static Bit32u bad_len_read_handler(void *this_ptr, Bit32u address, unsigned io_len);
+  static void   bad_len_write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+
+#if BX_DEBUGGER
+  // number of accesses and host time spent in the handlers per port (reads
+  // at 0..PORTS-1, writes at PORTS..2*PORTS-1), only while 'show io-stats'
+  // is on. The clock has a resolution of 1 usec, but the sum over many
+  // accesses is still a good estimate.
+  struct io_stats_struct {
+    Bit64u count;
+    Bit64u usec;
+  } *io_stats;
+#endif
+
   // more for informative purposes, the names of the devices which
   // are use each of the IRQ 0..15 lines are stored here
   char *irq_handler_name[BX_MAX_IRQS];
@@ -584,4 +646,54 @@ BX_CPP_INLINE void DEV_MEM_WRITE_PHYSICAL_BLOCK(bx_phy_address phy_addr, unsigne
 
 BOCHSAPI extern bx_devices_c bx_devices;
 
+/*
+ * Read a byte of data from the IO memory address space
+ */
+
+BX_CPP_INLINE Bit32u bx_devices_c::inp(Bit16u addr, unsigned io_len)
+{
+  struct io_dispatch_struct *entry = &io_read_dispatch[read_port_dispatch[addr]];
+  Bit32u ret;
+
+  BX_INSTR_INP(addr, io_len);
+
+#if BX_DEBUGGER
+  if (io_stats) {
+    Bit64u start = bx_get_realtime64_usec();
+    ret = ((bx_read_handler_t)entry->funct[io_len >> 1])(entry->this_ptr, (Bit32u)addr, io_len);
+    io_stats[addr].count++;
+    io_stats[addr].usec += bx_get_realtime64_usec() - start;
+  } else
+#endif
+  ret = ((bx_read_handler_t)entry->funct[io_len >> 1])(entry->this_ptr, (Bit32u)addr, io_len);
+
+  BX_INSTR_INP2(addr, io_len, ret);
+  BX_DBG_IO_REPORT(addr, io_len, BX_READ, ret);
+
+  return(ret);
+}
+
+/*
+ * Write a byte of data to the IO memory address space.
+ */
+
+BX_CPP_INLINE void bx_devices_c::outp(Bit16u addr, Bit32u value, unsigned io_len)
+{
+  struct io_dispatch_struct *entry = &io_write_dispatch[write_port_dispatch[addr]];
+
+  BX_INSTR_OUTP(addr, io_len, value);
+  BX_DBG_IO_REPORT(addr, io_len, BX_WRITE, value);
+
+#if BX_DEBUGGER
+  if (io_stats) {
+    Bit64u start = bx_get_realtime64_usec();
+    ((bx_write_handler_t)entry->funct[io_len >> 1])(entry->this_ptr, (Bit32u)addr, value, io_len);
+    io_stats[PORTS + addr].count++;
+    io_stats[PORTS + addr].usec += bx_get_realtime64_usec() - start;
+    return;
+  }
+#endif
+  ((bx_write_handler_t)entry->funct[io_len >> 1])(entry->this_ptr, (Bit32u)addr, value, io_len);
+}
+
 #endif /* IODEV_H */
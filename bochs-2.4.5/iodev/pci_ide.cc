@@ -232,7 +232,7 @@ void bx_pci_ide_c::timer_handler(void *this_ptr)
 
 void bx_pci_ide_c::timer()
 {
-  int timer_id, count;
+  int timer_id, count, direct;
   Bit8u channel;
   Bit32u size, sector_size;
   struct {
@@ -256,7 +256,19 @@ void bx_pci_ide_c::timer()
   if (size == 0) {
     size = 0x10000;
   }
-  if (BX_PIDE_THIS s.bmdma[channel].cmd_rwcon) {
+  direct = 0;
+  if (BX_PIDE_THIS s.bmdma[channel].buffer_top == BX_PIDE_THIS s.bmdma[channel].buffer_idx) {
+    direct = BX_PIDE_THIS bmdma_direct(channel, prd.addr, size);
+    if (direct < 0) {
+      BX_PIDE_THIS s.bmdma[channel].status &= ~0x01;
+      BX_PIDE_THIS s.bmdma[channel].status |= 0x06;
+      return;
+    }
+  }
+  if (direct) {
+    BX_DEBUG(("%s DMA addr=0x%08x, size=0x%08x (direct)",
+              BX_PIDE_THIS s.bmdma[channel].cmd_rwcon ? "READ" : "WRITE", prd.addr, size));
+  } else if (BX_PIDE_THIS s.bmdma[channel].cmd_rwcon) {
     BX_DEBUG(("READ DMA to addr=0x%08x, size=0x%08x", prd.addr, size));
     count = size - (BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx);
     while (count > 0) {
@@ -312,6 +324,28 @@ void bx_pci_ide_c::timer()
   }
 }
 
+// Called for each PRD while no data is left in the buffer: resolves the
+// memory of the PRD to host memory and lets the drive transfer the sectors
+// with one request, so the data still moves one PRD per timer tick. Returns
+// 0 if the PRD has to go through the buffer (size not a multiple of 512,
+// memory not directly accessible, CD-ROM) and -1 on error.
+int bx_pci_ide_c::bmdma_direct(Bit8u channel, Bit32u addr, Bit32u size)
+{
+  bx_iovec_t iov[BX_PIDE_MAX_IOV];
+  int iovcnt;
+  bx_bool read = BX_PIDE_THIS s.bmdma[channel].cmd_rwcon;
+
+  if (size & 0x1ff) {
+    return 0;
+  }
+  iovcnt = BX_MEM(0)->getHostMemIovec(addr, size, read ? BX_WRITE : BX_READ,
+                                      iov, 0, BX_PIDE_MAX_IOV);
+  if (iovcnt < 0) {
+    return 0;
+  }
+  return DEV_hd_bmdma_transfer(channel, read, iov, iovcnt, size);
+}
+
 
 // static IO port read callback handler
 // redirects to non-static class handler to avoid virtual functions
@@ -31,6 +31,9 @@
 #  define BX_PIDE_THIS_PTR this
 #endif
 
+// maximum number of host memory ranges for a direct BM-DMA transfer
+#define BX_PIDE_MAX_IOV 256
+
 class bx_pci_ide_c : public bx_pci_ide_stub_c {
 public:
   bx_pci_ide_c();
@@ -53,6 +56,7 @@ public:
 
   static void timer_handler(void *);
   BX_PIDE_SMF void timer(void);
+  BX_PIDE_SMF int  bmdma_direct(Bit8u channel, Bit32u addr, Bit32u size);
 
 private:
 
@@ -0,0 +1,527 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Paravirtual PCI block device, see pcivblk.h for the interface.
+//
+//  The requests are executed synchronously when the doorbell is written:
+//  the data buffers are resolved to host memory and passed to the image
+//  with a single readv_sectors() / writev_sectors() call per descriptor.
+//  Only the interrupt is delayed by VBLK_IRQ_DELAY, so that a guest
+//  submitting requests one by one gets a single interrupt for all of them.
+//
+/////////////////////////////////////////////////////////////////////////
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+#if BX_SUPPORT_PCI && BX_SUPPORT_PCIVBLK
+
+#include "pci.h"
+#include "hdimage.h"
+#include "pcivblk.h"
+
+#define LOG_THIS theVBlkDevice->
+
+bx_pcivblk_c* theVBlkDevice = NULL;
+
+const Bit8u vblk_iomask[VBLK_IO_SIZE] = {4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0,
+                                         4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 0};
+
+int libpcivblk_LTX_plugin_init(plugin_t *plugin, plugintype_t type, int argc, char *argv[])
+{
+  theVBlkDevice = new bx_pcivblk_c();
+  BX_REGISTER_DEVICE_DEVMODEL(plugin, type, theVBlkDevice, BX_PLUGIN_PCIVBLK);
+  return 0; // Success
+}
+
+void libpcivblk_LTX_plugin_fini(void)
+{
+  delete theVBlkDevice;
+}
+
+bx_pcivblk_c::bx_pcivblk_c()
+{
+  put("VBLK");
+  image = NULL;
+  iov = NULL;
+  s.irq_timer_index = BX_NULL_TIMER_HANDLE;
+  s.flush_timer_index = BX_NULL_TIMER_HANDLE;
+}
+
+bx_pcivblk_c::~bx_pcivblk_c()
+{
+  if (image != NULL) {
+    image->close();
+    delete image;
+  }
+  if (iov != NULL) {
+    delete [] iov;
+  }
+  BX_DEBUG(("Exit"));
+}
+
+void bx_pcivblk_c::init(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PCIVBLK);
+  const char *path = SIM->get_param_string("path", base)->getptr();
+  const char *journal = SIM->get_param_string("journal", base)->getptr();
+  unsigned mode = SIM->get_param_enum("mode", base)->get();
+
+  switch (mode) {
+    case BX_ATA_MODE_FLAT:
+      BX_VBLK_THIS image = new default_image_t();
+      break;
+    case BX_ATA_MODE_GROWING:
+      BX_VBLK_THIS image = new growing_image_t();
+      break;
+    case BX_ATA_MODE_UNDOABLE:
+      BX_VBLK_THIS image = new undoable_image_t(journal);
+      break;
+    case BX_ATA_MODE_VOLATILE:
+      BX_VBLK_THIS image = new volatile_image_t(journal);
+      break;
+    case BX_ATA_MODE_COW:
+      BX_VBLK_THIS image = new cow_image_t(journal);
+      break;
+    default:
+      BX_PANIC(("'%s' mode images are not supported by the paravirtual block device",
+                atadevice_mode_names[mode]));
+      return;
+  }
+  if (BX_VBLK_THIS image->open(path) < 0) {
+    BX_PANIC(("could not open disk image file '%s'", path));
+    delete BX_VBLK_THIS image;
+    BX_VBLK_THIS image = NULL;
+    return;
+  }
+  BX_VBLK_THIS iov = new bx_iovec_t[VBLK_MAX_IOV];
+
+  BX_VBLK_THIS s.devfunc = 0x00;
+  DEV_register_pci_handlers(this, &BX_VBLK_THIS s.devfunc, BX_PLUGIN_PCIVBLK,
+                            "Paravirtual PCI block device");
+
+  for (unsigned i=0; i<256; i++) {
+    BX_VBLK_THIS s.pci_conf[i] = 0x0;
+  }
+  BX_VBLK_THIS s.base_ioaddr = 0;
+
+  if (BX_VBLK_THIS s.irq_timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_VBLK_THIS s.irq_timer_index =
+      bx_pc_system.register_timer(this, irq_timer_handler, VBLK_IRQ_DELAY, 0, 0, "pcivblk");
+  }
+  if (BX_VBLK_THIS s.flush_timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_VBLK_THIS s.flush_timer_index =
+      bx_pc_system.register_timer(this, flush_timer_handler, VBLK_FLUSH_INTERVAL, 1, 1,
+                                  "pcivblk write-back");
+  }
+
+  BX_INFO(("PCI block device: '%s' '%s' mode, " FMT_LL "u sectors", path,
+           atadevice_mode_names[mode], BX_VBLK_THIS image->hd_size / 512));
+}
+
+void bx_pcivblk_c::reset(unsigned type)
+{
+  unsigned i;
+
+  static const struct reset_vals_t {
+    unsigned      addr;
+    unsigned char val;
+  } reset_vals[] = {
+    { 0x00, VBLK_PCI_VENDOR & 0xff },
+    { 0x01, VBLK_PCI_VENDOR >> 8 },
+    { 0x02, VBLK_PCI_DEVICE & 0xff },
+    { 0x03, VBLK_PCI_DEVICE >> 8 },
+    { 0x04, 0x05 }, { 0x05, 0x00 },	// command_io
+    { 0x06, 0x80 }, { 0x07, 0x02 },	// status
+    { 0x08, 0x01 },                 // revision number
+    { 0x09, 0x00 },                 // interface
+    { 0x0a, 0x80 },                 // class_sub other
+    { 0x0b, 0x01 },                 // class_base Mass Storage Controller
+    { 0x0d, 0x20 },                 // bus latency
+    { 0x0e, 0x00 },                 // header_type_generic
+    // address space 0x10 - 0x13
+    { 0x10, 0x01 }, { 0x11, 0x00 },
+    { 0x12, 0x00 }, { 0x13, 0x00 },
+    { 0x3c, 0x00, },                // IRQ
+    { 0x3d, BX_PCI_INTA },          // INT
+  };
+  for (i = 0; i < sizeof(reset_vals) / sizeof(*reset_vals); ++i) {
+      BX_VBLK_THIS s.pci_conf[reset_vals[i].addr] = reset_vals[i].val;
+  }
+
+  BX_VBLK_THIS s.ring_addr = 0;
+  BX_VBLK_THIS s.ring_size = 0;
+  BX_VBLK_THIS s.avail = 0;
+  BX_VBLK_THIS s.used = 0;
+  BX_VBLK_THIS s.isr = 0;
+  BX_VBLK_THIS s.irq_enabled = 0;
+  bx_pc_system.deactivate_timer(BX_VBLK_THIS s.irq_timer_index);
+
+  // Deassert IRQ
+  set_irq_level(0);
+}
+
+void bx_pcivblk_c::register_state(void)
+{
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "pcivblk", "PCI Block Device State", 7);
+  BXRS_HEX_PARAM_FIELD(list, ring_addr, BX_VBLK_THIS s.ring_addr);
+  BXRS_DEC_PARAM_FIELD(list, ring_size, BX_VBLK_THIS s.ring_size);
+  BXRS_DEC_PARAM_FIELD(list, avail, BX_VBLK_THIS s.avail);
+  BXRS_DEC_PARAM_FIELD(list, used, BX_VBLK_THIS s.used);
+  BXRS_HEX_PARAM_FIELD(list, isr, BX_VBLK_THIS s.isr);
+  BXRS_PARAM_BOOL(list, irq_enabled, BX_VBLK_THIS s.irq_enabled);
+  register_pci_state(list, BX_VBLK_THIS s.pci_conf);
+}
+
+void bx_pcivblk_c::after_restore_state(void)
+{
+  if (DEV_pci_set_base_io(BX_VBLK_THIS_PTR, read_handler, write_handler,
+                          &BX_VBLK_THIS s.base_ioaddr,
+                          &BX_VBLK_THIS s.pci_conf[0x10],
+                          VBLK_IO_SIZE, &vblk_iomask[0], "VBLK")) {
+    BX_INFO(("new base address: 0x%04x", BX_VBLK_THIS s.base_ioaddr));
+  }
+  // requests are never outstanding, only the interrupt may be pending
+  if (BX_VBLK_THIS s.isr && BX_VBLK_THIS s.irq_enabled) {
+    set_irq_level(1);
+  }
+}
+
+// Called before the simulation is cloned (see clone.cc): the clones read
+// the metadata of the image from the shared file, so it is written back.
+void bx_pcivblk_c::before_clone(void)
+{
+  if ((BX_VBLK_THIS image != NULL) && (BX_VBLK_THIS image->flush_cache() < 0)) {
+    BX_ERROR(("could not flush disk image"));
+  }
+}
+
+// Called in a clone of the simulation (see clone.cc): like the ATA disks,
+// a flat image gets a private volatile redolog on top of the shared file
+// and a cow image gets it on top of the cow image with its copied tables.
+void bx_pcivblk_c::after_clone(void)
+{
+  bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_PCIVBLK);
+  unsigned mode = SIM->get_param_enum("mode", base)->get();
+  device_image_t *new_image;
+
+  if (BX_VBLK_THIS image == NULL)
+    return;
+  BX_VBLK_THIS image->after_clone();
+  if ((mode != BX_ATA_MODE_FLAT) && (mode != BX_ATA_MODE_COW)) {
+    BX_ERROR(("'%s' mode disk image is shared with the other clones",
+              atadevice_mode_names[mode]));
+    return;
+  }
+  if (mode == BX_ATA_MODE_COW) {
+    new_image = new volatile_image_t(BX_VBLK_THIS image, SIM->get_param_string("journal", base)->getptr());
+  } else {
+    new_image = new volatile_image_t(SIM->get_param_string("journal", base)->getptr());
+  }
+  if (new_image->open(SIM->get_param_string("path", base)->getptr()) < 0) {
+    BX_PANIC(("could not reopen disk image file '%s'",
+              SIM->get_param_string("path", base)->getptr()));
+    // the cow image is still in use
+    if (mode != BX_ATA_MODE_COW)
+      delete new_image;
+    return;
+  }
+  // the replaced cow image is owned by the new redolog
+  if (mode != BX_ATA_MODE_COW) {
+    BX_VBLK_THIS image->close();
+    delete BX_VBLK_THIS image;
+  }
+  BX_VBLK_THIS image = new_image;
+}
+
+void bx_pcivblk_c::set_irq_level(bx_bool level)
+{
+  DEV_pci_set_irq(BX_VBLK_THIS s.devfunc, BX_VBLK_THIS s.pci_conf[0x3d], level);
+}
+
+void bx_pcivblk_c::irq_timer_handler(void *this_ptr)
+{
+  bx_pcivblk_c *class_ptr = (bx_pcivblk_c *) this_ptr;
+  class_ptr->irq_timer();
+}
+
+void bx_pcivblk_c::irq_timer(void)
+{
+  if (BX_VBLK_THIS s.isr && BX_VBLK_THIS s.irq_enabled) {
+    set_irq_level(1);
+  }
+}
+
+void bx_pcivblk_c::flush_timer_handler(void *this_ptr)
+{
+  bx_pcivblk_c *class_ptr = (bx_pcivblk_c *) this_ptr;
+  class_ptr->flush_timer();
+}
+
+// Writes back the metadata that the image keeps in memory, in case the
+// guest never sends a flush request. The requests are executed at the
+// doorbell write, so the image is never in use here.
+void bx_pcivblk_c::flush_timer(void)
+{
+  if ((BX_VBLK_THIS image != NULL) && (BX_VBLK_THIS image->flush_cache() < 0)) {
+    BX_ERROR(("could not flush disk image"));
+  }
+}
+
+// Transfers the data of one descriptor. The guest buffer is accessed in
+// place if it is in RAM, otherwise through a temporary buffer.
+Bit8u bx_pcivblk_c::execute(Bit64u sector, Bit32u addr, unsigned count, Bit8u command)
+{
+  Bit32u len = count << 9;
+  Bit64u disk_sectors = BX_VBLK_THIS image->hd_size / 512;
+  ssize_t ret;
+  int iovcnt;
+
+  if (command == VBLK_CMD_FLUSH) {
+    return (BX_VBLK_THIS image->flush_cache() < 0) ? VBLK_STATUS_ERROR : VBLK_STATUS_OK;
+  }
+  if (((command != VBLK_CMD_READ) && (command != VBLK_CMD_WRITE)) ||
+      (sector >= disk_sectors) || (count > disk_sectors - sector)) {
+    BX_ERROR(("invalid request: command %d, sector " FMT_LL "u, count %d",
+              command, sector, count));
+    return VBLK_STATUS_ERROR;
+  }
+  if (count == 0) {
+    return VBLK_STATUS_OK;
+  }
+
+  iovcnt = BX_MEM(0)->getHostMemIovec(addr, len, (command == VBLK_CMD_READ) ? BX_WRITE : BX_READ,
+                                      BX_VBLK_THIS iov, 0, VBLK_MAX_IOV);
+  if (iovcnt > 0) {
+    if (command == VBLK_CMD_READ) {
+      ret = BX_VBLK_THIS image->readv_sectors(sector, BX_VBLK_THIS iov, iovcnt);
+    } else {
+      ret = BX_VBLK_THIS image->writev_sectors(sector, BX_VBLK_THIS iov, iovcnt);
+    }
+  } else {
+    Bit8u *buffer = new Bit8u[len];
+    if (command == VBLK_CMD_READ) {
+      ret = BX_VBLK_THIS image->read_sectors(sector, buffer, count);
+      if (ret == (ssize_t)len) {
+        DEV_MEM_WRITE_PHYSICAL_BLOCK(addr, len, buffer);
+      }
+    } else {
+      DEV_MEM_READ_PHYSICAL_BLOCK(addr, len, buffer);
+      ret = BX_VBLK_THIS image->write_sectors(sector, buffer, count);
+    }
+    delete [] buffer;
+  }
+  if (ret != (ssize_t)len) {
+    BX_ERROR(("could not %s sectors " FMT_LL "u - " FMT_LL "u",
+              (command == VBLK_CMD_READ) ? "read" : "write", sector, sector + count - 1));
+    return VBLK_STATUS_ERROR;
+  }
+  return VBLK_STATUS_OK;
+}
+
+// Executes all descriptors between the consumer and the producer index.
+void bx_pcivblk_c::process_ring(void)
+{
+  Bit8u desc[VBLK_DESC_SIZE];
+  Bit64u sector;
+  Bit32u desc_addr, addr;
+  Bit16u count;
+  Bit8u status;
+
+  if (BX_VBLK_THIS s.ring_size == 0) {
+    BX_ERROR(("doorbell written without a ring"));
+    return;
+  }
+  if ((Bit32u)(BX_VBLK_THIS s.avail - BX_VBLK_THIS s.used) > BX_VBLK_THIS s.ring_size) {
+    BX_ERROR(("producer index %d is beyond the end of the ring", BX_VBLK_THIS s.avail));
+    BX_VBLK_THIS s.avail = BX_VBLK_THIS s.used + BX_VBLK_THIS s.ring_size;
+  }
+  if (BX_VBLK_THIS s.avail == BX_VBLK_THIS s.used)
+    return;
+
+  while (BX_VBLK_THIS s.used != BX_VBLK_THIS s.avail) {
+    desc_addr = BX_VBLK_THIS s.ring_addr +
+      (BX_VBLK_THIS s.used & (BX_VBLK_THIS s.ring_size - 1)) * VBLK_DESC_SIZE;
+    DEV_MEM_READ_PHYSICAL(desc_addr, VBLK_DESC_SIZE, desc);
+    ReadHostQWordFromLittleEndian(&desc[0x00], sector);
+    ReadHostDWordFromLittleEndian(&desc[0x08], addr);
+    ReadHostWordFromLittleEndian(&desc[0x0c], count);
+    status = BX_VBLK_THIS execute(sector, addr, count, desc[0x0e]);
+    DEV_MEM_WRITE_PHYSICAL(desc_addr + 0x0f, 1, &status);
+    BX_VBLK_THIS s.used++;
+  }
+
+  if (!BX_VBLK_THIS s.isr) {
+    BX_VBLK_THIS s.isr = 0x01;
+    bx_pc_system.activate_timer(BX_VBLK_THIS s.irq_timer_index, VBLK_IRQ_DELAY, 0);
+  }
+}
+
+// static IO port read callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+Bit32u bx_pcivblk_c::read_handler(void *this_ptr, Bit32u address, unsigned io_len)
+{
+#if !BX_USE_PCIVBLK_SMF
+  bx_pcivblk_c *class_ptr = (bx_pcivblk_c *) this_ptr;
+  return class_ptr->read(address, io_len);
+}
+
+Bit32u bx_pcivblk_c::read(Bit32u address, unsigned io_len)
+{
+#else
+  UNUSED(this_ptr);
+#endif // !BX_USE_PCIVBLK_SMF
+  Bit32u value = 0;
+
+  switch (address - BX_VBLK_THIS s.base_ioaddr) {
+    case VBLK_REG_ID:
+      value = VBLK_ID_MAGIC;
+      break;
+    case VBLK_REG_CAPACITY_LO:
+      value = (Bit32u)(BX_VBLK_THIS image->hd_size >> 9);
+      break;
+    case VBLK_REG_CAPACITY_HI:
+      value = (Bit32u)(BX_VBLK_THIS image->hd_size >> 41);
+      break;
+    case VBLK_REG_RING_ADDR:
+      value = BX_VBLK_THIS s.ring_addr;
+      break;
+    case VBLK_REG_RING_SIZE:
+      value = BX_VBLK_THIS s.ring_size;
+      break;
+    case VBLK_REG_DOORBELL:
+      value = BX_VBLK_THIS s.avail;
+      break;
+    case VBLK_REG_COMPLETED:
+      value = BX_VBLK_THIS s.used;
+      break;
+    case VBLK_REG_ISR:
+      value = BX_VBLK_THIS s.isr;
+      BX_VBLK_THIS s.isr = 0;
+      set_irq_level(0);
+      break;
+  }
+  BX_DEBUG(("register read from address 0x%04x: 0x%08x", (unsigned) address, value));
+
+  return value;
+}
+
+// static IO port write callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+void bx_pcivblk_c::write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len)
+{
+#if !BX_USE_PCIVBLK_SMF
+  bx_pcivblk_c *class_ptr = (bx_pcivblk_c *) this_ptr;
+  class_ptr->write(address, value, io_len);
+}
+
+void bx_pcivblk_c::write(Bit32u address, Bit32u value, unsigned io_len)
+{
+#else
+  UNUSED(this_ptr);
+#endif // !BX_USE_PCIVBLK_SMF
+
+  BX_DEBUG(("register write to address 0x%04x: 0x%08x", (unsigned) address, value));
+
+  switch (address - BX_VBLK_THIS s.base_ioaddr) {
+    case VBLK_REG_RING_ADDR:
+      BX_VBLK_THIS s.ring_addr = value;
+      break;
+    case VBLK_REG_RING_SIZE:
+      if ((value > VBLK_MAX_RING_SIZE) || (value & (value - 1))) {
+        BX_ERROR(("invalid ring size %d", value));
+        value = 0;
+      }
+      BX_VBLK_THIS s.ring_size = value;
+      BX_VBLK_THIS s.avail = 0;
+      BX_VBLK_THIS s.used = 0;
+      break;
+    case VBLK_REG_DOORBELL:
+      BX_VBLK_THIS s.avail = value;
+      BX_VBLK_THIS process_ring();
+      break;
+    case VBLK_REG_ISR:
+      BX_VBLK_THIS s.irq_enabled = value & 0x01;
+      set_irq_level(BX_VBLK_THIS s.isr && BX_VBLK_THIS s.irq_enabled);
+      break;
+    default:
+      BX_ERROR(("write to read-only register 0x%04x ignored", (unsigned) address));
+  }
+}
+
+// pci configuration space read callback handler
+Bit32u bx_pcivblk_c::pci_read_handler(Bit8u address, unsigned io_len)
+{
+  Bit32u value = 0;
+
+  for (unsigned i=0; i<io_len; i++) {
+    value |= (BX_VBLK_THIS s.pci_conf[address+i] << (i*8));
+  }
+
+  if (io_len == 1)
+    BX_DEBUG(("read  PCI register 0x%02x value 0x%02x", address, value));
+  else if (io_len == 2)
+    BX_DEBUG(("read  PCI register 0x%02x value 0x%04x", address, value));
+  else if (io_len == 4)
+    BX_DEBUG(("read  PCI register 0x%02x value 0x%08x", address, value));
+
+  return value;
+}
+
+// pci configuration space write callback handler
+void bx_pcivblk_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len)
+{
+  Bit8u value8, oldval;
+  bx_bool baseaddr_change = 0;
+
+  if ((address > 0x13) && (address < 0x34))
+    return;
+
+  for (unsigned i=0; i<io_len; i++) {
+    value8 = (value >> (i*8)) & 0xFF;
+    oldval = BX_VBLK_THIS s.pci_conf[address+i];
+    switch (address+i) {
+      case 0x3d: //
+      case 0x05: // disallowing write to command hi-byte
+      case 0x06: // disallowing write to status lo-byte (is that expected?)
+        break;
+      case 0x3c:
+        if (value8 != oldval) {
+          BX_INFO(("new irq line = %d", value8));
+          BX_VBLK_THIS s.pci_conf[address+i] = value8;
+        }
+        break;
+      case 0x10:
+        value8 = (value8 & 0xfc) | 0x01;
+      case 0x11:
+      case 0x12:
+      case 0x13:
+        baseaddr_change |= (value8 != oldval);
+      default:
+        BX_VBLK_THIS s.pci_conf[address+i] = value8;
+    }
+  }
+  if (baseaddr_change) {
+    if (DEV_pci_set_base_io(BX_VBLK_THIS_PTR, read_handler, write_handler,
+                            &BX_VBLK_THIS s.base_ioaddr,
+                            &BX_VBLK_THIS s.pci_conf[0x10],
+                            VBLK_IO_SIZE, &vblk_iomask[0], "VBLK")) {
+      BX_INFO(("new base address: 0x%04x", BX_VBLK_THIS s.base_ioaddr));
+    }
+  }
+
+  if (io_len == 1)
+    BX_DEBUG(("write PCI register 0x%02x value 0x%02x", address, value));
+  else if (io_len == 2)
+    BX_DEBUG(("write PCI register 0x%02x value 0x%04x", address, value));
+  else if (io_len == 4)
+    BX_DEBUG(("write PCI register 0x%02x value 0x%08x", address, value));
+}
+
+#endif // BX_SUPPORT_PCI && BX_SUPPORT_PCIVBLK
@@ -0,0 +1,134 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Paravirtual PCI block device.
+//
+//  The guest places request descriptors in a ring in its memory and
+//  submits any number of them with a single write of the producer index
+//  to the doorbell register. The device completes the requests in order,
+//  writes the status back into the descriptors and signals the completions
+//  with one (coalesced) interrupt.
+//
+//  I/O space (BAR0, 32-bit registers only):
+//
+//    0x00  ID          R   VBLK_ID_MAGIC
+//    0x04  CAPACITY_LO R   disk size in sectors, low dword
+//    0x08  CAPACITY_HI R   disk size in sectors, high dword
+//    0x0c  RING_ADDR   RW  guest physical address of the descriptor ring
+//    0x10  RING_SIZE   RW  number of descriptors (power of 2, max 1024),
+//                          writing resets the producer / consumer indices
+//    0x14  DOORBELL    RW  producer index (free running)
+//    0x18  COMPLETED   R   consumer index (free running)
+//    0x1c  ISR         R   interrupt status, read clears it and the IRQ
+//                      W   bit 0 enables the completion interrupt
+//
+//  Descriptor (16 bytes, little endian):
+//
+//    0x00  sector   64-bit start sector
+//    0x08  addr     32-bit guest physical buffer address
+//    0x0c  count    16-bit number of sectors
+//    0x0e  command  VBLK_CMD_*
+//    0x0f  status   VBLK_STATUS_*, written by the device
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_IODEV_PCIVBLK_H
+#define BX_IODEV_PCIVBLK_H
+
+#if BX_USE_PCIVBLK_SMF
+#  define BX_VBLK_SMF  static
+#  define BX_VBLK_THIS theVBlkDevice->
+#  define BX_VBLK_THIS_PTR theVBlkDevice
+#else
+#  define BX_VBLK_SMF
+#  define BX_VBLK_THIS this->
+#  define BX_VBLK_THIS_PTR this
+#endif
+
+#define VBLK_PCI_VENDOR     0xfefe
+#define VBLK_PCI_DEVICE     0xefee
+#define VBLK_ID_MAGIC       0x6b6c6276  // "vblk"
+
+#define VBLK_REG_ID         0x00
+#define VBLK_REG_CAPACITY_LO 0x04
+#define VBLK_REG_CAPACITY_HI 0x08
+#define VBLK_REG_RING_ADDR  0x0c
+#define VBLK_REG_RING_SIZE  0x10
+#define VBLK_REG_DOORBELL   0x14
+#define VBLK_REG_COMPLETED  0x18
+#define VBLK_REG_ISR        0x1c
+#define VBLK_IO_SIZE        32
+
+#define VBLK_CMD_READ       1
+#define VBLK_CMD_WRITE      2
+#define VBLK_CMD_FLUSH      3
+
+#define VBLK_STATUS_OK      0
+#define VBLK_STATUS_ERROR   1
+
+#define VBLK_DESC_SIZE      16
+#define VBLK_MAX_RING_SIZE  1024
+#define VBLK_MAX_IOV        (65536 / 8 + 1)  // pages of the largest request
+
+// delay between the first completion and the interrupt, completions
+// of further doorbell writes in this time share the interrupt
+#define VBLK_IRQ_DELAY      10
+// interval of the write-back of the image metadata (usec)
+#define VBLK_FLUSH_INTERVAL 5000000
+
+typedef struct {
+
+  Bit32u base_ioaddr;
+  Bit32u ring_addr;
+  Bit32u ring_size;
+  Bit32u avail;       // producer index written by the guest
+  Bit32u used;        // consumer index of the device
+  Bit8u  isr;
+  bx_bool irq_enabled;
+  int    irq_timer_index;
+  int    flush_timer_index;
+
+  Bit8u devfunc;
+  Bit8u pci_conf[256];
+
+} bx_vblk_t;
+
+
+class bx_pcivblk_c : public bx_devmodel_c, public bx_pci_device_stub_c {
+public:
+  bx_pcivblk_c();
+  virtual ~bx_pcivblk_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+  virtual void before_clone(void);
+  virtual void after_clone(void);
+
+  virtual Bit32u pci_read_handler(Bit8u address, unsigned io_len);
+  virtual void   pci_write_handler(Bit8u address, Bit32u value, unsigned io_len);
+
+private:
+  bx_vblk_t s;
+  device_image_t *image;
+  bx_iovec_t *iov;
+
+  BX_VBLK_SMF void set_irq_level(bx_bool level);
+  BX_VBLK_SMF void process_ring(void);
+  BX_VBLK_SMF Bit8u execute(Bit64u sector, Bit32u addr, unsigned count, Bit8u command);
+
+  static void irq_timer_handler(void *);
+  void irq_timer(void);
+  static void flush_timer_handler(void *);
+  void flush_timer(void);
+
+  static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
+  static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+#if !BX_USE_PCIVBLK_SMF
+  Bit32u read(Bit32u address, unsigned io_len);
+  void   write(Bit32u address, Bit32u value, unsigned io_len);
+#endif
+};
+
+#endif
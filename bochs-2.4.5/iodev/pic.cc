@@ -44,9 +44,31 @@ void libpic_LTX_plugin_fini(void)
   delete thePic;
 }
 
+// Number of the lowest set bit of each byte value (8 for 0)
+static Bit8u pic_lowest_bit[256];
+
+static void pic_init_lowest_bit(void)
+{
+  pic_lowest_bit[0] = 8;
+  for (unsigned i=1; i<256; i++) {
+    Bit8u bit = 0;
+    while (!(i & (1 << bit))) bit++;
+    pic_lowest_bit[i] = bit;
+  }
+}
+
+// Rotates the IRQ bitmap so that bit 0 is the IRQ with the highest
+// priority. The lowest set bit of the result is then the highest
+// priority IRQ and is found with a single table lookup.
+static BX_CPP_INLINE Bit8u pic_rotate(Bit8u bits, Bit8u highest_priority)
+{
+  return (Bit8u) ((bits >> highest_priority) | (bits << (8 - highest_priority)));
+}
+
 bx_pic_c::bx_pic_c(void)
 {
   put("PIC");
+  pic_init_lowest_bit();
 }
 
 bx_pic_c::~bx_pic_c(void)
@@ -668,151 +690,71 @@ void bx_pic_c::set_mode(bx_bool ma_sl, Bit8u mode)
 
 void bx_pic_c::clear_highest_interrupt(bx_pic_t *pic)
 {
-  int irq;
-  int lowest_priority;
-  int highest_priority;
-
   /* clear highest current in service bit */
-  lowest_priority = pic->lowest_priority;
-  highest_priority = lowest_priority + 1;
-  if(highest_priority > 7)
-    highest_priority = 0;
-
-  irq = highest_priority;
-  do {
-    if (pic->isr & (1 << irq)) {
-      pic->isr &= ~(1 << irq);
-      break; /* Return mask of bit cleared. */
-    }
+  Bit8u highest_priority = (pic->lowest_priority + 1) & 7;
+  Bit8u isr = pic_rotate(pic->isr, highest_priority);
 
-    irq ++;
-    if(irq > 7)
-      irq = 0;
-  } while(irq != highest_priority);
+  if (isr) {
+    pic->isr &= ~(1 << ((pic_lowest_bit[isr] + highest_priority) & 7));
+  }
 }
 
-void bx_pic_c::service_master_pic(void)
+// Returns the highest priority IRQ that is requested, not masked and
+// not blocked by an in-service IRQ of higher priority, or -1 if there is
+// none.
+int bx_pic_c::highest_request(bx_pic_t *pic)
 {
-  Bit8u unmasked_requests;
-  int irq;
-  Bit8u isr, max_irq;
-  Bit8u highest_priority = BX_PIC_THIS s.master_pic.lowest_priority + 1;
-  if(highest_priority > 7)
-    highest_priority = 0;
+  Bit8u highest_priority = (pic->lowest_priority + 1) & 7;
+  Bit8u requests = pic_rotate(pic->irr & ~pic->imr, highest_priority);
+  Bit8u isr = pic_rotate(pic->isr, highest_priority);
 
-  if (BX_PIC_THIS s.master_pic.INT) { /* last interrupt still not acknowleged */
-    return;
-  }
-
-  if (BX_PIC_THIS s.master_pic.special_mask) {
+  if (pic->special_mask) {
     /* all priorities may be enabled.  check all IRR bits except ones
      * which have corresponding ISR bits set
      */
-    max_irq = highest_priority;
+    requests &= ~isr;
   }
-  else { /* normal mode */
-    /* Find the highest priority IRQ that is enabled due to current ISR */
-    isr = BX_PIC_THIS s.master_pic.isr;
-    if (isr) {
-      max_irq = highest_priority;
-      while ((isr & (1 << max_irq)) == 0) {
-        max_irq++;
-        if(max_irq > 7)
-          max_irq = 0;
-      }
-      if (max_irq == highest_priority) return; /* Highest priority interrupt in-service,
-                                                * no other priorities allowed */
-      if (max_irq > 7) BX_PANIC(("error in service_master_pic()"));
-    }
-    else
-      max_irq = highest_priority; /* 0..7 bits in ISR are cleared */
+  else if (isr) {
+    /* normal mode: only IRQs with a higher priority than the highest
+     * priority one in service
+     */
+    requests &= (isr & (Bit8u) -isr) - 1;
   }
 
-  /* now, see if there are any higher priority requests */
-  if ((unmasked_requests = (BX_PIC_THIS s.master_pic.irr & ~BX_PIC_THIS s.master_pic.imr))) {
-    irq = highest_priority;
-    do {
-      /* for special mode, since we're looking at all IRQ's, skip if
-       * current IRQ is already in-service
-       */
-      if (! (BX_PIC_THIS s.master_pic.special_mask && ((BX_PIC_THIS s.master_pic.isr >> irq) & 0x01))) {
-        if (unmasked_requests & (1 << irq)) {
-          BX_DEBUG(("signalling IRQ(%u)", (unsigned) irq));
-          BX_PIC_THIS s.master_pic.INT = 1;
-          BX_PIC_THIS s.master_pic.irq = irq;
-          BX_SET_INTR(1);
-          return;
-        } /* if (unmasked_requests & ... */
-      }
-
-      irq ++;
-      if(irq > 7)
-        irq = 0;
-    } while(irq != max_irq); /* do ... */
-  } /* if (unmasked_requests = ... */
+  if (!requests) return -1;
+  return (pic_lowest_bit[requests] + highest_priority) & 7;
 }
 
-void bx_pic_c::service_slave_pic(void)
+void bx_pic_c::service_master_pic(void)
 {
-  Bit8u unmasked_requests;
   int irq;
-  Bit8u isr, max_irq;
-  Bit8u highest_priority = BX_PIC_THIS s.slave_pic.lowest_priority + 1;
-  if(highest_priority > 7)
-    highest_priority = 0;
 
-  if (BX_PIC_THIS s.slave_pic.INT) { /* last interrupt still not acknowleged */
+  if (BX_PIC_THIS s.master_pic.INT) { /* last interrupt still not acknowleged */
     return;
   }
 
-  if (BX_PIC_THIS s.slave_pic.special_mask) {
-    /* all priorities may be enabled.  check all IRR bits except ones
-     * which have corresponding ISR bits set
-     */
-    max_irq = highest_priority;
-  }
-  else { /* normal mode */
-    /* Find the highest priority IRQ that is enabled due to current ISR */
-    isr = BX_PIC_THIS s.slave_pic.isr;
-    if (isr) {
-      max_irq = highest_priority;
-      while ((isr & (1 << max_irq)) == 0) {
-        max_irq++;
-        if(max_irq > 7)
-          max_irq = 0;
-      }
-      if (max_irq == highest_priority) return; /* Highest priority interrupt in-service,
-                                                * no other priorities allowed */
-      if (max_irq > 7) BX_PANIC(("error in service_master_pic()"));
-    }
-    else
-      max_irq = highest_priority; /* 0..7 bits in ISR are cleared */
+  if ((irq = highest_request(&BX_PIC_THIS s.master_pic)) >= 0) {
+    BX_DEBUG(("signalling IRQ(%u)", (unsigned) irq));
+    BX_PIC_THIS s.master_pic.INT = 1;
+    BX_PIC_THIS s.master_pic.irq = irq;
+    BX_SET_INTR(1);
   }
+}
 
-  /* now, see if there are any higher priority requests */
-  if ((unmasked_requests = (BX_PIC_THIS s.slave_pic.irr & ~BX_PIC_THIS s.slave_pic.imr))) {
-    irq = highest_priority;
-    do {
-      /* for special mode, since we're looking at all IRQ's, skip if
-       * current IRQ is already in-service
-       */
-      if (! (BX_PIC_THIS s.slave_pic.special_mask && ((BX_PIC_THIS s.slave_pic.isr >> irq) & 0x01))) {
-        if (unmasked_requests & (1 << irq)) {
-          BX_DEBUG(("slave: signalling IRQ(%u)", (unsigned) 8 + irq));
-
-          BX_PIC_THIS s.slave_pic.INT = 1;
-          BX_PIC_THIS s.slave_pic.irq = irq;
-          BX_PIC_THIS raise_irq(2); /* request IRQ 2 on master pic */
-          return;
-        } /* if (unmasked_requests & ... */
-      }
+void bx_pic_c::service_slave_pic(void)
+{
+  int irq;
 
-      irq ++;
-      if(irq > 7)
-        irq = 0;
+  if (BX_PIC_THIS s.slave_pic.INT) { /* last interrupt still not acknowleged */
+    return;
+  }
 
-    } while(irq != max_irq); /* do ... */
-  } /* if (unmasked_requests = ... */
+  if ((irq = highest_request(&BX_PIC_THIS s.slave_pic)) >= 0) {
+    BX_DEBUG(("slave: signalling IRQ(%u)", (unsigned) 8 + irq));
+    BX_PIC_THIS s.slave_pic.INT = 1;
+    BX_PIC_THIS s.slave_pic.irq = irq;
+    BX_PIC_THIS raise_irq(2); /* request IRQ 2 on master pic */
+  }
 }
 
 /* CPU handshakes with PIC after acknowledging interrupt */
@@ -92,6 +92,7 @@ private:
   BX_PIC_SMF void   service_master_pic(void);
   BX_PIC_SMF void   service_slave_pic(void);
   BX_PIC_SMF void   clear_highest_interrupt(bx_pic_t *pic);
+  BX_PIC_SMF int    highest_request(bx_pic_t *pic);
 };
 
 #endif
@@ -969,6 +969,27 @@ Bit32u pit_82C54::get_next_event_time(void)
   return out;
 }
 
+// Returns the number of clocks until OUT of counter cnum may rise next,
+// or 0 if the counter is stopped. In mode 2 the one clock low pulse at
+// the end of the period is skipped, it is clocked together with the
+// rising edge that follows it. In the other modes this is the time of
+// the next state change.
+Bit32u pit_82C54::get_next_OUT_rise_time(Bit8u cnum)
+{
+  if (cnum>MAX_COUNTER) {
+    BX_ERROR(("Counter number incorrect in 82C54 get_next_OUT_rise_time"));
+    return 0;
+  }
+
+  counter_type &thisctr = counter[cnum];
+  if ((thisctr.mode == 2) && thisctr.count_written && thisctr.GATE &&
+      thisctr.OUTpin && !thisctr.first_pass && !thisctr.triggerGATE &&
+      (thisctr.next_change_time != 0)) {
+    return thisctr.next_change_time + 1;
+  }
+  return thisctr.next_change_time;
+}
+
 Bit16u pit_82C54::get_inlatch(int counternum)
 {
   return counter[counternum].inlatch;
@@ -140,6 +140,7 @@ public:
 
   Bit32u get_clock_event_time(Bit8u cnum);
   Bit32u get_next_event_time(void);
+  Bit32u get_next_OUT_rise_time(Bit8u cnum);
   Bit16u get_inlatch(int countnum);
 
   void print_cnum(Bit8u cnum);
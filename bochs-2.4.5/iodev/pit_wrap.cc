@@ -119,26 +119,16 @@ void bx_pit_c::init(void)
   if (BX_PIT_THIS s.timer_handle[0] == BX_NULL_TIMER_HANDLE) {
     BX_PIT_THIS s.timer_handle[0] = bx_virt_timer.register_timer(this, timer_handler, (unsigned) 100 , 1, 1, "pit_wrap");
   }
-  BX_DEBUG(("RESETting timer."));
-  bx_virt_timer.deactivate_timer(BX_PIT_THIS s.timer_handle[0]);
-  BX_DEBUG(("deactivated timer."));
-  if (BX_PIT_THIS s.timer.get_next_event_time()) {
-    bx_virt_timer.activate_timer(BX_PIT_THIS s.timer_handle[0],
-                                 (Bit32u)BX_MAX(1,TICKS_TO_USEC(BX_PIT_THIS s.timer.get_next_event_time())),
-                                 0);
-    BX_DEBUG(("activated timer."));
-  }
-  BX_PIT_THIS s.last_next_event_time = BX_PIT_THIS s.timer.get_next_event_time();
   BX_PIT_THIS s.last_usec=my_time_usec;
-
   BX_PIT_THIS s.total_ticks=0;
   BX_PIT_THIS s.total_usec=0;
+  BX_PIT_THIS s.last_next_event_time=0;
+  update_timer(1);
 
   BX_DEBUG(("finished init"));
 
   BX_DEBUG(("s.last_usec="FMT_LL"d",BX_PIT_THIS s.last_usec));
   BX_DEBUG(("s.timer_id=%d",BX_PIT_THIS s.timer_handle[0]));
-  BX_DEBUG(("s.timer.get_next_event_time=%d",BX_PIT_THIS s.timer.get_next_event_time()));
   BX_DEBUG(("s.last_next_event_time=%d",BX_PIT_THIS s.last_next_event_time));
 }
 
@@ -178,22 +168,9 @@ void bx_pit_c::handle_timer()
     periodic(time_passed32);
   }
   BX_PIT_THIS s.last_usec=BX_PIT_THIS s.last_usec + time_passed;
-  if(time_passed || (BX_PIT_THIS s.last_next_event_time != BX_PIT_THIS s.timer.get_next_event_time()))
-  {
-    BX_DEBUG(("RESETting timer"));
-    bx_virt_timer.deactivate_timer(BX_PIT_THIS s.timer_handle[0]);
-    BX_DEBUG(("deactivated timer"));
-    if(BX_PIT_THIS s.timer.get_next_event_time()) {
-      bx_virt_timer.activate_timer(BX_PIT_THIS s.timer_handle[0],
-                                   (Bit32u)BX_MAX(1,TICKS_TO_USEC(BX_PIT_THIS s.timer.get_next_event_time())),
-                                   0);
-      BX_DEBUG(("activated timer"));
-    }
-    BX_PIT_THIS s.last_next_event_time = BX_PIT_THIS s.timer.get_next_event_time();
-  }
+  update_timer(time_passed != 0);
   BX_DEBUG(("s.last_usec="FMT_LL"d",BX_PIT_THIS s.last_usec));
   BX_DEBUG(("s.timer_id=%d",BX_PIT_THIS s.timer_handle[0]));
-  BX_DEBUG(("s.timer.get_next_event_time=%x",BX_PIT_THIS s.timer.get_next_event_time()));
   BX_DEBUG(("s.last_next_event_time=%d",BX_PIT_THIS s.last_next_event_time));
 }
 
@@ -312,24 +289,40 @@ void bx_pit_c::write(Bit32u address, Bit32u dvalue, unsigned io_len)
       BX_PANIC(("unsupported io write to port 0x%04x = 0x%02x", address, value));
   }
 
-  if(time_passed || (BX_PIT_THIS s.last_next_event_time != BX_PIT_THIS s.timer.get_next_event_time()))
-  {
+  update_timer(time_passed != 0);
+  BX_DEBUG(("s.last_usec="FMT_LL"d",BX_PIT_THIS s.last_usec));
+  BX_DEBUG(("s.timer_id=%d",BX_PIT_THIS s.timer_handle[0]));
+  BX_DEBUG(("s.last_next_event_time=%d",BX_PIT_THIS s.last_next_event_time));
+
+}
+
+// The counters are clocked up to the current time on every port access,
+// so the timer is only needed for the rising edges of OUT0 (IRQ0). The
+// state changes in between, like the end of the low pulse in mode 2, are
+// clocked when the edge is due.
+void bx_pit_c::update_timer(bx_bool time_passed)
+{
+  Bit32u next_event_time = BX_PIT_THIS s.timer.get_next_OUT_rise_time(0);
+
+  if (time_passed || (BX_PIT_THIS s.last_next_event_time != next_event_time)) {
     BX_DEBUG(("RESETting timer"));
     bx_virt_timer.deactivate_timer(BX_PIT_THIS s.timer_handle[0]);
-    BX_DEBUG(("deactivated timer"));
-    if(BX_PIT_THIS s.timer.get_next_event_time()) {
+    if (next_event_time) {
       bx_virt_timer.activate_timer(BX_PIT_THIS s.timer_handle[0],
-                                   (Bit32u)BX_MAX(1,TICKS_TO_USEC(BX_PIT_THIS s.timer.get_next_event_time())),
-                                   0);
+                                   ticks_to_usec(next_event_time), 0);
       BX_DEBUG(("activated timer"));
     }
-    BX_PIT_THIS s.last_next_event_time = BX_PIT_THIS s.timer.get_next_event_time();
+    BX_PIT_THIS s.last_next_event_time = next_event_time;
   }
-  BX_DEBUG(("s.last_usec="FMT_LL"d",BX_PIT_THIS s.last_usec));
-  BX_DEBUG(("s.timer_id=%d",BX_PIT_THIS s.timer_handle[0]));
-  BX_DEBUG(("s.timer.get_next_event_time=%x",BX_PIT_THIS s.timer.get_next_event_time()));
-  BX_DEBUG(("s.last_next_event_time=%d",BX_PIT_THIS s.last_next_event_time));
+}
 
+// Returns the time in usec until the given number of further PIT clocks
+// have passed, rounded up so the timer does not fire before the edge.
+Bit32u bx_pit_c::ticks_to_usec(Bit32u ticks)
+{
+  Bit64u usec = ((BX_PIT_THIS s.total_ticks + ticks) * USEC_PER_SECOND +
+                 TICKS_PER_SECOND - 1) / TICKS_PER_SECOND;
+  return (Bit32u) BX_MAX(1, usec - BX_PIT_THIS s.total_usec);
 }
 
 bx_bool bx_pit_c::periodic(Bit32u usec_delta)
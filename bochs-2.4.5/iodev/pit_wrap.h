@@ -62,6 +62,8 @@ private:
   static void timer_handler(void *this_ptr);
   BX_PIT_SMF void handle_timer();
   BX_PIT_SMF bx_bool periodic(Bit32u usec_delta);
+  BX_PIT_SMF void update_timer(bx_bool time_passed);
+  BX_PIT_SMF Bit32u ticks_to_usec(Bit32u ticks);
 
   BX_PIT_SMF void  irq_handler(bx_bool value);
 
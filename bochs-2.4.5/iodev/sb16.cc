@@ -1360,74 +1360,122 @@ void bx_sb16_c::dsp_dmadone()
 // now the actual transfer routines, called by the DMA controller
 // note that read = from application to soundcard (output),
 // and write = from soundcard to application (input)
-void bx_sb16_c::dma_read8(Bit8u *data_byte)
+// Each DMA request moves a block of samples, the DMA timer is then
+// rearmed for the playing time of the block.
+Bit16u bx_sb16_c::dma_read8(Bit8u *buffer, Bit16u maxlen)
 {
+  Bit16u len = dma_blocklen(maxlen, 1);
+
   DEV_dma_set_drq(BX_SB16_DMAL, 0);  // the timer will raise it again
 
-  if (DSP.dma.count % 100 == 0) // otherwise it's just too many lines of log
-    writelog(WAVELOG(5), "Received 8-bit DMA %2x, %d remaining ",
-             *data_byte, DSP.dma.count);
-  DSP.dma.count--;
+  writelog(WAVELOG(5), "Received 8-bit DMA block of %d bytes, %d remaining ",
+           len, DSP.dma.count);
 
-  dsp_getsamplebyte(*data_byte);
+  for (unsigned i = 0; i < len; i++) {
+    DSP.dma.count--;
+    dsp_getsamplebyte(buffer[i]);
+  }
 
-  if (DSP.dma.count == 0xffff) // last byte received
-    dsp_dmadone();
+  dma_blockdone(len);
+  return len;
 }
 
-void bx_sb16_c::dma_write8(Bit8u *data_byte)
+Bit16u bx_sb16_c::dma_write8(Bit8u *buffer, Bit16u maxlen)
 {
-  DEV_dma_set_drq(BX_SB16_DMAL, 0);  // the timer will raise it again
+  Bit16u len = dma_blocklen(maxlen, 1);
 
-  DSP.dma.count--;
+  DEV_dma_set_drq(BX_SB16_DMAL, 0);  // the timer will raise it again
 
-  *data_byte = dsp_putsamplebyte();
+  for (unsigned i = 0; i < len; i++) {
+    DSP.dma.count--;
+    buffer[i] = dsp_putsamplebyte();
+  }
 
-  if (DSP.dma.count % 100 == 0) // otherwise it's just too many lines of log
-    writelog(WAVELOG(5), "Sent 8-bit DMA %2x, %d remaining ",
-             *data_byte, DSP.dma.count);
+  writelog(WAVELOG(5), "Sent 8-bit DMA block of %d bytes, %d remaining ",
+           len, DSP.dma.count);
 
-  if (DSP.dma.count == 0xffff) // last byte sent
-    dsp_dmadone();
+  dma_blockdone(len);
+  return len;
 }
 
-void bx_sb16_c::dma_read16(Bit16u *data_word)
+Bit16u bx_sb16_c::dma_read16(Bit16u *buffer, Bit16u maxlen)
 {
-  DEV_dma_set_drq(BX_SB16_DMAH, 0);  // the timer will raise it again
+  Bit16u len = dma_blocklen(maxlen, 2);
 
-  if (DSP.dma.count % 100 == 0) // otherwise it's just too many lines of log
-    writelog(WAVELOG(5), "Received 16-bit DMA %04x, %d remaining ",
-             *data_word, DSP.dma.count);
+  DEV_dma_set_drq(BX_SB16_DMAH, 0);  // the timer will raise it again
 
-  DSP.dma.count--;
+  writelog(WAVELOG(5), "Received 16-bit DMA block of %d words, %d remaining ",
+           len, DSP.dma.count);
 
-  dsp_getsamplebyte(*data_word & 0xff);
-  dsp_getsamplebyte(*data_word >> 8);
+  for (unsigned i = 0; i < len; i++) {
+    DSP.dma.count--;
+    dsp_getsamplebyte(buffer[i] & 0xff);
+    dsp_getsamplebyte(buffer[i] >> 8);
+  }
 
-  if (DSP.dma.count == 0xffff) // last word received
-    dsp_dmadone();
+  dma_blockdone(len);
+  return len;
 }
 
-void bx_sb16_c::dma_write16(Bit16u *data_word)
+Bit16u bx_sb16_c::dma_write16(Bit16u *buffer, Bit16u maxlen)
 {
   Bit8u byte1, byte2;
+  Bit16u len = dma_blocklen(maxlen, 2);
 
   DEV_dma_set_drq(BX_SB16_DMAH, 0);  // the timer will raise it again
 
-  DSP.dma.count--;
+  for (unsigned i = 0; i < len; i++) {
+    DSP.dma.count--;
 
-  byte1 = dsp_putsamplebyte();
-  byte2 = dsp_putsamplebyte();
+    byte1 = dsp_putsamplebyte();
+    byte2 = dsp_putsamplebyte();
 
-  // all input is in little endian
-  *data_word = byte1 | (byte2 << 8);
+    // all input is in little endian
+    buffer[i] = byte1 | (byte2 << 8);
+  }
 
-  if (DSP.dma.count % 100 == 0) // otherwise it's just too many lines of log
-    writelog(WAVELOG(5), "Sent 16-bit DMA %4x, %d remaining ",
-             *data_word, DSP.dma.count);
+  writelog(WAVELOG(5), "Sent 16-bit DMA block of %d words, %d remaining ",
+           len, DSP.dma.count);
 
-  if (DSP.dma.count == 0xffff) // last word sent
+  dma_blockdone(len);
+  return len;
+}
+
+// number of bytes / words (unitsize 1 / 2) of the next DMA block: the
+// samples of BX_SB16_DMA_BLOCK_TIME, but not beyond the end of the transfer
+// and not filling the output packet before the output is ready for it
+Bit16u bx_sb16_c::dma_blocklen(Bit16u maxlen, unsigned unitsize)
+{
+  Bit32u len = 1;
+
+  if (DSP.dma.timer > 0)
+    len = BX_SB16_DMA_BLOCK_TIME / DSP.dma.timer;
+  if (len < 1)
+    len = 1;
+  if (len > maxlen)
+    len = maxlen;
+  if (len > (Bit32u) DSP.dma.count + 1)
+    len = (Bit32u) DSP.dma.count + 1;
+
+  if ((DSP.dma.output == 1) && (BX_SB16_THIS wavemode == 1)) {
+    Bit32u room = (BX_SOUND_OUTPUT_WAVEPACKETSIZE - 1 - DSP.dma.chunkindex) / unitsize;
+    if ((room > 0) && (len > room) &&
+        (BX_SB16_OUTPUT->waveready() != BX_SOUND_OUTPUT_OK))
+      len = room;
+  }
+
+  return (Bit16u) len;
+}
+
+// called after each DMA block, rearms the DMA timer for the time the
+// samples of the block take
+void bx_sb16_c::dma_blockdone(Bit16u len)
+{
+  if (DSP.dma.count == 0xffff) // last byte / word transferred
     dsp_dmadone();
+
+  if (DSP.dma.mode != 0)
+    bx_pc_system.activate_timer(DSP.timer_handle, DSP.dma.timer * len, 1);
 }
 
 // the mixer, supported type is CT1745 (as in an SB16)
@@ -1651,7 +1699,7 @@ void bx_sb16_c::set_irq_dma()
 
   // And register the new 8bits DMA Channel
   if ((!isInitialized) || (oldDMA8 != BX_SB16_DMAL))
-    DEV_dma_register_8bit_channel(BX_SB16_DMAL, dma_read8, dma_write8, "SB16");
+    DEV_dma_register_8bit_block_channel(BX_SB16_DMAL, dma_read8, dma_write8, "SB16");
 
   // and the 16 bit DMA
   oldDMA16=BX_SB16_DMAH;
@@ -1684,7 +1732,7 @@ void bx_sb16_c::set_irq_dma()
 
   // And register the new 16bits DMA Channel
   if ((BX_SB16_DMAH != 0) && (oldDMA16 != BX_SB16_DMAH))
-    DEV_dma_register_16bit_channel(BX_SB16_DMAH, dma_read16, dma_write16, "SB16");
+    DEV_dma_register_16bit_block_channel(BX_SB16_DMAH, dma_read16, dma_write16, "SB16");
 
   // If not already initialized
   if(!isInitialized) {
@@ -90,6 +90,9 @@
 
 #define BX_SB16_MIX_REG  0x100        // total number of mixer registers
 
+// the samples of so many us are moved by one DMA block transfer
+#define BX_SB16_DMA_BLOCK_TIME  1000
+
 // The array containing an instrument/bank remapping
 struct bx_sb16_ins_map {
   Bit8u oldbankmsb, oldbanklsb, oldprogch;
@@ -302,10 +305,12 @@ private:
   } emuldata;
 
       /* DMA input and output, 8 and 16 bit */
-  BX_SB16_SMF void   dma_write8(Bit8u *data_byte);
-  BX_SB16_SMF void   dma_read8(Bit8u *data_byte);
-  BX_SB16_SMF void   dma_write16(Bit16u *data_word);
-  BX_SB16_SMF void   dma_read16(Bit16u *data_word);
+  BX_SB16_SMF Bit16u dma_write8(Bit8u *buffer, Bit16u maxlen);
+  BX_SB16_SMF Bit16u dma_read8(Bit8u *buffer, Bit16u maxlen);
+  BX_SB16_SMF Bit16u dma_write16(Bit16u *buffer, Bit16u maxlen);
+  BX_SB16_SMF Bit16u dma_read16(Bit16u *buffer, Bit16u maxlen);
+  BX_SB16_SMF Bit16u dma_blocklen(Bit16u maxlen, unsigned unitsize);
+  BX_SB16_SMF void   dma_blockdone(Bit16u len);
 
       /* the MPU 401 part of the emulator */
   BX_SB16_SMF Bit32u mpu_status();                   // read status port   3x1
@@ -73,7 +73,12 @@ bx_serial_c::bx_serial_c(void)
     s[i].tx_timer_index = BX_NULL_TIMER_HANDLE;
     s[i].rx_timer_index = BX_NULL_TIMER_HANDLE;
     s[i].fifo_timer_index = BX_NULL_TIMER_HANDLE;
+    s[i].instant = 0;
+    s[i].tx_buf = NULL;
+    s[i].tx_buf_len = 0;
   }
+  flush_timer_index = BX_NULL_TIMER_HANDLE;
+  flush_pending = 0;
 }
 
 bx_serial_c::~bx_serial_c(void)
@@ -85,6 +90,10 @@ bx_serial_c::~bx_serial_c(void)
     sprintf(pname, "ports.serial.%d", i+1);
     base = (bx_list_c*) SIM->get_param(pname);
     if (SIM->get_param_bool("enabled", base)->get()) {
+      if (BX_SER_THIS s[i].tx_buf != NULL) {
+        tx_buf_flush(i);
+        delete [] BX_SER_THIS s[i].tx_buf;
+      }
       switch (BX_SER_THIS s[i].io_mode) {
         case BX_SER_MODE_FILE:
           if (BX_SER_THIS s[i].output != NULL)
@@ -241,6 +250,15 @@ bx_serial_c::init(void)
         DEV_register_iowrite_handler(this, write_handler, addr, name, 1);
       }
 
+      BX_SER_THIS s[i].pv.ring_addr = 0;
+      BX_SER_THIS s[i].pv.ring_size = 0;
+      BX_SER_THIS s[i].pv.avail = 0;
+      BX_SER_THIS s[i].pv.used = 0;
+      for (unsigned addr=BX_SER_PV_PORT+i*16; addr<BX_SER_PV_PORT+i*16+16; addr+=4) {
+        DEV_register_ioread_handler(this, pv_read_handler, addr, name, 4);
+        DEV_register_iowrite_handler(this, pv_write_handler, addr, name, 4);
+      }
+
       BX_SER_THIS s[i].io_mode = BX_SER_MODE_NULL;
       const char *mode = SIM->get_param_enum("mode", base)->get_selected();
       const char *dev = SIM->get_param_string("dev", base)->getptr();
@@ -421,12 +439,30 @@ bx_serial_c::init(void)
       } else if (strcmp(mode, "null")) {
         BX_PANIC(("unknown serial i/o mode '%s'", mode));
       }
+      BX_SER_THIS s[i].instant = SIM->get_param_bool("instant", base)->get();
+      if (BX_SER_THIS s[i].instant) {
+        if ((BX_SER_THIS s[i].io_mode == BX_SER_MODE_RAW) ||
+            (BX_SER_THIS s[i].io_mode == BX_SER_MODE_MOUSE)) {
+          BX_ERROR(("com%d: instant transmit not supported in mode '%s'", i+1, mode));
+          BX_SER_THIS s[i].instant = 0;
+        } else {
+          BX_SER_THIS s[i].tx_buf = new Bit8u[BX_SER_TXBUF_SIZE];
+          BX_SER_THIS s[i].tx_buf_len = 0;
+          if (BX_SER_THIS flush_timer_index == BX_NULL_TIMER_HANDLE) {
+            BX_SER_THIS flush_timer_index =
+              bx_pc_system.register_timer(this, flush_timer_handler, 0,
+                                          0,0, "serial.flush"); // one-shot, inactive
+          }
+          BX_INFO(("com%d: instant transmit enabled", i+1));
+        }
+      }
       // simulate device connected
       if (BX_SER_THIS s[i].io_mode != BX_SER_MODE_RAW) {
         BX_SER_THIS s[i].modem_status.cts = 1;
         BX_SER_THIS s[i].modem_status.dsr = 1;
       }
-      BX_INFO(("com%d at 0x%04x irq %d", i+1, ports[i], BX_SER_THIS s[i].IRQ));
+      BX_INFO(("com%d at 0x%04x irq %d, console at 0x%04x", i+1, ports[i],
+                BX_SER_THIS s[i].IRQ, BX_SER_PV_PORT+i*16));
     }
   }
   if ((BX_SER_THIS mouse_type == BX_MOUSE_TYPE_SERIAL) ||
@@ -449,7 +485,7 @@ void bx_serial_c::register_state(void)
   bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "serial", "Serial Port State", 9);
   for (i=0; i<BX_N_SERIAL_PORTS; i++) {
     sprintf(name, "%d", i);
-    port = new bx_list_c(list, name, 28);
+    port = new bx_list_c(list, name, 29);
     new bx_shadow_bool_c(port, "ls_interrupt", &BX_SER_THIS s[i].ls_interrupt);
     new bx_shadow_bool_c(port, "ms_interrupt", &BX_SER_THIS s[i].ms_interrupt);
     new bx_shadow_bool_c(port, "rx_interrupt", &BX_SER_THIS s[i].rx_interrupt);
@@ -522,6 +558,11 @@ void bx_serial_c::register_state(void)
     }
     new bx_shadow_num_c(port, "divisor_lsb", &BX_SER_THIS s[i].divisor_lsb, BASE_HEX);
     new bx_shadow_num_c(port, "divisor_msb", &BX_SER_THIS s[i].divisor_msb, BASE_HEX);
+    bx_list_c *pv = new bx_list_c(port, "pv", 4);
+    new bx_shadow_num_c(pv, "ring_addr", &BX_SER_THIS s[i].pv.ring_addr, BASE_HEX);
+    new bx_shadow_num_c(pv, "ring_size", &BX_SER_THIS s[i].pv.ring_size);
+    new bx_shadow_num_c(pv, "avail", &BX_SER_THIS s[i].pv.avail);
+    new bx_shadow_num_c(pv, "used", &BX_SER_THIS s[i].pv.used);
   }
   new bx_shadow_num_c(list, "detect_mouse", &BX_SER_THIS detect_mouse);
   new bx_shadow_num_c(list, "mouse_delayed_dx", &BX_SER_THIS mouse_delayed_dx);
@@ -537,6 +578,43 @@ void bx_serial_c::register_state(void)
   new bx_shadow_num_c(mousebuf, "head", &BX_SER_THIS mouse_internal_buffer.head);
 }
 
+// Called in a clone of the simulation. Device files like /dev/stdout are
+// opened again to follow the output redirection of the clone, regular
+// output files stay shared with the parent and the other clones.
+void bx_serial_c::after_clone(void)
+{
+  char pname[20];
+  bx_list_c *base;
+
+  for (int i=0; i<BX_SERIAL_MAXDEV; i++) {
+    // output buffered before the clone is written by the parent
+    BX_SER_THIS s[i].tx_buf_len = 0;
+    if (BX_SER_THIS s[i].io_mode != BX_SER_MODE_FILE)
+      continue;
+    sprintf(pname, "ports.serial.%d", i+1);
+    base = (bx_list_c*) SIM->get_param(pname);
+    const char *dev = SIM->get_param_string("dev", base)->getptr();
+    if (strncmp(dev, "/dev/", 5)) {
+      BX_ERROR(("com%d: output file '%s' is shared with the other clones", i+1, dev));
+      continue;
+    }
+    fclose(BX_SER_THIS s[i].output);
+#if !defined(WIN32)
+    // share the file offset with the other users of stdout / stderr
+    if (!strcmp(dev, "/dev/stdout")) {
+      BX_SER_THIS s[i].output = fdopen(dup(STDOUT_FILENO), "wb");
+    } else if (!strcmp(dev, "/dev/stderr")) {
+      BX_SER_THIS s[i].output = fdopen(dup(STDERR_FILENO), "wb");
+    } else
+#endif
+    BX_SER_THIS s[i].output = fopen(dev, "wb");
+    if (BX_SER_THIS s[i].output == NULL) {
+      BX_ERROR(("com%d: could not reopen '%s'", i+1, dev));
+      BX_SER_THIS s[i].io_mode = BX_SER_MODE_NULL;
+    }
+  }
+}
+
 void bx_serial_c::lower_interrupt(Bit8u port)
 {
   /* If there are no more ints pending, clear the irq */
@@ -852,6 +930,23 @@ bx_serial_c::write(Bit32u address, Bit32u value, unsigned io_len)
                                          (16 * ((BX_SER_THIS s[port].divisor_msb << 8) |
                                          BX_SER_THIS s[port].divisor_lsb)));
         }
+      } else if (BX_SER_THIS s[port].instant &&
+                 !BX_SER_THIS s[port].modem_cntl.local_loopback &&
+                 BX_SER_THIS s[port].line_status.thr_empty &&
+                 BX_SER_THIS s[port].line_status.tsr_empty) {
+        // the transmitter stays empty, the byte goes to the host buffer
+        Bit8u bitmask = 0xff >> (3 - BX_SER_THIS s[port].line_cntl.wordlen_sel);
+        // don't postpone a flush already pending for another port
+        if ((BX_SER_THIS s[port].tx_buf_len == 0) && !BX_SER_THIS flush_pending) {
+          bx_pc_system.activate_timer(BX_SER_THIS flush_timer_index,
+                                      BX_SER_FLUSH_DELAY, 0); /* not continuous */
+          BX_SER_THIS flush_pending = 1;
+        }
+        BX_SER_THIS s[port].tx_buf[BX_SER_THIS s[port].tx_buf_len++] = value & bitmask;
+        if (BX_SER_THIS s[port].tx_buf_len == BX_SER_TXBUF_SIZE) {
+          tx_buf_flush(port);
+        }
+        raise_interrupt(port, BX_SER_INT_TXHOLD);
       } else {
         Bit8u bitmask = 0xff >> (3 - BX_SER_THIS s[port].line_cntl.wordlen_sel);
         if (BX_SER_THIS s[port].line_status.thr_empty) {
@@ -1239,6 +1334,184 @@ bx_serial_c::rx_fifo_enq(Bit8u port, Bit8u data)
 }
 
 
+// Sends LEN bytes from DATA to the output of the port
+void
+bx_serial_c::tx_bytes(Bit8u port, const Bit8u *data, unsigned len)
+{
+  switch (BX_SER_THIS s[port].io_mode) {
+    case BX_SER_MODE_FILE:
+      fwrite(data, 1, len, BX_SER_THIS s[port].output);
+      fflush(BX_SER_THIS s[port].output);
+      break;
+    case BX_SER_MODE_TERM:
+#if defined(SERIAL_ENABLE)
+      BX_DEBUG(("com%d: write: %u bytes, first '%c'", port+1, len, data[0]));
+      if (BX_SER_THIS s[port].tty_id >= 0) {
+        write(BX_SER_THIS s[port].tty_id, (bx_ptr_t) data, len);
+      }
+#endif
+      break;
+    case BX_SER_MODE_RAW:
+#if USE_RAW_SERIAL
+      for (unsigned i = 0; i < len; i++) {
+        if (!BX_SER_THIS s[port].raw->ready_transmit())
+          BX_PANIC(("com%d: not ready to transmit", port+1));
+        BX_SER_THIS s[port].raw->transmit(data[i]);
+      }
+#endif
+      break;
+    case BX_SER_MODE_MOUSE:
+      BX_INFO(("com%d: write to mouse ignored: 0x%02x", port+1, data[0]));
+      break;
+    case BX_SER_MODE_SOCKET:
+      if (BX_SER_THIS s[port].socket_id >= 0) {
+#ifdef WIN32
+        BX_INFO(("attempting to write win32 : %u bytes", len));
+        ::send(BX_SER_THIS s[port].socket_id, (const char*) data, len, 0);
+#else
+        ::write(BX_SER_THIS s[port].socket_id, (bx_ptr_t) data, len);
+#endif
+      }
+      break;
+    case BX_SER_MODE_PIPE:
+#ifdef WIN32
+      if (BX_SER_THIS s[port].pipe) {
+        DWORD written;
+        WriteFile(BX_SER_THIS s[port].pipe, (bx_ptr_t) data, len, &written, NULL);
+      }
+#endif
+      break;
+  }
+}
+
+// Writes the output collected in instant transmit mode
+void
+bx_serial_c::tx_buf_flush(Bit8u port)
+{
+  if (BX_SER_THIS s[port].tx_buf_len > 0) {
+    tx_bytes(port, BX_SER_THIS s[port].tx_buf, BX_SER_THIS s[port].tx_buf_len);
+    BX_SER_THIS s[port].tx_buf_len = 0;
+  }
+}
+
+void
+bx_serial_c::flush_timer_handler(void *this_ptr)
+{
+  bx_serial_c *class_ptr = (bx_serial_c *) this_ptr;
+
+  class_ptr->flush_timer();
+}
+
+void
+bx_serial_c::flush_timer(void)
+{
+  BX_SER_THIS flush_pending = 0;
+  for (Bit8u port=0; port<BX_SERIAL_MAXDEV; port++) {
+    tx_buf_flush(port);
+  }
+}
+
+// Sends the bytes between the consumer and the producer index of the
+// paravirtual console ring to the output of the port
+void
+bx_serial_c::pv_drain(Bit8u port)
+{
+  Bit8u buffer[4096];
+  Bit32u size = BX_SER_THIS s[port].pv.ring_size;
+
+  // the bytes collected from the UART in instant transmit mode go first
+  tx_buf_flush(port);
+  if (size == 0) {
+    BX_ERROR(("com%d: console doorbell without a ring", port+1));
+    BX_SER_THIS s[port].pv.used = BX_SER_THIS s[port].pv.avail;
+    return;
+  }
+  if ((BX_SER_THIS s[port].pv.avail - BX_SER_THIS s[port].pv.used) > size) {
+    BX_ERROR(("com%d: console producer index 0x%08x out of range", port+1,
+              BX_SER_THIS s[port].pv.avail));
+    BX_SER_THIS s[port].pv.used = BX_SER_THIS s[port].pv.avail;
+    return;
+  }
+  while (BX_SER_THIS s[port].pv.used != BX_SER_THIS s[port].pv.avail) {
+    Bit32u offset = BX_SER_THIS s[port].pv.used & (size - 1);
+    Bit32u len = BX_SER_THIS s[port].pv.avail - BX_SER_THIS s[port].pv.used;
+    if (len > size - offset)
+      len = size - offset;
+    if (len > sizeof(buffer))
+      len = sizeof(buffer);
+    DEV_MEM_READ_PHYSICAL_BLOCK(BX_SER_THIS s[port].pv.ring_addr + offset, len, buffer);
+    tx_bytes(port, buffer, len);
+    BX_SER_THIS s[port].pv.used += len;
+  }
+}
+
+// static IO port read callback handler for the paravirtual console
+Bit32u bx_serial_c::pv_read_handler(void *this_ptr, Bit32u address, unsigned io_len)
+{
+#if !BX_USE_SER_SMF
+  bx_serial_c *class_ptr = (bx_serial_c *) this_ptr;
+
+  return class_ptr->pv_read(address, io_len);
+}
+
+Bit32u bx_serial_c::pv_read(Bit32u address, unsigned io_len)
+{
+#else
+  UNUSED(this_ptr);
+#endif  // !BX_USE_SER_SMF
+  Bit8u port = (address - BX_SER_PV_PORT) >> 4;
+
+  switch (address & 0x0f) {
+    case BX_SER_PV_ID:
+      return BX_SER_PV_MAGIC;
+    case BX_SER_PV_RING_ADDR:
+      return BX_SER_THIS s[port].pv.ring_addr;
+    case BX_SER_PV_RING_SIZE:
+      return BX_SER_THIS s[port].pv.ring_size;
+    case BX_SER_PV_DOORBELL:
+      return BX_SER_THIS s[port].pv.used;
+  }
+  return 0xffffffff;
+}
+
+// static IO port write callback handler for the paravirtual console
+void bx_serial_c::pv_write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len)
+{
+#if !BX_USE_SER_SMF
+  bx_serial_c *class_ptr = (bx_serial_c *) this_ptr;
+
+  class_ptr->pv_write(address, value, io_len);
+}
+
+void bx_serial_c::pv_write(Bit32u address, Bit32u value, unsigned io_len)
+{
+#else
+  UNUSED(this_ptr);
+#endif  // !BX_USE_SER_SMF
+  Bit8u port = (address - BX_SER_PV_PORT) >> 4;
+
+  switch (address & 0x0f) {
+    case BX_SER_PV_RING_ADDR:
+      BX_SER_THIS s[port].pv.ring_addr = value;
+      break;
+    case BX_SER_PV_RING_SIZE:
+      if ((value & (value - 1)) || (value > BX_SER_PV_MAX_RING)) {
+        BX_ERROR(("com%d: invalid console ring size %u", port+1, value));
+        value = 0;
+      }
+      BX_SER_THIS s[port].pv.ring_size = value;
+      BX_SER_THIS s[port].pv.avail = 0;
+      BX_SER_THIS s[port].pv.used = 0;
+      break;
+    case BX_SER_PV_DOORBELL:
+      BX_SER_THIS s[port].pv.avail = value;
+      pv_drain(port);
+      break;
+    default:
+      BX_ERROR(("com%d: write to read-only console register 0x%04x", port+1, address));
+  }
+}
+
 void
 bx_serial_c::tx_timer_handler(void *this_ptr)
 {
@@ -1269,49 +1542,7 @@ bx_serial_c::tx_timer(void)
   if (BX_SER_THIS s[port].modem_cntl.local_loopback) {
     rx_fifo_enq(port, BX_SER_THIS s[port].tsrbuffer);
   } else {
-    switch (BX_SER_THIS s[port].io_mode) {
-      case BX_SER_MODE_FILE:
-        fputc(BX_SER_THIS s[port].tsrbuffer, BX_SER_THIS s[port].output);
-        fflush(BX_SER_THIS s[port].output);
-        break;
-      case BX_SER_MODE_TERM:
-#if defined(SERIAL_ENABLE)
-        BX_DEBUG(("com%d: write: '%c'", port+1, BX_SER_THIS s[port].tsrbuffer));
-        if (BX_SER_THIS s[port].tty_id >= 0) {
-          write(BX_SER_THIS s[port].tty_id, (bx_ptr_t) & BX_SER_THIS s[port].tsrbuffer, 1);
-        }
-#endif
-        break;
-      case BX_SER_MODE_RAW:
-#if USE_RAW_SERIAL
-        if (!BX_SER_THIS s[port].raw->ready_transmit())
-          BX_PANIC(("com%d: not ready to transmit", port+1));
-        BX_SER_THIS s[port].raw->transmit(BX_SER_THIS s[port].tsrbuffer);
-#endif
-        break;
-      case BX_SER_MODE_MOUSE:
-        BX_INFO(("com%d: write to mouse ignored: 0x%02x", port+1, BX_SER_THIS s[port].tsrbuffer));
-        break;
-      case BX_SER_MODE_SOCKET:
-        if (BX_SER_THIS s[port].socket_id >= 0) {
-#ifdef WIN32
-          BX_INFO(("attempting to write win32 : %c", BX_SER_THIS s[port].tsrbuffer));
-          ::send(BX_SER_THIS s[port].socket_id,
-                 (const char*) & BX_SER_THIS s[port].tsrbuffer, 1, 0);
-#else
-          ::write(BX_SER_THIS s[port].socket_id,
-                  (bx_ptr_t) & BX_SER_THIS s[port].tsrbuffer, 1);
-#endif
-      }
-      case BX_SER_MODE_PIPE:
-#ifdef WIN32
-        if (BX_SER_THIS s[port].pipe) {
-          DWORD written;
-          WriteFile(BX_SER_THIS s[port].pipe, (bx_ptr_t)& BX_SER_THIS s[port].tsrbuffer, 1, &written, NULL);
-        }
-#endif
-        break;
-    }
+    tx_bytes(port, &BX_SER_THIS s[port].tsrbuffer, 1);
   }
 
   BX_SER_THIS s[port].line_status.tsr_empty = 1;
@@ -71,6 +71,32 @@ extern "C" {
 #define BX_SER_MODE_SOCKET 5
 #define BX_SER_MODE_PIPE  6
 
+// Paravirtual console. Each enabled port has a window of 32-bit registers
+// next to the guest2host channel (BX_G2H_PORT). The guest writes its output
+// into a byte ring in its memory and hands any number of bytes to the port
+// output with one write of the producer index to the doorbell register.
+//
+//   0x00  ID         R   BX_SER_PV_MAGIC
+//   0x04  RING_ADDR  RW  guest physical address of the ring
+//   0x08  RING_SIZE  RW  size of the ring in bytes (power of 2, max 64k),
+//                        writing resets the producer / consumer indices
+//   0x0c  DOORBELL   W   producer index (free running)
+//                    R   consumer index (free running)
+#define BX_SER_PV_PORT      0x2010  // com1, each further port +0x10
+#define BX_SER_PV_MAGIC     0x736e6f63  // "cons"
+#define BX_SER_PV_ID        0x00
+#define BX_SER_PV_RING_ADDR 0x04
+#define BX_SER_PV_RING_SIZE 0x08
+#define BX_SER_PV_DOORBELL  0x0c
+#define BX_SER_PV_MAX_RING  65536
+
+// Instant transmit mode: the bytes written to the THR are collected in a
+// host buffer without the line delay and written out in bulk when the
+// buffer is full or BX_SER_FLUSH_DELAY usec after the first byte buffered
+// on any port.
+#define BX_SER_TXBUF_SIZE   65536
+#define BX_SER_FLUSH_DELAY  10000
+
 enum {
   BX_SER_INT_IER,
   BX_SER_INT_RXDATA,
@@ -110,6 +136,10 @@ typedef struct {
   int  rx_timer_index;
   int  fifo_timer_index;
 
+  bx_bool instant;      /* transmit without emulating the line speed */
+  Bit8u *tx_buf;        /* output not written yet in instant mode */
+  unsigned tx_buf_len;
+
   int io_mode;
   int tty_id;
   int socket_id;
@@ -194,6 +224,14 @@ typedef struct {
   Bit8u  tx_fifo[16];   /* transmit FIFO (internal) */
   Bit8u  divisor_lsb;   /* Divisor latch, least-sig. byte */
   Bit8u  divisor_msb;   /* Divisor latch, most-sig. byte */
+
+  /* Paravirtual console */
+  struct {
+    Bit32u     ring_addr;          /* guest physical address of the ring */
+    Bit32u     ring_size;          /* ring size in bytes, 0=not set up */
+    Bit32u     avail;              /* producer index written by the guest */
+    Bit32u     used;               /* consumer index */
+  } pv;
 } bx_serial_t;
 
 
@@ -205,10 +243,14 @@ public:
   virtual void init(void);
   virtual void reset(unsigned type);
   virtual void register_state(void);
+  virtual void after_clone(void);
 
 private:
   bx_serial_t s[BX_SERIAL_MAXDEV];
 
+  int   flush_timer_index;
+  bx_bool flush_pending;  // flush timer armed, shared by all ports
+
   int   detect_mouse;
   int   mouse_port;
   int   mouse_type;
@@ -226,6 +268,13 @@ private:
 
   static void rx_fifo_enq(Bit8u port, Bit8u data);
 
+  BX_SER_SMF void tx_bytes(Bit8u port, const Bit8u *data, unsigned len);
+  BX_SER_SMF void pv_drain(Bit8u port);
+  BX_SER_SMF void tx_buf_flush(Bit8u port);
+
+  static void flush_timer_handler(void *);
+  BX_SER_SMF void flush_timer(void);
+
   static void tx_timer_handler(void *);
   BX_SER_SMF void tx_timer(void);
 
@@ -240,9 +289,13 @@ private:
 
   static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
   static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+  static Bit32u pv_read_handler(void *this_ptr, Bit32u address, unsigned io_len);
+  static void   pv_write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
 #if !BX_USE_SER_SMF
   Bit32u read(Bit32u address, unsigned io_len);
   void   write(Bit32u address, Bit32u value, unsigned io_len);
+  Bit32u pv_read(Bit32u address, unsigned io_len);
+  void   pv_write(Bit32u address, Bit32u value, unsigned io_len);
 #endif
 };
 
@@ -92,6 +92,14 @@ void bx_slowdown_timer_c::after_restore_state(void)
   s.start_emulated_time = bx_pc_system.time_usec();
 }
 
+void bx_slowdown_timer_c::after_clone(void)
+{
+  // the parent may have been waiting for jobs for a long time
+  s.start_time = sectousec(time(NULL));
+  s.start_emulated_time = bx_pc_system.time_usec();
+  s.lasttime = 0;
+}
+
 void bx_slowdown_timer_c::timer_handler(void * this_ptr)
 {
   bx_slowdown_timer_c * class_ptr = (bx_slowdown_timer_c *) this_ptr;
@@ -41,6 +41,7 @@ public:
   void init(void);
   void exit(void);
   void after_restore_state(void);
+  void after_clone(void);
 
   static void timer_handler(void * this_ptr);
 
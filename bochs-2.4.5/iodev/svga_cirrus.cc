@@ -811,6 +811,39 @@ void bx_svga_cirrus_c::get_text_snapshot(Bit8u **text_snapshot,
   BX_CIRRUS_THIS bx_vga_c::get_text_snapshot(text_snapshot,txHeight,txWidth);
 }
 
+bx_bool bx_svga_cirrus_c::get_gfx_snapshot(Bit8u **gfx_snapshot,
+                                    unsigned *iWidth, unsigned *iHeight)
+{
+  unsigned width, height;
+  Bit8u *buffer;
+
+  if ((BX_CIRRUS_THIS sequencer.reg[0x07] & 0x01) == CIRRUS_SR7_BPP_VGA) {
+    return BX_CIRRUS_THIS bx_vga_c::get_gfx_snapshot(gfx_snapshot,iWidth,iHeight);
+  }
+
+  *gfx_snapshot = NULL;
+  *iWidth = 0;
+  *iHeight = 0;
+  if (BX_CIRRUS_THIS svga_needs_update_mode) {
+    svga_modeupdate();
+  }
+  if (BX_CIRRUS_THIS svga_dispbpp == 4) {
+    BX_ERROR(("cannot draw 4bpp SVGA"));
+    return 0;
+  }
+  width  = BX_CIRRUS_THIS svga_xres;
+  height = BX_CIRRUS_THIS svga_yres;
+  buffer = (Bit8u *) malloc(height * width * 3);
+  if (buffer == NULL) return 0;
+  BX_CIRRUS_THIS init_gfx_snapshot_conv(BX_CIRRUS_THIS svga_dispbpp, 6);
+  convert_tile(&BX_CIRRUS_THIS pixel_conv, BX_CIRRUS_THIS disp_ptr,
+               BX_CIRRUS_THIS svga_pitch, buffer, width * 3, width, height);
+  *gfx_snapshot = buffer;
+  *iWidth = width;
+  *iHeight = height;
+  return 1;
+}
+
 void bx_svga_cirrus_c::trigger_timer(void *this_ptr)
 {
   BX_CIRRUS_THIS timer_handler(this_ptr);
@@ -819,9 +852,7 @@ void bx_svga_cirrus_c::trigger_timer(void *this_ptr)
 Bit64s bx_svga_cirrus_c::svga_param_handler(bx_param_c *param, int set, Bit64s val)
 {
   if (set) {
-    BX_INFO (("Changing timer interval to %d", (Bit32u)val));
-    BX_CIRRUS_THIS svga_timer_handler (theSvga);
-    bx_pc_system.activate_timer (BX_CIRRUS_THIS timer_id, (Bit32u)val, 1);
+    BX_CIRRUS_THIS set_update_interval(svga_timer_handler, val);
   }
   return val;
 }
@@ -1252,254 +1283,32 @@ void bx_svga_cirrus_c::svga_update(void)
   BX_CIRRUS_THIS svga_needs_update_tile = false;
 
   unsigned xc, yc, xti, yti;
-  unsigned r, c, w, h;
-  int i;
-  Bit8u red, green, blue;
-  Bit32u colour;
-  Bit8u * vid_ptr, * vid_ptr2;
-  Bit8u * tile_ptr, * tile_ptr2;
+  unsigned w, h;
+  Bit8u * tile_ptr;
   bx_svga_tileinfo_t info;
 
   if (bx_gui->graphics_tile_info(&info)) {
-    if (info.is_indexed) {
-      switch (BX_CIRRUS_THIS svga_dispbpp) {
-        case 4:
-        case 15:
-        case 16:
-        case 24:
-        case 32:
-          BX_ERROR(("current guest pixel format is unsupported on indexed colour host displays, svga_dispbpp=%d",
-            BX_CIRRUS_THIS svga_dispbpp));
-          break;
-        case 8:
-          for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
-            for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
-              if (GET_TILE_UPDATED (xti, yti)) {
-                vid_ptr = BX_CIRRUS_THIS disp_ptr + (yc * pitch + xc);
-                tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                for (r=0; r<h; r++) {
-                  vid_ptr2  = vid_ptr;
-                  tile_ptr2 = tile_ptr;
-                  for (c=0; c<w; c++) {
-                    colour = 0;
-                    for (i=0; i<(int)BX_CIRRUS_THIS svga_bpp; i+=8) {
-                      colour |= *(vid_ptr2++) << i;
-                    }
-                    if (info.is_little_endian) {
-                      for (i=0; i<info.bpp; i+=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                    else {
-                      for (i=info.bpp-8; i>-8; i-=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                  }
-                  vid_ptr  += pitch;
-                  tile_ptr += info.pitch;
-                }
-                draw_hardware_cursor(xc, yc, &info);
-                bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                SET_TILE_UPDATED (xti, yti, 0);
-              }
-            }
-          }
-          break;
-      }
+    if (info.is_indexed && (BX_CIRRUS_THIS svga_dispbpp != 8)) {
+      BX_ERROR(("current guest pixel format is unsupported on indexed colour host displays, svga_dispbpp=%d",
+        BX_CIRRUS_THIS svga_dispbpp));
+    }
+    else if (BX_CIRRUS_THIS svga_dispbpp == 4) {
+      BX_ERROR(("cannot draw 4bpp SVGA"));
     }
     else {
-      switch (BX_CIRRUS_THIS svga_dispbpp) {
-        case 4:
-          BX_ERROR(("cannot draw 4bpp SVGA"));
-          break;
-        case 8:
-          for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
-            for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
-              if (GET_TILE_UPDATED (xti, yti)) {
-                vid_ptr = BX_CIRRUS_THIS disp_ptr + (yc * pitch + xc);
-                tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                for (r=0; r<h; r++) {
-                  vid_ptr2  = vid_ptr;
-                  tile_ptr2 = tile_ptr;
-                  for (c=0; c<w; c++) {
-                    colour = *(vid_ptr2++);
-                    colour = MAKE_COLOUR(
-                      BX_CIRRUS_THIS s.pel.data[colour].red, 6, info.red_shift, info.red_mask,
-                      BX_CIRRUS_THIS s.pel.data[colour].green, 6, info.green_shift, info.green_mask,
-                      BX_CIRRUS_THIS s.pel.data[colour].blue, 6, info.blue_shift, info.blue_mask);
-                    if (info.is_little_endian) {
-                      for (i=0; i<info.bpp; i+=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                    else {
-                      for (i=info.bpp-8; i>-8; i-=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                  }
-                  vid_ptr  += pitch;
-                  tile_ptr += info.pitch;
-                }
-                draw_hardware_cursor(xc, yc, &info);
-                bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                SET_TILE_UPDATED (xti, yti, 0);
-              }
-            }
+      BX_CIRRUS_THIS init_pixel_conv(&info, BX_CIRRUS_THIS svga_dispbpp, 6);
+      for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
+        for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
+          if (GET_TILE_UPDATED (xti, yti)) {
+            tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
+            convert_tile(&BX_CIRRUS_THIS pixel_conv,
+                         BX_CIRRUS_THIS disp_ptr + yc * pitch + xc * BX_CIRRUS_THIS pixel_conv.src_bytes,
+                         pitch, tile_ptr, info.pitch, w, h);
+            draw_hardware_cursor(xc, yc, &info);
+            bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
+            SET_TILE_UPDATED (xti, yti, 0);
           }
-          break;
-        case 15:
-          for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
-            for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
-              if (GET_TILE_UPDATED (xti, yti)) {
-                vid_ptr = BX_CIRRUS_THIS disp_ptr + (yc * pitch + (xc<<1));
-                tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                for (r=0; r<h; r++) {
-                  vid_ptr2  = vid_ptr;
-                  tile_ptr2 = tile_ptr;
-                  for (c=0; c<w; c++) {
-                    colour = *(vid_ptr2++);
-                    colour |= *(vid_ptr2++) << 8;
-                    colour = MAKE_COLOUR(
-                      colour & 0x001f, 5, info.blue_shift, info.blue_mask,
-                      colour & 0x03e0, 10, info.green_shift, info.green_mask,
-                      colour & 0x7c00, 15, info.red_shift, info.red_mask);
-                    if (info.is_little_endian) {
-                      for (i=0; i<info.bpp; i+=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                    else {
-                      for (i=info.bpp-8; i>-8; i-=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                  }
-                  vid_ptr  += pitch;
-                  tile_ptr += info.pitch;
-                }
-                draw_hardware_cursor(xc, yc, &info);
-                bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                SET_TILE_UPDATED (xti, yti, 0);
-              }
-            }
-          }
-          break;
-        case 16:
-          for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
-            for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
-              if (GET_TILE_UPDATED (xti, yti)) {
-                vid_ptr = BX_CIRRUS_THIS disp_ptr + (yc * pitch + (xc<<1));
-                tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                for (r=0; r<h; r++) {
-                  vid_ptr2  = vid_ptr;
-                  tile_ptr2 = tile_ptr;
-                  for (c=0; c<w; c++) {
-                    colour = *(vid_ptr2++);
-                    colour |= *(vid_ptr2++) << 8;
-                    colour = MAKE_COLOUR(
-                      colour & 0x001f, 5, info.blue_shift, info.blue_mask,
-                      colour & 0x07e0, 11, info.green_shift, info.green_mask,
-                      colour & 0xf800, 16, info.red_shift, info.red_mask);
-                    if (info.is_little_endian) {
-                      for (i=0; i<info.bpp; i+=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                    else {
-                      for (i=info.bpp-8; i>-8; i-=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                  }
-                  vid_ptr  += pitch;
-                  tile_ptr += info.pitch;
-                }
-                draw_hardware_cursor(xc, yc, &info);
-                bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                SET_TILE_UPDATED (xti, yti, 0);
-              }
-            }
-          }
-          break;
-        case 24:
-          for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
-            for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
-              if (GET_TILE_UPDATED (xti, yti)) {
-                vid_ptr = BX_CIRRUS_THIS disp_ptr + (yc * pitch + 3*xc);
-                tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                for (r=0; r<h; r++) {
-                  vid_ptr2  = vid_ptr;
-                  tile_ptr2 = tile_ptr;
-                  for (c=0; c<w; c++) {
-                    blue = *(vid_ptr2++);
-                    green = *(vid_ptr2++);
-                    red = *(vid_ptr2++);
-                    colour = MAKE_COLOUR(
-                      red, 8, info.red_shift, info.red_mask,
-                      green, 8, info.green_shift, info.green_mask,
-                      blue, 8, info.blue_shift, info.blue_mask);
-                    if (info.is_little_endian) {
-                      for (i=0; i<info.bpp; i+=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                    else {
-                      for (i=info.bpp-8; i>-8; i-=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                  }
-                  vid_ptr  += pitch;
-                  tile_ptr += info.pitch;
-                }
-                draw_hardware_cursor(xc, yc, &info);
-                bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                SET_TILE_UPDATED (xti, yti, 0);
-              }
-            }
-          }
-          break;
-        case 32:
-          for (yc=0, yti = 0; yc<height; yc+=Y_TILESIZE, yti++) {
-            for (xc=0, xti = 0; xc<width; xc+=X_TILESIZE, xti++) {
-              if (GET_TILE_UPDATED (xti, yti)) {
-                vid_ptr = BX_CIRRUS_THIS disp_ptr + (yc * pitch + (xc<<2));
-                tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                for (r=0; r<h; r++) {
-                  vid_ptr2  = vid_ptr;
-                  tile_ptr2 = tile_ptr;
-                  for (c=0; c<w; c++) {
-                    blue = *(vid_ptr2++);
-                    green = *(vid_ptr2++);
-                    red = *(vid_ptr2++);
-                    vid_ptr2++;
-                    colour = MAKE_COLOUR(
-                      red, 8, info.red_shift, info.red_mask,
-                      green, 8, info.green_shift, info.green_mask,
-                      blue, 8, info.blue_shift, info.blue_mask);
-                    if (info.is_little_endian) {
-                      for (i=0; i<info.bpp; i+=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                    else {
-                      for (i=info.bpp-8; i>-8; i-=8) {
-                        *(tile_ptr2++) = colour >> i;
-                      }
-                    }
-                  }
-                  vid_ptr  += pitch;
-                  tile_ptr += info.pitch;
-                }
-                draw_hardware_cursor(xc, yc, &info);
-                bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                SET_TILE_UPDATED (xti, yti, 0);
-              }
-            }
-          }
-          break;
+        }
       }
     }
   }
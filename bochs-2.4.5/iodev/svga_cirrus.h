@@ -78,6 +78,8 @@ public:
   virtual void mem_write(bx_phy_address addr, Bit8u value);
   virtual void get_text_snapshot(Bit8u **text_snapshot,
                                  unsigned *txHeight, unsigned *txWidth);
+  virtual bx_bool get_gfx_snapshot(Bit8u **gfx_snapshot,
+                                   unsigned *iWidth, unsigned *iHeight);
   virtual void trigger_timer(void *this_ptr);
   virtual Bit8u get_actl_palette_idx(Bit8u index);
   virtual void register_state(void);
@@ -61,6 +61,9 @@ void bx_unmapped_c::init(void)
   s.port80 = 0x00;
   s.port8e = 0x00;
   s.shutdown = 0;
+  s.clone = 0;
+  s.clone_cmdline = NULL;
+  s.clone_pos = 0;
   s.port_e9_hack = SIM->get_param_bool(BXPN_PORT_E9_HACK)->get();
 }
 
@@ -112,6 +115,17 @@ Bit32u bx_unmapped_c::read(Bit32u address, unsigned io_len)
       }
       break;
 
+    // In a clone of the simulation the guest reads its job command line
+    // from the shutdown port, terminated by a zero byte (see write()).
+    case 0x8900:
+      if (BX_UM_THIS s.clone_cmdline != NULL) {
+        retval = (Bit8u) BX_UM_THIS s.clone_cmdline[BX_UM_THIS s.clone_pos];
+        if (retval != 0) BX_UM_THIS s.clone_pos++;
+      } else {
+        retval = 0xffffffff;
+      }
+      break;
+
     case 0x03df:
       retval = 0xffffffff;
       BX_DEBUG(("unsupported IO read from port %04x (CGA)", address));
@@ -255,6 +269,28 @@ void bx_unmapped_c::write(Bit32u address, Bit32u value, unsigned io_len)
         LOG_THIS setonoff(LOGLEV_PANIC, ACT_FATAL);
         BX_PANIC(("Shutdown port: shutdown requested"));
       }
+      // Output "Clone" to port 8900 to mark the point where the clone
+      // server takes over and forks a copy of the simulation for each job
+      if (value == (Bit32u)"Clone"[BX_UM_THIS s.clone]) {
+        BX_UM_THIS s.clone++;
+      } else {
+        BX_UM_THIS s.clone = (value == 'C') ? 1 : 0;
+      }
+      if (BX_UM_THIS s.clone == 5) {
+        BX_UM_THIS s.clone = 0;
+        if (!SIM->get_param_bool(BXPN_CLONE_ENABLED)->get()) {
+          BX_DEBUG(("Shutdown port: clone marker ignored"));
+        } else if (BX_UM_THIS s.clone_cmdline != NULL) {
+          BX_ERROR(("Shutdown port: clone marker ignored in a clone"));
+        } else {
+          BX_UM_THIS s.clone_cmdline = bx_clone_server();
+          BX_UM_THIS s.clone_pos = 0;
+          if (BX_UM_THIS s.clone_cmdline == NULL) {
+            BX_INFO(("Shutdown port: clone server finished"));
+            bx_stop_simulation();
+          }
+        }
+      }
       break;
 
     case 0xfedc:
@@ -49,6 +49,9 @@ private:
     Bit8u port80;
     Bit8u port8e;
     Bit8u shutdown;
+    Bit8u clone;
+    const char *clone_cmdline; // job command line, returned by reads from 0x8900
+    unsigned clone_pos;
     bx_bool port_e9_hack;
   } s;  // state information
 };
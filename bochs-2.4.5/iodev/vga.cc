@@ -104,6 +104,7 @@ bx_vga_c::bx_vga_c()
   s.y_tilesize = Y_TILESIZE;
   timer_id = BX_NULL_TIMER_HANDLE;
   s.memory = NULL;
+  gfx_snapshot.buffer = NULL;
 }
 
 bx_vga_c::~bx_vga_c()
@@ -317,6 +318,7 @@ void bx_vga_c::init(void)
     BX_VGA_THIS vbe.virtual_start=0;
     BX_VGA_THIS vbe.lfb_enabled=0;
     BX_VGA_THIS vbe.get_capabilities=0;
+    memset(BX_VGA_THIS vbe.dirty_blocks, 0, sizeof(BX_VGA_THIS vbe.dirty_blocks));
     bx_gui->get_capabilities(&max_xres, &max_yres, &max_bpp);
     if (max_xres > VBE_DISPI_MAX_XRES) {
       BX_VGA_THIS vbe.max_xres=VBE_DISPI_MAX_XRES;
@@ -377,12 +379,17 @@ void bx_vga_c::init_systemtimer(bx_timer_handler_t f_timer, param_event_handler
   Bit64u interval = vga_update_interval->get();
   BX_INFO(("interval=" FMT_LL "u", interval));
   if (BX_VGA_THIS timer_id == BX_NULL_TIMER_HANDLE) {
+    // an interval of 0 selects the headless mode: the display is only
+    // rendered on demand by get_gfx_snapshot() / get_text_snapshot()
     BX_VGA_THIS timer_id = bx_pc_system.register_timer(this, f_timer,
-       (Bit32u)interval, 1, 1, "vga");
+       (Bit32u)interval, 1, (interval > 0), "vga");
     vga_update_interval->set_handler(f_param);
     vga_update_interval->set_runtime_param(1);
   }
-  if (interval < 300000) {
+  if (interval == 0) {
+    BX_INFO(("headless mode: periodic display updates disabled"));
+    BX_VGA_THIS s.blink_counter = 1;
+  } else if (interval < 300000) {
     BX_VGA_THIS s.blink_counter = 300000 / (unsigned)interval;
   } else {
     BX_VGA_THIS s.blink_counter = 1;
@@ -1519,13 +1526,33 @@ Bit64s bx_vga_c::vga_param_handler(bx_param_c *param, int set, Bit64s val)
 {
   // handler for runtime parameter 'vga_update_interval'
   if (set) {
-    BX_INFO (("Changing timer interval to %d", (Bit32u)val));
-    BX_VGA_THIS timer_handler (theVga);
-    bx_pc_system.activate_timer (BX_VGA_THIS timer_id, (Bit32u)val, 1);
+    BX_VGA_THIS set_update_interval(timer_handler, val);
   }
   return val;
 }
 
+// Restarts the display timer with a new update interval, or stops it for
+// the headless mode (0). Like in the bochsrc, intervals below 40000 usec
+// are raised to that. The headless mode draws nothing and its text
+// screenshots overwrite the text snapshot of the last drawn screen, so the
+// whole screen is drawn again.
+void bx_vga_c::set_update_interval(bx_timer_handler_t f_timer, Bit64s interval)
+{
+  if (interval > 0) {
+    if (interval < 40000) {
+      BX_ERROR(("VGA update interval %d is too small, using 40000", (Bit32u)interval));
+      interval = 40000;
+    }
+    BX_INFO (("Changing timer interval to %d", (Bit32u)interval));
+    BX_VGA_THIS redraw_area(0, 0, BX_MAX_XRES, BX_MAX_YRES);
+    f_timer(BX_VGA_THIS_PTR);
+    bx_pc_system.activate_timer (BX_VGA_THIS timer_id, (Bit32u)interval, 1);
+  } else {
+    BX_INFO (("Disabling periodic display updates"));
+    bx_pc_system.deactivate_timer (BX_VGA_THIS timer_id);
+  }
+}
+
 void bx_vga_c::trigger_timer(void *this_ptr)
 {
   timer_handler(this_ptr);
@@ -1548,6 +1575,143 @@ void bx_vga_c::timer(void)
   bx_gui->flush();
 }
 
+// Fills the pixel conversion tables for a packed pixel mode with 'bpp'
+// bits per pixel and a host display described by 'info'
+void bx_vga_c::init_pixel_conv(bx_svga_tileinfo_t *info, unsigned bpp, Bit8u dac_size)
+{
+  bx_vga_pixel_conv_t *conv = &BX_VGA_THIS pixel_conv;
+  Bit32u v;
+
+  conv->src_bytes = (bpp + 7) >> 3;
+  conv->dst_bytes = (info->bpp + 7) >> 3;
+  conv->little_endian = info->is_little_endian;
+  memset(conv->lut, 0, sizeof(conv->lut));
+  for (unsigned i = 0; i < 256; i++) {
+    if (info->is_indexed) {
+      conv->lut[0][i] = i;
+      continue;
+    }
+    switch (bpp) {
+      case 8:
+        conv->lut[0][i] = MAKE_COLOUR(
+          BX_VGA_THIS s.pel.data[i].red, dac_size, info->red_shift, info->red_mask,
+          BX_VGA_THIS s.pel.data[i].green, dac_size, info->green_shift, info->green_mask,
+          BX_VGA_THIS s.pel.data[i].blue, dac_size, info->blue_shift, info->blue_mask);
+        break;
+      case 15:
+        for (unsigned b = 0; b < 2; b++) {
+          v = i << (b * 8);
+          conv->lut[b][i] = MAKE_COLOUR(
+            v & 0x001f, 5, info->blue_shift, info->blue_mask,
+            v & 0x03e0, 10, info->green_shift, info->green_mask,
+            v & 0x7c00, 15, info->red_shift, info->red_mask);
+        }
+        break;
+      case 16:
+        for (unsigned b = 0; b < 2; b++) {
+          v = i << (b * 8);
+          conv->lut[b][i] = MAKE_COLOUR(
+            v & 0x001f, 5, info->blue_shift, info->blue_mask,
+            v & 0x07e0, 11, info->green_shift, info->green_mask,
+            v & 0xf800, 16, info->red_shift, info->red_mask);
+        }
+        break;
+      case 24:
+      case 32:
+        // byte 0 is blue, 1 is green and 2 is red, byte 3 is unused
+        conv->lut[0][i] = MAKE_COLOUR(0, 8, info->red_shift, info->red_mask,
+                                      0, 8, info->green_shift, info->green_mask,
+                                      i, 8, info->blue_shift, info->blue_mask);
+        conv->lut[1][i] = MAKE_COLOUR(0, 8, info->red_shift, info->red_mask,
+                                      i, 8, info->green_shift, info->green_mask,
+                                      0, 8, info->blue_shift, info->blue_mask);
+        conv->lut[2][i] = MAKE_COLOUR(i, 8, info->red_shift, info->red_mask,
+                                      0, 8, info->green_shift, info->green_mask,
+                                      0, 8, info->blue_shift, info->blue_mask);
+        break;
+    }
+  }
+}
+
+// Converts a row of 'w' guest pixels at 's' to host pixels at 'd', where
+// STORE(d, colour) writes one host pixel and 'inc' is its size
+#define BX_VGA_CONVERT_ROW(STORE, inc)                                   \
+  switch (conv->src_bytes) {                                             \
+    case 1:                                                              \
+      for (c = 0; c < w; c++, s++, d += (inc)) {                         \
+        colour = lut0[s[0]];                                             \
+        STORE(d, colour);                                                \
+      }                                                                  \
+      break;                                                             \
+    case 2:                                                              \
+      for (c = 0; c < w; c++, s += 2, d += (inc)) {                      \
+        colour = lut0[s[0]] | lut1[s[1]];                                \
+        STORE(d, colour);                                                \
+      }                                                                  \
+      break;                                                             \
+    default:                                                             \
+      for (c = 0; c < w; c++, s += conv->src_bytes, d += (inc)) {        \
+        colour = lut0[s[0]] | lut1[s[1]] | lut2[s[2]];                   \
+        STORE(d, colour);                                                \
+      }                                                                  \
+      break;                                                             \
+  }
+
+#define BX_VGA_STORE_PIXEL(d, colour) {                                  \
+  if (conv->little_endian) {                                             \
+    for (i = 0; i < conv->dst_bytes; i++)                                \
+      d[i] = (Bit8u)(colour >> (i * 8));                                 \
+  } else {                                                               \
+    for (i = 0; i < conv->dst_bytes; i++)                                \
+      d[i] = (Bit8u)(colour >> ((conv->dst_bytes - 1 - i) * 8));         \
+  }                                                                      \
+}
+
+// Converts a 'w' x 'h' pixel area of a packed pixel mode to the host format,
+// using the tables set up by init_pixel_conv()
+void bx_vga_c::convert_tile(const bx_vga_pixel_conv_t *conv, const Bit8u *src, unsigned src_pitch,
+                            Bit8u *dst, unsigned dst_pitch, unsigned w, unsigned h)
+{
+  const Bit32u *lut0 = conv->lut[0], *lut1 = conv->lut[1], *lut2 = conv->lut[2];
+  const Bit8u *s;
+  Bit8u *d;
+  Bit32u colour;
+  unsigned r, c, i;
+
+  for (r = 0; r < h; r++, src += src_pitch, dst += dst_pitch) {
+    s = src;
+    d = dst;
+    if (conv->little_endian && (conv->dst_bytes == 4)) {
+      BX_VGA_CONVERT_ROW(WriteHostDWordToLittleEndian, 4);
+    } else if (conv->little_endian && (conv->dst_bytes == 2)) {
+      BX_VGA_CONVERT_ROW(WriteHostWordToLittleEndian, 2);
+    } else {
+      BX_VGA_CONVERT_ROW(BX_VGA_STORE_PIXEL, conv->dst_bytes);
+    }
+  }
+}
+
+// Passes the palette index tile of a standard graphics mode to the gui, or
+// converts it into the frame rendered by get_gfx_snapshot()
+void bx_vga_c::put_graphics_tile(unsigned xc, unsigned yc)
+{
+  unsigned w, h;
+
+  if (BX_VGA_THIS gfx_snapshot.buffer == NULL) {
+    bx_gui->graphics_tile_update(BX_VGA_THIS s.tile, xc, yc);
+    return;
+  }
+  if ((xc >= BX_VGA_THIS gfx_snapshot.xres) || (yc >= BX_VGA_THIS gfx_snapshot.yres))
+    return;
+  w = BX_VGA_THIS gfx_snapshot.xres - xc;
+  if (w > X_TILESIZE) w = X_TILESIZE;
+  h = BX_VGA_THIS gfx_snapshot.yres - yc;
+  if (h > Y_TILESIZE) h = Y_TILESIZE;
+  convert_tile(&BX_VGA_THIS pixel_conv, BX_VGA_THIS s.tile, X_TILESIZE,
+               BX_VGA_THIS gfx_snapshot.buffer + (yc * BX_VGA_THIS gfx_snapshot.xres + xc) * 3,
+               BX_VGA_THIS gfx_snapshot.xres * 3, w, h);
+}
+
 void bx_vga_c::update(void)
 {
   unsigned iHeight, iWidth;
@@ -1563,8 +1727,9 @@ void bx_vga_c::update(void)
     return;
 
   /* skip screen update if the vertical retrace is in progress
-     (using 72 Hz vertical frequency) */
-  if ((bx_pc_system.time_usec() % 13888) < 70)
+     (using 72 Hz vertical frequency), unless a snapshot is rendered */
+  if (((bx_pc_system.time_usec() % 13888) < 70) &&
+      (BX_VGA_THIS gfx_snapshot.buffer == NULL))
     return;
 
 #if BX_SUPPORT_VBE
@@ -1573,11 +1738,8 @@ void bx_vga_c::update(void)
     // specific VBE code display update code
     unsigned pitch;
     unsigned xc, yc, xti, yti;
-    unsigned r, c, w, h;
-    int i;
-    unsigned long red, green, blue, colour;
-    Bit8u * vid_ptr, * vid_ptr2;
-    Bit8u * tile_ptr, * tile_ptr2;
+    unsigned w, h;
+    Bit8u * tile_ptr;
     bx_svga_tileinfo_t info;
     Bit8u dac_size = BX_VGA_THIS vbe.dac_8bit ? 8 : 6;
 
@@ -1586,239 +1748,25 @@ void bx_vga_c::update(void)
     pitch = BX_VGA_THIS s.line_offset;
     Bit8u *disp_ptr = &BX_VGA_THIS s.memory[BX_VGA_THIS vbe.virtual_start];
 
+    vbe_update_dirty_tiles();
+
     if (bx_gui->graphics_tile_info(&info)) {
-      if (info.is_indexed) {
-        switch (BX_VGA_THIS vbe.bpp) {
-          case 4:
-          case 15:
-          case 16:
-          case 24:
-          case 32:
-            BX_ERROR(("current guest pixel format is unsupported on indexed colour host displays"));
-            break;
-          case 8:
-            for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
-              for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
-                if (GET_TILE_UPDATED (xti, yti)) {
-                  vid_ptr = disp_ptr + (yc * pitch + xc);
-                  tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                  for (r=0; r<h; r++) {
-                    vid_ptr2  = vid_ptr;
-                    tile_ptr2 = tile_ptr;
-                    for (c=0; c<w; c++) {
-                      colour = 0;
-                      for (i=0; i<(int)BX_VGA_THIS vbe.bpp; i+=8) {
-                        colour |= *(vid_ptr2++) << i;
-                      }
-                      if (info.is_little_endian) {
-                        for (i=0; i<info.bpp; i+=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                      else {
-                        for (i=info.bpp-8; i>-8; i-=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                    }
-                    vid_ptr  += pitch;
-                    tile_ptr += info.pitch;
-                  }
-                  bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                  SET_TILE_UPDATED (xti, yti, 0);
-                }
-              }
-            }
-            break;
-        }
+      if (info.is_indexed && (BX_VGA_THIS vbe.bpp != 8)) {
+        BX_ERROR(("current guest pixel format is unsupported on indexed colour host displays"));
       }
       else {
-        switch (BX_VGA_THIS vbe.bpp) {
-          case 4:
-            BX_ERROR(("cannot draw 4bpp SVGA"));
-            break;
-          case 8:
-            for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
-              for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
-                if (GET_TILE_UPDATED (xti, yti)) {
-                  vid_ptr = disp_ptr + (yc * pitch + xc);
-                  tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                  for (r=0; r<h; r++) {
-                    vid_ptr2  = vid_ptr;
-                    tile_ptr2 = tile_ptr;
-                    for (c=0; c<w; c++) {
-                      colour = *(vid_ptr2++);
-                      colour = MAKE_COLOUR(
-                        BX_VGA_THIS s.pel.data[colour].red, dac_size, info.red_shift, info.red_mask,
-                        BX_VGA_THIS s.pel.data[colour].green, dac_size, info.green_shift, info.green_mask,
-                        BX_VGA_THIS s.pel.data[colour].blue, dac_size, info.blue_shift, info.blue_mask);
-                      if (info.is_little_endian) {
-                        for (i=0; i<info.bpp; i+=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                      else {
-                        for (i=info.bpp-8; i>-8; i-=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                    }
-                    vid_ptr  += pitch;
-                    tile_ptr += info.pitch;
-                  }
-                  bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                  SET_TILE_UPDATED (xti, yti, 0);
-                }
-              }
-            }
-            break;
-          case 15:
-            for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
-              for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
-                if (GET_TILE_UPDATED (xti, yti)) {
-                  vid_ptr = disp_ptr + (yc * pitch + (xc<<1));
-                  tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                  for (r=0; r<h; r++) {
-                    vid_ptr2  = vid_ptr;
-                    tile_ptr2 = tile_ptr;
-                    for (c=0; c<w; c++) {
-                      colour = *(vid_ptr2++);
-                      colour |= *(vid_ptr2++) << 8;
-                      colour = MAKE_COLOUR(
-                        colour & 0x001f, 5, info.blue_shift, info.blue_mask,
-                        colour & 0x03e0, 10, info.green_shift, info.green_mask,
-                        colour & 0x7c00, 15, info.red_shift, info.red_mask);
-                      if (info.is_little_endian) {
-                        for (i=0; i<info.bpp; i+=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                      else {
-                        for (i=info.bpp-8; i>-8; i-=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                    }
-                    vid_ptr  += pitch;
-                    tile_ptr += info.pitch;
-                  }
-                  bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                  SET_TILE_UPDATED (xti, yti, 0);
-                }
-              }
-            }
-            break;
-          case 16:
-            for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
-              for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
-                if (GET_TILE_UPDATED (xti, yti)) {
-                  vid_ptr = disp_ptr + (yc * pitch + (xc<<1));
-                  tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                  for (r=0; r<h; r++) {
-                    vid_ptr2  = vid_ptr;
-                    tile_ptr2 = tile_ptr;
-                    for (c=0; c<w; c++) {
-                      colour = *(vid_ptr2++);
-                      colour |= *(vid_ptr2++) << 8;
-                      colour = MAKE_COLOUR(
-                        colour & 0x001f, 5, info.blue_shift, info.blue_mask,
-                        colour & 0x07e0, 11, info.green_shift, info.green_mask,
-                        colour & 0xf800, 16, info.red_shift, info.red_mask);
-                      if (info.is_little_endian) {
-                        for (i=0; i<info.bpp; i+=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                      else {
-                        for (i=info.bpp-8; i>-8; i-=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                    }
-                    vid_ptr  += pitch;
-                    tile_ptr += info.pitch;
-                  }
-                  bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                  SET_TILE_UPDATED (xti, yti, 0);
-                }
-              }
-            }
-            break;
-          case 24:
-            for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
-              for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
-                if (GET_TILE_UPDATED (xti, yti)) {
-                  vid_ptr = disp_ptr + (yc * pitch + 3*xc);
-                  tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                  for (r=0; r<h; r++) {
-                    vid_ptr2  = vid_ptr;
-                    tile_ptr2 = tile_ptr;
-                    for (c=0; c<w; c++) {
-                      blue = *(vid_ptr2++);
-                      green = *(vid_ptr2++);
-                      red = *(vid_ptr2++);
-                      colour = MAKE_COLOUR(
-                        red, 8, info.red_shift, info.red_mask,
-                        green, 8, info.green_shift, info.green_mask,
-                        blue, 8, info.blue_shift, info.blue_mask);
-                      if (info.is_little_endian) {
-                        for (i=0; i<info.bpp; i+=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                      else {
-                        for (i=info.bpp-8; i>-8; i-=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                    }
-                    vid_ptr  += pitch;
-                    tile_ptr += info.pitch;
-                  }
-                  bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                  SET_TILE_UPDATED (xti, yti, 0);
-                }
-              }
-            }
-            break;
-          case 32:
-            for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
-              for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
-                if (GET_TILE_UPDATED (xti, yti)) {
-                  vid_ptr = disp_ptr + (yc * pitch + (xc<<2));
-                  tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
-                  for (r=0; r<h; r++) {
-                    vid_ptr2  = vid_ptr;
-                    tile_ptr2 = tile_ptr;
-                    for (c=0; c<w; c++) {
-                      blue = *(vid_ptr2++);
-                      green = *(vid_ptr2++);
-                      red = *(vid_ptr2++);
-                      vid_ptr2++;
-                      colour = MAKE_COLOUR(
-                        red, 8, info.red_shift, info.red_mask,
-                        green, 8, info.green_shift, info.green_mask,
-                        blue, 8, info.blue_shift, info.blue_mask);
-                      if (info.is_little_endian) {
-                        for (i=0; i<info.bpp; i+=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                      else {
-                        for (i=info.bpp-8; i>-8; i-=8) {
-                          *(tile_ptr2++) = (Bit8u)(colour >> i);
-                        }
-                      }
-                    }
-                    vid_ptr  += pitch;
-                    tile_ptr += info.pitch;
-                  }
-                  bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
-                  SET_TILE_UPDATED (xti, yti, 0);
-                }
-              }
+        init_pixel_conv(&info, BX_VGA_THIS vbe.bpp, dac_size);
+        for (yc=0, yti = 0; yc<iHeight; yc+=Y_TILESIZE, yti++) {
+          for (xc=0, xti = 0; xc<iWidth; xc+=X_TILESIZE, xti++) {
+            if (GET_TILE_UPDATED (xti, yti)) {
+              tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
+              convert_tile(&BX_VGA_THIS pixel_conv,
+                           disp_ptr + yc * pitch + xc * BX_VGA_THIS pixel_conv.src_bytes,
+                           pitch, tile_ptr, info.pitch, w, h);
+              bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
+              SET_TILE_UPDATED (xti, yti, 0);
             }
-            break;
+          }
         }
       }
       old_iWidth = iWidth;
@@ -1899,7 +1847,7 @@ void bx_vga_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED (xti, yti, 0);
-                bx_gui->graphics_tile_update(BX_VGA_THIS s.tile, xc, yc);
+                put_graphics_tile(xc, yc);
               }
             }
           }
@@ -1975,7 +1923,7 @@ void bx_vga_c::update(void)
                     }
                   }
                 SET_TILE_UPDATED (xti, yti, 0);
-                bx_gui->graphics_tile_update(BX_VGA_THIS s.tile, xc, yc);
+                put_graphics_tile(xc, yc);
                 }
               }
             }
@@ -2012,7 +1960,7 @@ void bx_vga_c::update(void)
                 }
               }
               SET_TILE_UPDATED (xti, yti, 0);
-              bx_gui->graphics_tile_update(BX_VGA_THIS s.tile, xc, yc);
+              put_graphics_tile(xc, yc);
             }
           }
         }
@@ -2046,7 +1994,7 @@ void bx_vga_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED (xti, yti, 0);
-                bx_gui->graphics_tile_update(BX_VGA_THIS s.tile, xc, yc);
+                put_graphics_tile(xc, yc);
               }
             }
           }
@@ -2072,7 +2020,7 @@ void bx_vga_c::update(void)
                   }
                 }
                 SET_TILE_UPDATED (xti, yti, 0);
-                bx_gui->graphics_tile_update(BX_VGA_THIS s.tile, xc, yc);
+                put_graphics_tile(xc, yc);
               }
 	    }
 	  }
@@ -2804,7 +2752,7 @@ void bx_vga_c::mem_write(bx_phy_address addr, Bit8u value)
 void bx_vga_c::get_text_snapshot(Bit8u **text_snapshot, unsigned *txHeight,
                                                    unsigned *txWidth)
 {
-  unsigned VDE, MSL;
+  unsigned VDE, MSL, start_address, line_offset;
 
   if (!BX_VGA_THIS s.graphics_ctrl.graphics_alpha) {
     *text_snapshot = &BX_VGA_THIS s.text_snapshot[0];
@@ -2812,12 +2760,104 @@ void bx_vga_c::get_text_snapshot(Bit8u **text_snapshot, unsigned *txHeight,
     MSL = BX_VGA_THIS s.CRTC.reg[0x09] & 0x1f;
     *txHeight = (VDE+1)/(MSL+1);
     *txWidth = BX_VGA_THIS s.CRTC.reg[1] + 1;
+    if (SIM->get_param_num(BXPN_VGA_UPDATE_INTERVAL)->get() == 0) {
+      // headless mode: update() does not maintain the text snapshot
+      start_address = 2*((BX_VGA_THIS s.CRTC.reg[12] << 8) +
+                      BX_VGA_THIS s.CRTC.reg[13]);
+      line_offset = BX_VGA_THIS s.CRTC.reg[0x13] << 2;
+      if ((start_address + *txHeight * line_offset) <= (1 << 17)) {
+        memcpy(BX_VGA_THIS s.text_snapshot, &BX_VGA_THIS s.memory[start_address],
+               *txHeight * line_offset);
+      }
+    }
   } else {
     *txHeight = 0;
     *txWidth = 0;
   }
 }
 
+// Sets up the pixel conversion from a guest mode with 'bpp' bits per pixel
+// to the 24 bpp frame format of get_gfx_snapshot(), which is the BMP layout
+void bx_vga_c::init_gfx_snapshot_conv(unsigned bpp, Bit8u dac_size)
+{
+  bx_svga_tileinfo_t info;
+
+  info.bpp = 24;
+  info.pitch = 0;
+  info.red_shift = 24;
+  info.green_shift = 16;
+  info.blue_shift = 8;
+  info.red_mask = 0xff0000;
+  info.green_mask = 0x00ff00;
+  info.blue_mask = 0x0000ff;
+  info.is_indexed = 0;
+  info.is_little_endian = 1;
+  init_pixel_conv(&info, bpp, dac_size);
+}
+
+// Renders the current graphics mode frame as 24 bpp pixels (blue, green, red)
+// with a pitch of 3 * iWidth bytes. The caller must free() the returned frame.
+bx_bool bx_vga_c::get_gfx_snapshot(Bit8u **gfx_snapshot, unsigned *iWidth,
+                                   unsigned *iHeight)
+{
+  unsigned xres, yres, xti, yti;
+  Bit8u dac_size = 6;
+  Bit8u *buffer;
+
+  *gfx_snapshot = NULL;
+  *iWidth = 0;
+  *iHeight = 0;
+
+#if BX_SUPPORT_VBE
+  if (BX_VGA_THIS vbe.dac_8bit) dac_size = 8;
+  if ((BX_VGA_THIS vbe.enabled) && (BX_VGA_THIS vbe.bpp != VBE_DISPI_BPP_4)) {
+    xres = BX_VGA_THIS vbe.xres;
+    yres = BX_VGA_THIS vbe.yres;
+    buffer = (Bit8u *) malloc(yres * xres * 3);
+    if (buffer == NULL) return 0;
+    init_gfx_snapshot_conv(BX_VGA_THIS vbe.bpp, dac_size);
+    convert_tile(&BX_VGA_THIS pixel_conv,
+                 &BX_VGA_THIS s.memory[BX_VGA_THIS vbe.virtual_start],
+                 BX_VGA_THIS s.line_offset, buffer, xres * 3, xres, yres);
+  }
+  else
+#endif
+  {
+    if (!BX_VGA_THIS s.graphics_ctrl.graphics_alpha)
+      return 0;
+    determine_screen_dimensions(&yres, &xres);
+    buffer = (Bit8u *) calloc(yres, xres * 3);
+    if (buffer == NULL) return 0;
+    // let update() render all tiles into the frame instead of the gui. The
+    // tiles are marked here, since redraw_area() clips to the dimensions of
+    // the last update, which never ran in the headless mode.
+    init_gfx_snapshot_conv(8, dac_size);
+    BX_VGA_THIS gfx_snapshot.buffer = buffer;
+    BX_VGA_THIS gfx_snapshot.xres = xres;
+    BX_VGA_THIS gfx_snapshot.yres = yres;
+    BX_VGA_THIS s.vga_mem_updated = 1;
+    for (xti = 0; xti < BX_NUM_X_TILES; xti++) {
+      for (yti = 0; yti < BX_NUM_Y_TILES; yti++) {
+        SET_TILE_UPDATED (xti, yti, 1);
+      }
+    }
+    update();
+    BX_VGA_THIS gfx_snapshot.buffer = NULL;
+    // the gui has not seen these tiles yet
+    BX_VGA_THIS s.vga_mem_updated = 1;
+    for (xti = 0; xti < BX_NUM_X_TILES; xti++) {
+      for (yti = 0; yti < BX_NUM_Y_TILES; yti++) {
+        SET_TILE_UPDATED (xti, yti, 1);
+      }
+    }
+  }
+
+  *gfx_snapshot = buffer;
+  *iWidth = xres;
+  *iHeight = yres;
+  return 1;
+}
+
 Bit8u bx_vga_c::get_actl_palette_idx(Bit8u index)
 {
   return BX_VGA_THIS s.attribute_ctrl.palette_reg[index];
@@ -2977,7 +3017,6 @@ bx_vga_c::vbe_mem_read(bx_phy_address addr)
 bx_vga_c::vbe_mem_write(bx_phy_address addr, Bit8u value)
 {
   Bit32u offset;
-  unsigned x_tileno, y_tileno;
 
   if (BX_VGA_THIS vbe.lfb_enabled)
   {
@@ -3010,6 +3049,14 @@ bx_vga_c::vbe_mem_write(bx_phy_address addr, Bit8u value)
   if (offset < VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES)
   {
     BX_VGA_THIS s.memory[offset]=value;
+
+    // only update the UI when writing 'onscreen'
+    if ((offset - BX_VGA_THIS vbe.virtual_start) < BX_VGA_THIS vbe.visible_screen_size)
+    {
+      unsigned block = offset >> VBE_DIRTY_BLOCK_SHIFT;
+      BX_VGA_THIS vbe.dirty_blocks[block >> 5] |= (1 << (block & 31));
+      BX_VGA_THIS s.vga_mem_updated = 1;
+    }
   }
   else
   {
@@ -3021,19 +3068,53 @@ bx_vga_c::vbe_mem_write(bx_phy_address addr, Bit8u value)
       BX_INFO(("VBE_mem_write out of video memory write at %x",offset));
     }
   }
+}
 
-  offset-=BX_VGA_THIS vbe.virtual_start;
+// Marks the tiles covered by the blocks written since the last update
+// and clears their dirty bits.
+void bx_vga_c::vbe_update_dirty_tiles(void)
+{
+  Bit32u start = BX_VGA_THIS vbe.virtual_start;
+  Bit32u end = start + BX_VGA_THIS vbe.visible_screen_size;
+  Bit32u pitch = BX_VGA_THIS s.line_offset;
+  Bit32u block_start, block_end, x0, x1, y0, y1, bits;
+  unsigned block, xti, yti;
 
-  // only update the UI when writing 'onscreen'
-  if (offset < BX_VGA_THIS vbe.visible_screen_size)
-  {
-    y_tileno = ((offset / BX_VGA_THIS vbe.bpp_multiplier) / BX_VGA_THIS vbe.virtual_xres) / Y_TILESIZE;
-    x_tileno = ((offset / BX_VGA_THIS vbe.bpp_multiplier) % BX_VGA_THIS vbe.virtual_xres) / X_TILESIZE;
+  if ((pitch == 0) || (end <= start))
+    return;
 
-    if ((y_tileno < BX_NUM_Y_TILES) && (x_tileno < BX_NUM_X_TILES))
-    {
-      BX_VGA_THIS s.vga_mem_updated = 1;
-      SET_TILE_UPDATED (x_tileno, y_tileno, 1);
+  // only the words of the bitmap covering the visible screen can be set
+  unsigned first = (start >> VBE_DIRTY_BLOCK_SHIFT) >> 5;
+  unsigned last = ((end - 1) >> VBE_DIRTY_BLOCK_SHIFT) >> 5;
+  if (last >= (VBE_DIRTY_BLOCKS / 32))
+    last = (VBE_DIRTY_BLOCKS / 32) - 1;
+
+  for (unsigned i = first; i <= last; i++) {
+    bits = BX_VGA_THIS vbe.dirty_blocks[i];
+    if (bits == 0) continue;
+    BX_VGA_THIS vbe.dirty_blocks[i] = 0;
+    for (block = i * 32; bits != 0; block++, bits >>= 1) {
+      if ((bits & 1) == 0) continue;
+      // the part of the block inside the visible screen, relative to its start
+      block_start = block << VBE_DIRTY_BLOCK_SHIFT;
+      block_end = block_start + (1 << VBE_DIRTY_BLOCK_SHIFT);
+      if ((block_end <= start) || (block_start >= end)) continue;
+      block_start = ((block_start > start) ? block_start : start) - start;
+      block_end = ((block_end < end) ? block_end : end) - start - 1;
+      y0 = block_start / pitch;
+      y1 = block_end / pitch;
+      if (y0 == y1) {
+        x0 = (block_start % pitch) / BX_VGA_THIS vbe.bpp_multiplier;
+        x1 = (block_end % pitch) / BX_VGA_THIS vbe.bpp_multiplier;
+      } else {
+        x0 = 0;
+        x1 = BX_VGA_THIS vbe.virtual_xres - 1;
+      }
+      for (yti = y0 / Y_TILESIZE; yti <= y1 / Y_TILESIZE; yti++) {
+        for (xti = x0 / X_TILESIZE; xti <= x1 / X_TILESIZE; xti++) {
+          SET_TILE_UPDATED (xti, yti, 1);
+        }
+      }
     }
   }
 }
@@ -114,6 +114,24 @@
 #define BX_NUM_X_TILES (BX_MAX_XRES /X_TILESIZE)
 #define BX_NUM_Y_TILES (BX_MAX_YRES /Y_TILESIZE)
 
+// Tables converting the pixels of a packed pixel mode to the host format of
+// the graphics tiles. The host colour of a pixel is the OR of the entries of
+// its bytes, since MAKE_COLOUR() only shifts and masks the bits of each byte.
+typedef struct {
+  unsigned src_bytes;     // bytes per guest pixel
+  unsigned dst_bytes;     // bytes per host pixel
+  bx_bool  little_endian; // byte order of the host pixels
+  Bit32u   lut[3][256];   // host colour by guest pixel byte 0..2
+} bx_vga_pixel_conv_t;
+
+#if BX_SUPPORT_VBE
+// VBE memory writes only mark their 64 byte block in a bitmap, the blocks
+// are turned into dirty tiles once per screen update. A block is at most
+// one tile wide in 32 bpp modes.
+#define VBE_DIRTY_BLOCK_SHIFT 6
+#define VBE_DIRTY_BLOCKS (VBE_DISPI_TOTAL_VIDEO_MEMORY_BYTES >> VBE_DIRTY_BLOCK_SHIFT)
+#endif
+
 #if BX_USE_VGA_SMF
 #  define BX_VGA_SMF  static
 #  define BX_VGA_THIS theVga->
@@ -153,6 +171,8 @@ public:
 
   virtual void   get_text_snapshot(Bit8u **text_snapshot, unsigned *txHeight,
                                    unsigned *txWidth);
+  virtual bx_bool get_gfx_snapshot(Bit8u **gfx_snapshot, unsigned *iWidth,
+                                   unsigned *iHeight);
   virtual Bit8u  get_actl_palette_idx(Bit8u index);
 
   static void     timer_handler(void *);
@@ -164,6 +184,7 @@ public:
 protected:
   void init_iohandlers(bx_read_handler_t f_read, bx_write_handler_t f_write);
   void init_systemtimer(bx_timer_handler_t f_timer, param_event_handler f_param);
+  BX_VGA_SMF void set_update_interval(bx_timer_handler_t f_timer, Bit64s interval);
 
   static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
   static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
@@ -191,6 +212,14 @@ protected:
 #endif // BX_SUPPORT_VBE
 
   BX_VGA_SMF void update(void);
+  BX_VGA_SMF void put_graphics_tile(unsigned xc, unsigned yc);
+  BX_VGA_SMF void init_gfx_snapshot_conv(unsigned bpp, Bit8u dac_size);
+  BX_VGA_SMF void init_pixel_conv(bx_svga_tileinfo_t *info, unsigned bpp, Bit8u dac_size);
+  static void convert_tile(const bx_vga_pixel_conv_t *conv, const Bit8u *src, unsigned src_pitch,
+                           Bit8u *dst, unsigned dst_pitch, unsigned w, unsigned h);
+#if BX_SUPPORT_VBE
+  BX_VGA_SMF void vbe_update_dirty_tiles(void);
+#endif
   BX_VGA_SMF void determine_screen_dimensions(unsigned *piHeight, unsigned *piWidth);
 
   struct {
@@ -305,6 +334,8 @@ protected:
     Bit8u last_bpp;
   } s;  // state information
 
+  bx_vga_pixel_conv_t pixel_conv;
+
 #if BX_SUPPORT_VBE
   struct {
     Bit16u  cur_dispi;
@@ -328,9 +359,16 @@ protected:
     bx_bool lfb_enabled;
     bx_bool get_capabilities;
     bx_bool dac_8bit;
+    Bit32u  dirty_blocks[VBE_DIRTY_BLOCKS / 32]; /**< Visible blocks written since the last update. */
   } vbe;  // VBE state information
 #endif
 
+  struct {
+    Bit8u *buffer;    // 24 bpp frame while get_gfx_snapshot() renders it
+    unsigned xres;
+    unsigned yres;
+  } gfx_snapshot;
+
   int timer_id;
   bx_bool extension_init;
   bx_bool extension_checked;
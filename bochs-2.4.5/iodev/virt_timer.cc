@@ -423,6 +423,15 @@ void bx_virt_timer_c::init(void)
   init_done = 1;
 }
 
+void bx_virt_timer_c::after_clone(void)
+{
+#if BX_HAVE_REALTIME_USEC
+  if (init_done) {
+    last_real_time = GET_VIRT_REALTIME64_USEC();
+  }
+#endif
+}
+
 void bx_virt_timer_c::register_state(void)
 {
   bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "virt_timer", "Virtual Timer State", 17);
@@ -147,6 +147,9 @@ public:
   void init(void);
 
   void register_state(void);
+
+  // Forget the host time spent before a fork() of the simulation
+  void after_clone(void);
 };
 
 BOCHSAPI extern bx_virt_timer_c bx_virt_timer;
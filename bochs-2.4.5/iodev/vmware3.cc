@@ -479,6 +479,18 @@ ssize_t vmware3_image_t::write(const void * buf, size_t count)
     return total;
 }
 
+ssize_t vmware3_image_t::read_sectors(Bit64u sector, void * buf, unsigned count)
+{
+    requested_offset = (off_t)(sector * 512);
+    return read(buf, (size_t)count * 512);
+}
+
+ssize_t vmware3_image_t::write_sectors(Bit64u sector, const void * buf, unsigned count)
+{
+    requested_offset = (off_t)(sector * 512);
+    return write(buf, (size_t)count * 512);
+}
+
 Bit64s vmware3_image_t::lseek(Bit64s offset, int whence)
 {
     if(whence == SEEK_SET)
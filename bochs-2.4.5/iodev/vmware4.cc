@@ -170,6 +170,20 @@ ssize_t vmware4_image_t::write(const void * buf, size_t count)
     return total;
 }
 
+ssize_t vmware4_image_t::read_sectors(Bit64u sector, void * buf, unsigned count)
+{
+    if(lseek((Bit64s)sector * SECTOR_SIZE, SEEK_SET) == INVALID_OFFSET)
+        return -1;
+    return read(buf, (size_t)count * SECTOR_SIZE);
+}
+
+ssize_t vmware4_image_t::write_sectors(Bit64u sector, const void * buf, unsigned count)
+{
+    if(lseek((Bit64s)sector * SECTOR_SIZE, SEEK_SET) == INVALID_OFFSET)
+        return -1;
+    return write(buf, (size_t)count * SECTOR_SIZE);
+}
+
 bool vmware4_image_t::is_open() const
 {
     return (file_descriptor != -1);
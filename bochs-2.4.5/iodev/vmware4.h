@@ -40,6 +40,8 @@ class vmware4_image_t : public device_image_t
         Bit64s lseek(Bit64s offset, int whence);
         ssize_t read(void* buf, size_t count);
         ssize_t write(const void* buf, size_t count);
+        ssize_t read_sectors(Bit64u sector, void* buf, unsigned count);
+        ssize_t write_sectors(Bit64u sector, const void* buf, unsigned count);
 
     private:
         static const off_t INVALID_OFFSET;
@@ -0,0 +1,156 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Small compressor / decompressor for the LZ4 block format, used to
+//  compress the memory pages of saved states.
+//
+//  The data layout is the one of the LZ4 block format: a sequence starts
+//  with a token byte (high nibble literal length, low nibble match length
+//  minus 4), optional length extension bytes, the literals and a 16-bit
+//  little endian match offset. The last 5 bytes are always literals. The
+//  compressor is a plain greedy one with a single hash table, this is fast
+//  and good enough for memory pages which are mostly very repetitive.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "config.h"
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT      12
+#define LZ4_MAX_OFFSET    65535
+#define LZ4_HASH_LOG      12
+
+static inline Bit32u lz4_read32(const Bit8u *p)
+{
+  Bit32u val;
+  memcpy(&val, p, 4);
+  return val;
+}
+
+static inline Bit32u lz4_hash(Bit32u seq)
+{
+  return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline Bit8u *lz4_put_length(Bit8u *op, unsigned len)
+{
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (Bit8u) len;
+  return op;
+}
+
+// returns the compressed size or 0 if the result does not fit into 'dst'
+int bx_lz4_compress(const Bit8u *src, int srclen, Bit8u *dst, int dstmax)
+{
+  Bit32u table[1 << LZ4_HASH_LOG];
+  const Bit8u *ip = src, *anchor = src;
+  const Bit8u *iend = src + srclen;
+  const Bit8u *mflimit = iend - LZ4_MF_LIMIT;
+  const Bit8u *matchlimit = iend - LZ4_LAST_LITERALS;
+  Bit8u *op = dst, *oend = dst + dstmax, *token;
+  unsigned litlen, len;
+
+  memset(table, 0, sizeof(table));
+  if (srclen > LZ4_MF_LIMIT) {
+    while (ip < mflimit) {
+      Bit32u seq = lz4_read32(ip);
+      Bit32u h = lz4_hash(seq);
+      const Bit8u *ref = src + table[h];
+      table[h] = (Bit32u)(ip - src);
+      if ((ref >= ip) || ((ip - ref) > LZ4_MAX_OFFSET) || (lz4_read32(ref) != seq)) {
+        ip++;
+        continue;
+      }
+      len = LZ4_MIN_MATCH;
+      while (((ip + len) < matchlimit) && (ref[len] == ip[len])) len++;
+
+      litlen = (unsigned)(ip - anchor);
+      if ((op + 1 + litlen + litlen / 255 + 1 + 2 + len / 255 + 1) > oend)
+        return 0;
+      token = op++;
+      if (litlen >= 15) {
+        *token = 15 << 4;
+        op = lz4_put_length(op, litlen - 15);
+      } else {
+        *token = (Bit8u)(litlen << 4);
+      }
+      memcpy(op, anchor, litlen);
+      op += litlen;
+      *op++ = (Bit8u)(ip - ref);
+      *op++ = (Bit8u)((ip - ref) >> 8);
+      if ((len - LZ4_MIN_MATCH) >= 15) {
+        *token |= 15;
+        op = lz4_put_length(op, len - LZ4_MIN_MATCH - 15);
+      } else {
+        *token |= (Bit8u)(len - LZ4_MIN_MATCH);
+      }
+      ip += len;
+      anchor = ip;
+    }
+  }
+  // last literals
+  litlen = (unsigned)(iend - anchor);
+  if ((op + 1 + litlen + litlen / 255 + 1) > oend)
+    return 0;
+  if (litlen >= 15) {
+    *op++ = 15 << 4;
+    op = lz4_put_length(op, litlen - 15);
+  } else {
+    *op++ = (Bit8u)(litlen << 4);
+  }
+  memcpy(op, anchor, litlen);
+  op += litlen;
+  return (int)(op - dst);
+}
+
+// returns the decompressed size or -1 if the input is malformed
+int bx_lz4_decompress(const Bit8u *src, int srclen, Bit8u *dst, int dstlen)
+{
+  const Bit8u *ip = src, *iend = src + srclen;
+  Bit8u *op = dst, *oend = dst + dstlen;
+  unsigned len, offset;
+  Bit8u token, b;
+
+  while (ip < iend) {
+    token = *ip++;
+    len = token >> 4;
+    if (len == 15) {
+      do {
+        if (ip >= iend) return -1;
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+    if ((len > (unsigned)(iend - ip)) || (len > (unsigned)(oend - op)))
+      return -1;
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+    if (ip >= iend) break;
+
+    if ((iend - ip) < 2) return -1;
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if ((offset == 0) || (offset > (unsigned)(op - dst))) return -1;
+    len = token & 15;
+    if (len == 15) {
+      do {
+        if (ip >= iend) return -1;
+        b = *ip++;
+        len += b;
+      } while (b == 255);
+    }
+    len += LZ4_MIN_MATCH;
+    if (len > (unsigned)(oend - op)) return -1;
+    // source and destination may overlap
+    const Bit8u *ref = op - offset;
+    while (len--) *op++ = *ref++;
+  }
+  return (int)(op - dst);
+}
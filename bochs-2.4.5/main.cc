@@ -1176,6 +1176,11 @@ void bx_init_hardware()
   signal(SIGINT, bx_signal_handler);
 #endif
 
+#if !defined(WIN32)
+  // save a screenshot on request, also in the headless display mode
+  signal(SIGUSR1, bx_signal_handler);
+#endif
+
 #if BX_SHOW_IPS
 #if !defined(WIN32)
   signal(SIGALRM, bx_signal_handler);
@@ -1220,6 +1225,10 @@ int bx_atexit(void)
   signal(SIGINT, SIG_DFL);
 #endif
 
+#if !defined(WIN32)
+  signal(SIGUSR1, SIG_DFL);
+#endif
+
 #if BX_SHOW_IPS
 #if !defined(__MINGW32__) && !defined(_MSC_VER)
   signal(SIGALRM, SIG_DFL);
@@ -1287,5 +1296,12 @@ void CDECL bx_signal_handler(int signum)
   }
 #endif
 
+#if !defined(WIN32)
+  if (signum == SIGUSR1) {
+    bx_gui->request_screenshot();
+    return;
+  }
+#endif
+
   BX_PANIC(("SIGNAL %u caught", signum));
 }
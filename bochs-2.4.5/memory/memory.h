@@ -57,7 +57,12 @@ struct memory_handler_struct {
 
 class BOCHSAPI BX_MEM_C : public logfunctions {
 private:
-  struct memory_handler_struct **memory_handlers;
+  // memory handlers dispatch table: one pointer per 4K page to the newest
+  // handler covering the page, the page arrays are allocated only for
+  // megabytes having registered handlers. The handlers are linked by 'next'
+  // from the newest registration to the oldest.
+  struct memory_handler_struct ***memory_handlers;
+  struct memory_handler_struct *memory_handler_list;
   bx_bool rom_present[65];
   bx_bool pci_enabled;
   bx_bool smram_available;
@@ -66,11 +71,14 @@ private:
 
   Bit64u  len, allocated;  // could be > 4G
   Bit8u   *actual_vector;
+  Bit64u   actual_vector_len;
+  bx_bool  vector_mapped;   // actual_vector came from anonymous mmap
   Bit8u   *vector;   // aligned correctly
   Bit8u  **blocks;
   Bit8u   *rom;      // 512k BIOS rom space + 128k expansion rom space
   Bit8u   *bogus;    // 4k for unexisting memory
   unsigned used_blocks;
+  Bit8u   *dirty_bitmap; // one bit per 4K page of guest RAM, NULL if not tracked
 
 public:
   BX_MEM_C();
@@ -96,6 +104,9 @@ public:
   BX_MEM_SMF bx_bool dbg_crc32(bx_phy_address addr1, bx_phy_address addr2, Bit32u *crc);
 #endif
   BX_MEM_SMF Bit8u* getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw);
+  BX_MEM_SMF int    getHostMemIovec(bx_phy_address addr, Bit32u len, unsigned rw,
+                                  bx_iovec_t *iov, int iovcnt, int maxiov);
+  BX_MEM_SMF struct memory_handler_struct *get_memory_handlers(bx_phy_address a20addr);
   BX_MEM_SMF bx_bool registerMemoryHandlers(void *param, memory_handler_t read_handler,
 		  memory_handler_t write_handler, bx_phy_address begin_addr, bx_phy_address end_addr);
   BX_MEM_SMF bx_bool unregisterMemoryHandlers(memory_handler_t read_handler, memory_handler_t write_handler,
@@ -103,6 +114,16 @@ public:
   BX_MEM_SMF Bit64u  get_memory_len(void);
   BX_MEM_SMF void allocate_block(Bit32u index);
   BX_MEM_SMF Bit8u* alloc_vector_aligned(Bit32u bytes, Bit32u alignment);
+  BX_MEM_SMF void   free_vector_aligned(void);
+  BX_MEM_SMF void   release_memory(void);
+
+  BX_MEM_SMF void    enable_dirty_tracking(bx_bool enable);
+  BX_MEM_SMF bx_bool dirty_tracking_enabled(void);
+  BX_MEM_SMF Bit32u  get_dirty_bitmap_size(void);
+  BX_MEM_SMF void    snapshot_dirty_pages(Bit8u *bitmap);
+  BX_MEM_SMF Bit32u  get_host_dirty_bitmap_size(void);
+  BX_MEM_SMF void    snapshot_dirty_host_pages(Bit8u *bitmap);
+  BX_MEM_SMF void    mark_dirty(bx_phy_address a20addr);
 
 #if BX_SUPPORT_MONITOR_MWAIT
   BX_MEM_SMF bx_bool is_monitor(bx_phy_address begin_addr, unsigned len);
@@ -120,6 +141,8 @@ BOCHSAPI extern BX_MEM_C bx_mem;
 // must be power of two
 #define BX_MEM_BLOCK_LEN (1024*1024) /* 1M blocks */
 
+#define BX_MEM_HANDLER_PAGES 256 /* 4K pages per megabyte */
+
 /*
 BX_CPP_INLINE Bit8u* BX_MEM_C::get_vector(bx_phy_address addr)
 {
@@ -134,6 +157,27 @@ BX_CPP_INLINE Bit8u* BX_MEM_C::get_vector(bx_phy_address addr)
   return BX_MEM_THIS blocks[block] + (Bit32u)(addr & (BX_MEM_BLOCK_LEN-1));
 }
 
+BX_CPP_INLINE bx_bool BX_MEM_C::dirty_tracking_enabled(void)
+{
+  return (BX_MEM_THIS dirty_bitmap != NULL);
+}
+
+BX_CPP_INLINE void BX_MEM_C::mark_dirty(bx_phy_address a20addr)
+{
+  if (BX_MEM_THIS dirty_bitmap != NULL && a20addr < BX_MEM_THIS len) {
+    Bit32u page = (Bit32u)(a20addr >> 12);
+    BX_MEM_THIS dirty_bitmap[page >> 3] |= (1 << (page & 7));
+  }
+}
+
+// returns the newest memory handler covering the 4K page, NULL for plain memory.
+// The older handlers follow in the 'next' chain, they may not cover the page.
+BX_CPP_INLINE struct memory_handler_struct *BX_MEM_C::get_memory_handlers(bx_phy_address a20addr)
+{
+  struct memory_handler_struct **page = BX_MEM_THIS memory_handlers[a20addr >> 20];
+  return page ? page[(Bit32u)(a20addr >> 12) & (BX_MEM_HANDLER_PAGES-1)] : NULL;
+}
+
 BX_CPP_INLINE Bit64u BX_MEM_C::get_memory_len(void)
 {
   return (BX_MEM_THIS len);
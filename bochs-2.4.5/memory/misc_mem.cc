@@ -28,8 +28,26 @@
 #include "iodev/iodev.h"
 #define LOG_THIS BX_MEM(0)->
 
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if BX_HAVE_SYS_MMAN_H && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if BX_HAVE_SYS_MMAN_H && defined(MAP_ANONYMOUS)
+#define BX_MEM_USE_MMAP 1
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#else
+#define BX_MEM_USE_MMAP 0
+#endif
+
 // alignment of memory vector, must be a power of 2
 #define BX_MEM_VECTOR_ALIGN 4096
+// alignment of memory vector backed by host huge pages (2M on x86 hosts)
+#define BX_MEM_HUGEPAGE_ALIGN (2*1024*1024)
 #define BX_MEM_HANDLERS   ((BX_CONST64(1) << BX_PHY_ADDRESS_WIDTH) >> 20) /* one per megabyte */
 
 BX_MEM_C::BX_MEM_C()
@@ -38,17 +56,38 @@ BX_MEM_C::BX_MEM_C()
 
   vector = NULL;
   actual_vector = NULL;
+  actual_vector_len = 0;
+  vector_mapped = 0;
   blocks = NULL;
   len    = 0;
   used_blocks = 0;
+  dirty_bitmap = NULL;
 
   memory_handlers = NULL;
+  memory_handler_list = NULL;
 }
 
 Bit8u* BX_MEM_C::alloc_vector_aligned(Bit32u bytes, Bit32u alignment)
 {
   Bit64u test_mask = alignment - 1;
-  BX_MEM_THIS actual_vector = new Bit8u [(Bit32u)(bytes + test_mask)];
+  BX_MEM_THIS actual_vector_len = bytes + test_mask;
+  BX_MEM_THIS actual_vector = NULL;
+  BX_MEM_THIS vector_mapped = 0;
+#if BX_MEM_USE_MMAP
+  // Only reserve the address space here. Host pages are committed and
+  // zero filled by the host OS when the guest touches them first time.
+  void *ptr = mmap(NULL, (size_t) BX_MEM_THIS actual_vector_len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (ptr != MAP_FAILED) {
+    BX_MEM_THIS actual_vector = (Bit8u *) ptr;
+    BX_MEM_THIS vector_mapped = 1;
+  }
+  else {
+    BX_INFO(("alloc_vector_aligned: mmap failed (%s), using heap memory", strerror(errno)));
+  }
+#endif
+  if (BX_MEM_THIS actual_vector == NULL)
+    BX_MEM_THIS actual_vector = new Bit8u [(Bit32u)(bytes + test_mask)];
   if (BX_MEM_THIS actual_vector == 0) {
     BX_PANIC(("alloc_vector_aligned: unable to allocate host RAM !"));
     return 0;
@@ -64,6 +103,150 @@ Bit8u* BX_MEM_C::alloc_vector_aligned(Bit32u bytes, Bit32u alignment)
   return vector;
 }
 
+void BX_MEM_C::free_vector_aligned(void)
+{
+#if BX_MEM_USE_MMAP
+  if (BX_MEM_THIS vector_mapped) {
+    munmap(BX_MEM_THIS actual_vector, (size_t) BX_MEM_THIS actual_vector_len);
+  }
+  else
+#endif
+  {
+    delete [] BX_MEM_THIS actual_vector;
+  }
+  BX_MEM_THIS actual_vector = NULL;
+  BX_MEM_THIS actual_vector_len = 0;
+  BX_MEM_THIS vector_mapped = 0;
+}
+
+//
+// Give the host pages backing guest RAM back to the host OS. The guest
+// will see zero filled memory afterwards, pages are committed again on
+// demand as soon as the guest touches them. The optional RAM images are
+// only loaded at init, so they are loaded again.
+//
+void BX_MEM_C::release_memory(void)
+{
+  static const char *optram_path[4] = {
+    BXPN_OPTRAM1_PATH, BXPN_OPTRAM2_PATH, BXPN_OPTRAM3_PATH, BXPN_OPTRAM4_PATH
+  };
+  static const char *optram_address[4] = {
+    BXPN_OPTRAM1_ADDRESS, BXPN_OPTRAM2_ADDRESS, BXPN_OPTRAM3_ADDRESS, BXPN_OPTRAM4_ADDRESS
+  };
+  bx_bool released = 0;
+
+  if (BX_MEM_THIS vector == NULL) return;
+
+  BX_INFO(("releasing %.2fMB of guest RAM to the host",
+    (float)(BX_MEM_THIS allocated / (1024.0*1024.0))));
+#if BX_MEM_USE_MMAP
+  if (BX_MEM_THIS vector_mapped) {
+    // map fresh anonymous pages over guest RAM, this drops the private
+    // pages as well as pages mapped from a checkpoint file by restore
+    void *ptr = mmap(BX_MEM_THIS vector, (size_t) BX_MEM_THIS allocated, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    released = (ptr != MAP_FAILED);
+    if (! released)
+      BX_ERROR(("release_memory: mmap failed (%s)", strerror(errno)));
+#ifdef MADV_HUGEPAGE
+    else if (SIM->get_param_bool(BXPN_MEM_HUGEPAGES)->get())
+      madvise(BX_MEM_THIS vector, (size_t) BX_MEM_THIS allocated, MADV_HUGEPAGE);
+#endif
+  }
+#endif
+  if (! released)
+    memset(BX_MEM_THIS vector, 0, (size_t) BX_MEM_THIS allocated);
+
+  for (int i = 0; i < 4; i++) {
+    if (strcmp(SIM->get_param_string(optram_path[i])->getptr(), "") != 0)
+      BX_MEM_THIS load_RAM(SIM->get_param_string(optram_path[i])->getptr(),
+                           SIM->get_param_num(optram_address[i])->get(), 2);
+  }
+
+  // all guest RAM changed its content
+  if (BX_MEM_THIS dirty_bitmap != NULL)
+    memset(BX_MEM_THIS dirty_bitmap, 0xff, BX_MEM_THIS get_dirty_bitmap_size());
+}
+
+//
+// Dirty page tracking. When enabled, every page of guest RAM written by
+// the CPU or by devices since the last snapshot has its bit set in the
+// dirty bitmap. Direct CPU writes through the TLB are covered because a
+// host pointer for writing is only handed out by getHostMemAddr, which
+// marks the page dirty; taking a snapshot flushes all TLBs so the next
+// write to a clean page comes back through getHostMemAddr. With tracking
+// disabled the bitmap is not allocated and the CPU fast paths are not
+// touched at all.
+//
+Bit32u BX_MEM_C::get_dirty_bitmap_size(void)
+{
+  return (Bit32u)(((BX_MEM_THIS len >> 12) + 7) >> 3);
+}
+
+void BX_MEM_C::enable_dirty_tracking(bx_bool enable)
+{
+  if (enable) {
+    if (BX_MEM_THIS dirty_bitmap != NULL) return;
+    Bit32u size = BX_MEM_THIS get_dirty_bitmap_size();
+    BX_MEM_THIS dirty_bitmap = new Bit8u[size];
+    // nothing is known about the pages written before, report all of them
+    memset(BX_MEM_THIS dirty_bitmap, 0xff, size);
+    BX_INFO(("dirty page tracking enabled"));
+  }
+  else {
+    if (BX_MEM_THIS dirty_bitmap == NULL) return;
+    delete [] BX_MEM_THIS dirty_bitmap;
+    BX_MEM_THIS dirty_bitmap = NULL;
+    BX_INFO(("dirty page tracking disabled"));
+  }
+  // forget host pointers handed out with the old tracking state
+  bx_pc_system.MemoryMappingChanged();
+}
+
+// copy dirty bitmap to 'bitmap' (get_dirty_bitmap_size() bytes) and clear it
+void BX_MEM_C::snapshot_dirty_pages(Bit8u *bitmap)
+{
+  Bit32u size = BX_MEM_THIS get_dirty_bitmap_size();
+
+  if (BX_MEM_THIS dirty_bitmap == NULL) {
+    BX_ERROR(("snapshot_dirty_pages: dirty page tracking is not enabled"));
+    memset(bitmap, 0xff, size);
+    return;
+  }
+  memcpy(bitmap, BX_MEM_THIS dirty_bitmap, size);
+  memset(BX_MEM_THIS dirty_bitmap, 0, size);
+  bx_pc_system.MemoryMappingChanged();
+}
+
+Bit32u BX_MEM_C::get_host_dirty_bitmap_size(void)
+{
+  return (Bit32u)(((BX_MEM_THIS allocated >> 12) + 7) >> 3);
+}
+
+// same as snapshot_dirty_pages(), but 'bitmap' (get_host_dirty_bitmap_size()
+// bytes) describes the pages of the host memory vector. Guest memory blocks
+// are placed in the vector in the order of first use, so this is the layout
+// in which guest RAM is saved.
+void BX_MEM_C::snapshot_dirty_host_pages(Bit8u *bitmap)
+{
+  Bit32u pages_per_block = BX_MEM_BLOCK_LEN >> 12;
+  Bit32u num_blocks = BX_MEM_THIS len / BX_MEM_BLOCK_LEN;
+  Bit8u *guest = new Bit8u[BX_MEM_THIS get_dirty_bitmap_size()];
+
+  BX_MEM_THIS snapshot_dirty_pages(guest);
+  memset(bitmap, 0, BX_MEM_THIS get_host_dirty_bitmap_size());
+  for (Bit32u blk = 0; blk < num_blocks; blk++) {
+    if (BX_MEM_THIS blocks[blk] == NULL) continue;
+    Bit32u gpage = blk * pages_per_block;
+    Bit32u hpage = (Bit32u)((BX_MEM_THIS blocks[blk] - BX_MEM_THIS vector) >> 12);
+    for (Bit32u i = 0; i < pages_per_block; i++, gpage++, hpage++) {
+      if (guest[gpage >> 3] & (1 << (gpage & 7)))
+        bitmap[hpage >> 3] |= (1 << (hpage & 7));
+    }
+  }
+  delete [] guest;
+}
+
 BX_MEM_C::~BX_MEM_C()
 {
   cleanup_memory();
@@ -81,14 +264,27 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
 
   if (BX_MEM_THIS actual_vector != NULL) {
     BX_INFO(("freeing existing memory vector"));
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
+    free_vector_aligned();
     BX_MEM_THIS vector = NULL;
     BX_MEM_THIS blocks = NULL;
   }
-  BX_MEM_THIS vector = alloc_vector_aligned(host + BIOSROMSZ + EXROMSIZE + 4096, BX_MEM_VECTOR_ALIGN);
+  bx_bool hugepages = SIM->get_param_bool(BXPN_MEM_HUGEPAGES)->get();
+  BX_MEM_THIS vector = alloc_vector_aligned(host + BIOSROMSZ + EXROMSIZE + 4096,
+      hugepages ? BX_MEM_HUGEPAGE_ALIGN : BX_MEM_VECTOR_ALIGN);
   BX_INFO(("allocated memory at %p. after alignment, vector=%p",
 	BX_MEM_THIS actual_vector, BX_MEM_THIS vector));
+  if (hugepages) {
+#if BX_MEM_USE_MMAP && defined(MADV_HUGEPAGE)
+    if (! BX_MEM_THIS vector_mapped) {
+      BX_INFO(("guest RAM is not mmap'ed, huge pages not used"));
+    }
+    else if (madvise(BX_MEM_THIS vector, (size_t) host, MADV_HUGEPAGE) != 0) {
+      BX_ERROR(("madvise(MADV_HUGEPAGE) failed (%s)", strerror(errno)));
+    }
+#else
+    BX_INFO(("transparent huge pages are not supported on this host"));
+#endif
+  }
 
   BX_MEM_THIS len = guest;
   BX_MEM_THIS allocated = host;
@@ -120,9 +316,10 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
     BX_MEM_THIS used_blocks = 0;
   }
 
-  BX_MEM_THIS memory_handlers = new struct memory_handler_struct *[BX_MEM_HANDLERS];
+  BX_MEM_THIS memory_handlers = new struct memory_handler_struct **[BX_MEM_HANDLERS];
   for (idx = 0; idx < BX_MEM_HANDLERS; idx++)
     BX_MEM_THIS memory_handlers[idx] = NULL;
+  BX_MEM_THIS memory_handler_list = NULL;
 
   BX_MEM_THIS pci_enabled = SIM->get_param_bool(BXPN_I440FX_SUPPORT)->get();
   BX_MEM_THIS smram_available = 0;
@@ -130,6 +327,10 @@ void BX_MEM_C::init_memory(Bit64u guest, Bit64u host)
   BX_MEM_THIS smram_restricted = 0;
 
   BX_MEM_THIS register_state();
+
+  // incremental checkpoints save only pages modified since the last one
+  if (SIM->get_param_bool(BXPN_CHECKPOINT_INCREMENTAL)->get())
+    BX_MEM_THIS enable_dirty_tracking(1);
 }
 
 void BX_MEM_C::allocate_block(Bit32u block)
@@ -178,7 +379,9 @@ void memory_param_restore_handler(void *devptr, bx_param_c *param, Bit64s val)
 void BX_MEM_C::register_state()
 {
   bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "memory", "Memory State", 6);
-  new bx_shadow_data_c(list, "ram", BX_MEM_THIS vector, BX_MEM_THIS allocated);
+  bx_shadow_data_c *ram = new bx_shadow_data_c(list, "ram", BX_MEM_THIS vector, BX_MEM_THIS allocated);
+  ram->set_options(bx_shadow_data_c::DIRTY_PAGES |
+    (BX_MEM_THIS vector_mapped ? bx_shadow_data_c::MAP_ON_RESTORE : 0));
   BXRS_DEC_PARAM_FIELD(list, len, BX_MEM_THIS len);
   BXRS_DEC_PARAM_FIELD(list, allocated, BX_MEM_THIS allocated);
   BXRS_DEC_PARAM_FIELD(list, used_blocks, BX_MEM_THIS used_blocks);
@@ -199,26 +402,29 @@ void BX_MEM_C::cleanup_memory()
   unsigned idx;
 
   if (BX_MEM_THIS vector != NULL) {
-    delete [] BX_MEM_THIS actual_vector;
-    BX_MEM_THIS actual_vector = NULL;
+    free_vector_aligned();
     BX_MEM_THIS vector = NULL;
     BX_MEM_THIS rom = NULL;
     BX_MEM_THIS bogus = NULL;
     delete [] BX_MEM_THIS blocks;
     BX_MEM_THIS blocks = 0;
     BX_MEM_THIS used_blocks = 0;
+    if (BX_MEM_THIS dirty_bitmap != NULL) {
+      delete [] BX_MEM_THIS dirty_bitmap;
+      BX_MEM_THIS dirty_bitmap = NULL;
+    }
     if (BX_MEM_THIS memory_handlers != NULL) {
       for (idx = 0; idx < BX_MEM_HANDLERS; idx++) {
-        struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[idx];
-        struct memory_handler_struct *prev = NULL;
-        while (memory_handler) {
-          prev = memory_handler;
-          memory_handler = memory_handler->next;
-          delete prev;
-        }
+        if (BX_MEM_THIS memory_handlers[idx])
+          delete [] BX_MEM_THIS memory_handlers[idx];
       }
       delete [] BX_MEM_THIS memory_handlers;
       BX_MEM_THIS memory_handlers = NULL;
+      while (BX_MEM_THIS memory_handler_list) {
+        struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handler_list;
+        BX_MEM_THIS memory_handler_list = memory_handler->next;
+        delete memory_handler;
+      }
     }
   }
 }
@@ -591,14 +797,10 @@ Bit8u *BX_MEM_C::getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw)
   }
 #endif
 
-  struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[a20addr >> 20];
-  while (memory_handler) {
-    if (memory_handler->begin <= a20addr &&
-        memory_handler->end >= a20addr) {
-      return(NULL); // Vetoed! memory handler for i/o apic, vram, mmio and PCI PnP
-    }
-    memory_handler = memory_handler->next;
-  }
+  // the caller may access the whole page directly, so any memory handler
+  // covering part of the page is enough to veto
+  if (BX_MEM_THIS get_memory_handlers(a20addr))
+    return(NULL); // Vetoed! memory handler for i/o apic, vram, mmio and PCI PnP
 
   if (! write) {
     if ((a20addr >= 0x000a0000 && a20addr < 0x000c0000))
@@ -670,6 +872,8 @@ Bit8u *BX_MEM_C::getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw)
     else
     {
       if (a20addr < 0x000c0000 || a20addr >= 0x00100000) {
+        // the caller is going to write the page
+        BX_MEM_THIS mark_dirty(a20addr);
         return BX_MEM_THIS get_vector(a20addr);
       }
       else {
@@ -679,6 +883,40 @@ Bit8u *BX_MEM_C::getHostMemAddr(BX_CPU_C *cpu, bx_phy_address addr, unsigned rw)
   }
 }
 
+// Resolves the guest physical range addr...addr+len-1 to host memory for a
+// device doing busmaster DMA and appends it to the scatter/gather list 'iov'
+// holding 'iovcnt' entries. Pages which are contiguous on the host are merged
+// with the previous entry. For a transfer into guest memory (BX_WRITE) the
+// pages are marked written, so that cached instructions from them are
+// invalidated. Returns the new number of entries or -1 if a page has to be
+// accessed through memory handlers or more than 'maxiov' entries are needed.
+int BX_MEM_C::getHostMemIovec(bx_phy_address addr, Bit32u len, unsigned rw,
+                              bx_iovec_t *iov, int iovcnt, int maxiov)
+{
+  while (len > 0) {
+    Bit32u remainingInPage = 0x1000 - (Bit32u)(addr & 0xfff);
+    if (len < remainingInPage) remainingInPage = len;
+    Bit8u *hostAddr = BX_MEM_THIS getHostMemAddr(NULL, addr, rw);
+    if (hostAddr == NULL)
+      return -1;
+    if (rw & 1)
+      pageWriteStampTable.decWriteStamp(A20ADDR(addr));
+    if ((iovcnt > 0) &&
+        ((Bit8u*) iov[iovcnt-1].iov_base + iov[iovcnt-1].iov_len == hostAddr)) {
+      iov[iovcnt-1].iov_len += remainingInPage;
+    } else {
+      if (iovcnt >= maxiov)
+        return -1;
+      iov[iovcnt].iov_base = hostAddr;
+      iov[iovcnt].iov_len = remainingInPage;
+      iovcnt++;
+    }
+    addr += remainingInPage;
+    len -= remainingInPage;
+  }
+  return iovcnt;
+}
+
 /*
  * One needs to provide both a read_handler and a write_handler.
  * XXX: maybe we should check for overlapping memory handlers
@@ -692,15 +930,24 @@ BX_MEM_C::registerMemoryHandlers(void *param, memory_handler_t read_handler,
   if (!read_handler || !write_handler)
     return 0;
   BX_INFO(("Register memory access handlers: 0x" FMT_PHY_ADDRX " - 0x" FMT_PHY_ADDRX, begin_addr, end_addr));
-  for (unsigned page_idx = begin_addr >> 20; page_idx <= end_addr >> 20; page_idx++) {
-    struct memory_handler_struct *memory_handler = new struct memory_handler_struct;
-    memory_handler->next = BX_MEM_THIS memory_handlers[page_idx];
-    BX_MEM_THIS memory_handlers[page_idx] = memory_handler;
-    memory_handler->read_handler = read_handler;
-    memory_handler->write_handler = write_handler;
-    memory_handler->param = param;
-    memory_handler->begin = begin_addr;
-    memory_handler->end = end_addr;
+  struct memory_handler_struct *memory_handler = new struct memory_handler_struct;
+  memory_handler->next = BX_MEM_THIS memory_handler_list;
+  BX_MEM_THIS memory_handler_list = memory_handler;
+  memory_handler->read_handler = read_handler;
+  memory_handler->write_handler = write_handler;
+  memory_handler->param = param;
+  memory_handler->begin = begin_addr;
+  memory_handler->end = end_addr;
+  // the new handler comes first on all of its pages
+  for (Bit32u page_idx = (Bit32u)(begin_addr >> 12); page_idx <= (Bit32u)(end_addr >> 12); page_idx++) {
+    struct memory_handler_struct **page = BX_MEM_THIS memory_handlers[page_idx / BX_MEM_HANDLER_PAGES];
+    if (! page) {
+      page = new struct memory_handler_struct *[BX_MEM_HANDLER_PAGES];
+      for (unsigned idx = 0; idx < BX_MEM_HANDLER_PAGES; idx++)
+        page[idx] = NULL;
+      BX_MEM_THIS memory_handlers[page_idx / BX_MEM_HANDLER_PAGES] = page;
+    }
+    page[page_idx % BX_MEM_HANDLER_PAGES] = memory_handler;
   }
   return 1;
 }
@@ -709,31 +956,37 @@ BX_MEM_C::registerMemoryHandlers(void *param, memory_handler_t read_handler,
 BX_MEM_C::unregisterMemoryHandlers(memory_handler_t read_handler, memory_handler_t write_handler,
 		bx_phy_address begin_addr, bx_phy_address end_addr)
 {
-  bx_bool ret = 1;
   BX_INFO(("Memory access handlers unregistered: 0x" FMT_PHY_ADDRX " - 0x" FMT_PHY_ADDRX, begin_addr, end_addr));
-  for (unsigned page_idx = begin_addr >> 20; page_idx <= end_addr >> 20; page_idx++) {
-    struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handlers[page_idx];
-    struct memory_handler_struct *prev = NULL;
-    while (memory_handler &&
-         memory_handler->read_handler != read_handler &&
-         memory_handler->write_handler != write_handler &&
-         memory_handler->begin != begin_addr &&
-         memory_handler->end != end_addr)
-    {
-      prev = memory_handler;
-      memory_handler = memory_handler->next;
-    }
-    if (!memory_handler) {
-      ret = 0;  // we should have found it
-      continue; // anyway, try the other pages
-    }
-    if (prev)
-      prev->next = memory_handler->next;
-    else
-      BX_MEM_THIS memory_handlers[page_idx] = memory_handler->next;
-    delete memory_handler;
+  struct memory_handler_struct *memory_handler = BX_MEM_THIS memory_handler_list;
+  struct memory_handler_struct *prev = NULL;
+  while (memory_handler &&
+       (memory_handler->read_handler != read_handler ||
+        memory_handler->write_handler != write_handler ||
+        memory_handler->begin != begin_addr ||
+        memory_handler->end != end_addr))
+  {
+    prev = memory_handler;
+    memory_handler = memory_handler->next;
   }
-  return ret;
+  if (!memory_handler)
+    return 0;  // we should have found it
+  if (prev)
+    prev->next = memory_handler->next;
+  else
+    BX_MEM_THIS memory_handler_list = memory_handler->next;
+  // the pages where it came first now start with the next older handler
+  // covering them
+  for (Bit32u page_idx = (Bit32u)(begin_addr >> 12); page_idx <= (Bit32u)(end_addr >> 12); page_idx++) {
+    struct memory_handler_struct **page = BX_MEM_THIS memory_handlers[page_idx / BX_MEM_HANDLER_PAGES];
+    if (page[page_idx % BX_MEM_HANDLER_PAGES] != memory_handler)
+      continue;
+    struct memory_handler_struct *older = memory_handler->next;
+    while (older && (((Bit32u)(older->begin >> 12) > page_idx) || ((Bit32u)(older->end >> 12) < page_idx)))
+      older = older->next;
+    page[page_idx % BX_MEM_HANDLER_PAGES] = older;
+  }
+  delete memory_handler;
+  return 1;
 }
 
 void BX_MEM_C::enable_smram(bx_bool enable, bx_bool restricted)
@@ -22,6 +22,9 @@
 #include "config.h"
 
 #include <string.h>
+#if BX_COMPRESSED_HD_SUPPORT
+#include <zlib.h>
+#endif
 
 #include "../osdep.h"
 
@@ -34,6 +37,7 @@ int bx_hdsize;
 int bx_hdimagemode;
 int bx_interactive;
 char bx_filename[256];
+char bx_compress_src[256];
 
 typedef int (*WRITE_IMAGE)(FILE*, Bit64u);
 #ifdef WIN32
@@ -420,6 +424,103 @@ int make_growing_image(FILE *fp, Bit64u sec)
   return 0;
 }
 
+#if BX_COMPRESSED_HD_SUPPORT
+/* produce a compressed image with a chunk index from a flat image */
+int make_compressed_image(char *srcname, char *filename)
+{
+  z_ro_header_t header;
+  FILE *src, *fp;
+  Bit8u *data, *zdata;
+  Bit64u *index, size;
+  Bit32u i, count;
+  uLongf len, zlen;
+  char buffer[1024];
+
+  src = fopen(srcname, "rb");
+  if (src == NULL)
+    fatal("ERROR: Could not open source image");
+  fseek(src, 0, SEEK_END);
+  size = (Bit64u)ftell(src);
+  fseek(src, 0, SEEK_SET);
+  if ((size == 0) || (size & 511))
+    fatal("ERROR: Source image size is not a multiple of 512 bytes");
+  count = (Bit32u)((size + Z_RO_CHUNK_SIZE - 1) / Z_RO_CHUNK_SIZE);
+
+  // check if it exists before trashing someone's disk image
+  fp = fopen(filename, "r");
+  if (fp) {
+    int confirm;
+    sprintf(buffer, "\nThe disk image '%s' already exists.  Are you sure you want to replace it?\nPlease type yes or no. ", filename);
+    if (ask_yn(buffer, 0, &confirm) < 0)
+      fatal(EOF_ERR);
+    if (!confirm)
+      fatal("ERROR: Aborted");
+    fclose(fp);
+  }
+  fp = fopen(filename, "wb");
+  if (fp == NULL)
+    fatal("ERROR: Could not write disk image");
+
+  memset(&header, 0, sizeof(header));
+  strcpy((char*)header.standard.magic, STANDARD_HEADER_MAGIC);
+  strcpy((char*)header.standard.type, Z_RO_TYPE);
+  strcpy((char*)header.standard.subtype, Z_RO_SUBTYPE_CHUNKED);
+  header.standard.version = htod32(STANDARD_HEADER_VERSION);
+  header.standard.header = htod32(STANDARD_HEADER_SIZE);
+  header.specific.chunk = htod32(Z_RO_CHUNK_SIZE);
+  header.specific.count = htod32(count);
+  header.specific.disk = htod64(size);
+
+  index = (Bit64u*)calloc(count + 1, sizeof(Bit64u));
+  data = (Bit8u*)malloc(Z_RO_CHUNK_SIZE);
+  zdata = (Bit8u*)malloc(compressBound(Z_RO_CHUNK_SIZE));
+  if ((index == NULL) || (data == NULL) || (zdata == NULL))
+    fatal("ERROR: Out of memory");
+
+  // the index is written again when all chunk offsets are known
+  if ((fwrite(&header, sizeof(header), 1, fp) != 1) ||
+      (fwrite(index, sizeof(Bit64u), count + 1, fp) != count + 1))
+    fatal("ERROR: The disk image is not complete - could not write header!");
+
+  printf("\nCompressing: [");
+  index[0] = STANDARD_HEADER_SIZE + (count + 1) * sizeof(Bit64u);
+  for (i = 0; i < count; i++) {
+    // the last chunk only holds the rest of the image
+    len = Z_RO_CHUNK_SIZE;
+    if ((Bit64u)i * Z_RO_CHUNK_SIZE + len > size)
+      len = (uLongf)(size - (Bit64u)i * Z_RO_CHUNK_SIZE);
+    if (fread(data, 1, len, src) != len)
+      fatal("ERROR: Could not read source image");
+    zlen = compressBound(Z_RO_CHUNK_SIZE);
+    if ((compress2(zdata, &zlen, data, len, Z_BEST_COMPRESSION) != Z_OK) ||
+        (zlen >= len)) {
+      memcpy(zdata, data, len);
+      zlen = len;
+    }
+    if (fwrite(zdata, 1, zlen, fp) != zlen)
+      fatal("ERROR: The disk image is not complete - could not write data block!");
+    index[i + 1] = index[i] + zlen;
+    if ((i & 255) == 255) printf(".");
+  }
+  printf("] Done.\n");
+  printf("\nI compressed " FMT_LL "u bytes into " FMT_LL "u bytes in %s.\n", size, index[count], filename);
+
+  for (i = 0; i <= count; i++) {
+    index[i] = htod64(index[i]);
+  }
+  if ((fseek(fp, STANDARD_HEADER_SIZE, SEEK_SET) != 0) ||
+      (fwrite(index, sizeof(Bit64u), count + 1, fp) != count + 1))
+    fatal("ERROR: The disk image is not complete - could not write index!");
+
+  free(zdata);
+  free(data);
+  free(index);
+  fclose(fp);
+  fclose(src);
+  return 0;
+}
+#endif
+
 /* produce the image file */
 #ifdef WIN32
 int make_image_win32 (Bit64u sec, char *filename, WRITE_IMAGE_WIN32 write_image)
@@ -508,6 +609,10 @@ void print_usage()
     "  -hd              create hard disk image\n"
     "  -mode=...        image mode (hard disks only)\n"
     "  -size=...        image size in megabytes\n"
+#if BX_COMPRESSED_HD_SUPPORT
+    "  -compress=...    create a compressed image from a flat image\n"
+    "                   (for the z-undoable and z-volatile modes)\n"
+#endif
     "  -q               quiet mode (don't prompt for user input)\n"
     "  --help           display this help and exit\n\n");
 }
@@ -523,6 +628,7 @@ int parse_cmdline(int argc, char *argv[])
   bx_hdimagemode = -1;
   bx_interactive = 1;
   bx_filename[0] = 0;
+  bx_compress_src[0] = 0;
   while ((arg < argc) && (ret == 1)) {
     // parse next arg
     if (!strcmp("--help", argv[arg]) || !strncmp("/?", argv[arg], 2)) {
@@ -568,6 +674,12 @@ int parse_cmdline(int argc, char *argv[])
         printf("Image type (fd/hd) not specified\n\n");
       }
     }
+#if BX_COMPRESSED_HD_SUPPORT
+    else if (!strncmp("-compress=", argv[arg], 10)) {
+      strncpy(bx_compress_src, &argv[arg][10], sizeof(bx_compress_src) - 1);
+      bx_compress_src[sizeof(bx_compress_src) - 1] = 0;
+    }
+#endif
     else if (!strcmp("-q", argv[arg])) {
       bx_interactive = 0;
     }
@@ -620,6 +732,16 @@ int CDECL main(int argc, char *argv[])
     myexit(1);
 
   print_banner();
+#if BX_COMPRESSED_HD_SUPPORT
+  if (strlen(bx_compress_src) > 0) {
+    if (!strlen(bx_filename))
+      fatal("ERROR: Illegal filename");
+    make_compressed_image(bx_compress_src, bx_filename);
+    printf("\nThe following line should appear in your bochsrc:\n");
+    printf("  ata0-master: type=disk, path=\"%s\", mode=z-volatile\n", bx_filename);
+    myexit(0);
+  }
+#endif
   if (bx_interactive) {
     if (ask_menu(fdhd_menu, fdhd_n_choices, fdhd_choices, bx_hdimage, &bx_hdimage) < 0)
       fatal(EOF_ERR);
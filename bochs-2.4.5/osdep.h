@@ -183,6 +183,16 @@ typedef int socklen_t;
   extern int bx_mkstemp(char *tpl);
 #endif
 
+// scatter/gather list entry, as used by readv() / writev()
+#ifndef WIN32
+typedef struct iovec bx_iovec_t;
+#else
+typedef struct {
+  void   *iov_base;
+  size_t iov_len;
+} bx_iovec_t;
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // Missing library functions, implemented for MacOS only
 //////////////////////////////////////////////////////////////////////
@@ -32,6 +32,11 @@
 #define BXPN_RESTORE_FLAG                "general.restore"
 #define BXPN_RESTORE_PATH                "general.restore_path"
 #define BXPN_DEBUG_RUNNING               "general.debug_running"
+#define BXPN_CHECKPOINT_COMPRESS         "general.checkpoint.compress"
+#define BXPN_CHECKPOINT_INCREMENTAL      "general.checkpoint.incremental"
+#define BXPN_CLONE_ENABLED               "general.clone.enabled"
+#define BXPN_CLONE_SOCKET                "general.clone.socket"
+#define BXPN_CLONE_JOBS                  "general.clone.jobs"
 #define BXPN_CPU_NPROCESSORS             "cpu.n_processors"
 #define BXPN_CPU_NCORES                  "cpu.n_cores"
 #define BXPN_CPU_NTHREADS                "cpu.n_threads"
@@ -54,6 +59,8 @@
 #define BXPN_CPUID_1G_PAGES              "cpuid.1g_pages"
 #define BXPN_MEM_SIZE                    "memory.standard.ram.size"
 #define BXPN_HOST_MEM_SIZE               "memory.standard.ram.host_size"
+#define BXPN_MEM_HUGEPAGES               "memory.standard.ram.hugepages"
+#define BXPN_MEM_RELEASE                 "memory.standard.ram.release"
 #define BXPN_ROM_PATH                    "memory.standard.rom.path"
 #define BXPN_ROM_ADDRESS                 "memory.standard.rom.addr"
 #define BXPN_VGA_ROM_PATH                "memory.standard.vgarom.path"
@@ -81,6 +88,8 @@
 #define BXPN_I440FX_SUPPORT              "pci.i440fx_support"
 #define BXPN_PCIDEV_VENDOR               "pci.pcidev.vendor"
 #define BXPN_PCIDEV_DEVICE               "pci.pcidev.device"
+#define BXPN_PCIVBLK                     "pci.vblk"
+#define BXPN_PCIVBLK_ENABLED             "pci.vblk.enabled"
 #define BXPN_SEL_DISPLAY_LIBRARY         "display.display_library"
 #define BXPN_DISPLAYLIB_OPTIONS          "display.displaylib_options"
 #define BXPN_PRIVATE_COLORMAP            "display.private_colormap"
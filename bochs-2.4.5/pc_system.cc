@@ -195,6 +195,9 @@ int bx_pc_system_c::Reset(unsigned type)
 
   // Reset devices only on Hardware resets
   if (type==BX_RESET_HARDWARE) {
+    // the power-on reset must keep the optional RAM images loaded
+    if (SIM->get_init_done() && SIM->get_param_bool(BXPN_MEM_RELEASE)->get())
+      BX_MEM(0)->release_memory();
     DEV_reset_devices(type);
   }
 
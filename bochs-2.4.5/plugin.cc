@@ -770,4 +770,30 @@ void bx_plugins_after_restore_state()
 #endif
 }
 
+/***************************************************************************/
+/* Plugin system: Execute code in the simulation before it is cloned       */
+/***************************************************************************/
+
+void bx_plugins_before_clone()
+{
+  device_t *device;
+
+  for (device = devices; device; device = device->next) {
+    device->devmodel->before_clone();
+  }
+}
+
+/***************************************************************************/
+/* Plugin system: Execute code in a clone of the simulation after fork()   */
+/***************************************************************************/
+
+void bx_plugins_after_clone()
+{
+  device_t *device;
+
+  for (device = devices; device; device = device->next) {
+    device->devmodel->after_clone();
+  }
+}
+
 }
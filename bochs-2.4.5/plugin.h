@@ -63,6 +63,7 @@ extern "C" {
 #define BX_PLUGIN_USB_UHCI  "usb_uhci"
 #define BX_PLUGIN_USB_OHCI  "usb_ohci"
 #define BX_PLUGIN_PCIPNIC   "pcipnic"
+#define BX_PLUGIN_PCIVBLK   "pcivblk"
 #define BX_PLUGIN_GAMEPORT  "gameport"
 #define BX_PLUGIN_SPEAKER   "speaker"
 #define BX_PLUGIN_ACPI      "acpi"
@@ -120,6 +121,8 @@ extern "C" {
 #define DEV_reset_devices(type) {bx_devices.reset(type); }
 #define DEV_register_state() {bx_devices.register_state(); }
 #define DEV_after_restore_state() {bx_devices.after_restore_state(); }
+#define DEV_before_clone() {bx_devices.before_clone(); }
+#define DEV_after_clone() {bx_devices.after_clone(); }
 
 #define DEV_register_timer(a,b,c,d,e,f) bx_pc_system.register_timer(a,b,c,d,e,f)
 #define DEV_mouse_enabled_changed(en) (bx_devices.mouse_enabled_changed(en))
@@ -168,6 +171,7 @@ extern "C" {
 #define DEV_hd_present() (bx_devices.pluginHardDrive != &bx_devices.stubHardDrive)
 #define DEV_hd_bmdma_read_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_read_sector(a,b,c)
 #define DEV_hd_bmdma_write_sector(a,b) bx_devices.pluginHardDrive->bmdma_write_sector(a,b)
+#define DEV_hd_bmdma_transfer(a,b,c,d,e) bx_devices.pluginHardDrive->bmdma_transfer(a,b,c,d,e)
 #define DEV_hd_bmdma_complete(a) bx_devices.pluginHardDrive->bmdma_complete(a)
 
 #define DEV_bulk_io_quantum_requested() (bx_devices.bulkIOQuantumsRequested)
@@ -184,6 +188,10 @@ extern "C" {
   (bx_devices.pluginDmaDevice->registerDMA8Channel(channel, dmaRead, dmaWrite, name))
 #define DEV_dma_register_16bit_channel(channel, dmaRead, dmaWrite, name) \
   (bx_devices.pluginDmaDevice->registerDMA16Channel(channel, dmaRead, dmaWrite, name))
+#define DEV_dma_register_8bit_block_channel(channel, dmaRead, dmaWrite, name) \
+  (bx_devices.pluginDmaDevice->registerDMA8BlockChannel(channel, dmaRead, dmaWrite, name))
+#define DEV_dma_register_16bit_block_channel(channel, dmaRead, dmaWrite, name) \
+  (bx_devices.pluginDmaDevice->registerDMA16BlockChannel(channel, dmaRead, dmaWrite, name))
 #define DEV_dma_unregister_channel(channel) \
   (bx_devices.pluginDmaDevice->unregisterDMAChannel(channel))
 #define DEV_dma_set_drq(channel, val) \
@@ -207,6 +215,8 @@ extern "C" {
   (bx_devices.pluginVgaDevice->redraw_area(left, top, right, bottom))
 #define DEV_vga_get_text_snapshot(rawsnap, height, width) \
   (bx_devices.pluginVgaDevice->get_text_snapshot(rawsnap, height, width))
+#define DEV_vga_get_gfx_snapshot(rawsnap, width, height) \
+  (bx_devices.pluginVgaDevice->get_gfx_snapshot(rawsnap, width, height))
 #define DEV_vga_refresh() \
   (bx_devices.pluginVgaDevice->trigger_timer(bx_devices.pluginVgaDevice))
 #define DEV_vga_get_actl_pal_idx(index) (bx_devices.pluginVgaDevice->get_actl_palette_idx(index))
@@ -354,6 +364,8 @@ extern void bx_reset_plugins(unsigned);
 extern void bx_unload_plugins(void);
 extern void bx_plugins_register_state(void);
 extern void bx_plugins_after_restore_state(void);
+extern void bx_plugins_before_clone(void);
+extern void bx_plugins_after_clone(void);
 
 // every plugin must define these, within the extern"C" block, so that
 // a non-mangled function symbol is available in the shared library.
@@ -386,6 +398,7 @@ DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(pcidev)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(usb_uhci)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(usb_ohci)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(pcipnic)
+DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(pcivblk)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(sb16)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(ne2k)
 DECLARE_PLUGIN_INIT_FINI_FOR_MODULE(extfpuirq)
@@ -1,5 +1,6 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <stdbool.h>
 #include "devices/input.h"
 #include "devices/intq.h"
 #include "devices/timer.h"
@@ -7,6 +8,7 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Register definitions for the 16550A UART used in PCs.
    The 16550A has a lot more going on than shown here, but this
@@ -48,6 +50,29 @@
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
 
+/* Paravirtual console of Bochs for the first serial port
+   (iodev/serial.h in the Bochs sources).  Output is collected in
+   a ring in memory and handed to the device with a single port
+   write per console call, instead of a port write and a wait for
+   the emulated line for every byte. */
+#define PV_BASE 0x2010
+#define PV_ID_REG (PV_BASE + 0x0)        /* Identification (r/o). */
+#define PV_RING_ADDR_REG (PV_BASE + 0x4) /* Physical address of ring. */
+#define PV_RING_SIZE_REG (PV_BASE + 0x8) /* Size of ring in bytes. */
+#define PV_DOORBELL_REG (PV_BASE + 0xc)  /* Producer/consumer index. */
+#define PV_MAGIC 0x736e6f63
+
+/* Size of the paravirtual console ring, a power of 2. */
+#define PV_RING_SIZE 4096
+
+/* True if the paravirtual console is used for output. */
+static bool pv_console;
+
+/* Paravirtual console ring and its free-running indices. */
+static uint8_t pv_ring[PV_RING_SIZE];
+static uint32_t pv_prod;                /* Next byte to write. */
+static uint32_t pv_cons;                /* Next byte to transmit. */
+
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
@@ -56,6 +81,7 @@ static struct intq txq;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void pv_kick (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -73,6 +99,15 @@ init_poll (void)
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
   mode = POLL;
+
+  /* Use the paravirtual console for output if it is there. */
+  if (inl (PV_ID_REG) == PV_MAGIC)
+    {
+      outl (PV_RING_ADDR_REG, vtop (pv_ring));
+      outl (PV_RING_SIZE_REG, PV_RING_SIZE);
+      pv_prod = pv_cons = 0;
+      pv_console = true;
+    }
 } 
 
 /* Initializes the serial port device for queued interrupt-driven
@@ -94,18 +129,27 @@ serial_init_queue (void)
   intr_set_level (old_level);
 }
 
-/* Sends BYTE to the serial port. */
+/* Sends BYTE to the serial port.  With the paravirtual console,
+   BYTE is only transmitted by the next serial_kick() or
+   serial_flush(), or when the ring fills up. */
 void
 serial_putc (uint8_t byte) 
 {
   enum intr_level old_level = intr_disable ();
 
-  if (mode != QUEUE)
+  if (mode == UNINIT)
+    init_poll ();
+
+  if (pv_console)
+    {
+      if (pv_prod - pv_cons == PV_RING_SIZE)
+        pv_kick ();
+      pv_ring[pv_prod++ % PV_RING_SIZE] = byte;
+    }
+  else if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
          use dumb polling to transmit a byte. */
-      if (mode == UNINIT)
-        init_poll ();
       putc_poll (byte); 
     }
   else 
@@ -129,12 +173,26 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Transmits the bytes written to the paravirtual console since
+   the last call.  Does nothing for the UART, which starts to
+   transmit each byte as soon as it is written. */
+void
+serial_kick (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (pv_console)
+    pv_kick ();
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
+  if (pv_console)
+    pv_kick ();
   while (!intq_empty (&txq))
     putc_poll (intq_getc (&txq));
   intr_set_level (old_level);
@@ -205,6 +263,20 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Hands the bytes in the paravirtual console ring to the
+   device, which transmits them before the port write returns. */
+static void
+pv_kick (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (pv_prod != pv_cons)
+    {
+      outl (PV_DOORBELL_REG, pv_prod);
+      pv_cons = inl (PV_DOORBELL_REG);
+    }
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
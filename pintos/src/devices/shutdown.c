@@ -4,6 +4,7 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "devices/vblk.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #ifdef USERPROG
@@ -93,6 +94,7 @@ shutdown_power_off (void)
 #ifdef FILESYS
   filesys_done ();
 #endif
+  vblk_flush ();
 
   print_stats ();
 
@@ -0,0 +1,252 @@
+#include "devices/vblk.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "threads/io.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file is a driver for the paravirtual PCI
+   block device of Bochs (iodev/pcivblk.h in the Bochs sources).
+   Requests are placed in a ring of descriptors in memory and
+   handed to the device by writing the producer index to the
+   doorbell register.  The device completes the requests in
+   order and signals the completions with a single interrupt, so
+   a request costs one port write instead of the nine port
+   accesses and 256 data transfers of the ATA driver in ide.c. */
+
+/* PCI configuration mechanism #1. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* PCI vendor and device IDs of the device. */
+#define VBLK_VENDOR 0xfefe
+#define VBLK_DEVICE 0xefee
+#define VBLK_ID_MAGIC 0x6b6c6276
+
+/* Device register offsets from the base of BAR0. */
+#define REG_ID 0x00             /* Identification (r/o). */
+#define REG_CAPACITY_LO 0x04    /* Size in sectors, low 32 bits (r/o). */
+#define REG_CAPACITY_HI 0x08    /* Size in sectors, high 32 bits (r/o). */
+#define REG_RING_ADDR 0x0c      /* Physical address of the ring. */
+#define REG_RING_SIZE 0x10      /* Number of descriptors in the ring. */
+#define REG_DOORBELL 0x14       /* Producer index. */
+#define REG_COMPLETED 0x18      /* Consumer index (r/o). */
+#define REG_ISR 0x1c            /* Interrupt status / enable. */
+
+/* Descriptor commands. */
+#define CMD_READ 1
+#define CMD_WRITE 2
+#define CMD_FLUSH 3             /* Write back the image metadata. */
+
+/* A request descriptor, as read by the device. */
+struct vblk_desc
+  {
+    uint64_t sector;            /* First sector. */
+    uint32_t addr;              /* Physical address of the buffer. */
+    uint16_t count;             /* Number of sectors. */
+    uint8_t command;            /* CMD_READ, CMD_WRITE or CMD_FLUSH. */
+    uint8_t status;             /* Set to 0 by the device on success. */
+  };
+
+/* Number of descriptors in the ring, which fills one page. */
+#define RING_SIZE (PGSIZE / sizeof (struct vblk_desc))
+
+/* A request waiting for its completion. */
+struct vblk_request
+  {
+    struct semaphore done;      /* Up'd by interrupt handler. */
+    uint8_t status;             /* Status copied from the descriptor. */
+  };
+
+static uint16_t reg_base;                  /* Base I/O port. */
+static struct vblk_desc *ring;             /* Descriptor ring. */
+static struct vblk_request *requests[RING_SIZE]; /* Request per slot. */
+static uint32_t prod;                      /* Next slot to fill. */
+static uint32_t cons;                      /* Next slot to complete. */
+static struct lock ring_lock;              /* Protects prod and the ring. */
+static struct semaphore free_slots;        /* Number of free slots. */
+
+static struct block_operations vblk_operations;
+
+static uint32_t pci_read_config (int bus, int dev, int func, int reg);
+static void pci_write_config (int bus, int dev, int func, int reg,
+                              uint32_t value);
+static void interrupt_handler (struct intr_frame *);
+
+/* Looks for the device on PCI bus 0 and, if it is present,
+   registers it with the block device layer as "vda". */
+void
+vblk_init (void)
+{
+  block_sector_t capacity;
+  struct block *block;
+  uint32_t bar;
+  int irq;
+  int dev;
+
+  for (dev = 0; dev < 32; dev++)
+    if (pci_read_config (0, dev, 0, 0x00)
+        == (((uint32_t) VBLK_DEVICE << 16) | VBLK_VENDOR))
+      break;
+  if (dev == 32)
+    return;
+
+  /* The PCI BIOS has assigned the I/O ports and the interrupt
+     line.  Enable I/O space decoding. */
+  bar = pci_read_config (0, dev, 0, 0x10);
+  irq = pci_read_config (0, dev, 0, 0x3c) & 0xff;
+  pci_write_config (0, dev, 0, 0x04,
+                    pci_read_config (0, dev, 0, 0x04) | 0x01);
+  if ((bar & 1) == 0 || irq == 0 || irq >= 16)
+    {
+      printf ("vda: device not configured by the BIOS\n");
+      return;
+    }
+  reg_base = bar & ~3;
+  if (inl (reg_base + REG_ID) != VBLK_ID_MAGIC)
+    {
+      printf ("vda: unknown device at port %#x\n", reg_base);
+      return;
+    }
+
+  /* Disks over 2 TB do not fit block_sector_t. */
+  if (inl (reg_base + REG_CAPACITY_HI) != 0)
+    {
+      printf ("vda: ignoring disk over 2 TB\n");
+      return;
+    }
+  capacity = inl (reg_base + REG_CAPACITY_LO);
+
+  ring = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  lock_init (&ring_lock);
+  sema_init (&free_slots, RING_SIZE);
+  prod = cons = 0;
+
+  intr_register_ext (irq + 0x20, interrupt_handler, "vda");
+  outl (reg_base + REG_RING_ADDR, vtop (ring));
+  outl (reg_base + REG_RING_SIZE, RING_SIZE);
+  outl (reg_base + REG_ISR, 1);
+
+  block = block_register ("vda", BLOCK_RAW, "paravirtual PCI disk",
+                          capacity, &vblk_operations, NULL);
+  partition_scan (block);
+}
+
+/* Queues a request for COMMAND on sector SEC_NO with BUFFER and
+   waits for its completion.  Requests of several threads are
+   queued at the same time and share the completion interrupt.
+   A CMD_FLUSH request has no BUFFER. */
+static void
+vblk_request (uint8_t command, block_sector_t sec_no, const void *buffer)
+{
+  struct vblk_request r;
+  struct vblk_desc *d;
+  size_t slot;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  sema_init (&r.done, 0);
+  sema_down (&free_slots);
+
+  lock_acquire (&ring_lock);
+  slot = prod % RING_SIZE;
+  d = &ring[slot];
+  d->sector = sec_no;
+  d->addr = buffer != NULL ? vtop (buffer) : 0;
+  d->count = buffer != NULL ? 1 : 0;
+  d->command = command;
+  d->status = 0xff;
+  requests[slot] = &r;
+  prod++;
+  outl (reg_base + REG_DOORBELL, prod);
+  lock_release (&ring_lock);
+
+  sema_down (&r.done);
+  if (r.status != 0)
+    PANIC ("vda: disk %s failed, sector=%"PRDSNu,
+           command == CMD_READ ? "read"
+           : command == CMD_WRITE ? "write" : "flush", sec_no);
+}
+
+/* Makes the device write back the metadata of its disk image,
+   so that the data written so far survives the end of the
+   simulator.  Does nothing if the device is not present or the
+   request cannot wait for the interrupt (e.g. after a kernel
+   panic). */
+void
+vblk_flush (void)
+{
+  if (ring == NULL || intr_get_level () == INTR_OFF || intr_context ())
+    return;
+  vblk_request (CMD_FLUSH, 0, NULL);
+}
+
+/* Reads sector SEC_NO into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+static void
+vblk_read (void *aux UNUSED, block_sector_t sec_no, void *buffer)
+{
+  vblk_request (CMD_READ, sec_no, buffer);
+}
+
+/* Writes sector SEC_NO from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the device has
+   completed the write. */
+static void
+vblk_write (void *aux UNUSED, block_sector_t sec_no, const void *buffer)
+{
+  vblk_request (CMD_WRITE, sec_no, buffer);
+}
+
+static struct block_operations vblk_operations =
+  {
+    vblk_read,
+    vblk_write
+  };
+
+/* Wakes up the waiters of all requests completed by the device
+   since the last interrupt. */
+static void
+interrupt_handler (struct intr_frame *f UNUSED)
+{
+  uint32_t completed;
+
+  /* Reading the status acknowledges the interrupt. */
+  if ((inl (reg_base + REG_ISR) & 1) == 0)
+    return;
+
+  completed = inl (reg_base + REG_COMPLETED);
+  while (cons != completed)
+    {
+      size_t slot = cons % RING_SIZE;
+      struct vblk_request *r = requests[slot];
+
+      r->status = ring[slot].status;
+      sema_up (&r->done);
+      sema_up (&free_slots);
+      cons++;
+    }
+}
+
+/* Reads register REG of PCI function BUS:DEV.FUNC. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to register REG of PCI function BUS:DEV.FUNC. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
@@ -0,0 +1,7 @@
+#ifndef DEVICES_VBLK_H
+#define DEVICES_VBLK_H
+
+void vblk_init (void);
+void vblk_flush (void);
+
+#endif /* devices/vblk.h */
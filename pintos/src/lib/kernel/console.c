@@ -129,6 +129,7 @@ vprintf (const char *format, va_list args)
 
   acquire_console ();
   __vprintf (format, args, vprintf_helper, &char_cnt);
+  serial_kick ();
   release_console ();
 
   return char_cnt;
@@ -143,6 +144,7 @@ puts (const char *s)
   while (*s != '\0')
     putchar_have_lock (*s++);
   putchar_have_lock ('\n');
+  serial_kick ();
   release_console ();
 
   return 0;
@@ -155,6 +157,7 @@ putbuf (const char *buffer, size_t n)
   acquire_console ();
   while (n-- > 0)
     putchar_have_lock (*buffer++);
+  serial_kick ();
   release_console ();
 }
 
@@ -164,6 +167,7 @@ putchar (int c)
 {
   acquire_console ();
   putchar_have_lock (c);
+  serial_kick ();
   release_console ();
   
   return c;
@@ -34,6 +34,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/vblk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -61,6 +62,7 @@ static void bss_init (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
+static bool clone_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
@@ -123,10 +125,20 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  vblk_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
 
+  /* Under the Bochs clone server, every test starts here with its
+     own command line.  Options that were already used during boot,
+     such as -ul or -f, keep the values of the booted command line. */
+  if (clone_command_line ())
+    {
+      argv = read_command_line ();
+      argv = parse_options (argv);
+    }
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -223,6 +235,63 @@ read_command_line (void)
   return argv;
 }
 
+/* Asks the Bochs clone server for a new kernel command line by
+   writing "Clone" to port 0x8900, then reads the command line back
+   from the same port, terminated by a null byte.  Other machines
+   and Bochs without the clone server return 0xff.  Words are
+   separated by white space, single or double quotes group words
+   into one argument.  Returns true if the command line in the
+   loader's argument area was replaced. */
+static bool
+clone_command_line (void)
+{
+  const char *s = "Clone";
+  char *args = ptov (LOADER_ARGS);
+  uint32_t argc = 0;
+  size_t len = 0;
+  bool in_word = false;
+  char quote = '\0';
+  uint8_t c;
+
+  for (; *s != '\0'; s++)
+    outb (0x8900, *s);
+  c = inb (0x8900);
+  if (c == 0xff)
+    return false;
+
+  for (; c != '\0' && c != 0xff; c = inb (0x8900))
+    {
+      if (len >= LOADER_ARGS_LEN - 1)
+        PANIC ("command line arguments overflow");
+      if (quote != '\0' ? c == quote : c == '\'' || c == '"')
+        {
+          quote = quote != '\0' ? '\0' : c;
+          if (!in_word)
+            {
+              argc++;
+              in_word = true;
+            }
+        }
+      else if (quote == '\0' && (c == ' ' || c == '\t'))
+        {
+          if (in_word)
+            args[len++] = '\0';
+          in_word = false;
+        }
+      else
+        {
+          if (!in_word)
+            argc++;
+          in_word = true;
+          args[len++] = c;
+        }
+    }
+  if (in_word)
+    args[len++] = '\0';
+  *(uint32_t *) ptov (LOADER_ARG_CNT) = argc;
+  return true;
+}
+
 /* Parses options in ARGV[]
    and returns the first non-option argument. */
 static char **